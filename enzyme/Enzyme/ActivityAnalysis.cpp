@@ -111,6 +111,7 @@ std::set<std::string> KnownInactiveFunctions = {
     "__kmpc_dispatch_fini_4u",
     "__kmpc_dispatch_fini_8",
     "__kmpc_dispatch_fini_8u",
+    "pthread_join",
     "malloc_usable_size",
     "malloc_size",
     "MPI_Init",
@@ -23,7 +23,10 @@
 // LLVM instructions.
 //
 //===----------------------------------------------------------------------===//
+#include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Transforms/Utils/Cloning.h"
@@ -37,6 +40,211 @@
 #define DEBUG_TYPE "enzyme"
 using namespace llvm;
 
+//! State available to the derivative rule of a vector math library function
+struct VectorLibMDerivative {
+  IRBuilder<> &B;
+  //! Vector arguments of the call, available at the insertion point of B
+  ArrayRef<Value *> Args;
+  //! Original callee, providing the library, attributes and calling convention
+  const VectorLibMFunction &VF;
+  Function *Called;
+
+  Value *C(double V) { return ConstantFP::get(Args[0]->getType(), V); }
+
+  //! Call the variant of scalar function Base from the same vector library
+  Value *call(StringRef Base, ArrayRef<Value *> CallArgs) {
+    Type *T = Args[0]->getType();
+    SmallVector<Type *, 2> tys(CallArgs.size(), T);
+    auto FT = FunctionType::get(T, tys, false);
+    auto F = Called->getParent()->getOrInsertFunction(
+        VF.getVariant(Base, CallArgs.size()), FT, Called->getAttributes());
+    auto cal = B.CreateCall(F, CallArgs);
+    cal->setCallingConv(Called->getCallingConv());
+    return cal;
+  }
+
+  Value *sqrt(Value *V) {
+    Type *tys[] = {V->getType()};
+    return B.CreateCall(Intrinsic::getDeclaration(Called->getParent(),
+                                                  Intrinsic::sqrt, tys),
+                        V);
+  }
+};
+
+//! Derivative rules for vector math library functions, keyed by the base name
+//! of the scalar function. Each entry holds the number of vector arguments and
+//! a function returning the partial derivative with respect to one of them.
+typedef Value *(*VectorLibMRule)(VectorLibMDerivative &, unsigned);
+static const std::map<std::string, std::pair<unsigned, VectorLibMRule>>
+    VectorLibMRules = {
+        {"exp",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.call("exp", D.Args);
+          }}},
+        {"exp2",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.B.CreateFMul(D.call("exp2", D.Args),
+                                  D.C(0.6931471805599453));
+          }}},
+        {"expm1",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.call("exp", D.Args);
+          }}},
+        {"log",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.B.CreateFDiv(D.C(1.0), D.Args[0]);
+          }}},
+        {"log2",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.B.CreateFDiv(
+                D.C(1.0), D.B.CreateFMul(D.Args[0], D.C(0.6931471805599453)));
+          }}},
+        {"log10",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.B.CreateFDiv(
+                D.C(1.0), D.B.CreateFMul(D.Args[0], D.C(2.302585092994046)));
+          }}},
+        {"log1p",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.B.CreateFDiv(D.C(1.0),
+                                  D.B.CreateFAdd(D.Args[0], D.C(1.0)));
+          }}},
+        {"sin",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.call("cos", D.Args);
+          }}},
+        {"cos",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.B.CreateFNeg(D.call("sin", D.Args));
+          }}},
+        {"tan",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *t = D.call("tan", D.Args);
+            return D.B.CreateFAdd(D.C(1.0), D.B.CreateFMul(t, t));
+          }}},
+        {"sinh",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.call("cosh", D.Args);
+          }}},
+        {"cosh",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.call("sinh", D.Args);
+          }}},
+        {"tanh",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *t = D.call("tanh", D.Args);
+            return D.B.CreateFSub(D.C(1.0), D.B.CreateFMul(t, t));
+          }}},
+        {"asin",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *x = D.Args[0];
+            return D.B.CreateFDiv(
+                D.C(1.0),
+                D.sqrt(D.B.CreateFSub(D.C(1.0), D.B.CreateFMul(x, x))));
+          }}},
+        {"acos",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *x = D.Args[0];
+            return D.B.CreateFDiv(
+                D.C(-1.0),
+                D.sqrt(D.B.CreateFSub(D.C(1.0), D.B.CreateFMul(x, x))));
+          }}},
+        {"atan",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *x = D.Args[0];
+            return D.B.CreateFDiv(
+                D.C(1.0), D.B.CreateFAdd(D.C(1.0), D.B.CreateFMul(x, x)));
+          }}},
+        {"asinh",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *x = D.Args[0];
+            return D.B.CreateFDiv(
+                D.C(1.0),
+                D.sqrt(D.B.CreateFAdd(D.B.CreateFMul(x, x), D.C(1.0))));
+          }}},
+        {"acosh",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *x = D.Args[0];
+            return D.B.CreateFDiv(
+                D.C(1.0),
+                D.sqrt(D.B.CreateFSub(D.B.CreateFMul(x, x), D.C(1.0))));
+          }}},
+        {"atanh",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *x = D.Args[0];
+            return D.B.CreateFDiv(
+                D.C(1.0), D.B.CreateFSub(D.C(1.0), D.B.CreateFMul(x, x)));
+          }}},
+        {"sqrt",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.B.CreateFDiv(D.C(0.5), D.sqrt(D.Args[0]));
+          }}},
+        {"cbrt",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            return D.B.CreateFDiv(D.call("cbrt", D.Args),
+                                  D.B.CreateFMul(D.Args[0], D.C(3.0)));
+          }}},
+        {"erf",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *x = D.Args[0];
+            Value *e = D.call("exp", D.B.CreateFNeg(D.B.CreateFMul(x, x)));
+            return D.B.CreateFMul(e, D.C(1.1283791670955126));
+          }}},
+        {"erfc",
+         {1,
+          [](VectorLibMDerivative &D, unsigned) {
+            Value *x = D.Args[0];
+            Value *e = D.call("exp", D.B.CreateFNeg(D.B.CreateFMul(x, x)));
+            return D.B.CreateFMul(e, D.C(-1.1283791670955126));
+          }}},
+        {"pow",
+         {2,
+          [](VectorLibMDerivative &D, unsigned i) {
+            Value *x = D.Args[0], *y = D.Args[1];
+            if (i == 0) {
+              Value *args[] = {x, D.B.CreateFSub(y, D.C(1.0))};
+              return D.B.CreateFMul(y, D.call("pow", args));
+            }
+            return D.B.CreateFMul(D.call("pow", D.Args), D.call("log", x));
+          }}},
+        {"atan2",
+         {2,
+          [](VectorLibMDerivative &D, unsigned i) {
+            Value *y = D.Args[0], *x = D.Args[1];
+            Value *denom = D.B.CreateFAdd(D.B.CreateFMul(x, x),
+                                          D.B.CreateFMul(y, y));
+            return i == 0 ? D.B.CreateFDiv(x, denom)
+                          : D.B.CreateFDiv(D.B.CreateFNeg(y), denom);
+          }}},
+        {"hypot",
+         {2,
+          [](VectorLibMDerivative &D, unsigned i) {
+            return D.B.CreateFDiv(D.Args[i], D.call("hypot", D.Args));
+          }}},
+};
+
 // Helper instruction visitor that generates adjoints
 template <class AugmentedReturnType = AugmentedReturn *>
 class AdjointGenerator
@@ -62,6 +270,10 @@ private:
   const SmallPtrSetImpl<BasicBlock *> &oldUnreachable;
   AllocaInst *dretAlloca;
 
+  // Location of the original instruction being visited, given to reverse
+  // builders created without one
+  DebugLoc visitedLoc;
+
 public:
   AdjointGenerator(
       DerivativeMode Mode, GradientUtils *gutils,
@@ -101,6 +313,13 @@ public:
     }
   }
 
+  using InstVisitor<AdjointGenerator<AugmentedReturnType>>::visit;
+  void visit(Instruction *I) {
+    visitedLoc = I->getDebugLoc();
+    InstVisitor<AdjointGenerator<AugmentedReturnType>>::visit(I);
+    visitedLoc = DebugLoc();
+  }
+
   SmallPtrSet<Instruction *, 4> erased;
 
   void eraseIfUnused(llvm::Instruction &I, bool erase = true,
@@ -248,6 +467,16 @@ public:
         Value *orig_op1 = FPMO->getOperand(0);
         bool constantval1 = gutils->isConstantValue(orig_op1);
 
+        if (gutils->TaylorDegree) {
+          IRBuilder<> Builder2(&inst);
+          getForwardBuilder(Builder2);
+          auto A = getTaylorSeries(orig_op1, Builder2);
+          for (unsigned k = 1; k < A.size(); ++k)
+            A[k] = Builder2.CreateFNeg(A[k]);
+          setTaylorSeries(&inst, A, Builder2);
+          return;
+        }
+
         IRBuilder<> Builder2(inst.getParent());
         getReverseBuilder(Builder2);
 
@@ -629,6 +858,381 @@ public:
     eraseIfUnused(SI);
   }
 
+  //! Return the intrinsic which performs the opposite memory access to the
+  //! masked load or store ID with the same lane mapping.
+  static Intrinsic::ID getMaskedInverse(Intrinsic::ID ID) {
+    switch (ID) {
+    case Intrinsic::masked_load:
+      return Intrinsic::masked_store;
+    case Intrinsic::masked_store:
+      return Intrinsic::masked_load;
+    case Intrinsic::masked_gather:
+      return Intrinsic::masked_scatter;
+    case Intrinsic::masked_scatter:
+      return Intrinsic::masked_gather;
+    case Intrinsic::masked_expandload:
+      return Intrinsic::masked_compressstore;
+    case Intrinsic::masked_compressstore:
+      return Intrinsic::masked_expandload;
+    default:
+      llvm_unreachable("not a masked memory intrinsic");
+    }
+  }
+
+  //! Emit the masked load-like intrinsic ID reading ptr under mask, taking
+  //! disabled lanes from passthru. Expand loads carry no alignment operand.
+  Value *createMaskedLoad(Intrinsic::ID ID, Value *ptr, Value *align,
+                          Value *mask, Value *passthru, IRBuilder<> &B) {
+    Module *M = B.GetInsertBlock()->getParent()->getParent();
+    if (ID == Intrinsic::masked_expandload) {
+      Type *tys[] = {passthru->getType()};
+      Value *args[] = {ptr, mask, passthru};
+      return B.CreateCall(Intrinsic::getDeclaration(M, ID, tys), args);
+    }
+    Type *tys[] = {passthru->getType(), ptr->getType()};
+    Value *args[] = {ptr, align, mask, passthru};
+    return B.CreateCall(Intrinsic::getDeclaration(M, ID, tys), args);
+  }
+
+  //! Emit the masked store-like intrinsic ID writing val to ptr under mask.
+  void createMaskedStore(Intrinsic::ID ID, Value *val, Value *ptr,
+                         Value *align, Value *mask, IRBuilder<> &B) {
+    Module *M = B.GetInsertBlock()->getParent()->getParent();
+    if (ID == Intrinsic::masked_compressstore) {
+      Type *tys[] = {val->getType()};
+      Value *args[] = {val, ptr, mask};
+      B.CreateCall(Intrinsic::getDeclaration(M, ID, tys), args);
+      return;
+    }
+    Type *tys[] = {val->getType(), ptr->getType()};
+    Value *args[] = {val, ptr, align, mask};
+    B.CreateCall(Intrinsic::getDeclaration(M, ID, tys), args);
+  }
+
+  //! Add two (possibly integer typed) floating point vectors.
+  Value *addMaskedLanes(Value *a, Value *b, IRBuilder<> &B) {
+    if (a->getType()->isFPOrFPVectorTy())
+      return B.CreateFAdd(a, b);
+    Type *FT = IntToFloatTy(a->getType());
+    return B.CreateBitCast(B.CreateFAdd(B.CreateBitCast(a, FT),
+                                        B.CreateBitCast(b, FT)),
+                           a->getType());
+  }
+
+  //! Return mask restricted to the single lane idx. Gathers and scatters may
+  //! address the same location from several lanes, so their adjoints are
+  //! applied one lane at a time.
+  Value *getMaskedLane(Value *mask, unsigned idx, IRBuilder<> &B) {
+    auto VT = cast<VectorType>(mask->getType());
+#if LLVM_VERSION_MAJOR >= 12
+    unsigned width = VT->getElementCount().getKnownMinValue();
+#else
+    unsigned width = VT->getNumElements();
+#endif
+    SmallVector<Constant *, 8> lanes;
+    for (unsigned i = 0; i < width; ++i)
+      lanes.push_back(i == idx ? ConstantInt::getTrue(VT->getContext())
+                               : ConstantInt::getFalse(VT->getContext()));
+    return B.CreateAnd(mask, ConstantVector::get(lanes));
+  }
+
+  unsigned getMaskedWidth(Type *T) {
+    auto VT = cast<VectorType>(T);
+#if LLVM_VERSION_MAJOR >= 12
+    if (VT->getElementCount().isScalable()) {
+      llvm::errs() << *gutils->oldFunc << "\n";
+      report_fatal_error("cannot differentiate scalable gather/scatter");
+    }
+    return VT->getElementCount().getKnownMinValue();
+#else
+    return VT->getNumElements();
+#endif
+  }
+
+  //! Return the floating point type of a masked access to type T, or null if
+  //! the lanes are integral.
+  Type *getMaskedFloatType(Value *val) {
+    Type *T = val->getType();
+    if (T->isFPOrFPVectorTy())
+      return T->getScalarType();
+    if (T->isPtrOrPtrVectorTy())
+      return nullptr;
+    auto &DL = gutils->newFunc->getParent()->getDataLayout();
+    auto size = DL.getTypeSizeInBits(T) / 8;
+    return TR.intType(size, val, /*errIfNotFound*/ !looseTypeAnalysis)
+        .isFloat();
+  }
+
+  //! Atomically add the lanes of dif enabled by mask to the shadow memory
+  //! that the masked load-like intrinsic ID read from dptr. Every lane is
+  //! added on its own, disabled lanes being redirected to a scratch slot so
+  //! that no memory outside of the mask is touched.
+  void atomicAddMaskedLanes(Intrinsic::ID ID, Value *dptr, Value *dif,
+                            Value *mask, IRBuilder<> &B) {
+#if LLVM_VERSION_MAJOR >= 9
+    if (!dif->getType()->isFPOrFPVectorTy())
+      dif = B.CreateBitCast(dif, IntToFloatTy(dif->getType()));
+    Type *ET = dif->getType()->getScalarType();
+    Type *I64 = Type::getInt64Ty(ET->getContext());
+    auto AS = cast<PointerType>(dptr->getType()->getScalarType())
+                  ->getAddressSpace();
+    Type *EPT = PointerType::get(ET, AS);
+
+    Value *scratch = B.CreatePointerBitCastOrAddrSpaceCast(
+        IRBuilder<>(gutils->inversionAllocs).CreateAlloca(ET), EPT);
+    Value *base = ID == Intrinsic::masked_gather
+                      ? nullptr
+                      : B.CreatePointerCast(dptr, EPT);
+    // Expand loads read the enabled lanes from consecutive elements
+    Value *offset = ConstantInt::get(I64, 0);
+    for (unsigned i = 0, e = getMaskedWidth(dif->getType()); i < e; ++i) {
+      Value *active = B.CreateExtractElement(mask, i);
+      Value *ptr;
+      if (ID == Intrinsic::masked_gather) {
+        ptr = B.CreatePointerCast(B.CreateExtractElement(dptr, i), EPT);
+      } else if (ID == Intrinsic::masked_expandload) {
+        ptr = B.CreateGEP(base, offset);
+        offset = B.CreateAdd(offset, B.CreateZExt(active, I64));
+      } else {
+        ptr = B.CreateGEP(base, ConstantInt::get(I64, i));
+      }
+      ptr = B.CreateSelect(active, ptr, scratch);
+      Value *val = B.CreateExtractElement(dif, i);
+#if LLVM_VERSION_MAJOR >= 13
+      B.CreateAtomicRMW(AtomicRMWInst::FAdd, ptr, val, MaybeAlign(),
+                        AtomicOrdering::Monotonic, SyncScope::System);
+#else
+      B.CreateAtomicRMW(AtomicRMWInst::FAdd, ptr, val,
+                        AtomicOrdering::Monotonic, SyncScope::System);
+#endif
+    }
+#else
+    llvm::errs() << "unhandled atomic fadd on llvm version " << *dptr << " "
+                 << *dif << "\n";
+    llvm_unreachable("unhandled atomic fadd");
+#endif
+  }
+
+  //! Handles llvm.masked.load, llvm.masked.gather and llvm.masked.expandload.
+  //! The shadow memory is accessed with the same intrinsic and mask as the
+  //! primal, so disabled lanes are never touched in the shadow either.
+  void visitMaskedLoad(llvm::IntrinsicInst &I) {
+    Intrinsic::ID ID = I.getIntrinsicID();
+    bool expand = ID == Intrinsic::masked_expandload;
+    Value *orig_ptr = I.getOperand(0);
+    Value *align = expand ? nullptr : I.getOperand(1);
+    Value *orig_mask = I.getOperand(expand ? 1 : 2);
+    Value *orig_passthru = I.getOperand(expand ? 2 : 3);
+    Type *type = I.getType();
+
+    bool constantval = gutils->isConstantValue(&I);
+    auto *newi = cast<Instruction>(gutils->getNewFromOriginal(&I));
+
+    //! Load the shadow of vectors of pointers, caching it where the reverse
+    //! pass cannot reload it.
+    if (!type->isFPOrFPVectorTy() &&
+        TR.query(&I).Inner0().isPossiblePointer()) {
+      Instruction *placeholder =
+          cast<Instruction>(gutils->invertedPointers[&I]);
+      assert(placeholder->getType() == type);
+      gutils->invertedPointers.erase(&I);
+
+      if (!constantval) {
+        IRBuilder<> BuilderZ(newi);
+        bool needShadow =
+            Mode == DerivativeMode::ForwardMode
+                ? false
+                : is_value_needed_in_reverse<ValueType::ShadowPtr>(
+                      TR, gutils, &I, Mode, oldUnreachable);
+
+        Value *newip = nullptr;
+        if (Mode == DerivativeMode::ReverseModeGradient) {
+          if (needShadow)
+            newip = gutils->cacheForReverse(BuilderZ, placeholder,
+                                            getIndex(&I, CacheType::Shadow));
+          else
+            gutils->erase(placeholder);
+        } else {
+          Value *passthru =
+              gutils->isConstantValue(orig_passthru)
+                  ? gutils->getNewFromOriginal(orig_passthru)
+                  : gutils->invertPointerM(orig_passthru, BuilderZ);
+          newip = createMaskedLoad(
+              ID, gutils->invertPointerM(orig_ptr, BuilderZ), align,
+              gutils->getNewFromOriginal(orig_mask), passthru, BuilderZ);
+          if (Mode == DerivativeMode::ReverseModePrimal && needShadow)
+            gutils->cacheForReverse(BuilderZ, newip,
+                                    getIndex(&I, CacheType::Shadow));
+          placeholder->replaceAllUsesWith(newip);
+          gutils->erase(placeholder);
+        }
+        if (newip)
+          gutils->invertedPointers[&I] = newip;
+      } else {
+        gutils->erase(placeholder);
+      }
+    }
+
+    // Masked loads read memory and thus are never legal to recompute, cache
+    // the result whenever it is needed in the reverse pass.
+    bool primalNeededInReverse =
+        Mode == DerivativeMode::ForwardMode
+            ? false
+            : is_value_needed_in_reverse<ValueType::Primal>(
+                  TR, gutils, &I, Mode, oldUnreachable);
+    if ((cache_reads_always || primalNeededInReverse) &&
+        !gutils->unnecessaryIntermediates.count(&I)) {
+      IRBuilder<> BuilderZ(newi->getNextNode());
+      gutils->cacheForReverse(BuilderZ, newi, getIndex(&I, CacheType::Self));
+    }
+
+    if (Mode == DerivativeMode::ReverseModePrimal || constantval)
+      return;
+
+    Type *FT = getMaskedFloatType(&I);
+    if (!FT)
+      return;
+
+    switch (Mode) {
+    case DerivativeMode::ForwardMode: {
+      IRBuilder<> Builder2(&I);
+      getForwardBuilder(Builder2);
+
+      Value *passthru = gutils->isConstantValue(orig_passthru)
+                            ? Constant::getNullValue(type)
+                            : diffe(orig_passthru, Builder2);
+      Value *diff = createMaskedLoad(
+          ID, gutils->invertPointerM(orig_ptr, Builder2), align,
+          gutils->getNewFromOriginal(orig_mask), passthru, Builder2);
+      setDiffe(&I, diff, Builder2);
+      break;
+    }
+    case DerivativeMode::ReverseModeGradient:
+    case DerivativeMode::ReverseModeCombined: {
+      IRBuilder<> Builder2(I.getParent());
+      getReverseBuilder(Builder2);
+
+      Value *dif = diffe(&I, Builder2);
+      setDiffe(&I, Constant::getNullValue(type), Builder2);
+
+      Value *mask = lookup(gutils->getNewFromOriginal(orig_mask), Builder2);
+      Value *zero = Constant::getNullValue(type);
+
+      if (!gutils->isConstantValue(orig_passthru))
+        addToDiffe(orig_passthru, Builder2.CreateSelect(mask, zero, dif),
+                   Builder2, FT);
+
+      if (gutils->isConstantValue(orig_ptr))
+        break;
+
+      Value *dptr = gutils->invertPointerM(orig_ptr, Builder2);
+      if (gutils->AtomicAdd) {
+        atomicAddMaskedLanes(ID, dptr, dif, mask, Builder2);
+        break;
+      }
+
+      Intrinsic::ID StoreID = getMaskedInverse(ID);
+      auto accumulate = [&](Value *lanes) {
+        Value *old = createMaskedLoad(ID, dptr, align, lanes, zero, Builder2);
+        createMaskedStore(StoreID, addMaskedLanes(old, dif, Builder2), dptr,
+                          align, lanes, Builder2);
+      };
+      if (ID == Intrinsic::masked_gather) {
+        for (unsigned i = 0, e = getMaskedWidth(type); i < e; ++i)
+          accumulate(getMaskedLane(mask, i, Builder2));
+      } else {
+        accumulate(mask);
+      }
+      break;
+    }
+    case DerivativeMode::ReverseModePrimal:
+      break;
+    }
+  }
+
+  //! Handles llvm.masked.store, llvm.masked.scatter and
+  //! llvm.masked.compressstore.
+  void visitMaskedStore(llvm::IntrinsicInst &I) {
+    Intrinsic::ID ID = I.getIntrinsicID();
+    bool compress = ID == Intrinsic::masked_compressstore;
+    Value *orig_val = I.getOperand(0);
+    Value *orig_ptr = I.getOperand(1);
+    Value *align = compress ? nullptr : I.getOperand(2);
+    Value *orig_mask = I.getOperand(compress ? 2 : 3);
+    Type *valType = orig_val->getType();
+
+    if (gutils->isConstantValue(orig_ptr))
+      return;
+
+    bool constantval = gutils->isConstantValue(orig_val);
+
+    Type *FT = getMaskedFloatType(orig_val);
+    if (!FT) {
+      //! Storing integers or pointers only updates the forward function
+      if (Mode == DerivativeMode::ReverseModePrimal ||
+          Mode == DerivativeMode::ReverseModeCombined ||
+          Mode == DerivativeMode::ForwardMode) {
+        IRBuilder<> storeBuilder(gutils->getNewFromOriginal(&I));
+        Value *valueop = constantval
+                             ? gutils->getNewFromOriginal(orig_val)
+                             : gutils->invertPointerM(orig_val, storeBuilder);
+        createMaskedStore(ID, valueop,
+                          gutils->invertPointerM(orig_ptr, storeBuilder),
+                          align, gutils->getNewFromOriginal(orig_mask),
+                          storeBuilder);
+      }
+      return;
+    }
+
+    Value *zero = Constant::getNullValue(valType);
+    switch (Mode) {
+    case DerivativeMode::ReverseModePrimal:
+      break;
+    case DerivativeMode::ForwardMode: {
+      IRBuilder<> Builder2(&I);
+      getForwardBuilder(Builder2);
+
+      Value *diff = constantval ? zero : diffe(orig_val, Builder2);
+      createMaskedStore(ID, diff, gutils->invertPointerM(orig_ptr, Builder2),
+                        align, gutils->getNewFromOriginal(orig_mask),
+                        Builder2);
+      break;
+    }
+    case DerivativeMode::ReverseModeGradient:
+    case DerivativeMode::ReverseModeCombined: {
+      IRBuilder<> Builder2(I.getParent());
+      getReverseBuilder(Builder2);
+
+      Intrinsic::ID LoadID = getMaskedInverse(ID);
+      Value *mask = lookup(gutils->getNewFromOriginal(orig_mask), Builder2);
+      Value *dptr = gutils->invertPointerM(orig_ptr, Builder2);
+
+      // Read the adjoint of the stored lanes, then clear it since the stored
+      // value overwrote whatever was there before.
+      Value *dif = nullptr;
+      auto release = [&](Value *lanes) {
+        if (!constantval) {
+          Value *ld = createMaskedLoad(LoadID, dptr, align, lanes, zero,
+                                       Builder2);
+          dif = dif ? addMaskedLanes(dif, ld, Builder2) : ld;
+        }
+        createMaskedStore(ID, zero, dptr, align, lanes, Builder2);
+      };
+      if (ID == Intrinsic::masked_scatter) {
+        // Only the last of several lanes scattering to one address is
+        // visible, so walk the lanes backwards.
+        for (unsigned i = getMaskedWidth(valType); i > 0; --i)
+          release(getMaskedLane(mask, i - 1, Builder2));
+      } else {
+        release(mask);
+      }
+      if (!constantval)
+        addToDiffe(orig_val, dif, Builder2, FT);
+      break;
+    }
+    }
+  }
+
   void visitGetElementPtrInst(llvm::GetElementPtrInst &gep) {
     eraseIfUnused(gep);
   }
@@ -658,7 +1262,8 @@ public:
     IRBuilder<> phiBuilder(&phi);
     getForwardBuilder(phiBuilder);
 
-    auto newPhi = phiBuilder.CreatePHI(phi.getType(), 1, phi.getName() + "'");
+    Type *shadowType = getTaylorShadowType(phi.getType(), gutils->TaylorDegree);
+    auto newPhi = phiBuilder.CreatePHI(shadowType, 1, phi.getName() + "'");
     for (unsigned int i = 0; i < phi.getNumIncomingValues(); ++i) {
       auto val = phi.getIncomingValue(i);
       auto block = phi.getIncomingBlock(i);
@@ -668,7 +1273,7 @@ public:
       pBuilder.setFastMathFlags(getFast());
 
       if (gutils->isConstantValue(val)) {
-        newPhi->addIncoming(Constant::getNullValue(val->getType()), newBlock);
+        newPhi->addIncoming(Constant::getNullValue(shadowType), newBlock);
       } else {
         auto diff = diffe(val, pBuilder);
         newPhi->addIncoming(diff, newBlock);
@@ -746,11 +1351,21 @@ public:
       getForwardBuilder(Builder2);
 
       if (!gutils->isConstantValue(orig_op0)) {
-        Value *dif = diffe(orig_op0, Builder2);
-        setDiffe(&I, Builder2.CreateCast(I.getOpcode(), dif, I.getType()),
-                 Builder2);
+        if (gutils->TaylorDegree && I.getType()->isFloatingPointTy()) {
+          auto A = getTaylorSeries(orig_op0, Builder2);
+          for (unsigned k = 1; k < A.size(); ++k)
+            A[k] = Builder2.CreateCast(I.getOpcode(), A[k], I.getType());
+          setTaylorSeries(&I, A, Builder2);
+        } else {
+          Value *dif = diffe(orig_op0, Builder2);
+          setDiffe(&I, Builder2.CreateCast(I.getOpcode(), dif, I.getType()),
+                   Builder2);
+        }
       } else {
-        setDiffe(&I, Constant::getNullValue(I.getType()), Builder2);
+        setDiffe(&I,
+                 Constant::getNullValue(
+                     getTaylorShadowType(I.getType(), gutils->TaylorDegree)),
+                 Builder2);
       }
 
       break;
@@ -890,17 +1505,18 @@ public:
 
     Value *dif1;
     Value *dif2;
+    Type *shadowType = getTaylorShadowType(SI.getType(), gutils->TaylorDegree);
 
     if (!constantval0) {
       dif1 = diffe(op1, Builder2);
     } else {
-      dif1 = Constant::getNullValue(SI.getType());
+      dif1 = Constant::getNullValue(shadowType);
     }
 
     if (!constantval1) {
       dif2 = diffe(op2, Builder2);
     } else {
-      dif2 = Constant::getNullValue(SI.getType());
+      dif2 = Constant::getNullValue(shadowType);
     }
 
     Value *diffe = Builder2.CreateSelect(cond, dif1, dif2);
@@ -1133,6 +1749,8 @@ public:
   }
 
   void getReverseBuilder(IRBuilder<> &Builder2, bool original = true) {
+    if (original && !Builder2.getCurrentDebugLocation())
+      Builder2.SetCurrentDebugLocation(visitedLoc);
     ((GradientUtils *)gutils)->getReverseBuilder(Builder2, original);
   }
 
@@ -1226,18 +1844,30 @@ public:
             "m1diffe" + orig_op1->getName());
       break;
     }
-    case Instruction::FAdd: {
-      if (!constantval0)
-        dif0 = idiff;
-      if (!constantval1)
-        dif1 = idiff;
-      break;
-    }
+    case Instruction::FAdd:
     case Instruction::FSub: {
+      // The update of a sum reduction, s' = s + x, leaves the adjoint of the
+      // final sum unchanged for the previous iteration. It is kept in place
+      // of threading it through the phi, and cleared once the reverse loop
+      // exits to the preheader
+      for (int i = 0; i < 2; i++) {
+        auto P0 = dyn_cast<PHINode>(BO.getOperand(i));
+        LoopContext lc;
+        if (P0 && gutils->getAdditiveReduction(P0, lc) == &BO) {
+          if (!gutils->isConstantValue(BO.getOperand(1 - i)))
+            addToDiffe(BO.getOperand(1 - i),
+                       BO.getOpcode() == Instruction::FSub
+                           ? Builder2.CreateFNeg(idiff)
+                           : idiff,
+                       Builder2, addingType);
+          return;
+        }
+      }
       if (!constantval0)
         dif0 = idiff;
       if (!constantval1)
-        dif1 = Builder2.CreateFNeg(idiff);
+        dif1 = BO.getOpcode() == Instruction::FSub ? Builder2.CreateFNeg(idiff)
+                                                   : idiff;
       break;
     }
     case Instruction::FDiv: {
@@ -1580,6 +2210,11 @@ public:
   }
 
   void createBinaryOperatorDual(llvm::BinaryOperator &BO) {
+    if (gutils->TaylorDegree) {
+      createBinaryOperatorTaylor(BO);
+      return;
+    }
+
     IRBuilder<> Builder2(&BO);
     getForwardBuilder(Builder2);
 
@@ -1668,6 +2303,392 @@ public:
     }
   }
 
+  /// Coefficients of degree 0 to TaylorDegree of the Taylor polynomial of
+  /// orig, the coefficient of degree 0 being its primal value
+  SmallVector<Value *, 4> getTaylorSeries(Value *orig, IRBuilder<> &Builder2) {
+    SmallVector<Value *, 4> series;
+    series.push_back(isa<Constant>(orig) ? orig
+                                         : gutils->getNewFromOriginal(orig));
+    Value *dif =
+        gutils->isConstantValue(orig) ? nullptr : diffe(orig, Builder2);
+    for (unsigned k = 0; k < gutils->TaylorDegree; ++k) {
+      unsigned idx[] = {k};
+      series.push_back(dif ? Builder2.CreateExtractValue(dif, idx)
+                           : Constant::getNullValue(orig->getType()));
+    }
+    return series;
+  }
+
+  /// Set the shadow of orig to the coefficients of degree 1 to TaylorDegree
+  /// of series
+  void setTaylorSeries(Value *orig, ArrayRef<Value *> series,
+                       IRBuilder<> &Builder2) {
+    assert(series.size() == gutils->TaylorDegree + 1);
+    Value *dif = UndefValue::get(
+        getTaylorShadowType(orig->getType(), gutils->TaylorDegree));
+    for (unsigned k = 1; k < series.size(); ++k) {
+      unsigned idx[] = {k - 1};
+      dif = Builder2.CreateInsertValue(dif, series[k], idx);
+    }
+    setDiffe(orig, dif, Builder2);
+  }
+
+  /// Sum over j in [lo, hi] of w(j) * X[j] * Y[k - j], where w(j) = j / k if
+  /// weighted and 1 otherwise, or null if the range is empty
+  Value *taylorConvolution(ArrayRef<Value *> X, ArrayRef<Value *> Y,
+                           unsigned k, unsigned lo, unsigned hi, bool weighted,
+                           IRBuilder<> &Builder2) {
+    Value *sum = nullptr;
+    for (unsigned j = lo; j <= hi; ++j) {
+      Value *term = Builder2.CreateFMul(X[j], Y[k - j]);
+      if (weighted)
+        term = Builder2.CreateFMul(
+            term, ConstantFP::get(term->getType(), (double)j / k));
+      sum = sum ? Builder2.CreateFAdd(sum, term) : term;
+    }
+    return sum;
+  }
+
+  /// Series of c = a * b, whose primal is c0
+  SmallVector<Value *, 4> taylorMul(ArrayRef<Value *> A, ArrayRef<Value *> B,
+                                    Value *c0, IRBuilder<> &Builder2) {
+    // c_k = sum_{j=0}^{k} a_j b_{k-j}
+    SmallVector<Value *, 4> C = {c0};
+    for (unsigned k = 1; k < A.size(); ++k)
+      C.push_back(taylorConvolution(A, B, k, 0, k, false, Builder2));
+    return C;
+  }
+
+  /// Series of q = a / b, whose primal is q0
+  SmallVector<Value *, 4> taylorDiv(ArrayRef<Value *> A, ArrayRef<Value *> B,
+                                    Value *q0, IRBuilder<> &Builder2) {
+    // q_k = (a_k - sum_{j=1}^{k} b_j q_{k-j}) / b_0
+    SmallVector<Value *, 4> Q = {q0};
+    for (unsigned k = 1; k < A.size(); ++k) {
+      Value *sum = taylorConvolution(B, Q, k, 1, k, false, Builder2);
+      Q.push_back(Builder2.CreateFDiv(Builder2.CreateFSub(A[k], sum), B[0]));
+    }
+    return Q;
+  }
+
+  /// Series of e = exp(a), whose primal is e0
+  SmallVector<Value *, 4> taylorExp(ArrayRef<Value *> A, Value *e0,
+                                    IRBuilder<> &Builder2) {
+    // e_k = sum_{j=1}^{k} (j / k) a_j e_{k-j}
+    SmallVector<Value *, 4> E = {e0};
+    for (unsigned k = 1; k < A.size(); ++k)
+      E.push_back(taylorConvolution(A, E, k, 1, k, true, Builder2));
+    return E;
+  }
+
+  /// Series of l = log(a), whose primal is l0
+  SmallVector<Value *, 4> taylorLog(ArrayRef<Value *> A, Value *l0,
+                                    IRBuilder<> &Builder2) {
+    // l_k = (a_k - sum_{j=1}^{k-1} (j / k) l_j a_{k-j}) / a_0
+    SmallVector<Value *, 4> L = {l0};
+    for (unsigned k = 1; k < A.size(); ++k) {
+      Value *num = A[k];
+      if (k > 1)
+        num = Builder2.CreateFSub(
+            num, taylorConvolution(L, A, k, 1, k - 1, true, Builder2));
+      L.push_back(Builder2.CreateFDiv(num, A[0]));
+    }
+    return L;
+  }
+
+  /// Series of s = sqrt(a), whose primal is s0
+  SmallVector<Value *, 4> taylorSqrt(ArrayRef<Value *> A, Value *s0,
+                                     IRBuilder<> &Builder2) {
+    // s_k = (a_k - sum_{j=1}^{k-1} s_j s_{k-j}) / (2 s_0)
+    SmallVector<Value *, 4> S = {s0};
+    Value *denom = Builder2.CreateFMul(ConstantFP::get(s0->getType(), 2.0), s0);
+    for (unsigned k = 1; k < A.size(); ++k) {
+      Value *num = A[k];
+      if (k > 1)
+        num = Builder2.CreateFSub(
+            num, taylorConvolution(S, S, k, 1, k - 1, false, Builder2));
+      S.push_back(Builder2.CreateFDiv(num, denom));
+    }
+    return S;
+  }
+
+  /// Series S of sin(a) and C of cos(a), whose primals are s0 and c0
+  void taylorSinCos(ArrayRef<Value *> A, Value *s0, Value *c0,
+                    SmallVectorImpl<Value *> &S, SmallVectorImpl<Value *> &C,
+                    IRBuilder<> &Builder2) {
+    // s_k = sum_{j=1}^{k} (j / k) a_j c_{k-j}
+    // c_k = -sum_{j=1}^{k} (j / k) a_j s_{k-j}
+    S.clear();
+    C.clear();
+    S.push_back(s0);
+    C.push_back(c0);
+    for (unsigned k = 1; k < A.size(); ++k) {
+      Value *sk = taylorConvolution(A, C, k, 1, k, true, Builder2);
+      Value *ck = Builder2.CreateFNeg(
+          taylorConvolution(A, S, k, 1, k, true, Builder2));
+      S.push_back(sk);
+      C.push_back(ck);
+    }
+  }
+
+  /// Series of y = pow(a, r) for an inactive exponent r, whose primal is y0
+  SmallVector<Value *, 4> taylorPow(ArrayRef<Value *> A, Value *r, Value *y0,
+                                    IRBuilder<> &Builder2) {
+    // y_k = sum_{j=1}^{k} ((r + 1) j / k - 1) a_j y_{k-j} / a_0
+    Type *T = y0->getType();
+    Value *r1 = Builder2.CreateFAdd(r, ConstantFP::get(T, 1.0));
+    // The recurrence divides by a_0. At a_0 == 0 the coefficients up to the
+    // degree vanish for exponents above the degree, other exponents are left
+    // to the division and thus give inf or NaN.
+    Value *zero = ConstantFP::get(T, 0.0);
+    Value *atZero = Builder2.CreateAnd(
+        Builder2.CreateFCmpOEQ(A[0], zero),
+        Builder2.CreateFCmpOGT(r, ConstantFP::get(T, (double)(A.size() - 1))));
+    SmallVector<Value *, 4> Y = {y0};
+    for (unsigned k = 1; k < A.size(); ++k) {
+      Value *sum = nullptr;
+      for (unsigned j = 1; j <= k; ++j) {
+        Value *w = Builder2.CreateFSub(
+            Builder2.CreateFMul(r1, ConstantFP::get(T, (double)j / k)),
+            ConstantFP::get(T, 1.0));
+        Value *term =
+            Builder2.CreateFMul(w, Builder2.CreateFMul(A[j], Y[k - j]));
+        sum = sum ? Builder2.CreateFAdd(sum, term) : term;
+      }
+      Y.push_back(
+          Builder2.CreateSelect(atZero, zero, Builder2.CreateFDiv(sum, A[0])));
+    }
+    return Y;
+  }
+
+  /// Series of y = pow(a, n) for a small constant n >= 0 by repeated
+  /// multiplication, which unlike taylorPow holds at a_0 == 0
+  SmallVector<Value *, 4> taylorPowi(ArrayRef<Value *> A, uint64_t n,
+                                     Value *y0, IRBuilder<> &Builder2) {
+    SmallVector<Value *, 4> Y;
+    if (n == 0) {
+      Y.push_back(y0);
+      for (unsigned k = 1; k < A.size(); ++k)
+        Y.push_back(ConstantFP::get(y0->getType(), 0.0));
+      return Y;
+    }
+    Y.append(A.begin(), A.end());
+    for (uint64_t i = 1; i < n; ++i)
+      Y = taylorMul(Y, A,
+                    i + 1 == n ? y0 : Builder2.CreateFMul(Y[0], A[0]),
+                    Builder2);
+    Y[0] = y0;
+    return Y;
+  }
+
+  /// The exponent of a pow or powi call as a small non-negative integer
+  /// constant, if it is one
+  Optional<uint64_t> getSmallTaylorExponent(Value *exp) {
+    const uint64_t MaxExponent = 8;
+    if (auto CI = dyn_cast<ConstantInt>(exp))
+      if (!CI->isNegative() && CI->getZExtValue() <= MaxExponent)
+        return CI->getZExtValue();
+    if (auto CF = dyn_cast<ConstantFP>(exp)) {
+      const APFloat &F = CF->getValueAPF();
+      if (F.isInteger() && !F.isNegative()) {
+        APSInt I(64, /*isUnsigned*/ true);
+        bool isExact = false;
+        F.convertToInteger(I, APFloat::rmTowardZero, &isExact);
+        if (isExact && I.getZExtValue() <= MaxExponent)
+          return I.getZExtValue();
+      }
+    }
+    return None;
+  }
+
+  void createBinaryOperatorTaylor(llvm::BinaryOperator &BO) {
+    // Integer operations carry no derivative
+    if (!BO.getType()->isFloatingPointTy())
+      return;
+
+    IRBuilder<> Builder2(&BO);
+    getForwardBuilder(Builder2);
+
+    auto A = getTaylorSeries(BO.getOperand(0), Builder2);
+    auto B = getTaylorSeries(BO.getOperand(1), Builder2);
+    Value *y0 = gutils->getNewFromOriginal(&BO);
+
+    SmallVector<Value *, 4> Y;
+    switch (BO.getOpcode()) {
+    case Instruction::FAdd:
+    case Instruction::FSub: {
+      Y.push_back(y0);
+      for (unsigned k = 1; k < A.size(); ++k)
+        Y.push_back(BO.getOpcode() == Instruction::FAdd
+                        ? Builder2.CreateFAdd(A[k], B[k])
+                        : Builder2.CreateFSub(A[k], B[k]));
+      break;
+    }
+    case Instruction::FMul:
+      Y = taylorMul(A, B, y0, Builder2);
+      break;
+    case Instruction::FDiv:
+      Y = taylorDiv(A, B, y0, Builder2);
+      break;
+    default:
+      llvm::errs() << *gutils->oldFunc << "\n";
+      llvm::errs() << "cannot propagate Taylor polynomials through " << BO
+                   << "\n";
+      report_fatal_error("unknown binary operator in Taylor mode");
+    }
+    setTaylorSeries(&BO, Y, Builder2);
+  }
+
+  /// The elementary function computed by call, if its Taylor polynomial can
+  /// be propagated
+  Intrinsic::ID getTaylorIntrinsic(llvm::CallInst &call) {
+    Intrinsic::ID ID = Intrinsic::not_intrinsic;
+    if (auto II = dyn_cast<IntrinsicInst>(&call))
+      ID = II->getIntrinsicID();
+    else if (Function *called = call.getCalledFunction())
+      ID = StringSwitch<Intrinsic::ID>(called->getName())
+               .Cases("exp", "expf", "expl", Intrinsic::exp)
+               .Cases("log", "logf", "logl", Intrinsic::log)
+               .Cases("sqrt", "sqrtf", "sqrtl", Intrinsic::sqrt)
+               .Cases("sin", "sinf", "sinl", Intrinsic::sin)
+               .Cases("cos", "cosf", "cosl", Intrinsic::cos)
+               .Cases("pow", "powf", "powl", Intrinsic::pow)
+               .Cases("fabs", "fabsf", "fabsl", Intrinsic::fabs)
+               .Default(Intrinsic::not_intrinsic);
+
+    switch (ID) {
+    case Intrinsic::exp:
+    case Intrinsic::log:
+    case Intrinsic::sqrt:
+    case Intrinsic::sin:
+    case Intrinsic::cos:
+    case Intrinsic::pow:
+    case Intrinsic::powi:
+    case Intrinsic::fabs:
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd:
+      return call.getType()->isFloatingPointTy() ? ID
+                                                 : Intrinsic::not_intrinsic;
+    default:
+      return Intrinsic::not_intrinsic;
+    }
+  }
+
+  void createTaylorCall(llvm::CallInst &call, Intrinsic::ID ID) {
+    IRBuilder<> Builder2(&call);
+    getForwardBuilder(Builder2);
+
+    Module *M = gutils->newFunc->getParent();
+    Type *T = call.getType();
+    Value *y0 = gutils->getNewFromOriginal(&call);
+    auto A = getTaylorSeries(call.getArgOperand(0), Builder2);
+
+    SmallVector<Value *, 4> Y;
+    switch (ID) {
+    case Intrinsic::exp:
+      Y = taylorExp(A, y0, Builder2);
+      break;
+    case Intrinsic::log:
+      Y = taylorLog(A, y0, Builder2);
+      break;
+    case Intrinsic::sqrt:
+      Y = taylorSqrt(A, y0, Builder2);
+      break;
+    case Intrinsic::sin:
+    case Intrinsic::cos: {
+      bool isSin = ID == Intrinsic::sin;
+      Value *other = Builder2.CreateCall(
+          Intrinsic::getDeclaration(
+              M, isSin ? Intrinsic::cos : Intrinsic::sin, T),
+          A[0]);
+      SmallVector<Value *, 4> S, C;
+      if (isSin)
+        taylorSinCos(A, y0, other, S, C, Builder2);
+      else
+        taylorSinCos(A, other, y0, S, C, Builder2);
+      Y = isSin ? S : C;
+      break;
+    }
+    case Intrinsic::fabs: {
+      Value *sign = Builder2.CreateSelect(
+          Builder2.CreateFCmpOLT(A[0], ConstantFP::get(T, 0.0)),
+          ConstantFP::get(T, -1.0), ConstantFP::get(T, 1.0));
+      Y.push_back(y0);
+      for (unsigned k = 1; k < A.size(); ++k)
+        Y.push_back(Builder2.CreateFMul(sign, A[k]));
+      break;
+    }
+    case Intrinsic::pow:
+    case Intrinsic::powi: {
+      Value *orig_exp = call.getArgOperand(1);
+      if (auto n = getSmallTaylorExponent(orig_exp)) {
+        Y = taylorPowi(A, *n, y0, Builder2);
+      } else if (ID == Intrinsic::powi || gutils->isConstantValue(orig_exp)) {
+        Value *r = isa<Constant>(orig_exp)
+                       ? orig_exp
+                       : gutils->getNewFromOriginal(orig_exp);
+        if (ID == Intrinsic::powi)
+          r = Builder2.CreateSIToFP(r, T);
+        Y = taylorPow(A, r, y0, Builder2);
+      } else {
+        // pow(a, b) = exp(b log(a))
+        Value *l0 = Builder2.CreateCall(
+            Intrinsic::getDeclaration(M, Intrinsic::log, T), A[0]);
+        auto L = taylorLog(A, l0, Builder2);
+        auto E = getTaylorSeries(orig_exp, Builder2);
+        auto P = taylorMul(E, L, Builder2.CreateFMul(E[0], l0), Builder2);
+        Y = taylorExp(P, y0, Builder2);
+      }
+      break;
+    }
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd: {
+      auto B = getTaylorSeries(call.getArgOperand(1), Builder2);
+      auto C = getTaylorSeries(call.getArgOperand(2), Builder2);
+      Y = taylorMul(A, B, y0, Builder2);
+      for (unsigned k = 1; k < A.size(); ++k)
+        Y[k] = Builder2.CreateFAdd(Y[k], C[k]);
+      break;
+    }
+    default:
+      llvm_unreachable("unhandled Taylor intrinsic");
+    }
+    setTaylorSeries(&call, Y, Builder2);
+  }
+
+  /// Report an error if the Taylor polynomials of the active values of inst
+  /// cannot be propagated, which is limited to scalar floating point values
+  /// held in registers
+  void checkTaylorSupport(llvm::Instruction &inst) {
+    if (gutils->isConstantInstruction(&inst) && gutils->isConstantValue(&inst))
+      return;
+
+    Type *T = inst.getType();
+    bool supported = !T->isFPOrFPVectorTy() || T->isFloatingPointTy();
+    if (auto CI = dyn_cast<CastInst>(&inst)) {
+      supported &= CI->getSrcTy()->isFPOrFPVectorTy() == T->isFPOrFPVectorTy();
+    } else if (auto call = dyn_cast<CallInst>(&inst)) {
+      supported &= getTaylorIntrinsic(*call) != Intrinsic::not_intrinsic;
+    } else if (isa<BinaryOperator>(&inst)) {
+      supported &= inst.getOpcode() != Instruction::FRem;
+#if LLVM_VERSION_MAJOR >= 10
+    } else if (inst.getOpcode() == Instruction::FNeg) {
+      // Negation applies coefficient-wise
+#endif
+    } else if (!isa<PHINode>(&inst) && !isa<SelectInst>(&inst) &&
+               !isa<CmpInst>(&inst) && !isa<GetElementPtrInst>(&inst) &&
+               !isa<AllocaInst>(&inst) && !inst.isTerminator()) {
+      supported = false;
+    }
+    if (supported)
+      return;
+
+    llvm::errs() << *gutils->oldFunc << "\n";
+    llvm::errs() << "cannot propagate Taylor polynomials through " << inst
+                 << "\n";
+    report_fatal_error("unsupported instruction in Taylor mode");
+  }
+
   void visitMemSetInst(llvm::MemSetInst &MS) {
     // Don't duplicate set in reverse pass
     if (Mode == DerivativeMode::ReverseModeGradient) {
@@ -1727,6 +2748,25 @@ public:
     }
   }
 
+  /// Width in bits of the vectors used by the derivatives of memcpy and
+  /// memmove, or zero for scalar helpers
+  unsigned getMemcpyVectorBits() {
+    if (!EnzymeVectorizeMemcpy)
+      return 0;
+    auto &TTI =
+        gutils->Logic.PPC.FAM.getResult<TargetIRAnalysis>(*gutils->oldFunc);
+#if LLVM_VERSION_MAJOR >= 12
+    unsigned bits =
+        TTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector)
+            .getFixedSize();
+#else
+    unsigned bits = TTI.getRegisterBitWidth(/*Vector*/ true);
+#endif
+    // Without target information, assume the 128 bit vectors available on
+    // all common targets
+    return std::max(bits, 128u);
+  }
+
   void subTransferHelper(Type *secretty, BasicBlock *parent,
                          Intrinsic::ID intrinsic, unsigned dstalign,
                          unsigned srcalign, unsigned offset, Value *orig_dst,
@@ -1794,7 +2834,8 @@ public:
           auto dmemcpy = ((intrinsic == Intrinsic::memcpy)
                               ? getOrInsertDifferentialFloatMemcpy
                               : getOrInsertDifferentialFloatMemmove)(
-              *parent->getParent()->getParent(), secretpt, dstalign, srcalign);
+              *parent->getParent()->getParent(), secretpt, dstalign, srcalign,
+              getMemcpyVectorBits());
           Builder2.CreateCall(dmemcpy, args);
         }
       }
@@ -2034,6 +3075,13 @@ public:
   }
 
   void visitIntrinsicInst(llvm::IntrinsicInst &II) {
+    if (gutils->TaylorDegree &&
+        getTaylorIntrinsic(II) != Intrinsic::not_intrinsic) {
+      eraseIfUnused(II);
+      if (!gutils->isConstantInstruction(&II))
+        createTaylorCall(II, getTaylorIntrinsic(II));
+      return;
+    }
     if (II.getIntrinsicID() == Intrinsic::stacksave) {
       eraseIfUnused(II, /*erase*/ true, /*check*/ false);
       return;
@@ -2043,6 +3091,22 @@ public:
       eraseIfUnused(II, /*erase*/ true, /*check*/ false);
       return;
     }
+    switch (II.getIntrinsicID()) {
+    case Intrinsic::masked_load:
+    case Intrinsic::masked_gather:
+    case Intrinsic::masked_expandload:
+      visitMaskedLoad(II);
+      eraseIfUnused(II);
+      return;
+    case Intrinsic::masked_store:
+    case Intrinsic::masked_scatter:
+    case Intrinsic::masked_compressstore:
+      visitMaskedStore(II);
+      eraseIfUnused(II);
+      return;
+    default:
+      break;
+    }
 
     eraseIfUnused(II);
     SmallVector<Value *, 2> orig_ops(II.getNumOperands());
@@ -2975,6 +4039,423 @@ public:
     }
   }
 
+  /// Layout of the heap closure handed to a differentiated pthread worker:
+  /// { reverse trampoline, primal arg, shadow arg, tape, return, rev thread }
+  StructType *getThreadClosureType(Type *threadTy) {
+    LLVMContext &C = threadTy->getContext();
+    auto i8p = Type::getInt8PtrTy(C);
+    auto trampTy = PointerType::getUnqual(FunctionType::get(i8p, {i8p}, false));
+    Type *types[] = {
+        /*0 */ trampTy,
+        /*1 */ i8p,
+        /*2 */ i8p,
+        /*3 */ i8p,
+        /*4 */ i8p,
+        /*5 */ threadTy,
+    };
+    return StructType::get(C, types, false);
+  }
+
+  /// Create the pair of thread entry points for a worker: one running the
+  /// augmented forward pass and stashing its tape into the closure, the
+  /// other running the corresponding reverse pass from that tape.
+  std::pair<Function *, Function *>
+  createThreadTrampolines(llvm::CallInst &call, Function *worker,
+                          StructType *closureTy) {
+    Module &M = *gutils->newFunc->getParent();
+    LLVMContext &C = M.getContext();
+    auto i8p = Type::getInt8PtrTy(C);
+    auto i32 = Type::getInt32Ty(C);
+    auto i64 = Type::getInt64Ty(C);
+    auto c0_64 = ConstantInt::get(i64, 0);
+
+    Value *arg = call.getArgOperand(3);
+    std::vector<DIFFE_TYPE> argsInverted = {
+        gutils->isConstantValue(arg) ? DIFFE_TYPE::CONSTANT
+                                     : DIFFE_TYPE::DUP_ARG};
+
+    // Another thread may overwrite anything reachable from the argument.
+    std::map<Argument *, bool> uncacheable_args;
+    uncacheable_args[worker->arg_begin()] = true;
+
+    FnTypeInfo nextTypeInfo(worker);
+    nextTypeInfo.Arguments.insert(
+        std::pair<Argument *, TypeTree>(worker->arg_begin(), TR.query(arg)));
+    nextTypeInfo.KnownValues.insert(std::pair<Argument *, std::set<int64_t>>(
+        worker->arg_begin(), TR.knownIntegralValues(arg)));
+    nextTypeInfo.Return = TypeTree(BaseType::Pointer).Only(-1);
+
+    // Each spawned thread needs its own tape, so force a heap-allocated one
+    // and accumulate into shadows atomically.
+    const AugmentedReturn &subdata = gutils->Logic.CreateAugmentedPrimal(
+        worker, DIFFE_TYPE::CONSTANT, argsInverted, gutils->TLI, TR.analysis,
+        /*return is used*/ true, nextTypeInfo, uncacheable_args,
+        /*forceAnonymousTape*/ true, /*AtomicAdd*/ true, /*PostOpt*/ false);
+
+    Function *grad = gutils->Logic.CreatePrimalAndGradient(
+        worker, DIFFE_TYPE::CONSTANT, argsInverted, gutils->TLI, TR.analysis,
+        /*returnValue*/ false, /*dretUsed*/ false,
+        DerivativeMode::ReverseModeGradient, i8p, nextTypeInfo,
+        uncacheable_args, &subdata, /*AtomicAdd*/ true);
+
+    auto trampFTy = FunctionType::get(i8p, {i8p}, false);
+
+    auto loadField = [&](IRBuilder<> &B, Value *closure, unsigned idx) {
+      return B.CreateLoad(B.CreateInBoundsGEP(
+          closure, {c0_64, ConstantInt::get(i32, idx)}));
+    };
+
+    Function *fwd =
+        Function::Create(trampFTy, GlobalValue::InternalLinkage,
+                         "augmentedthread_" + worker->getName(), &M);
+    {
+      IRBuilder<> B(BasicBlock::Create(C, "entry", fwd));
+      Value *raw = fwd->arg_begin();
+      Value *closure =
+          B.CreatePointerCast(raw, PointerType::getUnqual(closureTy));
+      SmallVector<Value *, 2> args = {loadField(B, closure, 1)};
+      if (argsInverted[0] == DIFFE_TYPE::DUP_ARG)
+        args.push_back(loadField(B, closure, 2));
+      for (unsigned i = 0; i < args.size(); ++i)
+        args[i] = B.CreatePointerCast(
+            args[i], subdata.fn->getFunctionType()->getParamType(i));
+      CallInst *res = B.CreateCall(subdata.fn, args);
+
+      auto tidx = subdata.returns.find(AugmentedStruct::Tape)->second;
+      Value *tape = tidx == -1
+                        ? (Value *)res
+                        : B.CreateExtractValue(res, {(unsigned)tidx});
+      B.CreateStore(tape, B.CreateInBoundsGEP(
+                              closure, {c0_64, ConstantInt::get(i32, 3)}));
+
+      auto found = subdata.returns.find(AugmentedStruct::Return);
+      if (found != subdata.returns.end()) {
+        Value *ret = found->second == -1
+                         ? (Value *)res
+                         : B.CreateExtractValue(res, {(unsigned)found->second});
+        B.CreateStore(
+            B.CreatePointerCast(ret, i8p),
+            B.CreateInBoundsGEP(closure, {c0_64, ConstantInt::get(i32, 4)}));
+      }
+      B.CreateRet(raw);
+    }
+
+    Function *rev =
+        Function::Create(trampFTy, GlobalValue::InternalLinkage,
+                         "diffethread_" + worker->getName(), &M);
+    {
+      IRBuilder<> B(BasicBlock::Create(C, "entry", rev));
+      Value *closure = B.CreatePointerCast(rev->arg_begin(),
+                                           PointerType::getUnqual(closureTy));
+      SmallVector<Value *, 3> args = {loadField(B, closure, 1)};
+      if (argsInverted[0] == DIFFE_TYPE::DUP_ARG)
+        args.push_back(loadField(B, closure, 2));
+      args.push_back(loadField(B, closure, 3));
+      for (unsigned i = 0; i < args.size(); ++i)
+        args[i] = B.CreatePointerCast(
+            args[i], grad->getFunctionType()->getParamType(i));
+      B.CreateCall(grad, args);
+      B.CreateRet(ConstantPointerNull::get(i8p));
+    }
+    return std::make_pair(fwd, rev);
+  }
+
+  /// Derivative of a call to a vector math library function (libmvec, SLEEF
+  /// or SVML). The partials come from VectorLibMRules and any function they
+  /// need is called from the same library, so both sweeps stay vectorized.
+  void handleVectorLibMCall(llvm::CallInst &call, Function *called,
+                            const VectorLibMFunction &VF, VectorLibMRule rule,
+                            IRBuilder<> &BuilderZ) {
+    if (gutils->knownRecomputeHeuristic.find(&call) !=
+        gutils->knownRecomputeHeuristic.end()) {
+      if (!gutils->knownRecomputeHeuristic[&call]) {
+        gutils->cacheForReverse(BuilderZ, gutils->getNewFromOriginal(&call),
+                                getIndex(&call, CacheType::Self));
+      }
+    }
+    if (Mode == DerivativeMode::ReverseModePrimal ||
+        gutils->isConstantInstruction(&call)) {
+      eraseIfUnused(call);
+      return;
+    }
+
+    if (Mode == DerivativeMode::ForwardMode) {
+      IRBuilder<> Builder2(&call);
+      getForwardBuilder(Builder2);
+      SmallVector<Value *, 2> args;
+      for (auto &arg : call.arg_operands())
+        args.push_back(gutils->getNewFromOriginal(arg));
+      VectorLibMDerivative D = {Builder2, args, VF, called};
+
+      Value *dif = nullptr;
+      for (unsigned i = 0; i < args.size(); ++i) {
+        if (gutils->isConstantValue(call.getArgOperand(i)))
+          continue;
+        Value *term = Builder2.CreateFMul(
+            diffe(call.getArgOperand(i), Builder2), rule(D, i));
+        dif = dif ? Builder2.CreateFAdd(dif, term) : term;
+      }
+      setDiffe(&call, dif ? dif : Constant::getNullValue(call.getType()),
+               Builder2);
+      eraseIfUnused(call);
+      return;
+    }
+
+    eraseIfUnused(call);
+    IRBuilder<> Builder2(call.getParent());
+    getReverseBuilder(Builder2);
+    SmallVector<Value *, 2> args;
+    for (auto &arg : call.arg_operands())
+      args.push_back(lookup(gutils->getNewFromOriginal(arg), Builder2));
+    VectorLibMDerivative D = {Builder2, args, VF, called};
+
+    Value *vdiff = diffe(&call, Builder2);
+    setDiffe(&call, Constant::getNullValue(call.getType()), Builder2);
+    for (unsigned i = 0; i < args.size(); ++i) {
+      if (gutils->isConstantValue(call.getArgOperand(i)))
+        continue;
+      addToDiffe(call.getArgOperand(i),
+                 Builder2.CreateFMul(vdiff, rule(D, i)), Builder2,
+                 call.getType()->getScalarType());
+    }
+  }
+
+  /// Whether the thread id slots a and b of the original function address
+  /// the same element: the same underlying object, indexed by the same value
+  /// or by recurrences with equal start and step. The latter matches a pool
+  /// of threads created in one loop and joined in another.
+  bool isSameThreadSlot(Value *a, Value *b) {
+    a = a->stripPointerCasts();
+    b = b->stripPointerCasts();
+    if (a == b)
+      return true;
+#if LLVM_VERSION_MAJOR >= 12
+    if (getUnderlyingObject(a, 100) != getUnderlyingObject(b, 100))
+      return false;
+#else
+    auto &DL = gutils->oldFunc->getParent()->getDataLayout();
+    if (GetUnderlyingObject(a, DL, 100) != GetUnderlyingObject(b, DL, 100))
+      return false;
+#endif
+    auto &SE = gutils->OrigSE;
+    if (!SE.isSCEVable(a->getType()) || !SE.isSCEVable(b->getType()))
+      return false;
+    const SCEV *SA = SE.getSCEV(a);
+    const SCEV *SB = SE.getSCEV(b);
+    if (SA == SB)
+      return true;
+    auto RA = dyn_cast<SCEVAddRecExpr>(SA);
+    auto RB = dyn_cast<SCEVAddRecExpr>(SB);
+    return RA && RB && RA->isAffine() && RB->isAffine() &&
+           RA->getStart() == RB->getStart() &&
+           RA->getStepRecurrence(SE) == RB->getStepRecurrence(SE);
+  }
+
+  /// Return the pthread_create in the original function which spawned the
+  /// thread that join waits for, that is the one which wrote the thread id
+  /// slot join loaded from, or null if there is no such visible call.
+  CallInst *findPthreadCreate(llvm::CallInst &join) {
+    auto LI = dyn_cast<LoadInst>(join.getArgOperand(0));
+    if (!LI)
+      return nullptr;
+    for (auto &BB : *gutils->oldFunc)
+      for (auto &I : BB) {
+        auto CI = dyn_cast<CallInst>(&I);
+        if (!CI)
+          continue;
+        auto F = CI->getCalledFunction();
+        if (F && F->getName() == "pthread_create" &&
+            isSameThreadSlot(CI->getArgOperand(0), LI->getPointerOperand()))
+          return CI;
+      }
+    return nullptr;
+  }
+
+  /// A thread whose worker or argument is inactive can not propagate any
+  /// derivative, so it is run exactly as in the primal.
+  bool isInactiveThread(llvm::CallInst &create) {
+    return gutils->isConstantInstruction(&create) ||
+           gutils->isConstantValue(create.getArgOperand(3));
+  }
+
+  /// Reverse-mode rule for pthread_create / pthread_join. The forward pass
+  /// spawns the augmented worker with a heap closure that carries its tape
+  /// and is handed back through pthread_join. The reverse of pthread_join
+  /// then spawns the adjoint worker, and the reverse of pthread_create joins
+  /// it, so adjoint workers run concurrently just as the primal ones did.
+  void handlePthread(llvm::CallInst &call, Function *called,
+                     StringRef funcName) {
+    assert(Mode != DerivativeMode::ForwardMode);
+    assert(called);
+
+    // A join is differentiated along with the create it pairs with, which
+    // carries the closure to it.
+    CallInst *create = &call;
+    if (funcName == "pthread_join") {
+      create = findPthreadCreate(call);
+      if (!create) {
+        EmitFailure("NoPthreadCreate", call.getDebugLoc(), &call,
+                    "could not find the pthread_create joined by ", call);
+        eraseIfUnused(call);
+        return;
+      }
+    }
+    if (isInactiveThread(*create)) {
+      eraseIfUnused(call);
+      return;
+    }
+    // A worker reached through a function pointer or only declared can not
+    // be differentiated. Its join is left alone, having been reported with
+    // the create.
+    Function *worker =
+        dyn_cast<Function>(create->getArgOperand(2)->stripPointerCasts());
+    if (worker == nullptr || worker->empty() ||
+        worker->getFunctionType()->getNumParams() != 1) {
+      if (create == &call)
+        EmitFailure("NoPthreadWorker", call.getDebugLoc(), &call,
+                    "could not find the definition of the worker spawned by ",
+                    call);
+      eraseIfUnused(call);
+      return;
+    }
+
+    Module &M = *gutils->newFunc->getParent();
+    LLVMContext &C = call.getContext();
+    auto i8p = Type::getInt8PtrTy(C);
+    auto i32 = Type::getInt32Ty(C);
+    auto i64 = Type::getInt64Ty(C);
+    auto c0_64 = ConstantInt::get(i64, 0);
+
+    CallInst *newcall = cast<CallInst>(gutils->getNewFromOriginal(&call));
+    IRBuilder<> BuilderZ(newcall);
+    BuilderZ.setFastMathFlags(getFast());
+
+    Type *threadTy =
+        funcName == "pthread_create"
+            ? cast<PointerType>(call.getArgOperand(0)->getType())
+                  ->getElementType()
+            : call.getArgOperand(0)->getType();
+    StructType *closureTy = getThreadClosureType(threadTy);
+    auto closurePtrTy = PointerType::getUnqual(closureTy);
+
+    Value *closure = nullptr;
+    if (Mode == DerivativeMode::ReverseModePrimal ||
+        Mode == DerivativeMode::ReverseModeCombined) {
+      if (funcName == "pthread_create") {
+        auto tramps = createThreadTrampolines(call, worker, closureTy);
+
+        closure = CallInst::CreateMalloc(
+            newcall, i64, closureTy,
+            ConstantInt::get(i64, M.getDataLayout().getTypeAllocSizeInBits(
+                                      closureTy) /
+                                      8),
+            nullptr, nullptr, "threadclosure");
+
+        auto storeField = [&](Value *val, unsigned idx) {
+          BuilderZ.CreateStore(
+              BuilderZ.CreatePointerCast(val, closureTy->getElementType(idx)),
+              BuilderZ.CreateInBoundsGEP(closure,
+                                         {c0_64, ConstantInt::get(i32, idx)}));
+        };
+        storeField(tramps.second, 0);
+        storeField(gutils->getNewFromOriginal(call.getArgOperand(3)), 1);
+        if (gutils->isConstantValue(call.getArgOperand(3)))
+          storeField(ConstantPointerNull::get(i8p), 2);
+        else
+          storeField(gutils->invertPointerM(call.getArgOperand(3), BuilderZ),
+                     2);
+        storeField(ConstantPointerNull::get(i8p), 3);
+        storeField(ConstantPointerNull::get(i8p), 4);
+
+        newcall->setArgOperand(
+            2, BuilderZ.CreatePointerCast(
+                   tramps.first, newcall->getArgOperand(2)->getType()));
+        newcall->setArgOperand(
+            3, BuilderZ.CreatePointerCast(
+                   closure, newcall->getArgOperand(3)->getType()));
+      } else {
+        // Receive the closure in place of the worker's return value, and
+        // forward the real return value if the caller asked for it.
+        auto slot = IRBuilder<>(gutils->inversionAllocs).CreateAlloca(i8p);
+        Value *retval = newcall->getArgOperand(1);
+        newcall->setArgOperand(
+            1, BuilderZ.CreatePointerCast(slot, retval->getType()));
+        BuilderZ.SetInsertPoint(newcall->getNextNode());
+        closure =
+            BuilderZ.CreatePointerCast(BuilderZ.CreateLoad(slot), closurePtrTy);
+        if (!isa<ConstantPointerNull>(retval)) {
+          // The caller may still pass a null pointer at runtime, in which
+          // case the return value is stored to the now unused slot instead.
+          Value *dst =
+              BuilderZ.CreatePointerCast(retval, PointerType::getUnqual(i8p));
+          dst = BuilderZ.CreateSelect(BuilderZ.CreateIsNull(dst), slot, dst);
+          BuilderZ.CreateStore(
+              BuilderZ.CreateLoad(BuilderZ.CreateInBoundsGEP(
+                  closure, {c0_64, ConstantInt::get(i32, 4)})),
+              dst);
+        }
+      }
+    } else {
+      closure = BuilderZ.CreatePHI(closurePtrTy, 1, "threadclosure");
+    }
+
+    closure = gutils->cacheForReverse(BuilderZ, closure,
+                                      getIndex(&call, CacheType::Tape));
+
+    // Threads are only spawned by the augmented forward pass.
+    if (Mode == DerivativeMode::ReverseModeGradient)
+      eraseIfUnused(call, /*erase*/ true, /*check*/ false);
+
+    if (Mode == DerivativeMode::ReverseModeGradient ||
+        Mode == DerivativeMode::ReverseModeCombined) {
+      IRBuilder<> Builder2(call.getParent());
+      getReverseBuilder(Builder2);
+      closure = lookup(closure, Builder2);
+      Value *revthread = Builder2.CreateInBoundsGEP(
+          closure, {c0_64, ConstantInt::get(i32, 5)});
+
+      // Reuse the declaration already in the module when there is one, so
+      // that the call type agrees with it.
+      auto callThreadFn = [&](StringRef name, FunctionType *FT,
+                              ArrayRef<Value *> args) {
+        if (auto F = M.getFunction(name))
+          FT = F->getFunctionType();
+        auto callee = M.getOrInsertFunction(name, FT);
+        SmallVector<Value *, 4> castargs;
+        for (unsigned i = 0; i < args.size(); ++i)
+          castargs.push_back(
+              Builder2.CreatePointerCast(args[i], FT->getParamType(i)));
+        auto fcall = Builder2.CreateCall(callee, castargs);
+        fcall->setDebugLoc(gutils->getNewFromOriginal(call.getDebugLoc()));
+      };
+
+      if (funcName == "pthread_join") {
+        Type *types[] = {PointerType::getUnqual(threadTy), i8p,
+                         closureTy->getElementType(0), i8p};
+        Value *args[] = {revthread, ConstantPointerNull::get(i8p),
+                         Builder2.CreateLoad(Builder2.CreateInBoundsGEP(
+                             closure, {c0_64, ConstantInt::get(i32, 0)})),
+                         Builder2.CreatePointerCast(closure, i8p)};
+        callThreadFn("pthread_create", FunctionType::get(i32, types, false),
+                     args);
+      } else {
+        Type *types[] = {threadTy, PointerType::getUnqual(i8p)};
+        Value *args[] = {Builder2.CreateLoad(revthread),
+                         ConstantPointerNull::get(PointerType::getUnqual(i8p))};
+        callThreadFn("pthread_join", FunctionType::get(i32, types, false),
+                     args);
+
+        auto ci = cast<CallInst>(
+            CallInst::CreateFree(Builder2.CreatePointerCast(closure, i8p),
+                                 Builder2.GetInsertBlock()));
+        ci->addAttribute(AttributeList::FirstArgIndex, Attribute::NonNull);
+        if (ci->getParent() == nullptr) {
+          Builder2.Insert(ci);
+        }
+      }
+    }
+  }
+
   void DifferentiableMemCopyFloats(CallInst &call, Value *origArg, Value *dsto,
                                    Value *srco, Value *len_arg,
                                    IRBuilder<> &Builder2) {
@@ -3057,7 +4538,7 @@ public:
 
         auto dmemcpy = getOrInsertDifferentialFloatMemcpy(
             *Builder2.GetInsertBlock()->getParent()->getParent(), secretpt,
-            /*dstalign*/ 1, /*srcalign*/ 1);
+            /*dstalign*/ 1, /*srcalign*/ 1, getMemcpyVectorBits());
         Builder2.CreateCall(dmemcpy, args);
       }
 
@@ -3539,6 +5020,13 @@ public:
 
   // Return
   void visitCallInst(llvm::CallInst &call) {
+    if (gutils->TaylorDegree &&
+        getTaylorIntrinsic(call) != Intrinsic::not_intrinsic) {
+      eraseIfUnused(call);
+      if (!gutils->isConstantInstruction(&call))
+        createTaylorCall(call, getTaylorIntrinsic(call));
+      return;
+    }
 
     IRBuilder<> BuilderZ(gutils->getNewFromOriginal(&call));
     BuilderZ.setFastMathFlags(getFast());
@@ -3748,6 +5236,46 @@ public:
         visitOMPCall(call);
         return;
       }
+      if ((funcName == "pthread_create" || funcName == "pthread_join") &&
+          Mode != DerivativeMode::ForwardMode) {
+        handlePthread(call, called, funcName);
+        return;
+      }
+      {
+        VectorLibMFunction VF;
+        if (parseVectorLibMFunction(funcName, VF)) {
+          auto found = VectorLibMRules.find(VF.Base);
+          if (found != VectorLibMRules.end() &&
+              orig->getNumArgOperands() == found->second.first &&
+              orig->getType()->isFPOrFPVectorTy() &&
+              llvm::all_of(orig->arg_operands(), [&](Value *arg) {
+                return arg->getType() == orig->getType();
+              })) {
+            handleVectorLibMCall(*orig, called, VF, found->second.second,
+                                 BuilderZ);
+            return;
+          }
+          // The scalar intrinsic of the base function does not apply to the
+          // vector signature, so a variant without a rule is unhandled.
+          if (gutils->knownRecomputeHeuristic.find(orig) !=
+              gutils->knownRecomputeHeuristic.end()) {
+            if (!gutils->knownRecomputeHeuristic[orig]) {
+              gutils->cacheForReverse(BuilderZ,
+                                      gutils->getNewFromOriginal(&call),
+                                      getIndex(orig, CacheType::Self));
+            }
+          }
+          if (Mode != DerivativeMode::ReverseModePrimal &&
+              !gutils->isConstantInstruction(orig)) {
+            EmitFailure("NoDerivative", orig->getDebugLoc(), orig,
+                        "cannot handle unknown vector math function ",
+                        funcName);
+          }
+          eraseIfUnused(*orig);
+          return;
+        }
+      }
+
       if (funcName == "asin" || funcName == "asinf" || funcName == "asinl") {
         if (gutils->knownRecomputeHeuristic.find(orig) !=
             gutils->knownRecomputeHeuristic.end()) {
@@ -4309,6 +5837,8 @@ public:
           auto CI = freeKnownAllocation(Builder2, tofree, *called, gutils->TLI);
           if (CI)
             CI->addAttribute(AttributeList::FirstArgIndex, Attribute::NonNull);
+          if (CI && EnzymeTapeProfile)
+            markTapeProfileCall(CI, "free", anti->getName(), nullptr);
         }
       }
 
@@ -4733,11 +6263,19 @@ public:
       } else {
         if (Mode == DerivativeMode::ReverseModePrimal ||
             Mode == DerivativeMode::ReverseModeCombined) {
+          // Only a combined derivative reverses its calls in order and on
+          // its own thread, which callees then inherit.
+          bool lifoTape = Mode == DerivativeMode::ReverseModeCombined ||
+                          (augmentedReturn && augmentedReturn->lifoTape);
           subdata = &gutils->Logic.CreateAugmentedPrimal(
               cast<Function>(called), subretType, argsInverted, gutils->TLI,
               TR.analysis, /*return is used*/ subretused, nextTypeInfo,
               uncacheable_args, false, gutils->AtomicAdd,
-              /*PostOpt*/ false);
+              /*PostOpt*/ false, /*omp*/ false, lifoTape);
+          // A finished recursive callee is only reachable here from outside
+          // of its recursion, so its outermost tape can be held by value.
+          if (subdata->byValueTape)
+            subdata = subdata->byValueTape;
           if (Mode == DerivativeMode::ReverseModePrimal) {
             assert(augmentedReturn);
             auto subaugmentations =
@@ -4982,15 +6520,30 @@ public:
       if (fnandtapetype && fnandtapetype->tapeType &&
           Mode != DerivativeMode::ReverseModePrimal) {
         assert(tape);
+        if (EnzymeTapeBuffer && EnzymeRelocatableTape &&
+            !fnandtapetype->stackTape)
+          tape = getTapeBufferPointer(BuilderZ, tape);
         auto tapep = BuilderZ.CreatePointerCast(
             tape, PointerType::getUnqual(fnandtapetype->tapeType));
         auto truetape = BuilderZ.CreateLoad(tapep, "tapeld");
         truetape->setMetadata("enzyme_mustcache",
                               MDNode::get(truetape->getContext(), {}));
 
-        CallInst *ci = cast<CallInst>(
-            CallInst::CreateFree(tape, &*BuilderZ.GetInsertPoint()));
-        ci->addAttribute(AttributeList::FirstArgIndex, Attribute::NonNull);
+        // A tape on the tape stack is instead popped after the reverse pass.
+        if (!fnandtapetype->stackTape) {
+          CallInst *ci =
+              EnzymeTapeBuffer
+                  ? BuilderZ.CreateCall(
+                        getOrInsertTapeBufferFree(
+                            *gutils->newFunc->getParent()),
+                        BuilderZ.CreatePointerCast(
+                            tape, Type::getInt8PtrTy(tape->getContext())))
+                  : cast<CallInst>(CallInst::CreateFree(
+                        tape, &*BuilderZ.GetInsertPoint()));
+          ci->addAttribute(AttributeList::FirstArgIndex, Attribute::NonNull);
+          if (EnzymeTapeProfile)
+            markTapeProfileCall(ci, "free", "tapemem", nullptr);
+        }
         tape = truetape;
       }
     } else {
@@ -5129,6 +6682,19 @@ public:
     CallInst *diffes = Builder2.CreateCall(FT, newcalled, args);
     diffes->setCallingConv(orig->getCallingConv());
     diffes->setDebugLoc(gutils->getNewFromOriginal(orig->getDebugLoc()));
+
+    // Tape stack records are popped in the reverse order of their pushes,
+    // which the reverse pass guarantees by releasing the callee's record
+    // once its derivative has been computed.
+    if (tape && subdata && subdata->stackTape) {
+      auto size = ConstantInt::get(
+          Type::getInt64Ty(diffes->getContext()),
+          gutils->newFunc->getParent()->getDataLayout().getTypeAllocSizeInBits(
+              subdata->tapeType) /
+              8);
+      Builder2.CreateCall(
+          getOrInsertTapeStackPop(*gutils->newFunc->getParent()), {size});
+    }
 #if LLVM_VERSION_MAJOR >= 9
     for (auto pair : gradByVal) {
       diffes->addParamAttr(pair.first, Attribute::getWithByValType(
@@ -29,6 +29,12 @@
 #include "GradientUtils.h"
 #include "LibraryFuncs.h"
 #include "SCEV/TargetLibraryInfo.h"
+#include "SparsityAnalysis.h"
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
 
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/CallGraph.h"
@@ -45,10 +51,103 @@ TargetLibraryInfo eunwrap(LLVMTargetLibraryInfoRef P) {
   return TargetLibraryInfo(*reinterpret_cast<TargetLibraryInfoImpl *>(P));
 }
 
-EnzymeLogic &eunwrap(EnzymeLogicRef LR) { return *(EnzymeLogic *)LR; }
+/// An LLVMContext may only be used by one thread at a time. Every request
+/// through this API holds the lock of the context it operates on, such that
+/// requests on distinct contexts proceed in parallel and a request for a
+/// derivative already being synthesized waits for, then reuses, that result.
+/// The lock is recursive as custom handlers may issue nested requests.
+///
+/// A context lock is always taken before the mutex of any shard table below,
+/// never while holding one. Locks are shared with their users, such that
+/// removing a context never frees a lock still held or waited on.
+static std::mutex ContextLocksMutex;
+static std::map<LLVMContext *, std::shared_ptr<std::recursive_mutex>>
+    ContextLocks;
+
+std::shared_ptr<std::recursive_mutex> getContextLock(LLVMContext &ctx) {
+  std::lock_guard<std::mutex> guard(ContextLocksMutex);
+  auto &lock = ContextLocks[&ctx];
+  if (!lock)
+    lock = std::make_shared<std::recursive_mutex>();
+  return lock;
+}
+
+/// The lock of a context which has been used through this API, or null if
+/// it has not been or has since been removed.
+static std::shared_ptr<std::recursive_mutex>
+findContextLock(LLVMContext *ctx) {
+  std::lock_guard<std::mutex> guard(ContextLocksMutex);
+  auto found = ContextLocks.find(ctx);
+  if (found == ContextLocks.end())
+    return nullptr;
+  return found->second;
+}
+
+/// The state behind an EnzymeLogicRef, with a separate EnzymeLogic and
+/// thus separate caches for every LLVMContext it is used with.
+struct ShardedEnzymeLogic {
+  std::mutex mutex;
+  std::map<LLVMContext *, std::unique_ptr<EnzymeLogic>> shards;
+};
+
+/// The state behind an EnzymeTypeAnalysisRef, with a separate TypeAnalysis
+/// for every LLVMContext it is used with, sharing the library info and
+/// custom rules.
+struct ShardedTypeAnalysis {
+  std::unique_ptr<TargetLibraryInfoImpl> TLII;
+  std::unique_ptr<TargetLibraryInfo> TLI;
+  decltype(TypeAnalysis::CustomRules) CustomRules;
+  std::mutex mutex;
+  std::map<LLVMContext *, std::unique_ptr<TypeAnalysis>> shards;
+};
+
+/// Every live EnzymeLogicRef and EnzymeTypeAnalysisRef, such that the shards
+/// of a context can be dropped from all of them once it is destroyed.
+static std::mutex LiveShardsMutex;
+static std::set<ShardedEnzymeLogic *> LiveEnzymeLogics;
+static std::set<ShardedTypeAnalysis *> LiveTypeAnalyses;
+
+/// Clear the shard of every context in a table, taking each context lock
+/// before the table's mutex as requests do.
+template <typename T>
+static void clearShards(std::mutex &mutex,
+                        std::map<LLVMContext *, std::unique_ptr<T>> &shards) {
+  std::vector<LLVMContext *> contexts;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    for (auto &pair : shards)
+      contexts.push_back(pair.first);
+  }
+  for (auto ctx : contexts) {
+    auto ctxLock = findContextLock(ctx);
+    if (!ctxLock)
+      continue;
+    std::lock_guard<std::recursive_mutex> lock(*ctxLock);
+    std::lock_guard<std::mutex> guard(mutex);
+    auto found = shards.find(ctx);
+    if (found != shards.end())
+      found->second->clear();
+  }
+}
+
+EnzymeLogic &eunwrap(EnzymeLogicRef LR, LLVMContext &ctx) {
+  auto &SL = *(ShardedEnzymeLogic *)LR;
+  std::lock_guard<std::mutex> guard(SL.mutex);
+  auto &shard = SL.shards[&ctx];
+  if (!shard)
+    shard.reset(new EnzymeLogic());
+  return *shard;
+}
 
-TypeAnalysis &eunwrap(EnzymeTypeAnalysisRef TAR) {
-  return *(TypeAnalysis *)TAR;
+TypeAnalysis &eunwrap(EnzymeTypeAnalysisRef TAR, LLVMContext &ctx) {
+  auto &STA = *(ShardedTypeAnalysis *)TAR;
+  std::lock_guard<std::mutex> guard(STA.mutex);
+  auto &shard = STA.shards[&ctx];
+  if (!shard) {
+    shard.reset(new TypeAnalysis(*STA.TLI));
+    shard->CustomRules = STA.CustomRules;
+  }
+  return *shard;
 }
 AugmentedReturn *eunwrap(EnzymeAugmentedReturnPtr ARP) {
   return (AugmentedReturn *)ARP;
@@ -118,6 +217,18 @@ CConcreteType ewrap(const ConcreteType &CT) {
   llvm_unreachable("Illegal conversion of concretetype");
 }
 
+IntList ewrap(const std::set<int64_t> &values) {
+  IntList IL;
+  IL.size = values.size();
+  IL.data = (int64_t *)malloc(IL.size * sizeof(*IL.data));
+  size_t i = 0;
+  for (auto v : values) {
+    IL.data[i] = v;
+    i++;
+  }
+  return IL;
+}
+
 IntList ewrap(const std::vector<int> &offsets) {
   IntList IL;
   IL.size = offsets.size();
@@ -169,19 +280,32 @@ int64_t EnzymeGetCLInteger(void *ptr) {
 }
 
 EnzymeLogicRef CreateEnzymeLogic() {
-  return (EnzymeLogicRef)(new EnzymeLogic());
+  auto SL = new ShardedEnzymeLogic();
+  std::lock_guard<std::mutex> guard(LiveShardsMutex);
+  LiveEnzymeLogics.insert(SL);
+  return (EnzymeLogicRef)SL;
 }
 
-void ClearEnzymeLogic(EnzymeLogicRef Ref) { eunwrap(Ref).clear(); }
+void ClearEnzymeLogic(EnzymeLogicRef Ref) {
+  auto &SL = *(ShardedEnzymeLogic *)Ref;
+  clearShards(SL.mutex, SL.shards);
+}
 
-void FreeEnzymeLogic(EnzymeLogicRef Ref) { delete (EnzymeLogic *)Ref; }
+void FreeEnzymeLogic(EnzymeLogicRef Ref) {
+  {
+    std::lock_guard<std::mutex> guard(LiveShardsMutex);
+    LiveEnzymeLogics.erase((ShardedEnzymeLogic *)Ref);
+  }
+  delete (ShardedEnzymeLogic *)Ref;
+}
 
 EnzymeTypeAnalysisRef CreateTypeAnalysis(char *TripleStr,
                                          char **customRuleNames,
                                          CustomRuleType *customRules,
                                          size_t numRules) {
-  TypeAnalysis *TA = new TypeAnalysis(*(
-      new TargetLibraryInfo(*(new TargetLibraryInfoImpl(Triple(TripleStr))))));
+  ShardedTypeAnalysis *TA = new ShardedTypeAnalysis();
+  TA->TLII.reset(new TargetLibraryInfoImpl(Triple(TripleStr)));
+  TA->TLI.reset(new TargetLibraryInfo(*TA->TLII));
   for (size_t i = 0; i < numRules; i++) {
     CustomRuleType rule = customRules[i];
     TA->CustomRules[customRuleNames[i]] =
@@ -212,16 +336,41 @@ EnzymeTypeAnalysisRef CreateTypeAnalysis(char *TripleStr,
       return result;
     };
   }
+  std::lock_guard<std::mutex> guard(LiveShardsMutex);
+  LiveTypeAnalyses.insert(TA);
   return (EnzymeTypeAnalysisRef)TA;
 }
 
-void ClearTypeAnalysis(EnzymeTypeAnalysisRef TAR) { eunwrap(TAR).clear(); }
+void ClearTypeAnalysis(EnzymeTypeAnalysisRef TAR) {
+  auto &STA = *(ShardedTypeAnalysis *)TAR;
+  clearShards(STA.mutex, STA.shards);
+}
 
 void FreeTypeAnalysis(EnzymeTypeAnalysisRef TAR) {
-  TypeAnalysis *TA = (TypeAnalysis *)TAR;
-  delete &TA->TLI.Impl;
-  delete &TA->TLI;
-  delete TA;
+  {
+    std::lock_guard<std::mutex> guard(LiveShardsMutex);
+    LiveTypeAnalyses.erase((ShardedTypeAnalysis *)TAR);
+  }
+  delete (ShardedTypeAnalysis *)TAR;
+}
+
+void EnzymeRemoveContext(LLVMContextRef C) {
+  LLVMContext *ctx = unwrap(C);
+  if (auto ctxLock = findContextLock(ctx)) {
+    // Wait for any request still running on the context
+    std::lock_guard<std::recursive_mutex> lock(*ctxLock);
+    std::lock_guard<std::mutex> guard(LiveShardsMutex);
+    for (auto SL : LiveEnzymeLogics) {
+      std::lock_guard<std::mutex> shardGuard(SL->mutex);
+      SL->shards.erase(ctx);
+    }
+    for (auto STA : LiveTypeAnalyses) {
+      std::lock_guard<std::mutex> shardGuard(STA->mutex);
+      STA->shards.erase(ctx);
+    }
+  }
+  std::lock_guard<std::mutex> guard(ContextLocksMutex);
+  ContextLocks.erase(ctx);
 }
 
 void EnzymeRegisterAllocationHandler(char *Name, CustomShadowAlloc AHandle,
@@ -340,9 +489,13 @@ LLVMValueRef EnzymeCreatePrimalAndGradient(
     uncacheable_args[&arg] = _uncacheable_args[argnum];
     argnum++;
   }
-  return wrap(eunwrap(Logic).CreatePrimalAndGradient(
+  LLVMContext &ctx = unwrap(todiff)->getContext();
+  auto ctxLock = getContextLock(ctx);
+  std::lock_guard<std::recursive_mutex> lock(*ctxLock);
+  TypeAnalysis &TAR = eunwrap(TA, ctx);
+  return wrap(eunwrap(Logic, ctx).CreatePrimalAndGradient(
       cast<Function>(unwrap(todiff)), (DIFFE_TYPE)retType, nconstant_args,
-      eunwrap(TA).TLI, eunwrap(TA), returnValue, dretUsed, (DerivativeMode)mode,
+      TAR.TLI, TAR, returnValue, dretUsed, (DerivativeMode)mode,
       unwrap(additionalArg), eunwrap(typeInfo, cast<Function>(unwrap(todiff))),
       uncacheable_args, eunwrap(augmented), AtomicAdd, PostOpt));
 }
@@ -363,9 +516,13 @@ EnzymeAugmentedReturnPtr EnzymeCreateAugmentedPrimal(
     uncacheable_args[&arg] = _uncacheable_args[argnum];
     argnum++;
   }
-  return ewrap(eunwrap(Logic).CreateAugmentedPrimal(
+  LLVMContext &ctx = unwrap(todiff)->getContext();
+  auto ctxLock = getContextLock(ctx);
+  std::lock_guard<std::recursive_mutex> lock(*ctxLock);
+  TypeAnalysis &TAR = eunwrap(TA, ctx);
+  return ewrap(eunwrap(Logic, ctx).CreateAugmentedPrimal(
       cast<Function>(unwrap(todiff)), (DIFFE_TYPE)retType, nconstant_args,
-      eunwrap(TA).TLI, eunwrap(TA), returnUsed,
+      TAR.TLI, TAR, returnUsed,
       eunwrap(typeInfo, cast<Function>(unwrap(todiff))), uncacheable_args,
       forceAnonymousTape, AtomicAdd, PostOpt));
 }
@@ -376,6 +533,58 @@ EnzymeExtractFunctionFromAugmentation(EnzymeAugmentedReturnPtr ret) {
   return wrap(AR->fn);
 }
 
+CSparsityPattern EnzymeComputeSparsityPattern(EnzymeLogicRef Logic,
+                                              LLVMValueRef fn,
+                                              EnzymeTypeAnalysisRef TA,
+                                              CFnTypeInfo typeInfo) {
+  auto F = cast<Function>(unwrap(fn));
+  LLVMContext &ctx = F->getContext();
+  auto ctxLock = getContextLock(ctx);
+  std::lock_guard<std::recursive_mutex> lock(*ctxLock);
+  SparsityPattern P;
+  if (hasSparsitySignature(F))
+    P = computeSparsityPattern(eunwrap(Logic, ctx).PPC, eunwrap(TA, ctx),
+                               eunwrap(typeInfo, F));
+  else
+    P.Dense = true;
+  CSparsityPattern CP;
+  CP.Dense = P.Dense;
+  CP.Offsets = ewrap(P.Offsets);
+  CP.Columns = ewrap(P.Columns);
+  CP.DenseRows = ewrap(P.DenseRows);
+  std::vector<int64_t> rows, cols;
+  for (auto &pair : P.Fixed)
+    for (auto c : pair.second) {
+      rows.push_back(pair.first);
+      cols.push_back(c);
+    }
+  CP.FixedRows.size = CP.FixedColumns.size = rows.size();
+  CP.FixedRows.data = (int64_t *)malloc(rows.size() * sizeof(int64_t));
+  CP.FixedColumns.data = (int64_t *)malloc(cols.size() * sizeof(int64_t));
+  std::copy(rows.begin(), rows.end(), CP.FixedRows.data);
+  std::copy(cols.begin(), cols.end(), CP.FixedColumns.data);
+  return CP;
+}
+
+void EnzymeFreeSparsityPattern(CSparsityPattern CP) {
+  free(CP.Offsets.data);
+  free(CP.Columns.data);
+  free(CP.DenseRows.data);
+  free(CP.FixedRows.data);
+  free(CP.FixedColumns.data);
+}
+
+LLVMValueRef EnzymeCreateSparsityPattern(EnzymeLogicRef Logic, LLVMValueRef fn,
+                                         EnzymeTypeAnalysisRef TA,
+                                         CFnTypeInfo typeInfo) {
+  auto F = cast<Function>(unwrap(fn));
+  LLVMContext &ctx = F->getContext();
+  auto ctxLock = getContextLock(ctx);
+  std::lock_guard<std::recursive_mutex> lock(*ctxLock);
+  return wrap(eunwrap(Logic, ctx).CreateSparsityPattern(F, eunwrap(TA, ctx),
+                                                        eunwrap(typeInfo, F)));
+}
+
 LLVMTypeRef
 EnzymeExtractTapeTypeFromAugmentation(EnzymeAugmentedReturnPtr ret) {
   auto AR = (AugmentedReturn *)ret;
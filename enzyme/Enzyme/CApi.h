@@ -142,10 +142,19 @@ EnzymeTypeAnalysisRef CreateTypeAnalysis(char *Triple, char **customRuleNames,
 void ClearTypeAnalysis(EnzymeTypeAnalysisRef);
 void FreeTypeAnalysis(EnzymeTypeAnalysisRef);
 
+/// EnzymeLogicRef and EnzymeTypeAnalysisRef may be shared between threads.
+/// Requests on functions of distinct LLVMContexts run concurrently, while
+/// requests within one LLVMContext are serialized. Handlers must be
+/// registered before any concurrent request is made.
 EnzymeLogicRef CreateEnzymeLogic();
 void ClearEnzymeLogic(EnzymeLogicRef);
 void FreeEnzymeLogic(EnzymeLogicRef);
 
+/// Drop everything cached for an LLVMContext from every EnzymeLogicRef and
+/// EnzymeTypeAnalysisRef. Must be called before disposing of a context used
+/// through this API, as a later context may reuse its address.
+void EnzymeRemoveContext(LLVMContextRef);
+
 void EnzymeExtractReturnInfo(EnzymeAugmentedReturnPtr ret, int64_t *data,
                              uint8_t *existed, size_t len);
 
@@ -153,6 +162,36 @@ LLVMValueRef
 EnzymeExtractFunctionFromAugmentation(EnzymeAugmentedReturnPtr ret);
 LLVMTypeRef EnzymeExtractTapeTypeFromAugmentation(EnzymeAugmentedReturnPtr ret);
 
+struct CSparsityPattern {
+  /// Whether every output may depend on every input
+  uint8_t Dense;
+
+  /// Output i may depend on input i + c for c in Offsets
+  struct IntList Offsets;
+
+  /// Inputs every output may depend on
+  struct IntList Columns;
+
+  /// Outputs which may depend on every input
+  struct IntList DenseRows;
+
+  /// Further (output, input) dependencies, of the same size
+  struct IntList FixedRows;
+  struct IntList FixedColumns;
+};
+
+/// A function whose first two arguments are not the input and output arrays
+/// of the same pointer type is reported with a Dense pattern, and
+/// EnzymeCreateSparsityPattern returns null for it
+struct CSparsityPattern
+EnzymeComputeSparsityPattern(EnzymeLogicRef, LLVMValueRef fn,
+                             EnzymeTypeAnalysisRef TA,
+                             struct CFnTypeInfo typeInfo);
+void EnzymeFreeSparsityPattern(struct CSparsityPattern pattern);
+LLVMValueRef EnzymeCreateSparsityPattern(EnzymeLogicRef, LLVMValueRef fn,
+                                         EnzymeTypeAnalysisRef TA,
+                                         struct CFnTypeInfo typeInfo);
+
 typedef LLVMValueRef (*CustomShadowAlloc)(LLVMBuilderRef, LLVMValueRef,
                                           size_t /*numArgs*/, LLVMValueRef *);
 typedef LLVMValueRef (*CustomShadowFree)(LLVMBuilderRef, LLVMValueRef,
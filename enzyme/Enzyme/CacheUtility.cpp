@@ -26,6 +26,9 @@
 
 #include "CacheUtility.h"
 #include "FunctionUtils.h"
+#include "Utils.h"
+
+#include "llvm/Transforms/Utils/LoopUtils.h"
 
 using namespace llvm;
 
@@ -43,6 +46,54 @@ llvm::cl::opt<bool> EfficientMaxCache(
     "enzyme-max-cache", cl::init(false), cl::Hidden,
     cl::desc(
         "Avoid reallocs when possible by potentially overallocating cache"));
+
+llvm::cl::opt<bool> EnzymeProfileGuidedCache(
+    "enzyme-profile-guided-cache", cl::init(false), cl::Hidden,
+    cl::desc("Use profile data to decide which values to cache and to presize "
+             "the caches of dynamic loops"));
+
+llvm::cl::opt<bool> EnzymeTapeBuffer(
+    "enzyme-tape-buffer", cl::init(false), cl::Hidden,
+    cl::desc("Allocate tapes and statically sized caches from a caller "
+             "provided buffer"));
+
+llvm::cl::opt<bool> EnzymeRelocatableTape(
+    "enzyme-relocatable-tape", cl::init(false), cl::Hidden,
+    cl::desc("Store pointers to caches within the tape buffer as offsets "
+             "from its start, such that the buffer may be moved"));
+
+llvm::cl::opt<unsigned> EnzymeMappedCacheThreshold(
+    "enzyme-mapped-cache-threshold", cl::init(0), cl::Hidden,
+    cl::desc("Size in MiB from which statically sized caches are kept in "
+             "memory mapped temporary files rather than on the heap, or 0 "
+             "to disable"));
+
+llvm::cl::opt<bool> EnzymeNonTemporalCache(
+    "enzyme-nontemporal-cache", cl::init(false), cl::Hidden,
+    cl::desc("Mark stores into loop caches as nontemporal, as they are not "
+             "read again until the reverse pass"));
+
+llvm::cl::opt<unsigned> EnzymeNonTemporalCacheThreshold(
+    "enzyme-nontemporal-cache-threshold", cl::init(1 << 20), cl::Hidden,
+    cl::desc("Size in bytes of a loop cache from which stores into it are "
+             "nontemporal, as smaller caches are likely still cached when "
+             "the reverse pass reads them"));
+
+llvm::cl::opt<unsigned> EnzymeCachePrefetchDistance(
+    "enzyme-cache-prefetch-distance", cl::init(0), cl::Hidden,
+    cl::desc("Distance in bytes ahead of a load from a loop cache in the "
+             "reverse pass, which walks the cache backwards, at which to "
+             "prefetch, or 0 to disable"));
+
+llvm::cl::opt<unsigned> EnzymeCombineCaches(
+    "enzyme-combine-caches", cl::init(0), cl::Hidden,
+    cl::desc("Allocate the caches of a loop together once it has at least "
+             "this many of them, or 0 to disable"));
+
+llvm::cl::opt<bool> EnzymeTapeProfile(
+    "enzyme-tape-profile", cl::init(false), cl::Hidden,
+    cl::desc("Report every allocation, reallocation and free of tape memory "
+             "to the tape profiling runtime library"));
 }
 
 CacheUtility::~CacheUtility() {}
@@ -694,6 +745,37 @@ AllocaInst *CacheUtility::createCacheForScope(LimitContext ctx, Type *T,
     }
   }
 
+  // Only stores into caches too large to remain in the cache hierarchy until
+  // the reverse pass are nontemporal. The number of iterations of loops
+  // whose trip count is only known at runtime is estimated from their
+  // profile, and such caches are otherwise left temporal.
+  if (EnzymeNonTemporalCache && sublimits.size() != 0) {
+    uint64_t bytes =
+        newFunc->getParent()->getDataLayout().getTypeAllocSizeInBits(T) / 8;
+    bool known = true;
+    for (const auto &sublimit : sublimits) {
+      if (auto CI = dyn_cast<ConstantInt>(sublimit.first)) {
+        bytes = SaturatingMultiply(bytes, CI->getZExtValue());
+        continue;
+      }
+      for (const auto &contained : sublimit.second) {
+        Loop *L = LI.getLoopFor(contained.first.header);
+        Optional<unsigned> trips;
+        if (L)
+          trips = getLoopEstimatedTripCount(L);
+        if (!trips) {
+          known = false;
+          break;
+        }
+        bytes = SaturatingMultiply(bytes, (uint64_t)*trips);
+      }
+      if (!known)
+        break;
+    }
+    if (known && bytes >= EnzymeNonTemporalCacheThreshold)
+      NonTemporalCaches.insert(alloc);
+  }
+
   Type *BPTy = Type::getInt8PtrTy(T->getContext());
   auto realloc = newFunc->getParent()->getOrInsertFunction(
       "realloc", BPTy, BPTy, Type::getInt64Ty(T->getContext()));
@@ -740,9 +822,31 @@ AllocaInst *CacheUtility::createCacheForScope(LimitContext ctx, Type *T,
       StoreInst *storealloc = nullptr;
       // Statically allocate memory for all iterations if possible
       if (sublimits[i].second.back().first.maxLimit) {
-        auto firstallocation = CallInst::CreateMalloc(
-            &allocationBuilder.GetInsertBlock()->back(), size->getType(),
-            myType, byteSizeOfType, size, nullptr, name + "_malloccache");
+        Instruction *firstallocation;
+        if (EnzymeTapeBuffer) {
+          auto bytes = allocationBuilder.CreateMul(size, byteSizeOfType, "",
+                                                   /*NUW*/ true, /*NSW*/ true);
+          firstallocation = cast<Instruction>(
+              allocationBuilder.CreatePointerCast(
+                  allocationBuilder.CreateCall(
+                      getOrInsertTapeBufferAlloc(*newFunc->getParent()),
+                      {bytes}, name + "_malloccache"),
+                  PointerType::getUnqual(myType)));
+        } else if (EnzymeMappedCacheThreshold) {
+          auto bytes = allocationBuilder.CreateMul(size, byteSizeOfType, "",
+                                                   /*NUW*/ true, /*NSW*/ true);
+          auto threshold = ConstantInt::get(
+              bytes->getType(), (uint64_t)EnzymeMappedCacheThreshold << 20);
+          firstallocation = cast<Instruction>(
+              allocationBuilder.CreatePointerCast(
+                  allocationBuilder.CreateCall(
+                      getOrInsertMappedCacheAlloc(*newFunc->getParent()),
+                      {bytes, threshold}, name + "_malloccache"),
+                  PointerType::getUnqual(myType)));
+        } else
+          firstallocation = CallInst::CreateMalloc(
+              &allocationBuilder.GetInsertBlock()->back(), size->getType(),
+              myType, byteSizeOfType, size, nullptr, name + "_malloccache");
         CallInst *malloccall = dyn_cast<CallInst>(firstallocation);
         if (malloccall == nullptr) {
           malloccall =
@@ -774,7 +878,22 @@ AllocaInst *CacheUtility::createCacheForScope(LimitContext ctx, Type *T,
         malloccall->addAttribute(AttributeList::ReturnIndex,
                                  Attribute::NonNull);
 
-        storealloc = allocationBuilder.CreateStore(firstallocation, storeInto);
+        if (EnzymeTapeProfile)
+          markTapeProfileCall(malloccall, "alloc", alloc->getName(),
+                              containedloops.back().first.header);
+
+        if (EnzymeCombineCaches && sublimits.size() == 1 &&
+            !EnzymeTapeBuffer && !EnzymeMappedCacheThreshold)
+          combinableAllocs[std::make_pair(allocationBuilder.GetInsertBlock(),
+                                          size)]
+              .emplace_back(alloc, malloccall,
+                            byteSizeOfType->getZExtValue());
+
+        Value *toStore = firstallocation;
+        if (EnzymeRelocatableTape && storeInto != alloc)
+          toStore = relocateCachePointer(allocationBuilder, firstallocation,
+                                         /*toOffset*/ true, alloc);
+        storealloc = allocationBuilder.CreateStore(toStore, storeInto);
 
         scopeAllocs[alloc].push_back(malloccall);
 
@@ -792,39 +911,83 @@ AllocaInst *CacheUtility::createCacheForScope(LimitContext ctx, Type *T,
       } else {
         // Reallocate memory dynamically as a fallback
         // TODO change this to a power-of-two allocation strategy
-        auto zerostore = allocationBuilder.CreateStore(
-            ConstantPointerNull::get(PointerType::getUnqual(myType)),
-            storeInto);
+        Value *null = ConstantPointerNull::get(PointerType::getUnqual(myType));
+        if (EnzymeRelocatableTape && storeInto != alloc)
+          null = relocateCachePointer(allocationBuilder, null,
+                                      /*toOffset*/ true, alloc);
+        auto zerostore = allocationBuilder.CreateStore(null, storeInto);
         scopeInstructions[alloc].push_back(zerostore);
 
         IRBuilder<> build(containedloops.back().first.incvar->getNextNode());
         Value *allocation = build.CreateLoad(storeInto);
-        Value *realloc_size = nullptr;
-        if (isa<ConstantInt>(sublimits[i].first) &&
-            cast<ConstantInt>(sublimits[i].first)->isOne()) {
-          realloc_size = containedloops.back().first.incvar;
-        } else {
-          realloc_size = build.CreateMul(containedloops.back().first.incvar,
-                                         sublimits[i].first, "", /*NUW*/ true,
-                                         /*NSW*/ true);
-        }
-
-        Value *idxs[2] = {
-            build.CreatePointerCast(allocation, BPTy),
-            build.CreateMul(
-                ConstantInt::get(size->getType(),
-                                 newFunc->getParent()
-                                         ->getDataLayout()
-                                         .getTypeAllocSizeInBits(myType) /
-                                     8),
-                realloc_size, "", /*NUW*/ true, /*NSW*/ true)};
+        if (EnzymeRelocatableTape && storeInto != alloc)
+          allocation =
+              relocateCachePointer(build, allocation, /*toOffset*/ false);
+        Value *realloc_count = containedloops.back().first.incvar;
+        Value *prev_count = nullptr;
+        // Reserve the profiled number of iterations up front and double the
+        // capacity past them, such that the cache is only reallocated when
+        // its capacity changes rather than on every iteration.
+        if (EnzymeProfileGuidedCache)
+          if (Loop *L = LI.getLoopFor(containedloops.back().first.header))
+            if (auto trips = getLoopEstimatedTripCount(L)) {
+              auto T = realloc_count->getType();
+              auto reserved = ConstantInt::get(T, *trips);
+              auto capacity = [&](Value *count) {
+                return build.CreateSelect(
+                    build.CreateICmpULE(count, reserved), reserved,
+                    nextPowerOfTwo(build, count));
+              };
+              prev_count = capacity(
+                  build.CreateSub(realloc_count, ConstantInt::get(T, 1)));
+              realloc_count = capacity(realloc_count);
+            }
+        auto bytesFor = [&](Value *count) -> Value * {
+          Value *realloc_size = count;
+          if (!isa<ConstantInt>(sublimits[i].first) ||
+              !cast<ConstantInt>(sublimits[i].first)->isOne())
+            realloc_size =
+                build.CreateMul(count, sublimits[i].first, "",
+                                /*NUW*/ true, /*NSW*/ true);
+          return build.CreateMul(
+              ConstantInt::get(size->getType(),
+                               newFunc->getParent()
+                                       ->getDataLayout()
+                                       .getTypeAllocSizeInBits(myType) /
+                                   8),
+              realloc_size, "", /*NUW*/ true, /*NSW*/ true);
+        };
 
         Value *realloccall = nullptr;
-        allocation = build.CreatePointerCast(
+        if (prev_count) {
+          Value *args[3] = {build.CreatePointerCast(allocation, BPTy),
+                            bytesFor(realloc_count), bytesFor(prev_count)};
+          realloccall = build.CreateCall(
+              getOrInsertCacheGrow(*newFunc->getParent(), EnzymeTapeBuffer),
+              args, name + "_realloccache");
+        } else {
+          Value *idxs[2] = {build.CreatePointerCast(allocation, BPTy),
+                            bytesFor(realloc_count)};
+          // Caches reallocated on the heap are tracked such that a tape
+          // buffer holding pointers to them is not serialized.
+          if (EnzymeTapeBuffer)
+            realloccall = build.CreateCall(
+                getOrInsertTapeBufferRealloc(*newFunc->getParent()), idxs,
+                name + "_realloccache");
+          else
             realloccall =
-                build.CreateCall(realloc, idxs, name + "_realloccache"),
-            allocation->getType(), name + "_realloccast");
+                build.CreateCall(realloc, idxs, name + "_realloccache");
+        }
+        allocation = build.CreatePointerCast(realloccall, allocation->getType(),
+                                             name + "_realloccast");
         scopeAllocs[alloc].push_back(cast<CallInst>(realloccall));
+        if (EnzymeTapeProfile)
+          markTapeProfileCall(cast<CallInst>(realloccall), "realloc",
+                              alloc->getName(),
+                              containedloops.back().first.header);
+        if (EnzymeRelocatableTape && storeInto != alloc)
+          allocation = relocateCachePointer(build, allocation,
+                                            /*toOffset*/ true, alloc);
         storealloc = build.CreateStore(allocation, storeInto);
         // Unlike the static case we can not mark the memory as invariant
         // since we are reloading/storing based off the number of loop
@@ -868,13 +1031,127 @@ AllocaInst *CacheUtility::createCacheForScope(LimitContext ctx, Type *T,
           /*inForwardPass*/ true, v, containedloops,
           ((unsigned)i == sublimits.size() - 1) ? ompOffset : nullptr);
 
-      storeInto = v.CreateGEP(v.CreateLoad(storeInto), idx);
+      Value *next = v.CreateLoad(storeInto);
+      if (EnzymeRelocatableTape && storeInto != alloc)
+        next = relocateCachePointer(v, next, /*toOffset*/ false);
+      storeInto = v.CreateGEP(next, idx);
       cast<GetElementPtrInst>(storeInto)->setIsInBounds(true);
     }
   }
   return alloc;
 }
 
+void CacheUtility::combineCacheAllocations() {
+  for (auto &pair : combinableAllocs) {
+    // Only caches still allocated and freed as created, all freed together,
+    // may be combined.
+    typedef std::tuple<AllocaInst *, CallInst *, uint64_t> Member;
+    std::vector<Member> members;
+    BasicBlock *freeBlock = nullptr;
+    for (auto &member : pair.second) {
+      AllocaInst *cache = std::get<0>(member);
+      uint64_t bsize = std::get<2>(member);
+      auto foundAlloc = scopeAllocs.find(cache);
+      if (foundAlloc == scopeAllocs.end() || foundAlloc->second.size() != 1 ||
+          foundAlloc->second[0] != std::get<1>(member))
+        continue;
+      auto foundFree = scopeFrees.find(cache);
+      if (foundFree == scopeFrees.end() || foundFree->second.size() != 1)
+        continue;
+      if ((bsize & (bsize - 1)) != 0)
+        continue;
+      BasicBlock *BB = (*foundFree->second.begin())->getParent();
+      if (freeBlock && BB != freeBlock)
+        continue;
+      freeBlock = BB;
+      members.push_back(member);
+    }
+    if (members.size() < std::max(2U, (unsigned)EnzymeCombineCaches))
+      continue;
+
+    // Placing larger elements first keeps every sub array aligned.
+    std::stable_sort(members.begin(), members.end(),
+                     [](const Member &a, const Member &b) {
+                       return std::get<2>(a) > std::get<2>(b);
+                     });
+
+    BasicBlock *BB = pair.first.first;
+    Value *size = pair.first.second;
+    Instruction *first = nullptr;
+    for (auto &I : *BB) {
+      for (auto &member : members)
+        if (&I == std::get<1>(member))
+          first = &I;
+      if (first)
+        break;
+    }
+    assert(first);
+
+    uint64_t total = 0;
+    for (auto &member : members)
+      total += std::get<2>(member);
+
+    IRBuilder<> B(first);
+    Value *bytes = B.CreateMul(size, ConstantInt::get(size->getType(), total),
+                               "", /*NUW*/ true, /*NSW*/ true);
+    auto combined = cast<CallInst>(CallInst::CreateMalloc(
+        first, size->getType(), Type::getInt8Ty(first->getContext()),
+        ConstantInt::get(size->getType(), 1), bytes, nullptr,
+        "combinedcache"));
+    combined->addAttribute(AttributeList::ReturnIndex, Attribute::NoAlias);
+    combined->addAttribute(AttributeList::ReturnIndex, Attribute::NonNull);
+    combined->setMetadata(
+        "enzyme_tapeprofile",
+        std::get<1>(members[0])->getMetadata("enzyme_tapeprofile"));
+
+    // The first sub array starts the allocation, hence its free releases the
+    // combined allocation, once all sub arrays are no longer used.
+    std::set<CallInst *> memberFrees;
+    for (auto &member : members)
+      memberFrees.insert(*scopeFrees[std::get<0>(member)].begin());
+    CallInst *lastFree = nullptr;
+    for (auto &I : *freeBlock)
+      if (auto CI = dyn_cast<CallInst>(&I))
+        if (memberFrees.count(CI))
+          lastFree = CI;
+    CallInst *combinedFree = *scopeFrees[std::get<0>(members[0])].begin();
+    combinedFree->moveBefore(lastFree);
+
+    uint64_t offset = 0;
+    for (auto &member : members) {
+      AllocaInst *cache = std::get<0>(member);
+      CallInst *malloccall = std::get<1>(member);
+      Value *sub = combined;
+      if (offset != 0) {
+        B.SetInsertPoint(malloccall);
+        sub = B.CreateInBoundsGEP(
+            combined,
+            B.CreateMul(size, ConstantInt::get(size->getType(), offset), "",
+                        /*NUW*/ true, /*NSW*/ true));
+      }
+      offset += std::get<2>(member);
+
+      malloccall->replaceAllUsesWith(sub);
+      Value *oldSize = malloccall->getArgOperand(0);
+      scopeAllocs[cache].clear();
+      erase(malloccall);
+      if (auto I = dyn_cast<Instruction>(oldSize))
+        if (I->use_empty())
+          erase(I);
+
+      if (cache == std::get<0>(members[0])) {
+        scopeAllocs[cache].push_back(combined);
+      } else {
+        scopeAllocs.erase(cache);
+        CallInst *free = *scopeFrees[cache].begin();
+        scopeFrees.erase(cache);
+        erase(free);
+      }
+    }
+  }
+  combinableAllocs.clear();
+}
+
 Value *CacheUtility::computeIndexOfChunk(
     bool inForwardPass, IRBuilder<> &v,
     const std::vector<std::pair<LoopContext, llvm::Value *>> &containedloops,
@@ -1232,6 +1509,16 @@ void CacheUtility::storeInstructionInCache(LimitContext ctx,
          cast<PointerType>(loc->getType())->getElementType());
   StoreInst *storeinst = v.CreateStore(tostore, loc);
 
+  // Values cached in a loop are written once and only read back, in
+  // reverse, once the forward pass is done.
+  if (tostore == val && isa<GetElementPtrInst>(loc) &&
+      NonTemporalCaches.count(cache))
+    storeinst->setMetadata(
+        LLVMContext::MD_nontemporal,
+        MDNode::get(storeinst->getContext(),
+                    {ConstantAsMetadata::get(ConstantInt::get(
+                        Type::getInt32Ty(storeinst->getContext()), 1))}));
+
   // If the value stored doesnt change (per efficient bool cache),
   // mark it as invariant
   if (tostore == val) {
@@ -1291,6 +1578,32 @@ void CacheUtility::storeInstructionInCache(LimitContext ctx,
 /// pointer that can hold the underlying type being cached. This value should be
 /// computed at BuilderM. Optionally, instructions needed to generate this
 /// pointer can be stored in scopeInstructions
+/// Append the instructions computing V, other than From, to Insts such that
+/// operands precede their users
+static void collectComputation(Value *V, Value *From,
+                               SmallVectorImpl<Instruction *> &Insts) {
+  auto I = dyn_cast<Instruction>(V);
+  if (!I || V == From || llvm::is_contained(Insts, I))
+    return;
+  for (auto &op : I->operands())
+    collectComputation(op, From, Insts);
+  Insts.push_back(I);
+}
+
+Value *CacheUtility::relocateCachePointer(IRBuilder<> &BuilderM, Value *V,
+                                          bool toOffset, AllocaInst *record) {
+  Value *result = toOffset ? getTapeBufferOffset(BuilderM, V)
+                           : getTapeBufferPointer(BuilderM, V);
+  if (record) {
+    // Erasing the recorded instructions in reverse removes users first.
+    SmallVector<Instruction *, 4> computation;
+    collectComputation(result, V, computation);
+    for (auto I : computation)
+      scopeInstructions[record].push_back(I);
+  }
+  return result;
+}
+
 Value *CacheUtility::getCachePointer(bool inForwardPass, IRBuilder<> &BuilderM,
                                      LimitContext ctx, Value *cache, bool isi1,
                                      bool storeInInstructionsMap,
@@ -1307,7 +1620,9 @@ Value *CacheUtility::getCachePointer(bool inForwardPass, IRBuilder<> &BuilderM,
 
   // Iterate from outermost loop to innermost loop
   for (int i = sublimits.size() - 1; i >= 0; i--) {
-    // Lookup the next allocation pointer
+    // Lookup the next allocation pointer, which is held as an offset if
+    // this cache is nested within another
+    bool relocated = EnzymeRelocatableTape && next != cache;
     next = BuilderM.CreateLoad(next);
     if (storeInInstructionsMap && isa<AllocaInst>(cache))
       scopeInstructions[cast<AllocaInst>(cache)].push_back(
@@ -1336,10 +1651,11 @@ Value *CacheUtility::getCachePointer(bool inForwardPass, IRBuilder<> &BuilderM,
         newFunc->getParent()->getDataLayout().getTypeAllocSizeInBits(
             next->getType()) /
             8);
-    cast<LoadInst>(next)->setMetadata(
-        LLVMContext::MD_dereferenceable,
-        MDNode::get(cache->getContext(),
-                    {ConstantAsMetadata::get(byteSizeOfType)}));
+    if (!relocated)
+      cast<LoadInst>(next)->setMetadata(
+          LLVMContext::MD_dereferenceable,
+          MDNode::get(cache->getContext(),
+                      {ConstantAsMetadata::get(byteSizeOfType)}));
     unsigned bsize = (unsigned)byteSizeOfType->getZExtValue();
     if ((bsize & (bsize - 1)) == 0) {
 #if LLVM_VERSION_MAJOR >= 10
@@ -1348,6 +1664,10 @@ Value *CacheUtility::getCachePointer(bool inForwardPass, IRBuilder<> &BuilderM,
       cast<LoadInst>(next)->setAlignment(bsize);
 #endif
     }
+    if (relocated)
+      next = relocateCachePointer(
+          BuilderM, next, /*toOffset*/ false,
+          storeInInstructionsMap ? dyn_cast<AllocaInst>(cache) : nullptr);
 
     const auto &containedloops = sublimits[i].second;
 
@@ -1363,11 +1683,30 @@ Value *CacheUtility::getCachePointer(bool inForwardPass, IRBuilder<> &BuilderM,
         assert(es);
         idx = BuilderM.CreateMul(idx, es, "", /*NUW*/ true, /*NSW*/ true);
       }
+      Value *chunk = next;
       next = BuilderM.CreateGEP(next, idx);
       cast<GetElementPtrInst>(next)->setIsInBounds(true);
       if (storeInInstructionsMap && isa<AllocaInst>(cache))
         scopeInstructions[cast<AllocaInst>(cache)].push_back(
             cast<Instruction>(next));
+
+      // Let a cache in a mapped file page out what has been accessed and
+      // page in what will be, as the accesses are sequential.
+      if (EnzymeMappedCacheThreshold && !EnzymeTapeBuffer &&
+          sublimits[i].second.back().first.maxLimit) {
+        auto i8p = Type::getInt8PtrTy(cache->getContext());
+        Value *args[] = {BuilderM.CreatePointerCast(chunk, i8p),
+                         BuilderM.CreatePointerCast(next, i8p)};
+        auto advise = BuilderM.CreateCall(
+            getOrInsertMappedCacheAdvise(*newFunc->getParent()), args);
+        if (storeInInstructionsMap && isa<AllocaInst>(cache)) {
+          for (auto arg : args)
+            if (arg != chunk && arg != next)
+              scopeInstructions[cast<AllocaInst>(cache)].push_back(
+                  cast<Instruction>(arg));
+          scopeInstructions[cast<AllocaInst>(cache)].push_back(advise);
+        }
+      }
     }
     assert(next->getType()->isPointerTy());
   }
@@ -1424,6 +1763,31 @@ Value *CacheUtility::lookupValueFromCache(bool inForwardPass,
     cast<GetElementPtrInst>(cptr)->setIsInBounds(true);
   }
 
+  // The reverse pass visits a loop cache from its end to its start, a
+  // pattern hardware prefetchers may not follow, hence prefetch the memory
+  // the coming iterations will load.
+  if (!inForwardPass && EnzymeCachePrefetchDistance &&
+      isa<GetElementPtrInst>(cptr)) {
+    auto i8p = Type::getInt8PtrTy(cache->getContext());
+    auto i32 = Type::getInt32Ty(cache->getContext());
+    Value *ahead = BuilderM.CreateGEP(
+        BuilderM.CreatePointerCast(cptr, i8p),
+        ConstantInt::getSigned(Type::getInt64Ty(cache->getContext()),
+                               -(int64_t)EnzymeCachePrefetchDistance));
+#if LLVM_VERSION_MAJOR >= 10
+    Type *tys[] = {i8p};
+    auto prefetch = Intrinsic::getDeclaration(newFunc->getParent(),
+                                              Intrinsic::prefetch, tys);
+#else
+    auto prefetch =
+        Intrinsic::getDeclaration(newFunc->getParent(), Intrinsic::prefetch);
+#endif
+    // read, no temporal locality as each value is loaded once, data cache
+    Value *args[] = {ahead, ConstantInt::get(i32, 0), ConstantInt::get(i32, 0),
+                     ConstantInt::get(i32, 1)};
+    BuilderM.CreateCall(prefetch, args);
+  }
+
   Value *result = loadFromCachePointer(BuilderM, cptr, cache);
 
   // If using the efficient bool cache, do the corresponding
@@ -43,6 +43,24 @@
 extern "C" {
 /// Pack 8 bools together in a single byte
 extern llvm::cl::opt<bool> EfficientBoolCache;
+/// Use profile data to guide caching decisions and cache sizes
+extern llvm::cl::opt<bool> EnzymeProfileGuidedCache;
+/// Allocate tapes and caches from the caller provided tape buffer
+extern llvm::cl::opt<bool> EnzymeTapeBuffer;
+/// Refer to caches within the tape buffer by their offset in it
+extern llvm::cl::opt<bool> EnzymeRelocatableTape;
+/// Size in MiB from which caches are kept in memory mapped files
+extern llvm::cl::opt<unsigned> EnzymeMappedCacheThreshold;
+/// Mark stores into loop caches as nontemporal
+extern llvm::cl::opt<bool> EnzymeNonTemporalCache;
+/// Size in bytes from which stores into a loop cache are nontemporal
+extern llvm::cl::opt<unsigned> EnzymeNonTemporalCacheThreshold;
+/// Distance in bytes at which reverse pass cache loads are prefetched
+extern llvm::cl::opt<unsigned> EnzymeCachePrefetchDistance;
+/// Least number of loop caches of one scope to allocate together
+extern llvm::cl::opt<unsigned> EnzymeCombineCaches;
+/// Whether to call the tape profiling runtime on cache (de)allocation
+extern llvm::cl::opt<bool> EnzymeTapeProfile;
 }
 
 /// Container for all loop information to synthesize gradients
@@ -259,6 +277,8 @@ private:
   /// Given a value being cached, return the invariant metadata of any
   /// loads/stores to memory storing that value
   std::map<llvm::Value *, llvm::MDNode *> ValueInvariantGroups;
+  /// Loop caches large enough that stores into them are nontemporal
+  std::set<llvm::Value *> NonTemporalCaches;
 
 protected:
   /// A map of values being cached to their underlying allocation/limit context
@@ -279,6 +299,14 @@ protected:
   /// part of the cache
   std::map<llvm::AllocaInst *, std::vector<llvm::CallInst *>> scopeAllocs;
 
+  /// A map of the block and number of elements of statically sized single
+  /// loop caches to their allocation, the malloc creating it and the size of
+  /// its elements. Caches allocated alike may share a single allocation.
+  std::map<std::pair<llvm::BasicBlock *, llvm::Value *>,
+           std::vector<std::tuple<llvm::AllocaInst *, llvm::CallInst *,
+                                  uint64_t>>>
+      combinableAllocs;
+
   /// Perform the final load from the cache, applying requisite invariant
   /// group and alignment
   llvm::Value *loadFromCachePointer(llvm::IRBuilder<> &BuilderM,
@@ -321,6 +349,11 @@ public:
 
   virtual bool assumeDynamicLoopOfSizeOne(llvm::Loop *L) const = 0;
 
+  /// Replace the allocations of loop caches of the same scope, which are read
+  /// in the same iterations of the reverse pass, with sub arrays of a single
+  /// allocation. This must be called once all caches have been created.
+  void combineCacheAllocations();
+
   /// If an allocation is requested to be freed, this subclass will be called to
   /// chose how and where to free it. It is by default not implemented, falling
   /// back to an error. Subclasses who want to free memory should implement this
@@ -364,6 +397,13 @@ public:
 protected:
   // List of values loaded from the cache
   llvm::SmallPtrSet<llvm::LoadInst *, 10> CacheLookups;
+
+  /// Convert a pointer to a cache held within another cache or the tape to
+  /// (toOffset) or from its offset in the tape buffer. Optionally, the
+  /// instructions doing so are stored in scopeInstructions of record
+  llvm::Value *relocateCachePointer(llvm::IRBuilder<> &BuilderM,
+                                    llvm::Value *V, bool toOffset,
+                                    llvm::AllocaInst *record = nullptr);
 };
 
 // Create a new canonical induction variable of Type Ty for Loop L
@@ -24,6 +24,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include <deque>
+#include <limits>
 #include <map>
 #include <set>
 
@@ -389,11 +390,97 @@ static inline int cmpLoopNest(Loop *prev, Loop *next) {
   return -1;
 }
 
+/// Variant of minCut where caching a value has the given cost rather than
+/// unit cost. Only values themselves may be cut, edges between them have
+/// unbounded capacity.
+static inline void
+weightedMinCut(const SmallPtrSetImpl<Value *> &Recomputes,
+               const SmallPtrSetImpl<Value *> &Intermediates,
+               const SmallPtrSetImpl<Value *> &Required,
+               SmallPtrSetImpl<Value *> &MinReq,
+               const std::map<Value *, uint64_t> &Costs) {
+  const uint64_t Unbounded = std::numeric_limits<uint64_t>::max();
+  // Residual capacities of the graph
+  std::map<Node, std::map<Node, uint64_t>> G;
+  for (auto V : Intermediates) {
+    auto found = Costs.find(V);
+    G[Node(V, false)][Node(V, true)] =
+        found == Costs.end() ? 1 : found->second;
+    for (auto U : V->users()) {
+      if (Intermediates.count(U)) {
+        G[Node(V, true)][Node(U, false)] = Unbounded;
+      }
+    }
+  }
+
+  auto search = [&](std::map<Node, Node> &parent) {
+    std::deque<Node> q;
+    for (auto V : Recomputes) {
+      Node N(V, false);
+      parent.emplace(N, Node(nullptr, true));
+      q.push_back(N);
+    }
+    while (!q.empty()) {
+      auto u = q.front();
+      q.pop_front();
+      auto found = G.find(u);
+      if (found == G.end())
+        continue;
+      for (auto &pair : found->second) {
+        if (pair.second != 0 && parent.find(pair.first) == parent.end()) {
+          q.push_back(pair.first);
+          parent.emplace(pair.first, u);
+        }
+      }
+    }
+  };
+
+  // Augment the flow while there is a path from source to sink
+  while (1) {
+    std::map<Node, Node> parent;
+    search(parent);
+    Node end(nullptr, false);
+    for (auto req : Required) {
+      if (parent.find(Node(req, true)) != parent.end()) {
+        end = Node(req, true);
+        break;
+      }
+    }
+    if (end.V == nullptr)
+      break;
+    // Every path crosses at least one value, so the bottleneck is bounded
+    uint64_t flow = Unbounded;
+    for (Node v = end; parent.find(v)->second.V != nullptr;
+         v = parent.find(v)->second)
+      flow = std::min(flow, G[parent.find(v)->second][v]);
+    assert(flow != Unbounded);
+    for (Node v = end; parent.find(v)->second.V != nullptr;
+         v = parent.find(v)->second) {
+      Node u = parent.find(v)->second;
+      if (G[u][v] != Unbounded)
+        G[u][v] -= flow;
+      if (G[v][u] != Unbounded)
+        G[v][u] += flow;
+    }
+  }
+
+  // Flow is maximum now, cache the values whose incoming half is reachable
+  // from the source but whose outgoing half is not
+  std::map<Node, Node> parent;
+  search(parent);
+  for (auto V : Intermediates) {
+    if (parent.find(Node(V, false)) != parent.end() &&
+        parent.find(Node(V, true)) == parent.end())
+      MinReq.insert(V);
+  }
+}
+
 static inline void minCut(const DataLayout &DL, LoopInfo &OrigLI,
                           const SmallPtrSetImpl<Value *> &Recomputes,
                           const SmallPtrSetImpl<Value *> &Intermediates,
                           SmallPtrSetImpl<Value *> &Required,
-                          SmallPtrSetImpl<Value *> &MinReq) {
+                          SmallPtrSetImpl<Value *> &MinReq,
+                          const std::map<Value *, uint64_t> *Costs = nullptr) {
   Graph G;
   for (auto V : Intermediates) {
     G[Node(V, false)].insert(Node(V, true));
@@ -412,62 +499,72 @@ static inline void minCut(const DataLayout &DL, LoopInfo &OrigLI,
 
   Graph Orig = G;
 
-  // Augment the flow while there is a path from source to sink
-  while (1) {
-    std::map<Node, Node> parent;
-    bfs(G, Recomputes, parent);
-    Node end(nullptr, false);
-    for (auto req : Required) {
-      if (parent.find(Node(req, true)) != parent.end()) {
-        end = Node(req, true);
-        break;
-      }
-    }
-    if (end.V == nullptr)
-      break;
-    // update residual capacities of the edges and reverse edges
-    // along the path
-    Node v = end;
+  if (Costs) {
+    weightedMinCut(Recomputes, Intermediates, Required, MinReq, *Costs);
+  } else {
+    // Augment the flow while there is a path from source to sink
     while (1) {
-      assert(parent.find(v) != parent.end());
-      Node u = parent.find(v)->second;
-      assert(u.V != nullptr);
-      assert(G[u].count(v) == 1);
-      G[u].erase(v);
-      assert(G[v].count(u) == 0);
-      G[v].insert(u);
-      if (Recomputes.count(u.V) && u.outgoing == false)
+      std::map<Node, Node> parent;
+      bfs(G, Recomputes, parent);
+      Node end(nullptr, false);
+      for (auto req : Required) {
+        if (parent.find(Node(req, true)) != parent.end()) {
+          end = Node(req, true);
+          break;
+        }
+      }
+      if (end.V == nullptr)
         break;
-      v = u;
+      // update residual capacities of the edges and reverse edges
+      // along the path
+      Node v = end;
+      while (1) {
+        assert(parent.find(v) != parent.end());
+        Node u = parent.find(v)->second;
+        assert(u.V != nullptr);
+        assert(G[u].count(v) == 1);
+        G[u].erase(v);
+        assert(G[v].count(u) == 0);
+        G[v].insert(u);
+        if (Recomputes.count(u.V) && u.outgoing == false)
+          break;
+        v = u;
+      }
     }
-  }
 
-  // Flow is maximum now, find vertices reachable from s
+    // Flow is maximum now, find vertices reachable from s
 
-  std::map<Node, Node> parent;
-  bfs(G, Recomputes, parent);
-
-  // Print all edges that are from a reachable vertex to
-  // non-reachable vertex in the original graph
-  for (auto &pair : Orig) {
-    if (parent.find(pair.first) != parent.end())
-      for (auto N : pair.second) {
-        if (parent.find(N) == parent.end()) {
-          assert(pair.first.outgoing == 0 && N.outgoing == 1);
-          assert(pair.first.V == N.V);
-          MinReq.insert(N.V);
+    std::map<Node, Node> parent;
+    bfs(G, Recomputes, parent);
+
+    // Print all edges that are from a reachable vertex to
+    // non-reachable vertex in the original graph
+    for (auto &pair : Orig) {
+      if (parent.find(pair.first) != parent.end())
+        for (auto N : pair.second) {
+          if (parent.find(N) == parent.end()) {
+            assert(pair.first.outgoing == 0 && N.outgoing == 1);
+            assert(pair.first.V == N.V);
+            MinReq.insert(N.V);
+          }
         }
-      }
+    }
   }
 
   // When ambiguous, push to cache the last value in a computation chain
-  // This should be considered in a cost for the max flow
+  // This should be considered in a cost for the max flow. With costs, the
+  // later value must also be no more expensive to cache.
+  auto cost = [&](Value *V) -> uint64_t {
+    auto found = Costs->find(V);
+    return found == Costs->end() ? 1 : found->second;
+  };
   std::deque<Value *> todo(MinReq.begin(), MinReq.end());
   while (todo.size()) {
     auto V = todo.front();
     todo.pop_front();
     auto found = Orig.find(Node(V, true));
-    if (found->second.size() == 1 && !Required.count(V)) {
+    if (found != Orig.end() && found->second.size() == 1 &&
+        !Required.count(V)) {
       bool potentiallyRecursive =
           isa<PHINode>((*found->second.begin()).V) &&
           OrigLI.isLoopHeader(
@@ -480,10 +577,12 @@ static inline void minCut(const DataLayout &DL, LoopInfo &OrigLI,
         continue;
       if (moreOuterLoop == -1)
         continue;
+      Value *Next = (*found->second.begin()).V;
+      if (Costs && cost(Next) > cost(V))
+        continue;
       if (moreOuterLoop == 1 ||
-          (moreOuterLoop == 0 &&
-           DL.getTypeSizeInBits(V->getType()) >=
-               DL.getTypeSizeInBits((*found->second.begin()).V->getType()))) {
+          (moreOuterLoop == 0 && DL.getTypeSizeInBits(V->getType()) >=
+                                     DL.getTypeSizeInBits(Next->getType()))) {
         MinReq.erase(V);
         MinReq.insert((*found->second.begin()).V);
         todo.push_back((*found->second.begin()).V);
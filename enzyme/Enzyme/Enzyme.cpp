@@ -58,6 +58,7 @@
 #include "ActivityAnalysis.h"
 #include "EnzymeLogic.h"
 #include "GradientUtils.h"
+#include "SparsityAnalysis.h"
 #include "Utils.h"
 
 #include "llvm/Transforms/Utils.h"
@@ -100,9 +101,403 @@ public:
     // AU.addRequiredID(llvm::LoopSimplifyID);//<LoopSimplifyWrapperPass>();
   }
 
+  /// Return the activity marker (enzyme_dup, enzyme_const, ...) that res
+  /// denotes, or an empty string if res is an ordinary argument.
+  static StringRef getActivityMarker(Value *res) {
+    if (auto av = dyn_cast<MetadataAsValue>(res))
+      if (auto MS = dyn_cast<MDString>(av->getMetadata()))
+        return MS->getString();
+    if (isa<LoadInst>(res) || isa<CastInst>(res))
+      res = cast<Instruction>(res)->getOperand(0);
+    if (auto CE = dyn_cast<ConstantExpr>(res))
+      if (CE->isCast())
+        res = CE->getOperand(0);
+    if (isa<GlobalVariable>(res) || isa<AllocaInst>(res)) {
+      auto MS = res->getName();
+      for (StringRef marker : {"enzyme_dupnoneed", "enzyme_dup",
+                               "enzyme_const", "enzyme_out"})
+        if (MS.startswith(marker))
+          return marker;
+    }
+    return "";
+  }
+
+  /// Lower __enzyme_hvp(fn, args...) to a Hessian-vector product. Every
+  /// active argument of fn is followed by its tangent direction, its gradient
+  /// accumulator and the accumulator receiving the Hessian-vector product.
+  /// Return whether successful
+  bool HandleHVP(CallInst *CI, TargetLibraryInfo &TLI, bool PostOpt) {
+    Value *fn = CI->getArgOperand(0);
+    while (auto ci = dyn_cast<CastInst>(fn))
+      fn = ci->getOperand(0);
+    while (auto ci = dyn_cast<ConstantExpr>(fn))
+      fn = ci->getOperand(0);
+    if (!isa<Function>(fn) || cast<Function>(fn)->empty()) {
+      EmitFailure("NoFunctionToDifferentiate", CI->getDebugLoc(), CI,
+                  "failed to find fn to differentiate", *CI, " - found - ",
+                  *fn);
+      return false;
+    }
+    auto FT = cast<Function>(fn)->getFunctionType();
+
+    std::vector<DIFFE_TYPE> constants;
+    SmallVector<Value *, 4> args;
+    IRBuilder<> Builder(CI);
+    unsigned truei = 0;
+    for (unsigned i = 1; i < CI->getNumArgOperands(); ++i, ++truei) {
+      if (truei >= FT->getNumParams()) {
+        EmitFailure("TooManyArgs", CI->getDebugLoc(), CI,
+                    "Had too many arguments to __enzyme_hvp", *CI);
+        return false;
+      }
+      auto PTy = FT->getParamType(truei);
+      DIFFE_TYPE ty = whatType(PTy, DerivativeMode::ReverseModeCombined);
+      StringRef marker = getActivityMarker(CI->getArgOperand(i));
+      if (marker.size()) {
+        if (marker == "enzyme_const")
+          ty = DIFFE_TYPE::CONSTANT;
+        else if (marker.startswith("enzyme_dup"))
+          ty = DIFFE_TYPE::DUP_ARG;
+        else
+          ty = DIFFE_TYPE::OUT_DIFF;
+        ++i;
+      }
+      if (ty == DIFFE_TYPE::OUT_DIFF) {
+        EmitFailure("IllegalDiffeType", CI->getDebugLoc(), CI,
+                    "__enzyme_hvp requires active argument ", truei,
+                    " to be passed by reference ", *CI);
+        return false;
+      }
+      unsigned count = ty == DIFFE_TYPE::CONSTANT ? 1 : 4;
+      SmallVector<Value *, 4> vals;
+      for (unsigned j = 0; j < count; ++j, ++i) {
+        if (i >= CI->getNumArgOperands()) {
+          EmitFailure("TooFewArguments", CI->getDebugLoc(), CI,
+                      "Too few arguments passed to __enzyme_hvp");
+          return false;
+        }
+        Value *res = CI->getArgOperand(i);
+        if (res->getType() != PTy) {
+          if (!res->getType()->canLosslesslyBitCastTo(PTy)) {
+            EmitFailure("IllegalArgCast", CI->getDebugLoc(), CI,
+                        "Cannot cast __enzyme_hvp argument ", i, ", found ",
+                        *res, " - to arg ", truei, " ", *PTy);
+            return false;
+          }
+          res = Builder.CreateBitCast(res, PTy);
+        }
+        vals.push_back(res);
+      }
+      --i;
+      // The product takes the primal and its shadow, receiving the
+      // Hessian-vector product, then the tangent and its shadow, receiving
+      // the gradient.
+      if (count == 4)
+        args.append({vals[0], vals[3], vals[1], vals[2]});
+      else
+        args.append(vals.begin(), vals.end());
+      constants.push_back(ty);
+    }
+    if (truei != FT->getNumParams()) {
+      EmitFailure("TooFewArguments", CI->getDebugLoc(), CI,
+                  "Too few arguments passed to __enzyme_hvp");
+      return false;
+    }
+
+    Type *RT = cast<Function>(fn)->getReturnType();
+    if (!RT->isFloatingPointTy()) {
+      EmitFailure("IllegalReturnType", CI->getDebugLoc(), CI,
+                  "__enzyme_hvp requires a floating point scalar return ",
+                  *CI);
+      return false;
+    }
+
+    auto Arch =
+        llvm::Triple(
+            CI->getParent()->getParent()->getParent()->getTargetTriple())
+            .getArch();
+    bool AtomicAdd = Arch == Triple::nvptx || Arch == Triple::nvptx64 ||
+                     Arch == Triple::amdgcn;
+
+    TypeAnalysis TA(TLI);
+    FnTypeInfo type_args = TA.getCallerTypeInfo(cast<Function>(fn));
+    Function *newFunc = Logic.CreateHessianVectorProduct(
+        cast<Function>(fn), constants, TLI, TA, type_args, AtomicAdd, PostOpt);
+    if (!newFunc)
+      return false;
+
+    args.push_back(ConstantFP::get(RT, 1.0));
+    assert(args.size() == newFunc->getFunctionType()->getNumParams());
+    CallInst *hvp = Builder.CreateCall(newFunc, args);
+    hvp->setCallingConv(CI->getCallingConv());
+    hvp->setDebugLoc(CI->getDebugLoc());
+    if (!CI->getType()->isVoidTy())
+      CI->replaceAllUsesWith(UndefValue::get(CI->getType()));
+    CI->eraseFromParent();
+    return true;
+  }
+
+  /// Lower __enzyme_taylor(fn, K, args...) to the propagation of truncated
+  /// Taylor polynomials of degree K through fn. Every floating point argument
+  /// of fn, unless marked enzyme_const, is followed by a pointer to its
+  /// coefficients of degree 1 to K. If fn returns a floating point value, a
+  /// final pointer receives the coefficients of degree 1 to K of the result.
+  /// Return whether successful
+  bool HandleTaylor(CallInst *CI, TargetLibraryInfo &TLI, bool PostOpt) {
+    Value *fn = CI->getArgOperand(0);
+    while (auto ci = dyn_cast<CastInst>(fn))
+      fn = ci->getOperand(0);
+    while (auto ci = dyn_cast<ConstantExpr>(fn))
+      fn = ci->getOperand(0);
+    if (!isa<Function>(fn) || cast<Function>(fn)->empty()) {
+      EmitFailure("NoFunctionToDifferentiate", CI->getDebugLoc(), CI,
+                  "failed to find fn to differentiate", *CI, " - found - ",
+                  *fn);
+      return false;
+    }
+    auto FT = cast<Function>(fn)->getFunctionType();
+
+    auto degree = CI->getNumArgOperands() > 1
+                      ? dyn_cast<ConstantInt>(CI->getArgOperand(1))
+                      : nullptr;
+    if (!degree || degree->isZero() || degree->isNegative()) {
+      EmitFailure("IllegalTaylorDegree", CI->getDebugLoc(), CI,
+                  "__enzyme_taylor requires a positive constant degree ", *CI);
+      return false;
+    }
+    unsigned K = degree->getZExtValue();
+
+    std::vector<DIFFE_TYPE> constants;
+    SmallVector<Value *, 4> args;
+    IRBuilder<> Builder(CI);
+    unsigned i = 2;
+    for (unsigned truei = 0; truei < FT->getNumParams(); ++truei, ++i) {
+      auto PTy = FT->getParamType(truei);
+      DIFFE_TYPE ty = PTy->isFloatingPointTy() ? DIFFE_TYPE::DUP_ARG
+                                               : DIFFE_TYPE::CONSTANT;
+      if (i < CI->getNumArgOperands()) {
+        StringRef marker = getActivityMarker(CI->getArgOperand(i));
+        if (marker == "enzyme_const") {
+          ty = DIFFE_TYPE::CONSTANT;
+          ++i;
+        } else if (marker.size()) {
+          EmitFailure("IllegalDiffeType", CI->getDebugLoc(), CI,
+                      "__enzyme_taylor only supports active floating point "
+                      "scalars, found ",
+                      marker, " for argument ", truei, " ", *CI);
+          return false;
+        }
+      }
+      unsigned count = ty == DIFFE_TYPE::CONSTANT ? 1 : 2;
+      if (i + count > CI->getNumArgOperands()) {
+        EmitFailure("TooFewArguments", CI->getDebugLoc(), CI,
+                    "Too few arguments passed to __enzyme_taylor");
+        return false;
+      }
+      Value *res = CI->getArgOperand(i);
+      if (res->getType() != PTy) {
+        if (!res->getType()->canLosslesslyBitCastTo(PTy)) {
+          EmitFailure("IllegalArgCast", CI->getDebugLoc(), CI,
+                      "Cannot cast __enzyme_taylor argument ", i, ", found ",
+                      *res, " - to arg ", truei, " ", *PTy);
+          return false;
+        }
+        res = Builder.CreateBitCast(res, PTy);
+      }
+      args.push_back(res);
+      if (ty == DIFFE_TYPE::DUP_ARG) {
+        ++i;
+        Type *ST = getTaylorShadowType(PTy, K);
+        Value *coeffs = CI->getArgOperand(i);
+        if (!coeffs->getType()->isPointerTy()) {
+          EmitFailure("IllegalArgCast", CI->getDebugLoc(), CI,
+                      "__enzyme_taylor expects a pointer to the coefficients "
+                      "of argument ",
+                      truei, ", found ", *coeffs);
+          return false;
+        }
+        args.push_back(Builder.CreateLoad(
+            Builder.CreatePointerCast(coeffs, PointerType::getUnqual(ST))));
+      }
+      constants.push_back(ty);
+    }
+
+    Type *RT = cast<Function>(fn)->getReturnType();
+    DIFFE_TYPE retType = RT->isFloatingPointTy() ? DIFFE_TYPE::DUP_ARG
+                                                 : DIFFE_TYPE::CONSTANT;
+    if (i + (retType == DIFFE_TYPE::DUP_ARG ? 1 : 0) !=
+        CI->getNumArgOperands()) {
+      EmitFailure("IllegalArgCount", CI->getDebugLoc(), CI,
+                  "__enzyme_taylor expects the arguments of fn followed by "
+                  "the coefficients of a floating point result ",
+                  *CI);
+      return false;
+    }
+
+    std::map<Argument *, bool> volatile_args;
+    for (auto &a : cast<Function>(fn)->args())
+      volatile_args[&a] = true;
+
+    TypeAnalysis TA(TLI);
+    FnTypeInfo type_args = TA.getCallerTypeInfo(cast<Function>(fn));
+    Function *newFunc = Logic.CreatePrimalAndGradient(
+        cast<Function>(fn), retType, constants, TLI, TA,
+        /*should return*/ false, /*dretPtr*/ false, DerivativeMode::ForwardMode,
+        /*addedType*/ nullptr, type_args, volatile_args,
+        /*index mapping*/ nullptr, /*AtomicAdd*/ false, PostOpt,
+        /*omp*/ false, /*TaylorDegree*/ K);
+    assert(args.size() == newFunc->getFunctionType()->getNumParams());
+
+    CallInst *taylor = Builder.CreateCall(newFunc, args);
+    taylor->setCallingConv(CI->getCallingConv());
+    taylor->setDebugLoc(CI->getDebugLoc());
+    if (retType == DIFFE_TYPE::DUP_ARG) {
+      Type *ST = getTaylorShadowType(RT, K);
+      Value *out = CI->getArgOperand(i);
+      if (!out->getType()->isPointerTy()) {
+        EmitFailure("IllegalArgCast", CI->getDebugLoc(), CI,
+                    "__enzyme_taylor expects a pointer to the coefficients "
+                    "of the result, found ",
+                    *out);
+        return false;
+      }
+      Builder.CreateStore(
+          Builder.CreateExtractValue(taylor, {0}),
+          Builder.CreatePointerCast(out, PointerType::getUnqual(ST)));
+    }
+    if (!CI->getType()->isVoidTy())
+      CI->replaceAllUsesWith(UndefValue::get(CI->getType()));
+    CI->eraseFromParent();
+    return true;
+  }
+
+  /// Lower __enzyme_sparse_jacobian(fn, n, m, rowptr, colidx, vals, x, y,
+  /// args...) to a colored sweep filling the CSR values of the Jacobian of
+  /// y with respect to x.
+  /// Return whether successful
+  bool HandleSparseJacobian(CallInst *CI, TargetLibraryInfo &TLI,
+                            bool PostOpt) {
+    Value *fn = CI->getArgOperand(0);
+    while (auto ci = dyn_cast<CastInst>(fn))
+      fn = ci->getOperand(0);
+    while (auto ci = dyn_cast<ConstantExpr>(fn))
+      fn = ci->getOperand(0);
+    if (!isa<Function>(fn) || cast<Function>(fn)->empty()) {
+      EmitFailure("NoFunctionToDifferentiate", CI->getDebugLoc(), CI,
+                  "failed to find fn to differentiate", *CI, " - found - ",
+                  *fn);
+      return false;
+    }
+    auto FT = cast<Function>(fn)->getFunctionType();
+    if (CI->getNumArgOperands() != 6 + FT->getNumParams()) {
+      EmitFailure("IllegalArgCount", CI->getDebugLoc(), CI,
+                  "__enzyme_sparse_jacobian expects the sizes, the pattern, "
+                  "the values and the arguments of fn ",
+                  *CI);
+      return false;
+    }
+    if (!hasSparsitySignature(cast<Function>(fn)) ||
+        !cast<PointerType>(FT->getParamType(0))
+             ->getElementType()
+             ->isFloatingPointTy()) {
+      EmitFailure("IllegalSparsitySignature", CI->getDebugLoc(), CI,
+                  "__enzyme_sparse_jacobian requires the first two arguments "
+                  "of fn to be the input and output floating point arrays ",
+                  *CI);
+      return false;
+    }
+
+    TypeAnalysis TA(TLI);
+    FnTypeInfo type_args = TA.getCallerTypeInfo(cast<Function>(fn));
+    Function *newFunc = Logic.CreateSparseJacobian(cast<Function>(fn), TLI, TA,
+                                                   type_args, PostOpt);
+
+    IRBuilder<> Builder(CI);
+    SmallVector<Value *, 8> args;
+    for (unsigned i = 1; i < CI->getNumArgOperands(); ++i) {
+      Value *res = CI->getArgOperand(i);
+      Type *PTy = newFunc->getFunctionType()->getParamType(i - 1);
+      if (res->getType() != PTy) {
+        if (res->getType()->isIntegerTy() && PTy->isIntegerTy()) {
+          res = Builder.CreateZExtOrTrunc(res, PTy);
+        } else if (res->getType()->canLosslesslyBitCastTo(PTy)) {
+          res = Builder.CreateBitCast(res, PTy);
+        } else {
+          EmitFailure("IllegalArgCast", CI->getDebugLoc(), CI,
+                      "Cannot cast __enzyme_sparse_jacobian argument ", i,
+                      ", found ", *res, " - to ", *PTy);
+          return false;
+        }
+      }
+      args.push_back(res);
+    }
+    CallInst *jac = Builder.CreateCall(newFunc, args);
+    jac->setDebugLoc(CI->getDebugLoc());
+    if (!CI->getType()->isVoidTy())
+      CI->replaceAllUsesWith(UndefValue::get(CI->getType()));
+    CI->eraseFromParent();
+    return true;
+  }
+
+  /// Lower __enzyme_sparsity_pattern(fn, n, m, rowptr, colidx) to a call
+  /// filling the CSR description of the statically deduced Jacobian sparsity
+  /// pattern of fn.
   /// Return whether successful
+  bool HandleSparsityPattern(CallInst *CI, TargetLibraryInfo &TLI) {
+    Value *fn = CI->getArgOperand(0);
+    while (auto ci = dyn_cast<CastInst>(fn))
+      fn = ci->getOperand(0);
+    while (auto ci = dyn_cast<ConstantExpr>(fn))
+      fn = ci->getOperand(0);
+    if (!isa<Function>(fn) || cast<Function>(fn)->empty()) {
+      EmitFailure("NoFunctionToDifferentiate", CI->getDebugLoc(), CI,
+                  "failed to find fn to analyze", *CI, " - found - ", *fn);
+      return false;
+    }
+    if (CI->getNumArgOperands() != 5) {
+      EmitFailure("IllegalArgCount", CI->getDebugLoc(), CI,
+                  "__enzyme_sparsity_pattern expects fn, the sizes and the "
+                  "CSR arrays ",
+                  *CI);
+      return false;
+    }
+
+    if (!hasSparsitySignature(cast<Function>(fn))) {
+      EmitFailure("IllegalSparsitySignature", CI->getDebugLoc(), CI,
+                  "__enzyme_sparsity_pattern requires the first two arguments "
+                  "of fn to be the input and output arrays ",
+                  *CI);
+      return false;
+    }
+
+    TypeAnalysis TA(TLI);
+    FnTypeInfo type_args = TA.getCallerTypeInfo(cast<Function>(fn));
+    Function *newFunc =
+        Logic.CreateSparsityPattern(cast<Function>(fn), TA, type_args);
+
+    IRBuilder<> Builder(CI);
+    SmallVector<Value *, 4> args;
+    for (unsigned i = 1; i < CI->getNumArgOperands(); ++i) {
+      Value *res = CI->getArgOperand(i);
+      Type *PTy = newFunc->getFunctionType()->getParamType(i - 1);
+      if (res->getType()->isIntegerTy())
+        res = Builder.CreateZExtOrTrunc(res, PTy);
+      else
+        res = Builder.CreatePointerCast(res, PTy);
+      args.push_back(res);
+    }
+    Builder.CreateCall(newFunc, args)->setDebugLoc(CI->getDebugLoc());
+    if (!CI->getType()->isVoidTy())
+      CI->replaceAllUsesWith(UndefValue::get(CI->getType()));
+    CI->eraseFromParent();
+    return true;
+  }
+
+  /// Return whether successful. If tapeSize, CI is a __enzyme_tape_size
+  /// call and is replaced by the size of the tape of the augmented forward
+  /// pass, as required by enzyme_allocated.
   bool HandleAutoDiff(CallInst *CI, TargetLibraryInfo &TLI, bool PostOpt,
-                      DerivativeMode mode) {
+                      DerivativeMode mode, bool tapeSize = false) {
 
     Value *fn = CI->getArgOperand(0);
 
@@ -150,6 +545,8 @@ public:
     std::map<int, Type *> byVal;
     llvm::Value *tape = nullptr;
     int allocatedTapeSize = -1;
+    llvm::Value *tapeBuffer = nullptr;
+    llvm::Value *tapeBufferSize = nullptr;
     for (unsigned i = 1; i < CI->getNumArgOperands(); ++i) {
       Value *res = CI->getArgOperand(i);
 
@@ -214,6 +611,16 @@ public:
           allocatedTapeSize =
               cast<ConstantInt>(CI->getArgOperand(i))->getSExtValue();
           continue;
+        } else if (MS == "enzyme_tape_buffer") {
+          if (i + 2 >= CI->getNumArgOperands()) {
+            EmitFailure("MissingTapeBuffer", CI->getDebugLoc(), CI,
+                        "enzyme_tape_buffer expects a buffer and its size ",
+                        *CI);
+            return false;
+          }
+          tapeBuffer = CI->getArgOperand(++i);
+          tapeBufferSize = CI->getArgOperand(++i);
+          continue;
         } else {
           ty = whatType(PTy, mode);
         }
@@ -249,6 +656,16 @@ public:
           allocatedTapeSize =
               cast<ConstantInt>(CI->getArgOperand(i))->getSExtValue();
           continue;
+        } else if (MS == "enzyme_tape_buffer") {
+          if (i + 2 >= CI->getNumArgOperands()) {
+            EmitFailure("MissingTapeBuffer", CI->getDebugLoc(), CI,
+                        "enzyme_tape_buffer expects a buffer and its size ",
+                        *CI);
+            return false;
+          }
+          tapeBuffer = CI->getArgOperand(++i);
+          tapeBufferSize = CI->getArgOperand(++i);
+          continue;
         } else {
           ty = whatType(PTy, mode);
         }
@@ -443,32 +860,11 @@ public:
     DIFFE_TYPE retType = whatType(cast<Function>(fn)->getReturnType(), mode);
 
     std::map<Argument *, bool> volatile_args;
-    FnTypeInfo type_args(cast<Function>(fn));
-    for (auto &a : type_args.Function->args()) {
+    for (auto &a : cast<Function>(fn)->args())
       volatile_args[&a] = !(mode == DerivativeMode::ReverseModeCombined);
-      TypeTree dt;
-      if (a.getType()->isFPOrFPVectorTy()) {
-        dt = ConcreteType(a.getType()->getScalarType());
-      } else if (a.getType()->isPointerTy()) {
-        auto et = cast<PointerType>(a.getType())->getElementType();
-        if (et->isFPOrFPVectorTy()) {
-          dt = TypeTree(ConcreteType(et->getScalarType())).Only(-1);
-        } else if (et->isPointerTy()) {
-          dt = TypeTree(ConcreteType(BaseType::Pointer)).Only(-1);
-        }
-      } else if (a.getType()->isIntOrIntVectorTy()) {
-        dt = ConcreteType(BaseType::Integer);
-      }
-      type_args.Arguments.insert(
-          std::pair<Argument *, TypeTree>(&a, dt.Only(-1)));
-      // TODO note that here we do NOT propagate constants in type info (and
-      // should consider whether we should)
-      type_args.KnownValues.insert(
-          std::pair<Argument *, std::set<int64_t>>(&a, {}));
-    }
 
     TypeAnalysis TA(TLI);
-    type_args = TA.analyzeFunction(type_args).getAnalyzedTypeInfo();
+    FnTypeInfo type_args = TA.getCallerTypeInfo(cast<Function>(fn));
 
     Function *newFunc = nullptr;
     Type *tapeType = nullptr;
@@ -484,11 +880,14 @@ public:
     case DerivativeMode::ReverseModePrimal:
     case DerivativeMode::ReverseModeGradient: {
       bool returnUsed = false;
-      bool forceAnonymousTape = allocatedTapeSize == -1;
-      auto &aug = Logic.CreateAugmentedPrimal(
+      bool forceAnonymousTape = allocatedTapeSize == -1 && !tapeSize;
+      auto *augp = &Logic.CreateAugmentedPrimal(
           cast<Function>(fn), retType, constants, TLI, TA,
           /*returnUsed*/ returnUsed, type_args, volatile_args,
           forceAnonymousTape, /*atomicAdd*/ AtomicAdd, /*PostOpt*/ PostOpt);
+      if (!forceAnonymousTape && augp->byValueTape)
+        augp = augp->byValueTape;
+      auto &aug = *augp;
       auto &DL = cast<Function>(fn)->getParent()->getDataLayout();
       if (!forceAnonymousTape) {
         assert(!aug.tapeType);
@@ -498,7 +897,7 @@ public:
                                      : cast<StructType>(aug.fn->getReturnType())
                                            ->getElementType(tapeIdx);
         }
-        if (tapeType &&
+        if (tapeType && !tapeSize &&
             DL.getTypeSizeInBits(tapeType) < 8 * allocatedTapeSize) {
           auto bytes = DL.getTypeSizeInBits(tapeType) / 8;
           EmitFailure("Insufficient tape allocation size", CI->getDebugLoc(),
@@ -521,6 +920,19 @@ public:
     if (!newFunc)
       return false;
 
+    if (tapeSize) {
+      if (!CI->getType()->isIntegerTy()) {
+        EmitFailure("IllegalTapeSize", CI->getDebugLoc(), CI,
+                    "__enzyme_tape_size must return an integer ", *CI);
+        return false;
+      }
+      auto &DL = cast<Function>(fn)->getParent()->getDataLayout();
+      CI->replaceAllUsesWith(ConstantInt::get(
+          CI->getType(), tapeType ? DL.getTypeAllocSize(tapeType) : 0));
+      CI->eraseFromParent();
+      return true;
+    }
+
     if (differentialReturn)
       args.push_back(ConstantFP::get(cast<Function>(fn)->getReturnType(), 1.0));
 
@@ -560,7 +972,18 @@ public:
       return false;
     }
     assert(args.size() == newFunc->getFunctionType()->getNumParams());
+    // The reverse pass keeps allocating after the caches of the augmented
+    // forward pass it consumes. The buffer of any enclosing call is restored
+    // once this call returns.
+    Value *savedTapeBuffer = nullptr;
+    if (tapeBuffer) {
+      savedTapeBuffer = saveTapeBuffer(Builder);
+      bool resetCursor = mode != DerivativeMode::ReverseModeGradient;
+      setTapeBuffer(Builder, tapeBuffer, tapeBufferSize, resetCursor);
+    }
     CallInst *diffret = cast<CallInst>(Builder.CreateCall(newFunc, args));
+    if (savedTapeBuffer)
+      restoreTapeBuffer(Builder, savedTapeBuffer);
     diffret->setCallingConv(CI->getCallingConv());
     diffret->setDebugLoc(CI->getDebugLoc());
 #if LLVM_VERSION_MAJOR >= 9
@@ -713,8 +1136,16 @@ public:
               Fn->getName().contains("__enzyme_call_inactive") ||
               Fn->getName().contains("__enzyme_autodiff") ||
               Fn->getName().contains("__enzyme_fwddiff") ||
+              Fn->getName().contains("__enzyme_hvp") ||
+              Fn->getName().contains("__enzyme_taylor") ||
+              Fn->getName().contains("__enzyme_sparse_jacobian") ||
+              Fn->getName().contains("__enzyme_sparsity_pattern") ||
               Fn->getName().contains("__enzyme_augmentfwd") ||
-              Fn->getName().contains("__enzyme_reverse")))
+              Fn->getName().contains("__enzyme_reverse") ||
+              Fn->getName().contains("__enzyme_tape_size") ||
+              Fn->getName().contains("__enzyme_tape_buffer_size") ||
+              Fn->getName().contains("__enzyme_tape_serialize") ||
+              Fn->getName().contains("__enzyme_tape_deserialize")))
           continue;
 
         SmallVector<Value *, 16> CallArgs(II->arg_begin(), II->arg_end());
@@ -748,6 +1179,12 @@ public:
       }
 
     std::map<CallInst *, DerivativeMode> toLower;
+    std::set<CallInst *> toLowerHVP;
+    std::set<CallInst *> toLowerTaylor;
+    std::set<CallInst *> toLowerSparse;
+    std::set<CallInst *> toLowerPattern;
+    std::set<CallInst *> toLowerTapeSize;
+    std::set<CallInst *> TapeBufferQueries;
     std::set<CallInst *> InactiveCalls;
   retry:;
     for (BasicBlock &BB : F) {
@@ -925,6 +1362,9 @@ public:
         }
 
         bool enableEnzyme = false;
+        bool hvp = false;
+        bool taylor = false;
+        bool sparse = false;
         DerivativeMode mode;
         if (Fn->getName().contains("__enzyme_autodiff")) {
           enableEnzyme = true;
@@ -938,10 +1378,36 @@ public:
         } else if (Fn->getName().contains("__enzyme_reverse")) {
           enableEnzyme = true;
           mode = DerivativeMode::ReverseModeGradient;
+        } else if (Fn->getName().contains("__enzyme_hvp")) {
+          enableEnzyme = true;
+          hvp = true;
+        } else if (Fn->getName().contains("__enzyme_taylor")) {
+          enableEnzyme = true;
+          taylor = true;
+        } else if (Fn->getName().contains("__enzyme_sparsity_pattern")) {
+          toLowerPattern.insert(CI);
+        } else if (Fn->getName().contains("__enzyme_tape_buffer_size") ||
+                   Fn->getName().contains("__enzyme_tape_serialize") ||
+                   Fn->getName().contains("__enzyme_tape_deserialize")) {
+          TapeBufferQueries.insert(CI);
+        } else if (Fn->getName().contains("__enzyme_tape_size")) {
+          enableEnzyme = true;
+          mode = DerivativeMode::ReverseModePrimal;
+          toLowerTapeSize.insert(CI);
+        } else if (Fn->getName().contains("__enzyme_sparse_jacobian")) {
+          enableEnzyme = true;
+          sparse = true;
         }
 
         if (enableEnzyme) {
-          toLower[CI] = mode;
+          if (hvp)
+            toLowerHVP.insert(CI);
+          else if (taylor)
+            toLowerTaylor.insert(CI);
+          else if (sparse)
+            toLowerSparse.insert(CI);
+          else if (!toLowerTapeSize.count(CI))
+            toLower[CI] = mode;
 
           Value *fn = CI->getArgOperand(0);
           while (auto ci = dyn_cast<CastInst>(fn)) {
@@ -1013,6 +1479,83 @@ public:
         break;
     }
 
+    if (successful)
+      for (auto CI : toLowerHVP) {
+        successful &= HandleHVP(CI, TLI, PostOpt);
+        Changed = true;
+        if (!successful)
+          break;
+      }
+
+    if (successful)
+      for (auto CI : toLowerTaylor) {
+        successful &= HandleTaylor(CI, TLI, PostOpt);
+        Changed = true;
+        if (!successful)
+          break;
+      }
+
+    if (successful)
+      for (auto CI : toLowerSparse) {
+        successful &= HandleSparseJacobian(CI, TLI, PostOpt);
+        Changed = true;
+        if (!successful)
+          break;
+      }
+
+    if (successful)
+      for (auto CI : toLowerPattern) {
+        successful &= HandleSparsityPattern(CI, TLI);
+        Changed = true;
+        if (!successful)
+          break;
+      }
+
+    if (successful)
+      for (auto CI : toLowerTapeSize) {
+        successful &= HandleAutoDiff(CI, TLI, PostOpt,
+                                     DerivativeMode::ReverseModePrimal,
+                                     /*tapeSize*/ true);
+        Changed = true;
+        if (!successful)
+          break;
+      }
+
+    for (auto CI : TapeBufferQueries) {
+      IRBuilder<> B(CI);
+      Value *res;
+      auto name = CI->getCalledFunction()->getName();
+      if (name.contains("__enzyme_tape_buffer_size")) {
+        res = getTapeBufferRequested(B);
+      } else {
+        Function *impl =
+            name.contains("__enzyme_tape_deserialize")
+                ? getOrInsertTapeBufferDeserialize(*F.getParent())
+                : getOrInsertTapeBufferSerialize(*F.getParent());
+        auto FT = impl->getFunctionType();
+        unsigned numParams = FT->getNumParams();
+        if (CI->getNumArgOperands() != numParams) {
+          EmitFailure("IllegalTapeSerialize", CI->getDebugLoc(), CI, name,
+                      " expects ", numParams, " arguments ", *CI);
+          continue;
+        }
+        SmallVector<Value *, 4> args;
+        for (unsigned i = 0; i < FT->getNumParams(); ++i) {
+          Value *arg = CI->getArgOperand(i);
+          if (FT->getParamType(i)->isPointerTy())
+            arg = B.CreatePointerCast(arg, FT->getParamType(i));
+          else
+            arg = B.CreateZExtOrTrunc(arg, FT->getParamType(i));
+          args.push_back(arg);
+        }
+        res = B.CreateCall(impl, args);
+      }
+      if (!CI->getType()->isVoidTy())
+        CI->replaceAllUsesWith(B.CreateZExtOrTrunc(res, CI->getType()));
+      CI->eraseFromParent();
+      Changed = true;
+    }
+
     if (Changed) {
       // TODO consider enabling when attributor does not delete
       // dead internal functions, which invalidates Enzyme's cache
@@ -59,6 +59,7 @@
 #include "FunctionUtils.h"
 #include "GradientUtils.h"
 #include "LibraryFuncs.h"
+#include "SparsityAnalysis.h"
 #include "Utils.h"
 
 using namespace llvm;
@@ -83,6 +84,16 @@ cl::opt<bool> cache_reads_never("enzyme-cache-never", cl::init(false),
 cl::opt<bool> nonmarkedglobals_inactiveloads(
     "enzyme_nonmarkedglobals_inactiveloads", cl::init(true), cl::Hidden,
     cl::desc("Consider loads of nonmarked globals to be inactive"));
+
+cl::opt<bool> EnzymeInlineSubTapes(
+    "enzyme-inline-subtapes", cl::init(false), cl::Hidden,
+    cl::desc("Store the outermost tape of a recursive callee by value in the "
+             "caller's tape rather than in a separate allocation"));
+
+cl::opt<bool> EnzymeStackTape(
+    "enzyme-stack-tape", cl::init(false), cl::Hidden,
+    cl::desc("Allocate the tapes of recursive functions on a thread local "
+             "stack popped by the reverse pass rather than with malloc"));
 }
 
 bool is_load_uncacheable(
@@ -634,6 +645,17 @@ void calculateUnusedValuesInFunction(
   calculateUnusedValues(
       func, unnecessaryValues, unnecessaryInstructions, returnValue,
       [&](const Value *val) {
+        // The Taylor coefficients of an active instruction are computed from
+        // the primal values, the coefficients of degree 0, of the instruction
+        // itself and of its operands
+        if (gutils->TaylorDegree) {
+          if (!gutils->isConstantValue(const_cast<Value *>(val)))
+            return true;
+          for (auto user : val->users())
+            if (auto I = dyn_cast<Instruction>(user))
+              if (!gutils->isConstantInstruction(I))
+                return true;
+        }
         bool ivn = is_value_needed_in_reverse<ValueType::Primal>(
             TR, gutils, val, mode, PrimalSeen, oldUnreachable);
         return ivn;
@@ -1326,13 +1348,26 @@ bool legalCombinedForwardReverse(
   return true;
 }
 
+/// Whether F spawns threads with pthread_create. The adjoint worker of such a
+/// thread runs concurrently with the reverse of F, from the reverse of its
+/// join to that of its create, and accumulates into shadows F may share.
+static bool spawnsThreads(const Function *F) {
+  for (auto &BB : *F)
+    for (auto &I : BB)
+      if (auto CI = dyn_cast<CallInst>(&I))
+        if (auto called = CI->getCalledFunction())
+          if (called->getName() == "pthread_create")
+            return true;
+  return false;
+}
+
 //! return structtype if recursive function
 const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
     Function *todiff, DIFFE_TYPE retType,
     const std::vector<DIFFE_TYPE> &constant_args, TargetLibraryInfo &TLI,
     TypeAnalysis &TA, bool returnUsed, const FnTypeInfo &oldTypeInfo_,
     const std::map<Argument *, bool> _uncacheable_args, bool forceAnonymousTape,
-    bool AtomicAdd, bool PostOpt, bool omp) {
+    bool AtomicAdd, bool PostOpt, bool omp, bool lifoTape) {
   if (returnUsed)
     assert(!todiff->getReturnType()->isEmptyTy() &&
            !todiff->getReturnType()->isVoidTy());
@@ -1368,7 +1403,8 @@ const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
       todiff, retType, constant_args,
       std::map<Argument *, bool>(_uncacheable_args.begin(),
                                  _uncacheable_args.end()),
-      returnUsed, oldTypeInfo, forceAnonymousTape, AtomicAdd, PostOpt, omp);
+      returnUsed, oldTypeInfo, forceAnonymousTape, AtomicAdd, PostOpt, omp,
+      lifoTape);
   auto found = AugmentedCachedFunctions.find(tup);
   if (found != AugmentedCachedFunctions.end()) {
     return found->second;
@@ -1464,7 +1500,7 @@ const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
       /*returnUsed*/ returnUsed, returnMapping);
   if (omp)
     gutils->setupOMPFor();
-  gutils->AtomicAdd = AtomicAdd;
+  gutils->AtomicAdd = AtomicAdd || spawnsThreads(gutils->oldFunc);
   const SmallPtrSet<BasicBlock *, 4> guaranteedUnreachable =
       getGuaranteedUnreachable(gutils->oldFunc);
 
@@ -1546,6 +1582,7 @@ const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
   insert_or_assign(AugmentedCachedFunctions, tup,
                    AugmentedReturn(gutils->newFunc, nullptr, {}, returnMapping,
                                    uncacheable_args_map, can_modref_map));
+  AugmentedCachedFunctions.find(tup)->second.lifoTape = lifoTape;
   AugmentedCachedFinished[tup] = false;
 
   auto getIndex = [&](Instruction *I, CacheType u) -> unsigned {
@@ -1857,22 +1894,45 @@ const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
 
   Value *ret = noReturn ? nullptr : ib.CreateAlloca(RetType);
 
+  // The tapes of a recursive function are released by the reverse pass of
+  // its caller in the opposite order to their creation, so unless they are
+  // handed to code with a different lifetime (such as parallel regions, or
+  // split mode callers which may run reverse passes in any order or thread)
+  // they may be allocated from a stack rather than the heap.
+  auto Arch = llvm::Triple(NewF->getParent()->getTargetTriple()).getArch();
+  bool stackTape = EnzymeStackTape && lifoTape && recursive && !omp &&
+                   !forceAnonymousTape && Arch != Triple::nvptx &&
+                   Arch != Triple::nvptx64 && Arch != Triple::amdgcn;
+
+  CallInst *tapeMalloc = nullptr;
   if (!noTape) {
     Value *tapeMemory;
     if (recursive && !omp) {
       auto i64 = Type::getInt64Ty(NewF->getContext());
-      ConstantInt *size;
-      tapeMemory = CallInst::CreateMalloc(
-          NewF->getEntryBlock().getFirstNonPHI(), i64, tapeType,
-          size = ConstantInt::get(
-              i64, NewF->getParent()->getDataLayout().getTypeAllocSizeInBits(
-                       tapeType) /
-                       8),
-          nullptr, nullptr, "tapemem");
-      CallInst *malloccall = dyn_cast<CallInst>(tapeMemory);
-      if (malloccall == nullptr) {
-        malloccall =
-            cast<CallInst>(cast<Instruction>(tapeMemory)->getOperand(0));
+      ConstantInt *size = ConstantInt::get(
+          i64, NewF->getParent()->getDataLayout().getTypeAllocSizeInBits(
+                   tapeType) /
+                   8);
+      CallInst *malloccall;
+      if (stackTape) {
+        malloccall = ib.CreateCall(
+            getOrInsertTapeStackPush(*NewF->getParent()), {size}, "tapemem");
+        tapeMemory =
+            ib.CreatePointerCast(malloccall, PointerType::getUnqual(tapeType));
+      } else if (EnzymeTapeBuffer) {
+        malloccall = ib.CreateCall(
+            getOrInsertTapeBufferAlloc(*NewF->getParent()), {size}, "tapemem");
+        tapeMemory =
+            ib.CreatePointerCast(malloccall, PointerType::getUnqual(tapeType));
+      } else {
+        tapeMemory = CallInst::CreateMalloc(
+            NewF->getEntryBlock().getFirstNonPHI(), i64, tapeType, size,
+            nullptr, nullptr, "tapemem");
+        malloccall = dyn_cast<CallInst>(tapeMemory);
+        if (malloccall == nullptr) {
+          malloccall =
+              cast<CallInst>(cast<Instruction>(tapeMemory)->getOperand(0));
+        }
       }
       malloccall->addAttribute(AttributeList::ReturnIndex, Attribute::NoAlias);
       malloccall->addAttribute(AttributeList::ReturnIndex, Attribute::NonNull);
@@ -1880,6 +1940,9 @@ const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
                                          size->getLimitedValue());
       malloccall->addDereferenceableOrNullAttr(llvm::AttributeList::ReturnIndex,
                                                size->getLimitedValue());
+      tapeMalloc = malloccall;
+      if (EnzymeTapeProfile && !stackTape)
+        markTapeProfileCall(malloccall, "alloc", "tapemem", nullptr);
       std::vector<Value *> Idxs = {
           ib.getInt32(0),
           ib.getInt32(returnMapping.find(AugmentedStruct::Tape)->second),
@@ -1891,7 +1954,10 @@ const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
         gep = ib.CreateGEP(ret, Idxs, "");
         cast<GetElementPtrInst>(gep)->setIsInBounds(true);
       }
-      ib.CreateStore(malloccall, gep);
+      Value *tapeRef = malloccall;
+      if (EnzymeTapeBuffer && EnzymeRelocatableTape && !stackTape)
+        tapeRef = getTapeBufferOffset(ib, malloccall);
+      ib.CreateStore(tapeRef, gep);
     } else if (omp) {
       j->setName("tape");
       tapeMemory = j;
@@ -2035,6 +2101,74 @@ const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
     PPC.FAM.invalidate(*NewF, PA);
   }
 
+  // A recursive function must heap allocate its tape so that each nested
+  // invocation has its own. The outermost invocation, called from outside of
+  // the recursion, can instead keep its tape on the stack and return it by
+  // value, letting the caller embed it in its own tape.
+  Function *ByValueF = nullptr;
+  if (EnzymeInlineSubTapes && tapeMalloc && !forceAnonymousTape) {
+    std::vector<Type *> ByValueRetTypes = RetTypes;
+    ByValueRetTypes[removeStruct
+                        ? 0
+                        : returnMapping.find(AugmentedStruct::Tape)->second] =
+        tapeType;
+    Type *ByValueRetType =
+        removeStruct ? tapeType
+                     : StructType::get(nf->getContext(), ByValueRetTypes);
+    ByValueF = Function::Create(
+        FunctionType::get(ByValueRetType, NewF->getFunctionType()->params(),
+                          NewF->getFunctionType()->isVarArg()),
+        NewF->getLinkage(), "augmented_outer_" + todiff->getName(),
+        NewF->getParent());
+
+    ValueToValueMapTy BVMap;
+    for (auto i = NewF->arg_begin(), j = ByValueF->arg_begin();
+         i != NewF->arg_end(); ++i, ++j) {
+      BVMap[i] = j;
+      j->setName(i->getName());
+    }
+    SmallVector<ReturnInst *, 4> ByValueReturns;
+#if LLVM_VERSION_MAJOR >= 13
+    CloneFunctionInto(ByValueF, NewF, BVMap,
+                      CloneFunctionChangeType::LocalChangesOnly,
+                      ByValueReturns, "", nullptr);
+#else
+    CloneFunctionInto(ByValueF, NewF, BVMap, NewF->getSubprogram() != nullptr,
+                      ByValueReturns, "", nullptr);
+#endif
+
+    auto clonedMalloc = cast<CallInst>(BVMap[tapeMalloc]);
+    IRBuilder<> eb(ByValueF->getEntryBlock().getFirstNonPHI());
+    auto stackTape = eb.CreateAlloca(tapeType, nullptr, "tapemem");
+    clonedMalloc->replaceAllUsesWith(
+        eb.CreatePointerCast(stackTape, clonedMalloc->getType()));
+    clonedMalloc->eraseFromParent();
+
+    for (auto rim : ByValueReturns) {
+      IRBuilder<> ib(rim);
+      Value *tapeVal = ib.CreateLoad(stackTape);
+      Value *rv = tapeVal;
+      if (!removeStruct) {
+        rv = UndefValue::get(ByValueRetType);
+        for (unsigned idx = 0; idx < ByValueRetTypes.size(); ++idx) {
+          Value *elem =
+              (int)idx == returnMapping.find(AugmentedStruct::Tape)->second
+                  ? tapeVal
+                  : ib.CreateExtractValue(rim->getReturnValue(), {idx});
+          rv = ib.CreateInsertValue(rv, elem, {idx});
+        }
+      }
+      ib.CreateRet(rv);
+      rim->eraseFromParent();
+    }
+
+    if (llvm::verifyFunction(*ByValueF, &llvm::errs())) {
+      llvm::errs() << *NewF << "\n";
+      llvm::errs() << *ByValueF << "\n";
+      report_fatal_error("augmented function failed verification (4)");
+    }
+  }
+
   SmallVector<CallInst *, 4> fnusers;
   for (auto user : AugmentedCachedFunctions.find(tup)->second.fn->users()) {
     fnusers.push_back(cast<CallInst>(user));
@@ -2068,15 +2202,36 @@ const AugmentedReturn &EnzymeLogic::CreateAugmentedPrimal(
       user->setCalledFunction(NewF);
     }
   }
-  auto Arch = llvm::Triple(NewF->getParent()->getTargetTriple()).getArch();
-  if (Arch == Triple::nvptx || Arch == Triple::nvptx64)
+  if (EnzymeTapeProfile) {
+    instrumentTapeProfile(*NewF);
+    if (ByValueF)
+      instrumentTapeProfile(*ByValueF);
+  }
+  if (Arch == Triple::nvptx || Arch == Triple::nvptx64) {
     PPC.ReplaceReallocs(NewF, /*mem2reg*/ true);
-  if (PostOpt)
+    if (ByValueF)
+      PPC.ReplaceReallocs(ByValueF, /*mem2reg*/ true);
+  }
+  if (PostOpt) {
     PPC.optimizeIntermediate(NewF);
+    if (ByValueF)
+      PPC.optimizeIntermediate(ByValueF);
+  }
 
   AugmentedCachedFunctions.find(tup)->second.fn = NewF;
   if (recursive || (omp && !noTape))
     AugmentedCachedFunctions.find(tup)->second.tapeType = tapeType;
+  AugmentedCachedFunctions.find(tup)->second.stackTape = stackTape && !noTape;
+  if (ByValueF) {
+    AugmentedReturn ByValue = AugmentedCachedFunctions.find(tup)->second;
+    ByValue.fn = ByValueF;
+    ByValue.tapeType = nullptr;
+    ByValue.stackTape = false;
+    AugmentedCachedFunctions.find(tup)->second.byValueTape =
+        &insert_or_assign<AugmentedCacheKey, AugmentedReturn>(
+             AugmentedByValueFunctions, tup, std::move(ByValue))
+             ->second;
+  }
   insert_or_assign(AugmentedCachedFinished, tup, true);
 
   {
@@ -2128,7 +2283,8 @@ void createTerminator(DiffeGradientUtils *gutils,
     auto retVal = inst->getOperand(0);
 
     if (gutils->isConstantValue(retVal)) {
-      retargs.push_back(ConstantFP::get(retVal->getType(), 0.0));
+      retargs.push_back(Constant::getNullValue(
+          getTaylorShadowType(retVal->getType(), gutils->TaylorDegree)));
     } else {
       retargs.push_back(gutils->diffe(retVal, nBuilder));
     }
@@ -2156,6 +2312,8 @@ void createInvertedTerminator(TypeResults &TR, DiffeGradientUtils *gutils,
   BasicBlock *BB2 = gutils->reverseBlocks[BB].back();
   assert(BB2);
   IRBuilder<> Builder(BB2);
+  Builder.SetCurrentDebugLocation(
+      gutils->getNewFromOriginal(oBB->getTerminator()->getDebugLoc()));
   Builder.setFastMathFlags(getFast());
 
   std::map<BasicBlock *, std::vector<BasicBlock *>> targetToPreds;
@@ -2212,12 +2370,22 @@ void createInvertedTerminator(TypeResults &TR, DiffeGradientUtils *gutils,
   IRBuilder<> phibuilder(BB2);
   bool setphi = false;
 
+  // Sum reductions whose adjoint is only handed to the initial value once the
+  // reverse loop exits
+  SmallVector<PHINode *, 1> reductions;
+
   // Ensure phi values have their derivatives propagated
   for (auto I = oBB->begin(), E = oBB->end(); I != E; ++I) {
     if (PHINode *orig = dyn_cast<PHINode>(&*I)) {
       if (gutils->isConstantInstruction(orig))
         continue;
 
+      LoopContext rlc;
+      if (gutils->getAdditiveReduction(orig, rlc)) {
+        reductions.push_back(orig);
+        continue;
+      }
+
       size_t size = 1;
       if (orig->getType()->isSized())
         size = (gutils->newFunc->getParent()->getDataLayout().getTypeSizeInBits(
@@ -2455,9 +2623,32 @@ void createInvertedTerminator(TypeResults &TR, DiffeGradientUtils *gutils,
     BB2 = gutils->reverseBlocks[BB].back();
     Builder.SetInsertPoint(BB2);
 
-    Builder.CreateCondBr(
-        phi, gutils->getReverseOrLatchMerge(loopContext.preheader, BB),
-        targetToPreds.begin()->first);
+    BasicBlock *exitTarget =
+        gutils->getReverseOrLatchMerge(loopContext.preheader, BB);
+    if (reductions.size()) {
+      BasicBlock *RB = BasicBlock::Create(BB->getContext(),
+                                          BB2->getName() + "_reduction",
+                                          BB->getParent());
+      RB->moveAfter(BB2);
+      IRBuilder<> RBuilder(RB);
+      RBuilder.setFastMathFlags(getFast());
+      for (auto orig : reductions) {
+        LoopContext rlc;
+        auto update = gutils->getAdditiveReduction(orig, rlc);
+        Value *dif = gutils->diffe(update, RBuilder);
+        auto oval = orig->getIncomingValueForBlock(
+            gutils->getOriginalFromNew(loopContext.preheader));
+        if (!gutils->isConstantValue(oval))
+          gutils->addToDiffe(oval, dif, RBuilder,
+                             orig->getType()->getScalarType());
+        gutils->setDiffe(update, Constant::getNullValue(update->getType()),
+                         RBuilder);
+      }
+      RBuilder.CreateBr(exitTarget);
+      exitTarget = RB;
+    }
+
+    Builder.CreateCondBr(phi, exitTarget, targetToPreds.begin()->first);
 
   } else {
     std::map<BasicBlock *, std::vector<std::pair<BasicBlock *, BasicBlock *>>>
@@ -2520,8 +2711,9 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
     llvm::Type *additionalArg, const FnTypeInfo &oldTypeInfo_,
     const std::map<Argument *, bool> _uncacheable_args,
     const AugmentedReturn *augmenteddata, bool AtomicAdd, bool PostOpt,
-    bool omp) {
+    bool omp, unsigned TaylorDegree) {
 
+  assert(TaylorDegree == 0 || mode == DerivativeMode::ForwardMode);
   assert(mode == DerivativeMode::ReverseModeCombined ||
          mode == DerivativeMode::ReverseModeGradient ||
          mode == DerivativeMode::ForwardMode);
@@ -2558,7 +2750,8 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
       std::make_tuple(todiff, retType, constant_args,
                       std::map<Argument *, bool>(_uncacheable_args.begin(),
                                                  _uncacheable_args.end()),
-                      returnUsed, dretPtr, mode, additionalArg, oldTypeInfo);
+                      returnUsed, dretPtr, mode, additionalArg, oldTypeInfo,
+                      TaylorDegree);
   if (ReverseCachedFunctions.find(tup) != ReverseCachedFunctions.end()) {
     return ReverseCachedFunctions.find(tup)->second;
   }
@@ -2576,7 +2769,8 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
   }
 
   if (!hasconstant && mode != DerivativeMode::ReverseModeCombined &&
-      !returnValue && hasMetadata(todiff, "enzyme_gradient")) {
+      !returnValue && TaylorDegree == 0 &&
+      hasMetadata(todiff, "enzyme_gradient")) {
 
     auto md = todiff->getMetadata("enzyme_gradient");
     if (!isa<MDTuple>(md)) {
@@ -2695,11 +2889,12 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
 
   DiffeGradientUtils *gutils = DiffeGradientUtils::CreateFromClone(
       *this, mode, todiff, TLI, TA, retType, diffeReturnArg, constant_args,
-      retVal, additionalArg);
+      retVal, additionalArg, TaylorDegree);
 
   if (omp)
     gutils->setupOMPFor();
-  gutils->AtomicAdd = AtomicAdd;
+  // Shadow updates racing with an adjoint worker must be atomic as well
+  gutils->AtomicAdd = AtomicAdd || spawnsThreads(gutils->oldFunc);
   insert_or_assign2<ReverseCacheKey, Function *>(ReverseCachedFunctions, tup,
                                                  gutils->newFunc);
 
@@ -2802,6 +2997,9 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
     if (augmenteddata->tapeType &&
         augmenteddata->tapeType != additionalValue->getType()) {
       IRBuilder<> BuilderZ(gutils->inversionAllocs);
+      if (EnzymeTapeBuffer && EnzymeRelocatableTape &&
+          !augmenteddata->stackTape)
+        additionalValue = getTapeBufferPointer(BuilderZ, additionalValue);
       // assert(PointerType::getUnqual(augmenteddata->tapeType) ==
       // additionalValue->getType()); auto tapep = additionalValue;
       auto tapep = BuilderZ.CreatePointerCast(
@@ -2811,10 +3009,21 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
                             MDNode::get(truetape->getContext(), {}));
 
       if (!omp) {
-        CallInst *ci = cast<CallInst>(CallInst::CreateFree(
-            additionalValue, truetape)); //&*BuilderZ.GetInsertPoint()));
-        ci->moveAfter(truetape);
+        CallInst *ci;
+        if (EnzymeTapeBuffer) {
+          ci = BuilderZ.CreateCall(
+              getOrInsertTapeBufferFree(*gutils->newFunc->getParent()),
+              BuilderZ.CreatePointerCast(
+                  additionalValue,
+                  Type::getInt8PtrTy(additionalValue->getContext())));
+        } else {
+          ci = cast<CallInst>(CallInst::CreateFree(
+              additionalValue, truetape)); //&*BuilderZ.GetInsertPoint()));
+          ci->moveAfter(truetape);
+        }
         ci->addAttribute(AttributeList::FirstArgIndex, Attribute::NonNull);
+        if (EnzymeTapeProfile)
+          markTapeProfileCall(ci, "free", "tapemem", nullptr);
       }
       additionalValue = truetape;
     }
@@ -2982,6 +3191,8 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
       auto first = oBB.begin();
       auto last = oBB.empty() ? oBB.end() : std::prev(oBB.end());
       for (auto it = first; it != last; ++it) {
+        if (TaylorDegree)
+          maker.checkTaylorSupport(*it);
         maker.visit(&*it);
       }
 
@@ -3052,6 +3263,9 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
 
   gutils->eraseFictiousPHIs();
 
+  if (EnzymeCombineCaches && mode == DerivativeMode::ReverseModeCombined)
+    gutils->combineCacheAllocations();
+
   BasicBlock *entry = &gutils->newFunc->getEntryBlock();
 
   auto Arch =
@@ -3206,6 +3420,11 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
     report_fatal_error("function failed verification (4)");
   }
 
+  if (EnzymeReverseCycleCounters && mode != DerivativeMode::ForwardMode)
+    gutils->addReverseCycleCounters();
+  if (EnzymeTapeProfile)
+    instrumentTapeProfile(*gutils->newFunc);
+
   {
     PreservedAnalyses PA;
     PPC.FAM.invalidate(*gutils->newFunc, PA);
@@ -3223,9 +3442,280 @@ Function *EnzymeLogic::CreatePrimalAndGradient(
   return nf;
 }
 
+llvm::Function *EnzymeLogic::CreateHessianVectorProduct(
+    llvm::Function *todiff, const std::vector<DIFFE_TYPE> &constant_args,
+    TargetLibraryInfo &TLI, TypeAnalysis &TA, const FnTypeInfo &oldTypeInfo,
+    bool AtomicAdd, bool PostOpt) {
+  assert(todiff->getReturnType()->isFloatingPointTy());
+  HessianVectorCacheKey tup =
+      std::make_tuple(todiff, constant_args, oldTypeInfo, AtomicAdd, PostOpt);
+  auto found = HessianVectorCachedFunctions.find(tup);
+  if (found != HessianVectorCachedFunctions.end())
+    return found->second;
+
+  // The tangent function returns the directional derivative of todiff along
+  // the tangents of its duplicated arguments. It holds no tape, so the
+  // reverse sweep over it differentiates no cache allocation or lookup, and
+  // its augmented forward sweep caches primal and tangent values together.
+  std::map<Argument *, bool> uncacheable_args;
+  for (auto &a : todiff->args())
+    uncacheable_args[&a] = false;
+  Function *tangent = CreatePrimalAndGradient(
+      todiff, DIFFE_TYPE::DUP_ARG, constant_args, TLI, TA,
+      /*returnValue*/ false, /*dretUsed*/ false, DerivativeMode::ForwardMode,
+      /*additionalArg*/ nullptr, oldTypeInfo, uncacheable_args,
+      /*augmented*/ nullptr, AtomicAdd, /*PostOpt*/ true);
+  if (!tangent)
+    return HessianVectorCachedFunctions[tup] = nullptr;
+  assert(tangent->getReturnType() == todiff->getReturnType());
+
+  // The adjoint of a tangent is the Hessian-vector product while the adjoint
+  // of the tangent direction is the gradient.
+  std::vector<DIFFE_TYPE> tangent_args;
+  FnTypeInfo typeInfo(tangent);
+  std::map<Argument *, bool> tangent_uncacheable_args;
+  auto tangentArg = tangent->arg_begin();
+  for (auto &a : todiff->args()) {
+    auto ty = constant_args[a.getArgNo()];
+    assert(ty != DIFFE_TYPE::OUT_DIFF);
+    bool dup = ty == DIFFE_TYPE::DUP_ARG || ty == DIFFE_TYPE::DUP_NONEED;
+    for (int i = 0; i < (dup ? 2 : 1); ++i) {
+      tangent_args.push_back(dup ? DIFFE_TYPE::DUP_ARG : DIFFE_TYPE::CONSTANT);
+      typeInfo.Arguments.insert(
+          std::make_pair(&*tangentArg, oldTypeInfo.Arguments.find(&a)->second));
+      typeInfo.KnownValues.insert(std::make_pair(
+          &*tangentArg, oldTypeInfo.KnownValues.find(&a)->second));
+      tangent_uncacheable_args[&*tangentArg] = false;
+      ++tangentArg;
+    }
+  }
+  assert(tangentArg == tangent->arg_end());
+  typeInfo = TA.analyzeFunction(typeInfo).getAnalyzedTypeInfo();
+
+  Function *hvp = CreatePrimalAndGradient(
+      tangent, DIFFE_TYPE::OUT_DIFF, tangent_args, TLI, TA,
+      /*returnValue*/ false, /*dretUsed*/ false,
+      DerivativeMode::ReverseModeCombined, /*additionalArg*/ nullptr,
+      typeInfo, tangent_uncacheable_args, /*augmented*/ nullptr, AtomicAdd,
+      PostOpt);
+  return HessianVectorCachedFunctions[tup] = hvp;
+}
+
+llvm::Function *EnzymeLogic::CreateSparseJacobian(llvm::Function *todiff,
+                                                  TargetLibraryInfo &TLI,
+                                                  TypeAnalysis &TA,
+                                                  const FnTypeInfo &typeInfo,
+                                                  bool PostOpt) {
+  SparseJacobianCacheKey tup = std::make_tuple(todiff, typeInfo, PostOpt);
+  auto found = SparseJacobianCachedFunctions.find(tup);
+  if (found != SparseJacobianCachedFunctions.end())
+    return found->second;
+
+  auto FT = todiff->getFunctionType();
+  if (!hasSparsitySignature(todiff) || !cast<PointerType>(FT->getParamType(0))
+                                            ->getElementType()
+                                            ->isFloatingPointTy())
+    return nullptr;
+  auto PT = cast<PointerType>(FT->getParamType(0));
+  Type *T = PT->getElementType();
+
+  std::vector<DIFFE_TYPE> constant_args(FT->getNumParams(),
+                                        DIFFE_TYPE::CONSTANT);
+  constant_args[0] = DIFFE_TYPE::DUP_ARG;
+  constant_args[1] = DIFFE_TYPE::DUP_ARG;
+  std::map<Argument *, bool> uncacheable_args;
+  for (auto &a : todiff->args())
+    uncacheable_args[&a] = false;
+  Function *fwd = CreatePrimalAndGradient(
+      todiff, DIFFE_TYPE::CONSTANT, constant_args, TLI, TA,
+      /*returnValue*/ false, /*dretUsed*/ false, DerivativeMode::ForwardMode,
+      /*additionalArg*/ nullptr, typeInfo, uncacheable_args,
+      /*augmented*/ nullptr, /*AtomicAdd*/ false, PostOpt);
+
+  LLVMContext &Ctx = todiff->getContext();
+  Module &M = *todiff->getParent();
+  auto i64 = Type::getInt64Ty(Ctx);
+  auto i64p = PointerType::getUnqual(i64);
+  SmallVector<Type *, 8> params = {i64, i64, i64p, i64p, PT};
+  for (auto P : FT->params())
+    params.push_back(P);
+  auto NFT = FunctionType::get(Type::getVoidTy(Ctx), params, false);
+  Function *NewF =
+      Function::Create(NFT, Function::LinkageTypes::InternalLinkage,
+                       "sparsejacobian_" + todiff->getName(), &M);
+  NewF->addFnAttr(Attribute::NoUnwind);
+
+  auto arg = NewF->arg_begin();
+  Value *n = arg++;
+  n->setName("n");
+  Value *m = arg++;
+  m->setName("m");
+  Value *rowptr = arg++;
+  rowptr->setName("rowptr");
+  Value *colidx = arg++;
+  colidx->setName("colidx");
+  Value *vals = arg++;
+  vals->setName("vals");
+  SmallVector<Value *, 4> fnargs;
+  for (auto &a : todiff->args()) {
+    arg->setName(a.getName());
+    fnargs.push_back(arg++);
+  }
+
+  BasicBlock *entry = BasicBlock::Create(Ctx, "entry", NewF);
+  IRBuilder<> B(entry);
+  auto zero = ConstantInt::get(i64, 0);
+  auto one = ConstantInt::get(i64, 1);
+  auto none = ConstantInt::get(i64, -1);
+  Value *ncolors = B.CreateAlloca(i64, nullptr, "ncolors");
+  B.CreateStore(zero, ncolors);
+  Value *nnz = B.CreateLoad(B.CreateGEP(rowptr, m), "nnz");
+
+  SmallVector<Value *, 6> allocations;
+  auto allocate = [&](Type *ET, Value *count, const Twine &name) {
+    auto ret = B.CreateRetVoid();
+    Instruction *mem = CallInst::CreateMalloc(
+        ret, i64, ET, ConstantExpr::getSizeOf(ET), count, nullptr, name);
+    ret->eraseFromParent();
+    B.SetInsertPoint(entry);
+    allocations.push_back(mem);
+    return mem;
+  };
+  Value *colptr = allocate(i64, B.CreateAdd(n, one), "colptr");
+  Value *rowidx = allocate(i64, nnz, "rowidx");
+  Value *color = allocate(i64, n, "color");
+  Value *forbidden = allocate(i64, n, "forbidden");
+  Value *dx = allocate(T, n, "dx");
+  Value *dy = allocate(T, m, "dy");
+
+  auto load = [&](IRBuilder<> &B, Value *ptr, Value *idx) {
+    return B.CreateLoad(B.CreateGEP(ptr, idx));
+  };
+  auto store = [&](IRBuilder<> &B, Value *val, Value *ptr, Value *idx) {
+    B.CreateStore(val, B.CreateGEP(ptr, idx));
+  };
+  // Run body on every (row, position in colidx) of the pattern
+  auto forEachNonzero = [&](IRBuilder<> &B, const Twine &name,
+                            function_ref<void(IRBuilder<> &, Value *, Value *)>
+                                body) {
+    emitCountedLoop(B, zero, m, name + ".row", [&](IRBuilder<> &B, Value *r) {
+      emitCountedLoop(B, load(B, rowptr, r),
+                      load(B, rowptr, B.CreateAdd(r, one)), name + ".nz",
+                      [&](IRBuilder<> &B, Value *q) { body(B, r, q); });
+    });
+  };
+
+  // Transpose the pattern so that the rows of each column are known. The
+  // forbidden array temporarily holds the next free slot of each column.
+  store(B, zero, colptr, zero);
+  emitCountedLoop(B, zero, n, "init", [&](IRBuilder<> &B, Value *j) {
+    store(B, zero, colptr, B.CreateAdd(j, one));
+    store(B, none, color, j);
+  });
+  forEachNonzero(B, "count", [&](IRBuilder<> &B, Value *r, Value *q) {
+    Value *slot = B.CreateAdd(load(B, colidx, q), one);
+    store(B, B.CreateAdd(load(B, colptr, slot), one), colptr, slot);
+  });
+  emitCountedLoop(B, zero, n, "scan", [&](IRBuilder<> &B, Value *j) {
+    Value *slot = B.CreateAdd(j, one);
+    store(B, B.CreateAdd(load(B, colptr, slot), load(B, colptr, j)), colptr,
+          slot);
+    store(B, load(B, colptr, j), forbidden, j);
+  });
+  forEachNonzero(B, "transpose", [&](IRBuilder<> &B, Value *r, Value *q) {
+    Value *c = load(B, colidx, q);
+    Value *p = load(B, forbidden, c);
+    store(B, r, rowidx, p);
+    store(B, B.CreateAdd(p, one), forbidden, c);
+  });
+  emitCountedLoop(B, zero, n, "reset", [&](IRBuilder<> &B, Value *j) {
+    store(B, none, forbidden, j);
+  });
+
+  // Greedily color the columns such that no two columns sharing a row have
+  // the same color. forbidden[c] == j marks c as taken by a neighbor of j.
+  emitCountedLoop(B, zero, n, "color", [&](IRBuilder<> &B, Value *j) {
+    emitCountedLoop(
+        B, load(B, colptr, j), load(B, colptr, B.CreateAdd(j, one)),
+        "color.col", [&](IRBuilder<> &B, Value *p) {
+          Value *r = load(B, rowidx, p);
+          emitCountedLoop(
+              B, load(B, rowptr, r), load(B, rowptr, B.CreateAdd(r, one)),
+              "color.row", [&](IRBuilder<> &B, Value *q) {
+                Value *ck = load(B, color, load(B, colidx, q));
+                BasicBlock *mark = BasicBlock::Create(Ctx, "mark", NewF);
+                BasicBlock *cont = BasicBlock::Create(Ctx, "cont", NewF);
+                B.CreateCondBr(B.CreateICmpSGE(ck, zero), mark, cont);
+                B.SetInsertPoint(mark);
+                store(B, j, forbidden, ck);
+                B.CreateBr(cont);
+                B.SetInsertPoint(cont);
+              });
+        });
+    BasicBlock *pre = B.GetInsertBlock();
+    BasicBlock *search = BasicBlock::Create(Ctx, "search", NewF);
+    BasicBlock *done = BasicBlock::Create(Ctx, "found", NewF);
+    B.CreateBr(search);
+    B.SetInsertPoint(search);
+    PHINode *c = B.CreatePHI(i64, 2, "c");
+    c->addIncoming(zero, pre);
+    Value *nextc = B.CreateAdd(c, one);
+    c->addIncoming(nextc, search);
+    B.CreateCondBr(B.CreateICmpEQ(load(B, forbidden, c), j), search, done);
+    B.SetInsertPoint(done);
+    store(B, c, color, j);
+    Value *prev = B.CreateLoad(ncolors);
+    B.CreateStore(B.CreateSelect(B.CreateICmpSGT(nextc, prev), nextc, prev),
+                  ncolors);
+  });
+
+  // Seed every column of a color at once and scatter the compressed result
+  // back to the nonzeros of those columns.
+  emitCountedLoop(
+      B, zero, B.CreateLoad(ncolors), "sweep", [&](IRBuilder<> &B, Value *c) {
+        emitCountedLoop(B, zero, n, "seed", [&](IRBuilder<> &B, Value *j) {
+          Value *active = B.CreateICmpEQ(load(B, color, j), c);
+          store(B,
+                B.CreateSelect(active, ConstantFP::get(T, 1.0),
+                               ConstantFP::get(T, 0.0)),
+                dx, j);
+        });
+        emitCountedLoop(B, zero, m, "clear", [&](IRBuilder<> &B, Value *i) {
+          store(B, ConstantFP::get(T, 0.0), dy, i);
+        });
+        SmallVector<Value *, 8> args = {fnargs[0], dx, fnargs[1], dy};
+        for (unsigned i = 2; i < fnargs.size(); ++i)
+          args.push_back(fnargs[i]);
+        B.CreateCall(fwd, args);
+        forEachNonzero(B, "scatter", [&](IRBuilder<> &B, Value *r, Value *q) {
+          Value *active =
+              B.CreateICmpEQ(load(B, color, load(B, colidx, q)), c);
+          store(B, B.CreateSelect(active, load(B, dy, r), load(B, vals, q)),
+                vals, q);
+        });
+      });
+
+  auto ret = B.CreateRetVoid();
+  for (auto mem : allocations)
+    CallInst::CreateFree(mem, ret);
+  return SparseJacobianCachedFunctions[tup] = NewF;
+}
+
+llvm::Function *EnzymeLogic::CreateSparsityPattern(llvm::Function *todiff,
+                                                   TypeAnalysis &TA,
+                                                   const FnTypeInfo &typeInfo) {
+  if (!hasSparsitySignature(todiff))
+    return nullptr;
+  return createSparsityPatternFunction(
+      todiff, computeSparsityPattern(PPC, TA, typeInfo));
+}
+
 void EnzymeLogic::clear() {
   PPC.clear();
   AugmentedCachedFunctions.clear();
   AugmentedCachedFinished.clear();
+  AugmentedByValueFunctions.clear();
   ReverseCachedFunctions.clear();
+  HessianVectorCachedFunctions.clear();
+  SparseJacobianCachedFunctions.clear();
 }
@@ -114,6 +114,19 @@ public:
 
   std::set<size_t> tapeIndiciesToFree;
 
+  //! Variant of a recursive function returning its tape by value, for use
+  //! by callers outside of the recursion
+  const AugmentedReturn *byValueTape = nullptr;
+
+  //! Whether the tape was pushed onto the tape stack, and must be popped by
+  //! the caller after its reverse pass
+  bool stackTape = false;
+
+  //! Whether every caller runs the reverse pass on the same thread as, and
+  //! in the opposite order to, the augmented forward pass, which allows the
+  //! tape stack to be used
+  bool lifoTape = false;
+
   AugmentedReturn(
       llvm::Function *fn, llvm::StructType *tapeType,
       std::map<std::pair<llvm::Instruction *, CacheType>, int> tapeIndices,
@@ -133,9 +146,11 @@ public:
       std::tuple<llvm::Function *, DIFFE_TYPE /*retType*/,
                  std::vector<DIFFE_TYPE> /*constant_args*/,
                  std::map<llvm::Argument *, bool> /*uncacheable_args*/,
-                 bool /*returnUsed*/, const FnTypeInfo, bool, bool, bool, bool>;
+                 bool /*returnUsed*/, const FnTypeInfo, bool, bool, bool, bool,
+                 bool /*lifoTape*/>;
   std::map<AugmentedCacheKey, AugmentedReturn> AugmentedCachedFunctions;
   std::map<AugmentedCacheKey, bool> AugmentedCachedFinished;
+  std::map<AugmentedCacheKey, AugmentedReturn> AugmentedByValueFunctions;
 
   /// Create an augmented forward pass.
   ///  \p todiff is the function to differentiate
@@ -148,21 +163,24 @@ public:
   ///  forceAnonymousTape forces the tape to be an i8* rather than the true tape
   ///  structure \p AtomicAdd is whether to perform all adjoint updates to
   ///  memory in an atomic way \p PostOpt is whether to perform basic
-  ///  optimization of the function after synthesis
+  ///  optimization of the function after synthesis. \p lifoTape is whether
+  ///  the caller runs the reverse pass in the same thread and in the opposite
+  ///  order to this forward pass, as a combined derivative does
   const AugmentedReturn &CreateAugmentedPrimal(
       llvm::Function *todiff, DIFFE_TYPE retType,
       const std::vector<DIFFE_TYPE> &constant_args,
       llvm::TargetLibraryInfo &TLI, TypeAnalysis &TA, bool returnUsed,
       const FnTypeInfo &typeInfo,
       const std::map<llvm::Argument *, bool> _uncacheable_args,
-      bool forceAnonymousTape, bool AtomicAdd, bool PostOpt, bool omp = false);
+      bool forceAnonymousTape, bool AtomicAdd, bool PostOpt, bool omp = false,
+      bool lifoTape = false);
 
   using ReverseCacheKey =
       std::tuple<llvm::Function *, DIFFE_TYPE /*retType*/,
                  std::vector<DIFFE_TYPE> /*constant_args*/,
                  std::map<llvm::Argument *, bool> /*uncacheable_args*/,
                  bool /*retval*/, bool /*dretPtr*/, DerivativeMode,
-                 llvm::Type *, const FnTypeInfo>;
+                 llvm::Type *, const FnTypeInfo, unsigned /*TaylorDegree*/>;
   std::map<ReverseCacheKey, llvm::Function *> ReverseCachedFunctions;
 
   /// Create the derivative function itself.
@@ -178,7 +196,9 @@ public:
   ///  be cached). \p augmented is the data structure created by prior call to
   ///  an augmented forward pass \p AtomicAdd is whether to perform all adjoint
   ///  updates to memory in an atomic way \p PostOpt is whether to perform basic
-  ///  optimization of the function after synthesis
+  ///  optimization of the function after synthesis. \p TaylorDegree, in
+  ///  forward mode, propagates truncated Taylor polynomials of that degree
+  ///  rather than first order derivatives
   llvm::Function *CreatePrimalAndGradient(
       llvm::Function *todiff, DIFFE_TYPE retType,
       const std::vector<DIFFE_TYPE> &constant_args,
@@ -187,7 +207,57 @@ public:
       const FnTypeInfo &typeInfo,
       const std::map<llvm::Argument *, bool> _uncacheable_args,
       const AugmentedReturn *augmented, bool AtomicAdd, bool PostOpt = false,
-      bool omp = false);
+      bool omp = false, unsigned TaylorDegree = 0);
+
+  using HessianVectorCacheKey =
+      std::tuple<llvm::Function *, std::vector<DIFFE_TYPE> /*constant_args*/,
+                 const FnTypeInfo, bool /*AtomicAdd*/, bool /*PostOpt*/>;
+  std::map<HessianVectorCacheKey, llvm::Function *>
+      HessianVectorCachedFunctions;
+
+  /// Create a Hessian-vector product of \p todiff, which returns a floating
+  /// point scalar, by reverse differentiating its tangent function. The
+  /// augmented forward sweep thus carries tangents along with the primal
+  /// values, caching both side by side, and no tape bookkeeping is
+  /// differentiated. The result takes, for each duplicated argument of
+  /// \p todiff, the primal, the accumulator for the Hessian-vector product,
+  /// the tangent direction and the gradient accumulator, followed by the seed
+  /// of the return.
+  ///  \p constant_args is the activity info of the arguments
+  ///  \p typeInfo is the type info information about the calling context
+  llvm::Function *CreateHessianVectorProduct(
+      llvm::Function *todiff, const std::vector<DIFFE_TYPE> &constant_args,
+      llvm::TargetLibraryInfo &TLI, TypeAnalysis &TA,
+      const FnTypeInfo &typeInfo, bool AtomicAdd, bool PostOpt);
+
+  using SparseJacobianCacheKey =
+      std::tuple<llvm::Function *, const FnTypeInfo, bool /*PostOpt*/>;
+  std::map<SparseJacobianCacheKey, llvm::Function *>
+      SparseJacobianCachedFunctions;
+
+  /// Create a function filling the values of the Jacobian of \p todiff, whose
+  /// first argument is the input and second the output array, for a CSR
+  /// sparsity pattern given at runtime. The columns are colored so that one
+  /// forward derivative sweep computes every column of a color at once. The
+  /// result takes the input size, the output size, the CSR row offsets and
+  /// column indices, the array of values to fill and the arguments of
+  /// \p todiff, all arguments but the first two being inactive. Return null
+  /// if \p todiff does not take floating point input and output arrays.
+  ///  \p typeInfo is the type info information about the calling context
+  llvm::Function *CreateSparseJacobian(llvm::Function *todiff,
+                                       llvm::TargetLibraryInfo &TLI,
+                                       TypeAnalysis &TA,
+                                       const FnTypeInfo &typeInfo,
+                                       bool PostOpt);
+
+  /// Create a function filling the CSR description of the statically deduced
+  /// Jacobian sparsity pattern of \p todiff, whose first argument is the
+  /// input and second the output array, see createSparsityPatternFunction.
+  /// Return null if \p todiff does not take these arrays.
+  ///  \p typeInfo is the type info information about the calling context
+  llvm::Function *CreateSparsityPattern(llvm::Function *todiff,
+                                        TypeAnalysis &TA,
+                                        const FnTypeInfo &typeInfo);
 
   void clear();
 };
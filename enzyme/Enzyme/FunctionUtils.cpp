@@ -40,6 +40,8 @@
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/AssumptionCache.h"
 #include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
 #include "llvm/Analysis/GlobalsModRef.h"
 #include "llvm/Analysis/LazyValueInfo.h"
 #include "llvm/Analysis/LoopInfo.h"
@@ -128,6 +130,14 @@ cl::opt<int>
     EnzymeInlineCount("enzyme-inline-count", cl::init(10000), cl::Hidden,
                       cl::desc("Limit of number of functions to inline"));
 
+cl::opt<bool> EnzymeInlineHeuristic(
+    "enzyme-inline-heuristic", cl::init(false), cl::Hidden,
+    cl::desc("Selectively inline calls of autodiff using a cost model"));
+
+cl::opt<int> EnzymeInlineThreshold(
+    "enzyme-inline-threshold", cl::init(100), cl::Hidden,
+    cl::desc("Maximum adjusted callee size for heuristic inlining"));
+
 cl::opt<bool> EnzymeCoalese("enzyme-coalese", cl::init(false), cl::Hidden,
                             cl::desc("Whether to coalese memory allocations"));
 
@@ -599,13 +609,19 @@ void PreProcessCache::ReplaceReallocs(Function *NewF, bool mem2reg) {
   FAM.invalidate(*NewF, PA);
 }
 
-/// Perform recursive inlinining on NewF up to the given limit
-static void ForceRecursiveInlining(Function *NewF, size_t Limit) {
+/// Perform recursive inlinining on NewF up to the given limit, inlining
+/// those calls of known, non-recursive callees that ShouldInline accepts
+static void
+RecursiveInlining(Function *NewF, size_t Limit,
+                  llvm::function_ref<bool(CallInst *)> ShouldInline) {
   std::map<const Function *, RecurType> RecurResults;
+  SmallPtrSet<CallInst *, 4> Rejected;
   for (size_t count = 0; count < Limit; count++) {
     for (auto &BB : *NewF) {
       for (auto &I : BB) {
         if (auto CI = dyn_cast<CallInst>(&I)) {
+          if (Rejected.count(CI))
+            continue;
           if (CI->getCalledFunction() == nullptr)
             continue;
           if (CI->getCalledFunction()->empty())
@@ -623,6 +639,11 @@ static void ForceRecursiveInlining(Function *NewF, size_t Limit) {
             LLVM_DEBUG(llvm::dbgs()
                        << "not inlining recursive "
                        << CI->getCalledFunction()->getName() << "\n");
+            Rejected.insert(CI);
+            continue;
+          }
+          if (!ShouldInline(CI)) {
+            Rejected.insert(CI);
             continue;
           }
           InlineFunctionInfo IFI;
@@ -643,6 +664,51 @@ static void ForceRecursiveInlining(Function *NewF, size_t Limit) {
   }
 }
 
+/// Estimate the benefit-adjusted cost of inlining call CI into its caller.
+/// Starting from the callee size times its number of call sites, each of
+/// which receives a copy of the body, the cost is discounted when the
+/// inlined body could be recomputed in the reverse pass rather than cached
+/// on a separate tape, and when the callee is reached from several call
+/// contexts that would otherwise each get their own augmented and gradient
+/// copies.
+static size_t EstimateInlineCost(CallInst *CI) {
+  Function *Callee = CI->getCalledFunction();
+  Function *NewF = CI->getParent()->getParent();
+
+  size_t Size = 0;
+  for (auto &BB : *Callee)
+    for (auto &I : BB)
+      if (!isa<DbgInfoIntrinsic>(&I))
+        Size++;
+
+  // Calls differing in which arguments are known constants are likely to be
+  // differentiated under distinct FnTypeInfo, each producing a separate
+  // specialization of the callee.
+  size_t CallSites = 0;
+  std::set<std::vector<Value *>> Contexts;
+  for (auto U : Callee->users()) {
+    auto Call = dyn_cast<CallInst>(U);
+    if (!Call || Call->getParent()->getParent() != NewF)
+      continue;
+    CallSites++;
+    std::vector<Value *> Context;
+    for (auto &Arg : Call->args())
+      Context.push_back(isa<Constant>(Arg) ? Arg.get() : nullptr);
+    Contexts.insert(Context);
+  }
+  Size *= std::max((size_t)1, CallSites);
+
+  // Values computed by a callee that does not write memory can be
+  // recomputed once inlined rather than stored on the callee's tape.
+  if (Callee->onlyReadsMemory())
+    Size /= 2;
+
+  if (Contexts.size() > 1)
+    Size /= Contexts.size();
+
+  return Size;
+}
+
 void CanonicalizeLoops(Function *F, FunctionAnalysisManager &FAM) {
 
   DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(*F);
@@ -724,6 +790,8 @@ PreProcessCache::PreProcessCache() {
 
   // Used by GradientUtils
   FAM.registerPass([] { return PostDominatorTreeAnalysis(); });
+  FAM.registerPass([] { return BranchProbabilityAnalysis(); });
+  FAM.registerPass([] { return BlockFrequencyAnalysis(); });
 }
 
 llvm::AAResults &
@@ -781,7 +849,22 @@ Function *PreProcessCache::preprocessForClone(Function *F,
 
   if (EnzymePreopt) {
     if (EnzymeInline) {
-      ForceRecursiveInlining(NewF, /*Limit*/ EnzymeInlineCount);
+      RecursiveInlining(NewF, /*Limit*/ EnzymeInlineCount,
+                        [](CallInst *) { return true; });
+      PreservedAnalyses PA;
+      FAM.invalidate(*NewF, PA);
+    } else if (EnzymeInlineHeuristic) {
+      RecursiveInlining(NewF, /*Limit*/ EnzymeInlineCount,
+                        [](CallInst *CI) {
+                          size_t Cost = EstimateInlineCost(CI);
+                          if (Cost <= (size_t)EnzymeInlineThreshold)
+                            return true;
+                          LLVM_DEBUG(llvm::dbgs()
+                                     << "not inlining "
+                                     << CI->getCalledFunction()->getName()
+                                     << " with cost " << Cost << "\n");
+                          return false;
+                        });
       PreservedAnalyses PA;
       FAM.invalidate(*NewF, PA);
     }
@@ -1386,15 +1469,20 @@ Function *PreProcessCache::CloneFunctionWithReturns(
     const std::vector<DIFFE_TYPE> &constant_args,
     SmallPtrSetImpl<Value *> &constants, SmallPtrSetImpl<Value *> &nonconstant,
     SmallPtrSetImpl<Value *> &returnvals, ReturnType returnValue, Twine name,
-    ValueToValueMapTy *VMapO, bool diffeReturnArg, llvm::Type *additionalArg) {
+    ValueToValueMapTy *VMapO, bool diffeReturnArg, llvm::Type *additionalArg,
+    unsigned TaylorDegree) {
   assert(!F->empty());
   F = preprocessForClone(F, mode);
   std::vector<Type *> RetTypes;
+  // Taylor mode only returns the shadow of the return
+  assert(TaylorDegree == 0 || returnValue == ReturnType::Return ||
+         returnValue == ReturnType::Void);
   if (returnValue == ReturnType::ArgsWithReturn ||
       returnValue == ReturnType::ArgsWithTwoReturns ||
       returnValue == ReturnType::Return ||
       returnValue == ReturnType::TwoReturns)
-    RetTypes.push_back(F->getReturnType());
+    RetTypes.push_back(
+        getTaylorShadowType(F->getReturnType(), TaylorDegree));
   if (returnValue == ReturnType::ArgsWithTwoReturns ||
       returnValue == ReturnType::TwoReturns)
     RetTypes.push_back(F->getReturnType());
@@ -1409,7 +1497,7 @@ Function *PreProcessCache::CloneFunctionWithReturns(
     ArgTypes.push_back(I.getType());
     if (constant_args[argno] == DIFFE_TYPE::DUP_ARG ||
         constant_args[argno] == DIFFE_TYPE::DUP_NONEED) {
-      ArgTypes.push_back(I.getType());
+      ArgTypes.push_back(getTaylorShadowType(I.getType(), TaylorDegree));
     } else if (constant_args[argno] == DIFFE_TYPE::OUT_DIFF) {
       RetTypes.push_back(I.getType());
     }
@@ -68,7 +68,8 @@ public:
                            llvm::SmallPtrSetImpl<llvm::Value *> &returnvals,
                            ReturnType returnValue, llvm::Twine name,
                            llvm::ValueToValueMapTy *VMapO, bool diffeReturnArg,
-                           llvm::Type *additionalArg = nullptr);
+                           llvm::Type *additionalArg = nullptr,
+                           unsigned TaylorDegree = 0);
 
   void ReplaceReallocs(llvm::Function *NewF, bool mem2reg = false);
   void optimizeIntermediate(llvm::Function *F);
@@ -39,6 +39,13 @@
 
 #include "llvm/IR/Constants.h"
 
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#if LLVM_VERSION_MAJOR >= 8
+#include "llvm/Analysis/IVDescriptors.h"
+#else
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#endif
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/Support/AMDGPUMetadata.h"
@@ -86,6 +93,22 @@ llvm::cl::opt<bool>
 llvm::cl::opt<bool>
     EnzymeSpeculatePHIs("enzyme-speculate-phis", cl::init(false), cl::Hidden,
                         cl::desc("Speculatively execute phi computations"));
+llvm::cl::opt<bool> EnzymeReductionAdjoint(
+    "enzyme-reduction-adjoint", cl::init(false), cl::Hidden,
+    cl::desc("Do not carry the adjoint of sum reductions across iterations "
+             "of the reverse loop"));
+llvm::cl::opt<bool> EnzymeInvertRecurrences(
+    "enzyme-invert-recurrences", cl::init(false), cl::Hidden,
+    cl::desc("Reconstruct invertible loop recurrences in the reverse pass "
+             "rather than caching them"));
+llvm::cl::opt<bool> EnzymeInvertFPRecurrences(
+    "enzyme-invert-fp-recurrences", cl::init(false), cl::Hidden,
+    cl::desc("Also invert floating point recurrences whose inverse is "
+             "inexact"));
+llvm::cl::opt<bool> EnzymeReverseCycleCounters(
+    "enzyme-reverse-cycle-counters", cl::init(false), cl::Hidden,
+    cl::desc("Count the cycles spent in the reverse of each source region "
+             "for the reverse profiling runtime library"));
 }
 
 bool isPotentialLastLoopValue(Value *val, const BasicBlock *loc,
@@ -1286,7 +1309,10 @@ Value *GradientUtils::cacheForReverse(IRBuilder<> &BuilderQ, Value *malloc,
       assert(malloc);
       bool isi1 = malloc->getType()->isIntegerTy() &&
                   cast<IntegerType>(malloc->getType())->getBitWidth() == 1;
-      entryBuilder.CreateStore(ret, cache);
+      Value *outer = ret;
+      if (EnzymeRelocatableTape)
+        outer = relocateCachePointer(entryBuilder, ret, /*toOffset*/ false);
+      entryBuilder.CreateStore(outer, cache);
 
       auto v = lookupValueFromCache(/*forwardPass*/ true, BuilderQ, lctx, cache,
                                     isi1);
@@ -1437,9 +1463,12 @@ Value *GradientUtils::cacheForReverse(IRBuilder<> &BuilderQ, Value *malloc,
             if (auto li = dyn_cast<LoadInst>(u)) {
               IRBuilder<> lb(li);
               // llvm::errs() << "fixing li: " << *li << "\n";
-              auto replacewith =
+              Value *replacewith =
                   (idx < 0) ? tape
                             : lb.CreateExtractValue(tape, {(unsigned)idx});
+              if (EnzymeRelocatableTape)
+                replacewith = relocateCachePointer(lb, replacewith,
+                                                   /*toOffset*/ false);
               // llvm::errs() << "fixing with rw: " << *replacewith << "\n";
               li->replaceAllUsesWith(replacewith);
               erase(li);
@@ -1551,6 +1580,11 @@ Value *GradientUtils::cacheForReverse(IRBuilder<> &BuilderQ, Value *malloc,
       }
       assert(innerType == malloc->getType());
     }
+    // The tape refers to the cache by its offset in the tape buffer
+    if (EnzymeRelocatableTape) {
+      IRBuilder<> tb(cast<Instruction>(toadd)->getNextNode());
+      toadd = relocateCachePointer(tb, toadd, /*toOffset*/ true);
+    }
     addedTapeVals.push_back(toadd);
     return malloc;
   }
@@ -1559,6 +1593,230 @@ Value *GradientUtils::cacheForReverse(IRBuilder<> &BuilderQ, Value *malloc,
   assert(false);
 }
 
+BinaryOperator *GradientUtils::getAdditiveReduction(PHINode *orig,
+                                                    LoopContext &lc) {
+  if (!EnzymeReductionAdjoint || isConstantValue(orig))
+    return nullptr;
+  Loop *L = OrigLI.getLoopFor(orig->getParent());
+  if (!L || L->getHeader() != orig->getParent())
+    return nullptr;
+  if (!getContext(getNewFromOriginal(orig->getParent()), lc) ||
+      lc.exitBlocks.size() != 1)
+    return nullptr;
+
+  RecurrenceDescriptor RD;
+  if (!RecurrenceDescriptor::isReductionPHI(orig, L, RD))
+    return nullptr;
+#if LLVM_VERSION_MAJOR >= 12
+  if (RD.getRecurrenceKind() != RecurKind::FAdd)
+    return nullptr;
+#else
+  if (RD.getRecurrenceKind() != RecurrenceDescriptor::RK_FloatAdd)
+    return nullptr;
+#endif
+
+  // Only a single update s + x, x + s or s - x on every backedge is handled
+  SmallVector<BasicBlock *, 1> Latches;
+  L->getLoopLatches(Latches);
+  auto update =
+      dyn_cast<BinaryOperator>(orig->getIncomingValueForBlock(Latches[0]));
+  if (!update || isConstantValue(update) ||
+      update->getOperand(0) == update->getOperand(1))
+    return nullptr;
+  for (auto Latch : Latches)
+    if (orig->getIncomingValueForBlock(Latch) != update)
+      return nullptr;
+  if (update->getOpcode() == Instruction::FAdd) {
+    if (update->getOperand(0) != orig && update->getOperand(1) != orig)
+      return nullptr;
+  } else if (update->getOpcode() != Instruction::FSub ||
+             update->getOperand(0) != orig)
+    return nullptr;
+
+  for (auto U : orig->users()) {
+    if (U == update)
+      continue;
+    if (!isConstantInstruction(cast<Instruction>(U)) || isa<ReturnInst>(U))
+      return nullptr;
+  }
+  return update;
+}
+
+Instruction *GradientUtils::getInvertibleUpdate(const PHINode *orig) const {
+  if (!EnzymeInvertRecurrences)
+    return nullptr;
+  Loop *L = OrigLI.getLoopFor(orig->getParent());
+  if (!L || L->getHeader() != orig->getParent())
+    return nullptr;
+
+  // The final update must be the last one, such that every prior value can
+  // be reconstructed from the value at the single exit
+  BasicBlock *latch = L->getLoopLatch();
+  SmallVector<BasicBlock *, 1> exits;
+  L->getExitBlocks(exits);
+  if (!latch || L->getExitingBlock() != latch || exits.size() != 1)
+    return nullptr;
+
+  auto invariant = [&](Value *V) {
+    if (isa<Constant>(V) || isa<Argument>(V))
+      return true;
+    if (auto I = dyn_cast<Instruction>(V))
+      return !L->contains(I->getParent());
+    return false;
+  };
+
+  auto update = dyn_cast<Instruction>(orig->getIncomingValueForBlock(latch));
+  if (!update || OrigLI.getLoopFor(update->getParent()) != L)
+    return nullptr;
+
+#if LLVM_VERSION_MAJOR >= 10
+  if (update->getOpcode() == Instruction::FNeg)
+    return update->getOperand(0) == orig ? update : nullptr;
+#endif
+
+  auto BO = dyn_cast<BinaryOperator>(update);
+  if (!BO)
+    return nullptr;
+  Value *op0 = BO->getOperand(0);
+  Value *op1 = BO->getOperand(1);
+  switch (BO->getOpcode()) {
+  case Instruction::Xor:
+    if ((op0 == orig && invariant(op1)) || (op1 == orig && invariant(op0)))
+      return BO;
+    return nullptr;
+  case Instruction::Sub:
+    // Integer add and subtract of invariants are induction variables and
+    // already recomputed, only negation is considered here
+    if (op1 == orig && isa<Constant>(op0) && cast<Constant>(op0)->isNullValue())
+      return BO;
+    return nullptr;
+  case Instruction::FSub:
+    if (op1 == orig)
+      if (auto C = dyn_cast<ConstantFP>(op0))
+        if (C->isZero() && C->isNegative())
+          return BO;
+    if (EnzymeInvertFPRecurrences && op0 == orig && invariant(op1))
+      return BO;
+    return nullptr;
+  case Instruction::FAdd:
+    if (EnzymeInvertFPRecurrences &&
+        ((op0 == orig && invariant(op1)) || (op1 == orig && invariant(op0))))
+      return BO;
+    return nullptr;
+  case Instruction::FMul:
+  case Instruction::FDiv: {
+    if (!EnzymeInvertFPRecurrences)
+      return nullptr;
+    // Scaling is only undone by a nonzero finite factor known statically
+    Value *factor = nullptr;
+    if (op0 == orig)
+      factor = op1;
+    else if (op1 == orig && BO->getOpcode() == Instruction::FMul)
+      factor = op0;
+    auto C = dyn_cast_or_null<ConstantFP>(factor);
+    if (C && !C->isZero() && C->getValueAPF().isFinite())
+      return BO;
+    return nullptr;
+  }
+  default:
+    return nullptr;
+  }
+}
+
+bool GradientUtils::canInvertRecurrence(const PHINode *orig,
+                                        IRBuilder<> *BuilderM) const {
+  if (mode != DerivativeMode::ReverseModeCombined)
+    return false;
+  auto update = getInvertibleUpdate(orig);
+  if (!update)
+    return false;
+  Loop *L = OrigLI.getLoopFor(orig->getParent());
+
+  // Without a lookup location every use must be reversed within the loop
+  if (!BuilderM) {
+    for (const Value *V : {(const Value *)orig, (const Value *)update})
+      for (auto U : V->users())
+        if (auto I = dyn_cast<Instruction>(U))
+          if (!L->contains(I->getParent()))
+            return false;
+    return true;
+  }
+
+  BasicBlock *BB = BuilderM->GetInsertBlock();
+  for (auto origBB : L->blocks()) {
+    auto found = reverseBlocks.find(getNewFromOriginal(origBB));
+    if (found != reverseBlocks.end() &&
+        std::find(found->second.begin(), found->second.end(), BB) !=
+            found->second.end())
+      return true;
+  }
+  return false;
+}
+
+Value *GradientUtils::lookupInvertedRecurrence(PHINode *phi, bool update) {
+  auto found = invertedRecurrences.find(phi);
+  if (found == invertedRecurrences.end()) {
+    BasicBlock *latch = LI.getLoopFor(phi->getParent())->getLoopLatch();
+    auto U = cast<Instruction>(phi->getIncomingValueForBlock(latch));
+    LoopContext lc;
+    getContext(phi->getParent(), lc);
+    assert(lc.exitBlocks.size() == 1);
+
+    IRBuilder<> allocaBuilder(inversionAllocs);
+    AllocaInst *slot = allocaBuilder.CreateAlloca(phi->getType(), nullptr,
+                                                  phi->getName() + "'inv");
+
+    // Enter the reverse loop with the value of the last update
+    IRBuilder<> EB(*lc.exitBlocks.begin());
+    getReverseBuilder(EB, /*original=*/false);
+    EB.CreateStore(lookupM(U, EB), slot);
+
+    // and undo one update at the start of every reverse iteration.
+    BasicBlock *RB = reverseBlocks[latch].front();
+    IRBuilder<> RBuilder(RB, RB->getFirstInsertionPt());
+    Value *Ur = RBuilder.CreateLoad(slot);
+    Value *prev = nullptr;
+#if LLVM_VERSION_MAJOR >= 10
+    if (U->getOpcode() == Instruction::FNeg)
+      prev = RBuilder.CreateFNeg(Ur);
+#endif
+    if (!prev) {
+      Value *op0 = U->getOperand(0);
+      Value *op1 = U->getOperand(1);
+      Value *c = op0 == phi ? op1 : op0;
+      bool neg = op1 == phi && (U->getOpcode() == Instruction::Sub ||
+                                U->getOpcode() == Instruction::FSub);
+      if (!neg)
+        c = lookupM(c, RBuilder);
+      switch (U->getOpcode()) {
+      case Instruction::Xor:
+        prev = RBuilder.CreateXor(Ur, c);
+        break;
+      case Instruction::Sub:
+        prev = RBuilder.CreateNeg(Ur);
+        break;
+      case Instruction::FSub:
+        prev = neg ? RBuilder.CreateFNeg(Ur) : RBuilder.CreateFAdd(Ur, c);
+        break;
+      case Instruction::FAdd:
+        prev = RBuilder.CreateFSub(Ur, c);
+        break;
+      case Instruction::FMul:
+        prev = RBuilder.CreateFDiv(Ur, c);
+        break;
+      case Instruction::FDiv:
+        prev = RBuilder.CreateFMul(Ur, c);
+        break;
+      default:
+        llvm_unreachable("unknown invertible recurrence");
+      }
+    }
+    RBuilder.CreateStore(prev, slot);
+    found = invertedRecurrences.emplace(phi, std::make_pair(prev, Ur)).first;
+  }
+  return update ? found->second.second : found->second.first;
+}
+
 /// Given an edge from BB to branchingBlock get the corresponding block to
 /// branch to in the reverse pass
 BasicBlock *GradientUtils::getReverseOrLatchMerge(BasicBlock *BB,
@@ -1683,6 +1941,8 @@ bool GradientUtils::legalRecompute(const Value *val,
     auto parent = phi->getParent();
     if (parent->getParent() == newFunc) {
       if (LI.isLoopHeader(parent)) {
+        if (auto orig = dyn_cast_or_null<PHINode>(isOriginal(phi)))
+          return canInvertRecurrence(orig, BuilderM);
         return false;
       }
       for (auto &val : phi->incoming_values()) {
@@ -1692,7 +1952,7 @@ bool GradientUtils::legalRecompute(const Value *val,
       return true;
     } else if (parent->getParent() == oldFunc) {
       if (OrigLI.isLoopHeader(parent)) {
-        return false;
+        return canInvertRecurrence(phi, BuilderM);
       }
       for (auto &val : phi->incoming_values()) {
         if (isPotentialLastLoopValue(val, parent, OrigLI))
@@ -2111,8 +2371,9 @@ DiffeGradientUtils *DiffeGradientUtils::CreateFromClone(
     EnzymeLogic &Logic, DerivativeMode mode, Function *todiff,
     TargetLibraryInfo &TLI, TypeAnalysis &TA, DIFFE_TYPE retType,
     bool diffeReturnArg, const std::vector<DIFFE_TYPE> &constant_args,
-    ReturnType returnValue, Type *additionalArg) {
+    ReturnType returnValue, Type *additionalArg, unsigned TaylorDegree) {
   assert(!todiff->empty());
+  assert(TaylorDegree == 0 || mode == DerivativeMode::ForwardMode);
   assert(mode == DerivativeMode::ReverseModeGradient ||
          mode == DerivativeMode::ReverseModeCombined ||
          mode == DerivativeMode::ForwardMode);
@@ -2127,13 +2388,16 @@ DiffeGradientUtils *DiffeGradientUtils::CreateFromClone(
 
   auto newFunc = Logic.PPC.CloneFunctionWithReturns(
       mode, todiff, invertedPointers, constant_args, constant_values,
-      nonconstant_values, returnvals, returnValue, "diffe" + todiff->getName(),
+      nonconstant_values, returnvals, returnValue,
+      (TaylorDegree ? "taylor" + std::to_string(TaylorDegree) : "diffe") +
+          todiff->getName(),
       &originalToNew,
-      /*diffeReturnArg*/ diffeReturnArg, additionalArg);
+      /*diffeReturnArg*/ diffeReturnArg, additionalArg, TaylorDegree);
   auto res = new DiffeGradientUtils(
       Logic, newFunc, todiff, TLI, TA, invertedPointers, constant_values,
       nonconstant_values, /*ActiveValues*/ retType != DIFFE_TYPE::CONSTANT,
       originalToNew, mode);
+  res->TaylorDegree = TaylorDegree;
   return res;
 }
 
@@ -2942,6 +3206,23 @@ Value *GradientUtils::lookupM(Value *val, IRBuilder<> &BuilderM,
     return available[inst];
   }
 
+  // Invertible recurrences are reconstructed within their reverse loop
+  if (EnzymeInvertRecurrences && !isOriginalBlock(*BuilderM.GetInsertBlock())) {
+    PHINode *phi = dyn_cast<PHINode>(inst);
+    bool update = false;
+    if (!phi)
+      if (Loop *L = LI.getLoopFor(inst->getParent()))
+        if (BasicBlock *latch = L->getLoopLatch())
+          for (PHINode &PN : L->getHeader()->phis())
+            if (PN.getIncomingValueForBlock(latch) == inst) {
+              phi = &PN;
+              update = true;
+            }
+    auto orig = phi ? dyn_cast_or_null<PHINode>(isOriginal(phi)) : nullptr;
+    if (orig && canInvertRecurrence(orig, &BuilderM))
+      return lookupInvertedRecurrence(phi, update);
+  }
+
   // If requesting loop bound and not available from index per above
   // we must be requesting the total size. Rather than generating
   // a new lcssa variable, use the existing loop exact bound var
@@ -4250,6 +4531,18 @@ nofast:;
   return;
 }
 
+/// Return whether the function carries profile data, either as an entry
+/// count or as branch weights
+static bool hasProfileData(const Function &F) {
+  if (F.hasProfileData())
+    return true;
+  for (auto &BB : F)
+    if (auto TI = BB.getTerminator())
+      if (TI->getMetadata(LLVMContext::MD_prof))
+        return true;
+  return false;
+}
+
 void GradientUtils::computeMinCache(
     TypeResults &TR,
     const SmallPtrSetImpl<BasicBlock *> &guaranteedUnreachable) {
@@ -4320,6 +4613,10 @@ void GradientUtils::computeMinCache(
                 LoopAvail[L].insert(I);
             }
           }
+          if (canInvertRecurrence(PN, /*BuilderM*/ nullptr)) {
+            LoopAvail[L].insert(PN);
+            LoopAvail[L].insert(getInvertibleUpdate(PN));
+          }
         } else if (auto CI = dyn_cast<CallInst>(&I)) {
           Function *F = CI->getCalledFunction();
 
@@ -4413,9 +4710,37 @@ void GradientUtils::computeMinCache(
       }
     }
 
+    // When profile data is available, weigh the cost of caching each value by
+    // how often it is computed. A cache holds a slot for every iteration of
+    // the enclosing loops whether or not the value's block executes, whereas
+    // recomputing only costs work when it does. Values in hot blocks are
+    // thus cheap to cache relative to their recomputation, and those in cold
+    // blocks expensive.
+    std::map<Value *, uint64_t> Costs;
+    if (EnzymeProfileGuidedCache && hasProfileData(*oldFunc)) {
+      auto &BFI = Logic.PPC.FAM.getResult<BlockFrequencyAnalysis>(*oldFunc);
+      auto &DL = oldFunc->getParent()->getDataLayout();
+      double entry = std::max<uint64_t>(BFI.getEntryFreq(), 1);
+      for (auto V : Intermediates) {
+        auto I = dyn_cast<Instruction>(V);
+        if (!I)
+          continue;
+        auto BB = I->getParent();
+        double freq =
+            std::max<uint64_t>(BFI.getBlockFreq(BB).getFrequency(), 1);
+        double scope = entry;
+        if (auto L = OrigLI.getLoopFor(BB))
+          scope = std::max<uint64_t>(
+              BFI.getBlockFreq(L->getHeader()).getFrequency(), 1);
+        double bytes = (DL.getTypeSizeInBits(V->getType()) + 7) / 8;
+        double cost = bytes * (scope / entry) * (scope / freq);
+        Costs[V] = (uint64_t)std::min(std::max(cost, 1.0), 1e12);
+      }
+    }
+
     SmallPtrSet<Value *, 5> MinReq;
     minCut(oldFunc->getParent()->getDataLayout(), OrigLI, Recomputes,
-           Intermediates, Required, MinReq);
+           Intermediates, Required, MinReq, Costs.size() ? &Costs : nullptr);
     SmallPtrSet<Value *, 5> NeedGraph;
     for (Value *V : MinReq)
       NeedGraph.insert(V);
@@ -4442,3 +4767,100 @@ void GradientUtils::computeMinCache(
     }
   }
 }
+
+void GradientUtils::addReverseCycleCounters() {
+  Module &M = *newFunc->getParent();
+  LLVMContext &C = M.getContext();
+  auto i32 = Type::getInt32Ty(C);
+  auto i64 = Type::getInt64Ty(C);
+  auto i8p = Type::getInt8PtrTy(C);
+
+  auto str = [&](StringRef S) -> Constant * {
+    auto init = ConstantDataArray::getString(C, S);
+    auto GV = new GlobalVariable(M, init->getType(), /*isConstant*/ true,
+                                 GlobalVariable::PrivateLinkage, init,
+                                 "enzyme_region_str");
+    GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    return ConstantExpr::getPointerCast(GV, i8p);
+  };
+
+  SmallPtrSet<BasicBlock *, 16> live;
+  for (auto &BB : *newFunc)
+    live.insert(&BB);
+
+  // The runtime library describes each region as
+  // { function, block, file, line, cycles, executions }
+  StructType *regionTy = StructType::get(i8p, i8p, i8p, i32, i64, i64);
+  std::vector<Constant *> regions;
+  std::vector<std::pair<BasicBlock *, BasicBlock *>> bounds;
+  for (BasicBlock *BB : originalBlocks) {
+    auto found = reverseBlocks.find(BB);
+    if (!live.count(BB) || found == reverseBlocks.end() ||
+        found->second.empty())
+      continue;
+    BasicBlock *front = found->second.front();
+    BasicBlock *back = found->second.back();
+    if (!live.count(front) || !live.count(back) || !back->getTerminator())
+      continue;
+
+    StringRef file = "";
+    unsigned line = 0;
+    for (auto &I : *BB)
+      if (auto loc = I.getDebugLoc()) {
+        file = loc->getFilename();
+        line = loc.getLine();
+        break;
+      }
+    Constant *fields[] = {str(newFunc->getName()), str(front->getName()),
+                          str(file),
+                          ConstantInt::get(i32, line),
+                          ConstantInt::get(i64, 0),
+                          ConstantInt::get(i64, 0)};
+    regions.push_back(ConstantStruct::get(regionTy, fields));
+    bounds.emplace_back(front, back);
+  }
+  if (regions.empty())
+    return;
+
+  ArrayType *arrayTy = ArrayType::get(regionTy, regions.size());
+  auto GV = new GlobalVariable(M, arrayTy, /*isConstant*/ false,
+                               GlobalVariable::InternalLinkage,
+                               ConstantArray::get(arrayTy, regions),
+                               "enzyme_reverse_regions");
+
+  Function *cycles = Intrinsic::getDeclaration(&M, Intrinsic::readcyclecounter);
+  for (unsigned i = 0; i < bounds.size(); ++i) {
+    IRBuilder<> B(&*bounds[i].first->getFirstInsertionPt());
+    Value *start = B.CreateCall(cycles, ArrayRef<Value *>(), "cyclestart");
+
+    B.SetInsertPoint(bounds[i].second->getTerminator());
+    Value *elapsed =
+        B.CreateSub(B.CreateCall(cycles, ArrayRef<Value *>()), start);
+    Value *counters[2] = {elapsed, ConstantInt::get(i64, 1)};
+    for (unsigned field = 0; field < 2; ++field) {
+      Constant *idxs[] = {ConstantInt::get(i32, 0), ConstantInt::get(i32, i),
+                          ConstantInt::get(i32, 4 + field)};
+      Constant *ptr = ConstantExpr::getInBoundsGetElementPtr(arrayTy, GV, idxs);
+#if LLVM_VERSION_MAJOR >= 13
+      B.CreateAtomicRMW(AtomicRMWInst::Add, ptr, counters[field], Align(8),
+                        AtomicOrdering::Monotonic, SyncScope::System);
+#else
+      B.CreateAtomicRMW(AtomicRMWInst::Add, ptr, counters[field],
+                        AtomicOrdering::Monotonic, SyncScope::System);
+#endif
+    }
+  }
+
+  // Register the regions once, before main runs
+  auto registerF = M.getOrInsertFunction("__enzyme_reverse_profile_register",
+                                         Type::getVoidTy(C), i8p, i64);
+  Function *init = Function::Create(
+      FunctionType::get(Type::getVoidTy(C), {}, false),
+      GlobalValue::InternalLinkage,
+      "__enzyme_reverse_profile_init_" + newFunc->getName(), &M);
+  IRBuilder<> B(BasicBlock::Create(C, "entry", init));
+  B.CreateCall(registerF, {ConstantExpr::getPointerCast(GV, i8p),
+                           ConstantInt::get(i64, regions.size())});
+  B.CreateRetVoid();
+  appendToGlobalCtors(M, init, 65535);
+}
@@ -90,6 +90,10 @@ extern std::map<
 
 extern "C" {
 extern llvm::cl::opt<bool> EnzymeInactiveDynamic;
+extern llvm::cl::opt<bool> EnzymeReductionAdjoint;
+extern llvm::cl::opt<bool> EnzymeInvertRecurrences;
+extern llvm::cl::opt<bool> EnzymeInvertFPRecurrences;
+extern llvm::cl::opt<bool> EnzymeReverseCycleCounters;
 }
 
 enum class AugmentedStruct;
@@ -98,6 +102,9 @@ public:
   EnzymeLogic &Logic;
   bool AtomicAdd;
   DerivativeMode mode;
+  /// Degree of the Taylor polynomials propagated in forward mode, or 0 for
+  /// first order duals
+  unsigned TaylorDegree = 0;
   llvm::Function *oldFunc;
   ValueToValueMapTy invertedPointers;
   DominatorTree &OrigDT;
@@ -264,6 +271,35 @@ public:
     return red;
   }
 
+  /// If orig is the header phi of a floating point sum reduction
+  ///   s = phi [init, preheader], [s + x, latch]
+  /// whose update is its only active use, return that update and set lc to
+  /// the context of the loop. The adjoint of every partial sum then equals
+  /// the adjoint of the final sum and is not carried across iterations of
+  /// the reverse loop.
+  BinaryOperator *getAdditiveReduction(PHINode *orig, LoopContext &lc);
+
+  /// If the loop header phi orig is overwritten on every iteration by an
+  /// update that can be undone, namely x ^ c, -x and, for floating point,
+  /// x + c, x - c, x * c and x / c with c loop invariant, return that update.
+  /// Floating point inverses other than negation are inexact and only used
+  /// if EnzymeInvertFPRecurrences is set.
+  Instruction *getInvertibleUpdate(const PHINode *orig) const;
+
+  /// Whether the invertible recurrence orig may be reconstructed for a
+  /// lookup at BuilderM, or for every use in the reverse pass if BuilderM is
+  /// null. Only the reverse loop of a combined derivative reconstructs it.
+  bool canInvertRecurrence(const PHINode *orig, IRBuilder<> *BuilderM) const;
+
+  /// Reverse pass values of invertible recurrences, mapping the header phi
+  /// to its value and the value of its update in the current iteration.
+  std::map<PHINode *, std::pair<Value *, Value *>> invertedRecurrences;
+
+  /// Value of the invertible recurrence phi, or of its update if update is
+  /// set, in the current iteration of the reverse loop, reconstructed from
+  /// the final value rather than cached.
+  Value *lookupInvertedRecurrence(PHINode *phi, bool update);
+
   bool assumeDynamicLoopOfSizeOne(llvm::Loop *L) const override {
     if (!EnzymeInactiveDynamic)
       return false;
@@ -623,6 +659,9 @@ public:
                                        Attribute::NoAlias);
     cast<CallInst>(anti)->addAttribute(AttributeList::ReturnIndex,
                                        Attribute::NonNull);
+    if (EnzymeTapeProfile)
+      markTapeProfileCall(cast<CallInst>(anti), "alloc", anti->getName(),
+                          nullptr);
 
     unsigned derefBytes = 0;
     if (orig->getCalledFunction()->getName() == "malloc" ||
@@ -987,7 +1026,14 @@ public:
         if (!TR.query(inst).Inner0().isPossiblePointer())
           continue;
 
-        if (isa<LoadInst>(inst)) {
+        if (isa<LoadInst>(inst) ||
+            (isa<IntrinsicInst>(inst) &&
+             (cast<IntrinsicInst>(inst)->getIntrinsicID() ==
+                  Intrinsic::masked_load ||
+              cast<IntrinsicInst>(inst)->getIntrinsicID() ==
+                  Intrinsic::masked_gather ||
+              cast<IntrinsicInst>(inst)->getIntrinsicID() ==
+                  Intrinsic::masked_expandload))) {
           IRBuilder<> BuilderZ(inst);
           getForwardBuilder(BuilderZ);
 
@@ -1233,6 +1279,11 @@ public:
     Builder2.setFastMathFlags(getFast());
   }
 
+  /// Count the cycles spent in, and the executions of, the reverse of every
+  /// original block, registering the counters with the reverse profiling
+  /// runtime library
+  void addReverseCycleCounters();
+
   void getForwardBuilder(IRBuilder<> &Builder2) {
     Instruction *insert = &*Builder2.GetInsertPoint();
     Instruction *nInsert = getNewFromOriginal(insert);
@@ -1261,11 +1312,24 @@ class DiffeGradientUtils : public GradientUtils {
     if (mode == DerivativeMode::ForwardMode) {
       return;
     }
+    unsigned index = 0;
     for (BasicBlock *BB : originalBlocks) {
+      ++index;
       if (BB == inversionAllocs)
         continue;
-      reverseBlocks[BB].push_back(BasicBlock::Create(
-          BB->getContext(), "invert" + BB->getName(), newFunc));
+      // Blocks of code compiled without value names are named after their
+      // position and source line, such that their reverse remains recognizable
+      std::string name = BB->getName().str();
+      if (name.empty()) {
+        name = "bb" + std::to_string(index);
+        for (auto &I : *BB)
+          if (I.getDebugLoc()) {
+            name += ".L" + std::to_string(I.getDebugLoc().getLine());
+            break;
+          }
+      }
+      reverseBlocks[BB].push_back(
+          BasicBlock::Create(BB->getContext(), "invert" + name, newFunc));
     }
     assert(reverseBlocks.size() != 0);
   }
@@ -1277,7 +1341,8 @@ public:
                   TargetLibraryInfo &TLI, TypeAnalysis &TA, DIFFE_TYPE retType,
                   bool diffeReturnArg,
                   const std::vector<DIFFE_TYPE> &constant_args,
-                  ReturnType returnValue, Type *additionalArg);
+                  ReturnType returnValue, Type *additionalArg,
+                  unsigned TaylorDegree = 0);
 
 private:
   Value *getDifferential(Value *val) {
@@ -1290,13 +1355,14 @@ private:
     if (differentials.find(val) == differentials.end()) {
       IRBuilder<> entryBuilder(inversionAllocs);
       entryBuilder.setFastMathFlags(getFast());
-      differentials[val] = entryBuilder.CreateAlloca(val->getType(), nullptr,
+      Type *shadowType = getTaylorShadowType(val->getType(), TaylorDegree);
+      differentials[val] = entryBuilder.CreateAlloca(shadowType, nullptr,
                                                      val->getName() + "'de");
-      entryBuilder.CreateStore(Constant::getNullValue(val->getType()),
+      entryBuilder.CreateStore(Constant::getNullValue(shadowType),
                                differentials[val]);
     }
     assert(cast<PointerType>(differentials[val]->getType())->getElementType() ==
-           val->getType());
+           getTaylorShadowType(val->getType(), TaylorDegree));
     return differentials[val];
   }
 
@@ -1595,13 +1661,16 @@ public:
       }
     }
 
+    // Caches nested within another are held as their offset
+    bool relocated = EnzymeRelocatableTape && storeInto != alloc;
     auto forfree = cast<LoadInst>(tbuild.CreateLoad(
         unwrapM(storeInto, tbuild, antimap, UnwrapMode::LegalFullUnwrap)));
     forfree->setMetadata(LLVMContext::MD_invariant_group, InvariantMD);
-    forfree->setMetadata(
-        LLVMContext::MD_dereferenceable,
-        MDNode::get(forfree->getContext(),
-                    {ConstantAsMetadata::get(byteSizeOfType)}));
+    if (!relocated)
+      forfree->setMetadata(
+          LLVMContext::MD_dereferenceable,
+          MDNode::get(forfree->getContext(),
+                      {ConstantAsMetadata::get(byteSizeOfType)}));
     forfree->setName("forfree");
     unsigned bsize = (unsigned)byteSizeOfType->getZExtValue();
     if ((bsize & (bsize - 1)) == 0) {
@@ -1611,10 +1680,21 @@ public:
       forfree->setAlignment(bsize);
 #endif
     }
-    auto ci = cast<CallInst>(CallInst::CreateFree(
-        tbuild.CreatePointerCast(forfree,
-                                 Type::getInt8PtrTy(newFunc->getContext())),
-        tbuild.GetInsertBlock()));
+    Value *tofree = forfree;
+    if (relocated)
+      tofree = relocateCachePointer(tbuild, forfree, /*toOffset*/ false);
+    auto ptr = tbuild.CreatePointerCast(
+        tofree, Type::getInt8PtrTy(newFunc->getContext()));
+    CallInst *ci;
+    if (EnzymeTapeBuffer)
+      ci = tbuild.CreateCall(getOrInsertTapeBufferFree(*newFunc->getParent()),
+                             ptr);
+    else if (EnzymeMappedCacheThreshold &&
+             sublimits[i].second.back().first.maxLimit)
+      ci = tbuild.CreateCall(getOrInsertMappedCacheFree(*newFunc->getParent()),
+                             ptr);
+    else
+      ci = cast<CallInst>(CallInst::CreateFree(ptr, tbuild.GetInsertBlock()));
     if (newFunc->getSubprogram())
       ci->setDebugLoc(DILocation::get(newFunc->getContext(), 0, 0,
                                       newFunc->getSubprogram(), 0));
@@ -1622,6 +1702,8 @@ public:
     if (ci->getParent() == nullptr) {
       tbuild.Insert(ci);
     }
+    if (EnzymeTapeProfile)
+      markTapeProfileCall(ci, "free", alloc->getName(), nullptr);
     scopeFrees[alloc].insert(ci);
   }
 
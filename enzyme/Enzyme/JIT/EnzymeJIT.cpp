@@ -0,0 +1,351 @@
+//===- EnzymeJIT.cpp - Compile derivatives on demand with ORC    ----------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a derivative service on top of ORC. Every request
+// parses its bitcode into a fresh LLVMContext, synthesizes the derivative
+// with its own EnzymeLogic and TypeAnalysis and compiles the result into its
+// own JITDylib, such that requests are independent and may run concurrently.
+//
+//===----------------------------------------------------------------------===//
+#include "EnzymeJIT.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include "../EnzymeLogic.h"
+#include "EnzymeSourceHash.h"
+
+using namespace llvm;
+
+namespace {
+
+/// Store compiled derivatives as object files named after their key.
+class DiskObjectCache : public ObjectCache {
+public:
+  DiskObjectCache(std::string Dir) : Dir(std::move(Dir)) {}
+
+  void notifyObjectCompiled(const Module *M, MemoryBufferRef Obj) override {
+    // Write to a temporary file first, such that concurrent readers never
+    // observe a partial object.
+    int FD;
+    SmallString<128> Tmp;
+    if (sys::fs::createUniqueFile(getPath("%%%%%%%%") + ".tmp", FD, Tmp))
+      return;
+    {
+      raw_fd_ostream os(FD, /*shouldClose*/ true);
+      os << Obj.getBuffer();
+    }
+    if (sys::fs::rename(Tmp, getPath(M->getModuleIdentifier())))
+      sys::fs::remove(Tmp);
+  }
+
+  std::unique_ptr<MemoryBuffer> getObject(const Module *M) override {
+    return load(M->getModuleIdentifier());
+  }
+
+  std::unique_ptr<MemoryBuffer> load(StringRef Key) {
+    auto Buf = MemoryBuffer::getFile(getPath(Key));
+    if (!Buf)
+      return nullptr;
+    return std::move(*Buf);
+  }
+
+private:
+  std::string Dir;
+
+  std::string getPath(StringRef Key) {
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, "enzyme-" + Key + ".o");
+    return std::string(Path.str());
+  }
+};
+
+/// Address of a compiled derivative, or an error message.
+using JITResult = std::pair<uint64_t, std::string>;
+
+class EnzymeJIT {
+public:
+  EnzymeJIT(const char *cacheDir, unsigned numThreads)
+      : Pool(hardware_concurrency(numThreads)) {
+    if (cacheDir)
+      Cache.reset(new DiskObjectCache(cacheDir));
+    auto JTMB = orc::JITTargetMachineBuilder::detectHost();
+    if (!JTMB) {
+      InitError = toString(JTMB.takeError());
+      return;
+    }
+    JTMB->setCodeGenOptLevel(CodeGenOpt::Aggressive);
+    // Cached objects are only valid for the compiler and host they were
+    // generated by.
+    Target = (JTMB->getTargetTriple().str() + ":" + JTMB->getCPU() + ":" +
+              JTMB->getFeatures().getString() + ":" + LLVM_VERSION_STRING +
+              ":" + ENZYME_SOURCE_HASH);
+    ObjectCache *OC = Cache.get();
+    // Every compilation creates its own TargetMachine and may thus run on
+    // any thread.
+    auto J =
+        orc::LLJITBuilder()
+            .setJITTargetMachineBuilder(*JTMB)
+            .setCompileFunctionCreator(
+                [OC](orc::JITTargetMachineBuilder JTMB)
+                    -> Expected<
+                        std::unique_ptr<orc::IRCompileLayer::IRCompiler>> {
+                  return std::make_unique<orc::ConcurrentIRCompiler>(
+                      std::move(JTMB), OC);
+                })
+            .create();
+    if (!J) {
+      InitError = toString(J.takeError());
+      return;
+    }
+    this->J = std::move(*J);
+  }
+
+  ~EnzymeJIT() { Pool.wait(); }
+
+  JITResult getDerivative(StringRef bitcode, StringRef fnName,
+                          DIFFE_TYPE retType,
+                          const std::vector<DIFFE_TYPE> &argTypes,
+                          DerivativeMode mode) {
+    if (!J)
+      return JITResult(0, InitError);
+
+    std::string key;
+    raw_string_ostream ks(key);
+    ks << Target << ":" << fnName << ":" << (int)mode
+       << ":" << (int)retType << ":";
+    for (auto ty : argTypes)
+      ks << (int)ty;
+    ks << ":" << utohexstr(xxHash64(bitcode));
+    ks.flush();
+
+    // Requests for a derivative being compiled wait for that compilation.
+    std::promise<JITResult> promise;
+    std::shared_future<JITResult> result;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      auto found = Compiled.find(key);
+      if (found != Compiled.end())
+        return found->second.get();
+      result = promise.get_future().share();
+      Compiled[key] = result;
+    }
+
+    JITResult R = compile(key, bitcode, fnName, retType, argTypes, mode);
+    if (!R.second.empty()) {
+      // Do not remember failures, such that a request may be retried.
+      std::lock_guard<std::mutex> guard(mutex);
+      Compiled.erase(key);
+    }
+    promise.set_value(R);
+    return R;
+  }
+
+  ThreadPool Pool;
+
+private:
+  std::unique_ptr<DiskObjectCache> Cache;
+  std::unique_ptr<orc::LLJIT> J;
+  std::string InitError;
+  std::string Target;
+#if LLVM_VERSION_MAJOR < 13
+  std::atomic<unsigned> Attempts{0};
+#endif
+
+  std::mutex mutex;
+  std::map<std::string, std::shared_future<JITResult>> Compiled;
+
+  JITResult lookup(orc::JITDylib &JD, StringRef name) {
+    auto Sym = J->lookup(JD, name);
+    if (!Sym)
+      return JITResult(0, toString(Sym.takeError()));
+#if LLVM_VERSION_MAJOR >= 15
+    return JITResult(Sym->getValue(), "");
+#else
+    return JITResult(Sym->getAddress(), "");
+#endif
+  }
+
+  JITResult compile(StringRef key, StringRef bitcode, StringRef fnName,
+                    DIFFE_TYPE retType, const std::vector<DIFFE_TYPE> &argTypes,
+                    DerivativeMode mode) {
+    std::string hash = utohexstr(xxHash64(key));
+    std::string name = "__enzyme_jit_" + hash;
+
+#if LLVM_VERSION_MAJOR >= 13
+    // A JITDylib left behind by a failed attempt is reused by the retry.
+    std::string dylibName = name;
+#else
+    // A failed attempt can not be removed and would clash with the retry,
+    // so every attempt compiles into a JITDylib of its own.
+    std::string dylibName = name + "." + std::to_string(Attempts++);
+#endif
+    auto &ES = J->getExecutionSession();
+    orc::JITDylib *JD = ES.getJITDylibByName(dylibName);
+    if (!JD) {
+      auto NewJD = J->createJITDylib(dylibName);
+      if (!NewJD)
+        return JITResult(0, toString(NewJD.takeError()));
+      JD = &*NewJD;
+      auto G = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          J->getDataLayout().getGlobalPrefix());
+      if (!G)
+        return JITResult(0, toString(G.takeError()));
+      JD->addGenerator(std::move(*G));
+    }
+
+    JITResult R = compileInto(*JD, hash, name, bitcode, fnName, retType,
+                              argTypes, mode);
+#if LLVM_VERSION_MAJOR >= 13
+    // Drop whatever a failed attempt added, such that a retry starts afresh.
+    if (!R.second.empty())
+      if (auto Err = ES.removeJITDylib(*JD))
+        R.second += "; " + toString(std::move(Err));
+#endif
+    return R;
+  }
+
+  /// Compile the derivative of fnName as name into JD
+  JITResult compileInto(orc::JITDylib &JD, StringRef hash, StringRef name,
+                        StringRef bitcode, StringRef fnName,
+                        DIFFE_TYPE retType,
+                        const std::vector<DIFFE_TYPE> &argTypes,
+                        DerivativeMode mode) {
+    if (Cache)
+      if (auto Obj = Cache->load(hash)) {
+        if (auto Err = J->addObjectFile(JD, std::move(Obj)))
+          return JITResult(0, toString(std::move(Err)));
+        return lookup(JD, name);
+      }
+
+    auto Ctx = std::make_unique<LLVMContext>();
+    auto M = parseBitcodeFile(MemoryBufferRef(bitcode, fnName), *Ctx);
+    if (!M)
+      return JITResult(0, toString(M.takeError()));
+    (*M)->setModuleIdentifier(hash);
+    (*M)->setTargetTriple(J->getTargetTriple().str());
+    (*M)->setDataLayout(J->getDataLayout());
+
+    Function *F = (*M)->getFunction(fnName);
+    if (!F || F->empty())
+      return JITResult(0, ("no definition of " + fnName).str());
+    if (F->arg_size() != argTypes.size())
+      return JITResult(0, ("wrong number of activities for " + fnName).str());
+    if (mode != DerivativeMode::ForwardMode &&
+        mode != DerivativeMode::ReverseModeCombined)
+      return JITResult(0, "only forward and combined reverse mode derivatives "
+                          "may be compiled");
+
+    {
+      TargetLibraryInfoImpl TLII(Triple((*M)->getTargetTriple()));
+      TargetLibraryInfo TLI(TLII);
+      TypeAnalysis TA(TLI);
+      EnzymeLogic Logic;
+      std::map<Argument *, bool> uncacheable_args;
+      for (auto &a : F->args())
+        uncacheable_args[&a] = false;
+      Function *D = Logic.CreatePrimalAndGradient(
+          F, retType, argTypes, TLI, TA, /*returnValue*/ false,
+          /*dretUsed*/ false, mode, /*additionalArg*/ nullptr,
+          TA.getCallerTypeInfo(F), uncacheable_args,
+          /*augmented*/ nullptr, /*AtomicAdd*/ false, /*PostOpt*/ true);
+      if (!D)
+        return JITResult(0, ("could not differentiate " + fnName).str());
+      D->setName(name);
+      D->setLinkage(GlobalValue::ExternalLinkage);
+    }
+
+    if (auto Err = J->addIRModule(
+            JD, orc::ThreadSafeModule(std::move(*M), std::move(Ctx))))
+      return JITResult(0, toString(std::move(Err)));
+    return lookup(JD, name);
+  }
+};
+
+} // namespace
+
+extern "C" {
+
+EnzymeJITRef EnzymeCreateJIT(const char *cacheDir, unsigned numThreads) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  return (EnzymeJITRef)(new EnzymeJIT(cacheDir, numThreads));
+}
+
+void EnzymeFreeJIT(EnzymeJITRef JIT) { delete (EnzymeJIT *)JIT; }
+
+uint64_t EnzymeJITGetDerivative(EnzymeJITRef JIT, const char *bitcode,
+                                size_t bitcodeSize, const char *fnName,
+                                CDIFFE_TYPE retType, CDIFFE_TYPE *argTypes,
+                                size_t numArgs, CDerivativeMode mode,
+                                char **error) {
+  JITResult R = ((EnzymeJIT *)JIT)
+                    ->getDerivative(StringRef(bitcode, bitcodeSize), fnName,
+                                    (DIFFE_TYPE)retType,
+                                    std::vector<DIFFE_TYPE>(
+                                        (DIFFE_TYPE *)argTypes,
+                                        (DIFFE_TYPE *)argTypes + numArgs),
+                                    (DerivativeMode)mode);
+  if (error)
+    *error = R.second.empty() ? nullptr : strdup(R.second.c_str());
+  return R.first;
+}
+
+void EnzymeJITGetDerivativeAsync(EnzymeJITRef JIT, const char *bitcode,
+                                 size_t bitcodeSize, const char *fnName,
+                                 CDIFFE_TYPE retType, CDIFFE_TYPE *argTypes,
+                                 size_t numArgs, CDerivativeMode mode,
+                                 EnzymeJITCallback callback, void *userData) {
+  auto EJ = (EnzymeJIT *)JIT;
+  std::string bc(bitcode, bitcodeSize);
+  std::string name(fnName);
+  std::vector<DIFFE_TYPE> types((DIFFE_TYPE *)argTypes,
+                                (DIFFE_TYPE *)argTypes + numArgs);
+  EJ->Pool.async([=]() {
+    JITResult R = EJ->getDerivative(bc, name, (DIFFE_TYPE)retType, types,
+                                    (DerivativeMode)mode);
+    callback(userData, R.first, R.second.empty() ? nullptr : R.second.c_str());
+  });
+}
+
+void EnzymeJITDisposeMessage(char *message) { free(message); }
+}
@@ -0,0 +1,85 @@
+//===- EnzymeJIT.h - Compile derivatives on demand with ORC      ----------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a C interface for obtaining native derivatives of
+// functions given as bitcode. Derivatives are synthesized by Enzyme and
+// compiled with ORC, each in its own LLVMContext, on a pool of threads.
+// Compiled derivatives are cached in memory and optionally as object files
+// on disk.
+//
+//===----------------------------------------------------------------------===//
+#ifndef ENZYME_JIT_H
+#define ENZYME_JIT_H
+
+#include "../CApi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct EnzymeOpaqueJIT;
+typedef struct EnzymeOpaqueJIT *EnzymeJITRef;
+
+/// Create a JIT for the host. If cacheDir is not null, compiled derivatives
+/// are also stored in and loaded from object files in that directory, keyed
+/// by the hash of the Enzyme sources, the LLVM version and the host CPU
+/// along with the request.
+/// Asynchronous requests are compiled on a pool of numThreads threads, or
+/// of one thread per hardware thread if numThreads is zero.
+EnzymeJITRef EnzymeCreateJIT(const char *cacheDir, unsigned numThreads);
+
+/// Wait for all pending compilations and free the JIT along with all code
+/// it has compiled.
+void EnzymeFreeJIT(EnzymeJITRef);
+
+/// Return the address of the derivative of the function fnName defined in
+/// the given bitcode, or 0 and an error message to be freed with
+/// EnzymeJITDisposeMessage. Mode is either DEM_ForwardMode or
+/// DEM_ReverseModeCombined and the derivative has the signature of the one
+/// returned by __enzyme_fwddiff or __enzyme_autodiff respectively, with the
+/// differential return, if any, passed as an additional last argument.
+/// Concurrent requests with the same bitcode, name and activity share a
+/// single compilation.
+uint64_t EnzymeJITGetDerivative(EnzymeJITRef, const char *bitcode,
+                                size_t bitcodeSize, const char *fnName,
+                                CDIFFE_TYPE retType, CDIFFE_TYPE *argTypes,
+                                size_t numArgs, CDerivativeMode mode,
+                                char **error);
+
+typedef void (*EnzymeJITCallback)(void * /*userData*/, uint64_t /*address*/,
+                                  const char * /*error*/);
+
+/// Like EnzymeJITGetDerivative, but return immediately and invoke callback
+/// from a thread of the pool once the derivative is available. The bitcode
+/// is copied and need not outlive the call. The error passed to the
+/// callback is only valid for the duration of the callback.
+void EnzymeJITGetDerivativeAsync(EnzymeJITRef, const char *bitcode,
+                                 size_t bitcodeSize, const char *fnName,
+                                 CDIFFE_TYPE retType, CDIFFE_TYPE *argTypes,
+                                 size_t numArgs, CDerivativeMode mode,
+                                 EnzymeJITCallback callback, void *userData);
+
+void EnzymeJITDisposeMessage(char *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
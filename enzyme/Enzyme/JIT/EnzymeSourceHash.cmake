@@ -0,0 +1,22 @@
+# Write a header defining ENZYME_SOURCE_HASH as the hash of the sources of
+# Enzyme in SOURCE_DIR to OUTPUT. It keys the on-disk object cache of
+# EnzymeJIT, such that a rebuilt Enzyme never loads objects of another.
+file(GLOB_RECURSE sources ${SOURCE_DIR}/*.cpp ${SOURCE_DIR}/*.h)
+list(SORT sources)
+set(hashes "")
+foreach(src ${sources})
+    file(SHA256 ${src} hash)
+    string(APPEND hashes "${hash}")
+endforeach()
+string(SHA256 hash "${hashes}")
+set(content "#define ENZYME_SOURCE_HASH \"${hash}\"\n")
+
+set(old "")
+if (EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} old)
+endif()
+if (old STREQUAL content)
+    file(TOUCH ${OUTPUT})
+else()
+    file(WRITE ${OUTPUT} "${content}")
+endif()
@@ -0,0 +1,143 @@
+//===- EnzymeReverseProfile.cpp - Cycle counts of reverse passes ----------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the reverse profiling runtime. Derivatives update
+// their counters themselves, hence the runtime only remembers where they are
+// and reports them.
+//
+//===----------------------------------------------------------------------===//
+#include "EnzymeReverseProfile.h"
+#include "ProfileWriter.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using EnzymeProfile::printString;
+
+uint64_t read(const uint64_t &counter) {
+  return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+struct ReverseProfile {
+  std::mutex lock;
+  std::vector<std::pair<EnzymeReverseRegion *, uint64_t>> derivatives;
+
+  /// Write the counters as JSON, with the lock held
+  void dump(FILE *out) {
+    std::vector<EnzymeReverseRegion *> regions;
+    for (auto &pair : derivatives)
+      for (uint64_t i = 0; i < pair.second; ++i)
+        regions.push_back(&pair.first[i]);
+
+    // Sum the regions of every source line, whichever derivative they are of
+    std::map<std::pair<std::string, int32_t>, std::pair<uint64_t, uint64_t>>
+        lines;
+    for (auto region : regions) {
+      auto &sum = lines[std::make_pair(
+          std::string(region->file ? region->file : ""), region->line)];
+      sum.first += read(region->cycles);
+      sum.second += read(region->executions);
+    }
+    std::vector<std::pair<std::pair<std::string, int32_t>,
+                          std::pair<uint64_t, uint64_t>>>
+        sorted(lines.begin(), lines.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const decltype(sorted)::value_type &a,
+                        const decltype(sorted)::value_type &b) {
+                       return a.second.first > b.second.first;
+                     });
+    std::stable_sort(regions.begin(), regions.end(),
+                     [](EnzymeReverseRegion *a, EnzymeReverseRegion *b) {
+                       return read(a->cycles) > read(b->cycles);
+                     });
+
+    fputs("{\n  \"lines\": [", out);
+    bool first = true;
+    for (auto &line : sorted) {
+      fputs(first ? "\n    {\"file\": " : ",\n    {\"file\": ", out);
+      printString(out, line.first.first.c_str());
+      fprintf(out, ", \"line\": %d, \"cycles\": %llu, \"executions\": %llu}",
+              (int)line.first.second, (unsigned long long)line.second.first,
+              (unsigned long long)line.second.second);
+      first = false;
+    }
+    fputs("\n  ],\n  \"regions\": [", out);
+    first = true;
+    for (auto region : regions) {
+      fputs(first ? "\n    {\"function\": " : ",\n    {\"function\": ", out);
+      printString(out, region->function);
+      fputs(", \"block\": ", out);
+      printString(out, region->block);
+      fputs(", \"file\": ", out);
+      printString(out, region->file);
+      fprintf(out, ", \"line\": %d, \"cycles\": %llu, \"executions\": %llu}",
+              (int)region->line, (unsigned long long)read(region->cycles),
+              (unsigned long long)read(region->executions));
+      first = false;
+    }
+    fputs("\n  ]\n}\n", out);
+    fflush(out);
+  }
+
+  ~ReverseProfile() {
+    EnzymeProfile::writeAtExit(
+        "ENZYME_REVERSE_PROFILE",
+        [](void *P, FILE *out) { ((ReverseProfile *)P)->dump(out); }, this);
+  }
+};
+
+ReverseProfile &getProfile() {
+  static ReverseProfile profile;
+  return profile;
+}
+
+} // namespace
+
+extern "C" {
+
+void __enzyme_reverse_profile_register(EnzymeReverseRegion *regions,
+                                       uint64_t count) {
+  ReverseProfile &P = getProfile();
+  std::lock_guard<std::mutex> guard(P.lock);
+  P.derivatives.emplace_back(regions, count);
+}
+
+void __enzyme_reverse_profile_dump(FILE *out) {
+  ReverseProfile &P = getProfile();
+  std::lock_guard<std::mutex> guard(P.lock);
+  P.dump(out);
+}
+
+void __enzyme_reverse_profile_reset(void) {
+  ReverseProfile &P = getProfile();
+  std::lock_guard<std::mutex> guard(P.lock);
+  for (auto &pair : P.derivatives)
+    for (uint64_t i = 0; i < pair.second; ++i) {
+      __atomic_store_n(&pair.first[i].cycles, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&pair.first[i].executions, 0, __ATOMIC_RELAXED);
+    }
+}
+}
@@ -0,0 +1,65 @@
+//===- EnzymeReverseProfile.h - Cycle counts of reverse passes   ----------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the runtime of derivatives synthesized with
+// -enzyme-reverse-cycle-counters. Such derivatives count the cycles spent in
+// the reverse of every original block and register their counters before
+// main runs. At exit the runtime writes the counters as JSON, summed per
+// source line and sorted by cycles, to the file named by
+// ENZYME_REVERSE_PROFILE, or to stderr if it is not set.
+//
+//===----------------------------------------------------------------------===//
+#ifndef ENZYME_REVERSE_PROFILE_H
+#define ENZYME_REVERSE_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// The counters of the reverse of an original block, as emitted by Enzyme.
+/// File and line locate the first instruction of the original block with a
+/// debug location, if any. The counters are updated atomically.
+struct EnzymeReverseRegion {
+  const char *function;
+  const char *block;
+  const char *file;
+  int32_t line;
+  uint64_t cycles;
+  uint64_t executions;
+};
+
+/// Register the given number of regions of a derivative.
+void __enzyme_reverse_profile_register(struct EnzymeReverseRegion *regions,
+                                       uint64_t count);
+
+/// Write the counters of all registered regions as JSON.
+void __enzyme_reverse_profile_dump(FILE *out);
+
+/// Reset the counters of all registered regions.
+void __enzyme_reverse_profile_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
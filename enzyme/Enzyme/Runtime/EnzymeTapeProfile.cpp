@@ -0,0 +1,219 @@
+//===- EnzymeTapeProfile.cpp - Runtime accounting of tape memory ----------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the tape profiling runtime. Every live allocation is
+// remembered along with its size and site, such that frees, which only know
+// the pointer, are attributed to the site and derivative that allocated it.
+//
+//===----------------------------------------------------------------------===//
+#include "EnzymeTapeProfile.h"
+#include "ProfileWriter.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+using EnzymeProfile::printString;
+
+struct Counters {
+  uint64_t allocations = 0;
+  uint64_t reallocations = 0;
+  uint64_t frees = 0;
+  uint64_t totalBytes = 0;
+  uint64_t liveBytes = 0;
+  uint64_t peakBytes = 0;
+
+  void grow(uint64_t oldSize, uint64_t newSize) {
+    if (newSize > oldSize)
+      totalBytes += newSize - oldSize;
+    liveBytes = liveBytes - oldSize + newSize;
+    if (liveBytes > peakBytes)
+      peakBytes = liveBytes;
+  }
+
+  void reset() {
+    allocations = reallocations = frees = totalBytes = 0;
+    peakBytes = liveBytes;
+  }
+};
+
+struct Allocation {
+  uint64_t size;
+  const EnzymeTapeSite *site;
+};
+
+struct TapeProfile {
+  std::mutex lock;
+  std::unordered_map<void *, Allocation> live;
+  Counters total;
+  std::map<std::string, Counters> functions;
+  std::map<const EnzymeTapeSite *, Counters> sites;
+
+  /// Account for an allocation of the given site changing from oldSize to
+  /// newSize bytes, returning the counters of its derivative and site
+  void resize(const EnzymeTapeSite *site, uint64_t oldSize, uint64_t newSize,
+              Counters *&function, Counters *&atSite) {
+    function = &functions[site->function ? site->function : ""];
+    atSite = &sites[site];
+    total.grow(oldSize, newSize);
+    function->grow(oldSize, newSize);
+    atSite->grow(oldSize, newSize);
+  }
+
+  /// Write the statistics as JSON, with the lock held
+  void dump(FILE *out);
+
+  ~TapeProfile() {
+    EnzymeProfile::writeAtExit(
+        "ENZYME_TAPE_PROFILE",
+        [](void *P, FILE *out) { ((TapeProfile *)P)->dump(out); }, this);
+  }
+};
+
+TapeProfile &getProfile() {
+  static TapeProfile profile;
+  return profile;
+}
+
+void printCounters(FILE *out, const Counters &C) {
+  fprintf(out,
+          "\"allocations\": %llu, \"reallocations\": %llu, \"frees\": %llu, "
+          "\"total_bytes\": %llu, \"peak_bytes\": %llu, \"live_bytes\": %llu",
+          (unsigned long long)C.allocations,
+          (unsigned long long)C.reallocations, (unsigned long long)C.frees,
+          (unsigned long long)C.totalBytes, (unsigned long long)C.peakBytes,
+          (unsigned long long)C.liveBytes);
+}
+
+void TapeProfile::dump(FILE *out) {
+  fputs("{\n  \"total\": {", out);
+  printCounters(out, total);
+  fputs("},\n  \"functions\": [", out);
+  bool first = true;
+  for (auto &pair : functions) {
+    fputs(first ? "\n    {\"function\": " : ",\n    {\"function\": ", out);
+    printString(out, pair.first.c_str());
+    fputs(", ", out);
+    printCounters(out, pair.second);
+    fputc('}', out);
+    first = false;
+  }
+  fputs("\n  ],\n  \"sites\": [", out);
+  first = true;
+  for (auto &pair : sites) {
+    const EnzymeTapeSite *site = pair.first;
+    fputs(first ? "\n    {\"function\": " : ",\n    {\"function\": ", out);
+    printString(out, site->function);
+    fputs(", \"cache\": ", out);
+    printString(out, site->cache);
+    fputs(", \"loop\": ", out);
+    printString(out, site->loop);
+    fputs(", \"file\": ", out);
+    printString(out, site->file);
+    fprintf(out, ", \"line\": %d, ", (int)site->line);
+    printCounters(out, pair.second);
+    fputc('}', out);
+    first = false;
+  }
+  fputs("\n  ]\n}\n", out);
+  fflush(out);
+}
+
+} // namespace
+
+extern "C" {
+
+void __enzyme_tape_profile_alloc(void *ptr, uint64_t size,
+                                 const EnzymeTapeSite *site) {
+  if (!ptr)
+    return;
+  TapeProfile &P = getProfile();
+  std::lock_guard<std::mutex> guard(P.lock);
+  Counters *function, *atSite;
+  P.resize(site, 0, size, function, atSite);
+  ++P.total.allocations;
+  ++function->allocations;
+  ++atSite->allocations;
+  P.live[ptr] = {size, site};
+}
+
+void __enzyme_tape_profile_realloc(void *old, void *ptr, uint64_t size,
+                                   const EnzymeTapeSite *site) {
+  if (!ptr)
+    return;
+  TapeProfile &P = getProfile();
+  std::lock_guard<std::mutex> guard(P.lock);
+  uint64_t oldSize = 0;
+  if (old) {
+    auto found = P.live.find(old);
+    if (found != P.live.end()) {
+      oldSize = found->second.size;
+      P.live.erase(found);
+    }
+  }
+  Counters *function, *atSite;
+  P.resize(site, oldSize, size, function, atSite);
+  if (old) {
+    ++P.total.reallocations;
+    ++function->reallocations;
+    ++atSite->reallocations;
+  } else {
+    ++P.total.allocations;
+    ++function->allocations;
+    ++atSite->allocations;
+  }
+  P.live[ptr] = {size, site};
+}
+
+void __enzyme_tape_profile_free(void *ptr) {
+  if (!ptr)
+    return;
+  TapeProfile &P = getProfile();
+  std::lock_guard<std::mutex> guard(P.lock);
+  auto found = P.live.find(ptr);
+  if (found == P.live.end())
+    return;
+  Counters *function, *atSite;
+  P.resize(found->second.site, found->second.size, 0, function, atSite);
+  ++P.total.frees;
+  ++function->frees;
+  ++atSite->frees;
+  P.live.erase(found);
+}
+
+void __enzyme_tape_profile_dump(FILE *out) {
+  TapeProfile &P = getProfile();
+  std::lock_guard<std::mutex> guard(P.lock);
+  P.dump(out);
+}
+
+void __enzyme_tape_profile_reset(void) {
+  TapeProfile &P = getProfile();
+  std::lock_guard<std::mutex> guard(P.lock);
+  P.total.reset();
+  for (auto &pair : P.functions)
+    pair.second.reset();
+  for (auto &pair : P.sites)
+    pair.second.reset();
+}
+}
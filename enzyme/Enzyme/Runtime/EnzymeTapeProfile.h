@@ -0,0 +1,73 @@
+//===- EnzymeTapeProfile.h - Runtime accounting of tape memory   ----------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the hooks called by derivatives synthesized with
+// -enzyme-tape-profile whenever tape memory is allocated, reallocated or
+// freed. The runtime aggregates the number of allocations along with the
+// total and peak bytes per derivative and per allocation site, and writes
+// them as JSON at exit to the file named by ENZYME_TAPE_PROFILE, or to
+// stderr if it is not set.
+//
+//===----------------------------------------------------------------------===//
+#ifndef ENZYME_TAPE_PROFILE_H
+#define ENZYME_TAPE_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Where tape memory is allocated, as emitted by Enzyme. The loop is the name
+/// of the header of the loop the cache is for, or empty if none, and file and
+/// line locate that loop, or the allocation itself, in the source.
+struct EnzymeTapeSite {
+  const char *function;
+  const char *cache;
+  const char *loop;
+  const char *file;
+  int32_t line;
+};
+
+/// Record size bytes of tape memory at ptr allocated at site.
+void __enzyme_tape_profile_alloc(void *ptr, uint64_t size,
+                                 const struct EnzymeTapeSite *site);
+
+/// Record that the tape memory at old, which may be null, now has size bytes
+/// and is at ptr.
+void __enzyme_tape_profile_realloc(void *old, void *ptr, uint64_t size,
+                                   const struct EnzymeTapeSite *site);
+
+/// Record that the tape memory at ptr is freed.
+void __enzyme_tape_profile_free(void *ptr);
+
+/// Write the statistics recorded so far as JSON.
+void __enzyme_tape_profile_dump(FILE *out);
+
+/// Forget the statistics recorded so far, keeping memory still live as
+/// allocated.
+void __enzyme_tape_profile_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+//===- ProfileWriter.cpp - Output shared by the profiling runtimes --------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the JSON output shared by the profiling runtimes.
+//
+//===----------------------------------------------------------------------===//
+#include "ProfileWriter.h"
+
+#include <cstdlib>
+
+namespace EnzymeProfile {
+
+void printString(FILE *out, const char *str) {
+  fputc('"', out);
+  for (const char *c = str ? str : ""; *c; ++c) {
+    switch (*c) {
+    case '"':
+      fputs("\\\"", out);
+      break;
+    case '\\':
+      fputs("\\\\", out);
+      break;
+    case '\n':
+      fputs("\\n", out);
+      break;
+    case '\t':
+      fputs("\\t", out);
+      break;
+    default:
+      if ((unsigned char)*c < 0x20)
+        fprintf(out, "\\u%04x", (unsigned char)*c);
+      else
+        fputc(*c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+void writeAtExit(const char *envVar, void (*dump)(void *, FILE *),
+                 void *profile) {
+  const char *path = getenv(envVar);
+  FILE *out = path && *path ? fopen(path, "w") : stderr;
+  if (!out)
+    return;
+  dump(profile, out);
+  if (out != stderr)
+    fclose(out);
+}
+
+} // namespace EnzymeProfile
@@ -0,0 +1,42 @@
+//===- ProfileWriter.h - Output shared by the profiling runtimes ----------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the JSON output shared by the profiling runtimes of the
+// EnzymeProfile library.
+//
+//===----------------------------------------------------------------------===//
+#ifndef ENZYME_PROFILE_WRITER_H
+#define ENZYME_PROFILE_WRITER_H
+
+#include <cstdio>
+
+namespace EnzymeProfile {
+
+/// Write str, or the empty string if it is null, as a JSON string
+void printString(FILE *out, const char *str);
+
+/// Open the file named by the environment variable envVar, or stderr if it
+/// is not set, and let dump write the profile to it
+void writeAtExit(const char *envVar, void (*dump)(void *, FILE *),
+                 void *profile);
+
+} // namespace EnzymeProfile
+
+#endif
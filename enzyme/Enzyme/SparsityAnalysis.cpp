@@ -0,0 +1,462 @@
+//===- SparsityAnalysis.cpp - Static Jacobian sparsity patterns ---------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the implementation of an analysis deducing a
+// conservative Jacobian sparsity pattern of a function f(T *in, T *out, ...)
+// and of the generation of a runtime function describing it as CSR.
+//
+// Every store into out is traced back through the values activity analysis
+// deems active to the loads from in it may depend on. The byte offsets of
+// such a load and of the store, relative to in and out, are then related
+// through scalar evolution, yielding either fixed entries, a constant offset
+// between input and output index, or an unknown and thus dense dependency.
+//
+//===----------------------------------------------------------------------===//
+#include "SparsityAnalysis.h"
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include "ActivityAnalysis.h"
+#include "FunctionUtils.h"
+#include "Utils.h"
+
+using namespace llvm;
+
+#ifdef DEBUG_TYPE
+#undef DEBUG_TYPE
+#endif
+#define DEBUG_TYPE "sparsity-analysis"
+
+/// Function the sparsity analysis printer will analyze
+static llvm::cl::opt<std::string>
+    FunctionToAnalyze("sparsity-analysis-func", cl::init(""), cl::Hidden,
+                      cl::desc("Which function to analyze/print"));
+
+void SparsityPattern::print(llvm::raw_ostream &OS) const {
+  OS << "dense: " << Dense << "\n";
+  OS << "offsets:";
+  for (auto c : Offsets)
+    OS << " " << c;
+  OS << "\ncolumns:";
+  for (auto c : Columns)
+    OS << " " << c;
+  OS << "\ndense rows:";
+  for (auto r : DenseRows)
+    OS << " " << r;
+  OS << "\nfixed:";
+  for (auto &pair : Fixed) {
+    OS << " " << pair.first << ":[";
+    bool first = true;
+    for (auto c : pair.second) {
+      OS << (first ? "" : " ") << c;
+      first = false;
+    }
+    OS << "]";
+  }
+  OS << "\n";
+}
+
+namespace {
+/// Analysis state for the stores into the output of a single function
+class SparsityAnalyzer {
+  Argument *In;
+  Argument *Out;
+  Type *T;
+  uint64_t ElementSize;
+  ActivityAnalyzer &ATA;
+  TypeResults &TR;
+  ScalarEvolution &SE;
+  LoopInfo &LI;
+
+public:
+  SparsityAnalyzer(Argument *In, Argument *Out, ActivityAnalyzer &ATA,
+                   TypeResults &TR, ScalarEvolution &SE, LoopInfo &LI)
+      : In(In), Out(Out), T(cast<PointerType>(In->getType())->getElementType()),
+        ElementSize(In->getParent()->getParent()->getDataLayout()
+                        .getTypeAllocSize(T)),
+        ATA(ATA), TR(TR), SE(SE), LI(LI) {}
+
+  /// Return the underlying object of ptr
+  Value *getBase(Value *ptr) {
+#if LLVM_VERSION_MAJOR >= 12
+    return getUnderlyingObject(ptr, 100);
+#else
+    return GetUnderlyingObject(
+        ptr, In->getParent()->getParent()->getDataLayout(), 100);
+#endif
+  }
+
+  /// Return whether ptr may be based on the argument base, assuming distinct
+  /// arguments do not alias
+  bool isBasedOn(Value *ptr, Argument *base) {
+    auto obj = getBase(ptr);
+    return obj == base || !(isa<Argument>(obj) || isIdentifiedObject(obj));
+  }
+
+  /// Return the byte offset of ptr from the argument base, or null if it is
+  /// not known to be based on that argument
+  const SCEV *getByteOffset(Value *ptr, Argument *base) {
+    if (getBase(ptr) != base)
+      return nullptr;
+    const SCEV *off = SE.getMinusSCEV(SE.getSCEV(ptr), SE.getSCEV(base));
+    if (isa<SCEVCouldNotCompute>(off))
+      return nullptr;
+    return off;
+  }
+
+  /// Return the byte offset S as a number of elements, if it is constant
+  Optional<int64_t> getElementOffset(const SCEV *S) {
+    if (auto C = dyn_cast<SCEVConstant>(S)) {
+      int64_t bytes = C->getAPInt().getSExtValue();
+      if (bytes % (int64_t)ElementSize == 0)
+        return bytes / (int64_t)ElementSize;
+    }
+    return None;
+  }
+
+  /// Return whether the byte offset S of a load may denote a different
+  /// iteration of some loop than the one executing the store SI, in which
+  /// case it can not be related to the offset of the store.
+  bool isFromOtherIteration(const SCEV *S, StoreInst *SI) {
+    return SCEVExprContains(S, [&](const SCEV *E) {
+      if (auto AR = dyn_cast<SCEVAddRecExpr>(E))
+        return !AR->getLoop()->contains(SI->getParent());
+      return false;
+    });
+  }
+
+  /// Collect the byte offsets of the loads from the input that val may
+  /// actively depend on. Return false if val may depend on anything else.
+  bool collectLoads(Value *val, SmallPtrSetImpl<Value *> &seen,
+                    SmallVectorImpl<const SCEV *> &loads) {
+    if (!seen.insert(val).second)
+      return true;
+    if (isa<Constant>(val) || ATA.isConstantValue(TR, val))
+      return true;
+
+    // A value carried around a loop, such as a running sum, depends on the
+    // loads of all earlier iterations rather than just the current one.
+    if (auto PN = dyn_cast<PHINode>(val))
+      if (LI.isLoopHeader(PN->getParent()))
+        return false;
+
+    if (auto LI = dyn_cast<LoadInst>(val)) {
+      if (LI->getType() != T)
+        return false;
+      auto off = getByteOffset(LI->getPointerOperand(), In);
+      if (!off)
+        return false;
+      loads.push_back(off);
+      return true;
+    }
+
+    if (auto CI = dyn_cast<CallInst>(val)) {
+      Function *called = CI->getCalledFunction();
+      if (!called || CI->mayReadOrWriteMemory() ||
+          !(isa<IntrinsicInst>(CI) || isMemFreeLibMFunction(called->getName())))
+        return false;
+      for (unsigned i = 0; i < CI->getNumArgOperands(); ++i)
+        if (!collectLoads(CI->getArgOperand(i), seen, loads))
+          return false;
+      return true;
+    }
+
+    auto I = dyn_cast<Instruction>(val);
+    if (!I || I->mayReadOrWriteMemory())
+      return false;
+    for (auto &op : I->operands())
+      if (!collectLoads(op, seen, loads))
+        return false;
+    return true;
+  }
+
+  /// Add the dependencies of the store SI into the output to P
+  void addStore(StoreInst *SI, SparsityPattern &P) {
+    if (!isBasedOn(SI->getPointerOperand(), Out))
+      return;
+    auto storeOff = getByteOffset(SI->getPointerOperand(), Out);
+    if (!storeOff) {
+      P.Dense = true;
+      return;
+    }
+    auto row = getElementOffset(storeOff);
+
+    SmallPtrSet<Value *, 8> seen;
+    SmallVector<const SCEV *, 4> loads;
+    if (SI->getValueOperand()->getType() != T ||
+        !collectLoads(SI->getValueOperand(), seen, loads)) {
+      if (row)
+        P.DenseRows.insert(*row);
+      else
+        P.Dense = true;
+      return;
+    }
+
+    for (auto loadOff : loads) {
+      auto col = getElementOffset(loadOff);
+      if (isFromOtherIteration(loadOff, SI)) {
+        if (row)
+          P.DenseRows.insert(*row);
+        else
+          P.Dense = true;
+      } else if (row && col)
+        P.Fixed[*row].insert(*col);
+      else if (row)
+        P.DenseRows.insert(*row);
+      else if (col)
+        P.Columns.insert(*col);
+      else if (auto diff =
+                   getElementOffset(SE.getMinusSCEV(loadOff, storeOff)))
+        P.Offsets.insert(*diff);
+      else
+        P.Dense = true;
+    }
+  }
+
+  /// Return whether I may write to the output other than through a store
+  bool mayOtherwiseWriteOutput(Instruction &I) {
+    if (isa<StoreInst>(&I) || !I.mayWriteToMemory())
+      return false;
+    auto CI = dyn_cast<CallInst>(&I);
+    if (!CI)
+      return true;
+    for (unsigned i = 0; i < CI->getNumArgOperands(); ++i) {
+      Value *arg = CI->getArgOperand(i);
+      if (arg->getType()->isPointerTy() && isBasedOn(arg, Out))
+        return true;
+    }
+    return false;
+  }
+};
+} // namespace
+
+bool hasSparsitySignature(Function *F) {
+  auto FT = F->getFunctionType();
+  return FT->getNumParams() >= 2 && FT->getParamType(0)->isPointerTy() &&
+         FT->getParamType(0) == FT->getParamType(1);
+}
+
+SparsityPattern computeSparsityPattern(PreProcessCache &PPC, TypeAnalysis &TA,
+                                       const FnTypeInfo &typeInfo) {
+  Function *F = typeInfo.Function;
+  assert(hasSparsitySignature(F));
+  Argument *In = F->arg_begin();
+  Argument *Out = In + 1;
+
+  TypeResults TR = TA.analyzeFunction(typeInfo);
+  SmallPtrSet<Value *, 4> ConstantValues;
+  SmallPtrSet<Value *, 4> ActiveValues;
+  for (auto &a : F->args()) {
+    if (&a == In || &a == Out)
+      ActiveValues.insert(&a);
+    else
+      ConstantValues.insert(&a);
+  }
+  ActivityAnalyzer ATA(PPC, PPC.FAM.getResult<AAManager>(*F), TA.TLI,
+                       ConstantValues, ActiveValues, /*ActiveReturns*/ false);
+  SparsityAnalyzer SA(In, Out, ATA, TR,
+                      PPC.FAM.getResult<ScalarEvolutionAnalysis>(*F),
+                      PPC.FAM.getResult<LoopAnalysis>(*F));
+
+  SparsityPattern P;
+  for (auto &I : instructions(F)) {
+    if (auto SI = dyn_cast<StoreInst>(&I)) {
+      if (!ATA.isConstantInstruction(TR, SI))
+        SA.addStore(SI, P);
+    } else if (SA.mayOtherwiseWriteOutput(I)) {
+      P.Dense = true;
+    }
+    if (P.Dense)
+      break;
+  }
+  return P;
+}
+
+Function *createSparsityPatternFunction(Function *F, const SparsityPattern &P) {
+  Module &M = *F->getParent();
+  LLVMContext &Ctx = M.getContext();
+  auto i64 = Type::getInt64Ty(Ctx);
+  auto i64p = PointerType::getUnqual(i64);
+  FunctionType *FT = FunctionType::get(Type::getVoidTy(Ctx),
+                                       {i64, i64, i64p, i64p}, false);
+  std::string name = ("__enzyme_sparsity_" + F->getName()).str();
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *NewF = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *NewF = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!NewF->empty())
+    return NewF;
+
+  NewF->setLinkage(Function::LinkageTypes::InternalLinkage);
+  NewF->addFnAttr(Attribute::ArgMemOnly);
+  NewF->addFnAttr(Attribute::NoUnwind);
+
+  auto arg = NewF->arg_begin();
+  Value *n = arg++;
+  n->setName("n");
+  Value *m = arg++;
+  m->setName("m");
+  Value *rowptr = arg++;
+  rowptr->setName("rowptr");
+  Value *colidx = arg++;
+  colidx->setName("colidx");
+
+  BasicBlock *entry = BasicBlock::Create(Ctx, "entry", NewF);
+  IRBuilder<> B(entry);
+  auto zero = ConstantInt::get(i64, 0);
+  auto one = ConstantInt::get(i64, 1);
+  Value *pos = B.CreateAlloca(i64, nullptr, "pos");
+  B.CreateStore(zero, pos);
+  B.CreateStore(zero, B.CreateGEP(rowptr, zero));
+  Value *hasidx = B.CreateIsNotNull(colidx, "hasidx");
+
+  // Append col to the current row if valid
+  auto emitEntry = [&](IRBuilder<> &B, Value *col, Value *valid) {
+    BasicBlock *store = BasicBlock::Create(Ctx, "store", NewF);
+    BasicBlock *next = BasicBlock::Create(Ctx, "next", NewF);
+    Value *cur = B.CreateLoad(pos);
+    B.CreateCondBr(B.CreateAnd(valid, hasidx), store, next);
+    B.SetInsertPoint(store);
+    B.CreateStore(col, B.CreateGEP(colidx, cur));
+    B.CreateBr(next);
+    B.SetInsertPoint(next);
+    B.CreateStore(B.CreateAdd(cur, B.CreateZExt(valid, i64)), pos);
+  };
+  auto emitDense = [&](IRBuilder<> &B) {
+    emitCountedLoop(B, zero, n, "dense", [&](IRBuilder<> &B, Value *j) {
+      emitEntry(B, j, B.getTrue());
+    });
+  };
+
+  emitCountedLoop(B, zero, m, "row", [&](IRBuilder<> &B, Value *r) {
+    BasicBlock *rowEnd = BasicBlock::Create(Ctx, "row.fill", NewF);
+    if (P.Dense) {
+      emitDense(B);
+    } else {
+      // Rows with known entries have their columns computed statically
+      std::set<int64_t> special(P.DenseRows.begin(), P.DenseRows.end());
+      for (auto &pair : P.Fixed)
+        special.insert(pair.first);
+      BasicBlock *general = BasicBlock::Create(Ctx, "general", NewF);
+      auto SwI = B.CreateSwitch(r, general, special.size());
+      for (auto k : special) {
+        BasicBlock *caseBB =
+            BasicBlock::Create(Ctx, "row." + std::to_string(k), NewF);
+        SwI->addCase(ConstantInt::get(i64, k), caseBB);
+        B.SetInsertPoint(caseBB);
+        if (P.DenseRows.count(k)) {
+          emitDense(B);
+        } else {
+          std::set<int64_t> cols(P.Columns.begin(), P.Columns.end());
+          for (auto c : P.Offsets)
+            cols.insert(k + c);
+          auto found = P.Fixed.find(k);
+          cols.insert(found->second.begin(), found->second.end());
+          for (auto c : cols) {
+            if (c < 0)
+              continue;
+            auto col = ConstantInt::get(i64, c);
+            emitEntry(B, col, B.CreateICmpSLT(col, n));
+          }
+        }
+        B.CreateBr(rowEnd);
+      }
+
+      B.SetInsertPoint(general);
+      for (auto c : P.Offsets) {
+        Value *col = B.CreateAdd(r, ConstantInt::get(i64, c));
+        emitEntry(B, col,
+                  B.CreateAnd(B.CreateICmpSGE(col, zero),
+                              B.CreateICmpSLT(col, n)));
+      }
+      for (auto j : P.Columns) {
+        if (j < 0)
+          continue;
+        auto col = ConstantInt::get(i64, j);
+        Value *valid = B.CreateICmpSLT(col, n);
+        for (auto c : P.Offsets)
+          valid = B.CreateAnd(
+              valid, B.CreateICmpNE(B.CreateAdd(r, ConstantInt::get(i64, c)),
+                                    col));
+        emitEntry(B, col, valid);
+      }
+    }
+    B.CreateBr(rowEnd);
+    B.SetInsertPoint(rowEnd);
+    B.CreateStore(B.CreateLoad(pos), B.CreateGEP(rowptr, B.CreateAdd(r, one)));
+  });
+  B.CreateRetVoid();
+  return NewF;
+}
+
+namespace {
+
+class SparsityAnalysisPrinter : public FunctionPass {
+public:
+  static char ID;
+  SparsityAnalysisPrinter() : FunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+  }
+
+  bool runOnFunction(Function &F) override {
+    if (F.getName() != FunctionToAnalyze)
+      return /*changed*/ false;
+
+#if LLVM_VERSION_MAJOR >= 10
+    auto &TLI = getAnalysis<TargetLibraryInfoWrapperPass>().getTLI(F);
+#else
+    auto &TLI = getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
+#endif
+
+    TypeAnalysis TA(TLI);
+    PreProcessCache PPC;
+    computeSparsityPattern(PPC, TA, TA.getCallerTypeInfo(&F))
+        .print(llvm::outs());
+    return /*changed*/ false;
+  }
+};
+
+} // namespace
+
+char SparsityAnalysisPrinter::ID = 0;
+
+static RegisterPass<SparsityAnalysisPrinter>
+    X("print-sparsity-analysis", "Print Jacobian Sparsity Analysis Results");
@@ -0,0 +1,73 @@
+//===- SparsityAnalysis.h - Static Jacobian sparsity patterns -----------===//
+//
+//                             Enzyme Project
+//
+// Part of the Enzyme Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+// If using this code in an academic setting, please cite the following:
+// @incollection{enzymeNeurips,
+// title = {Instead of Rewriting Foreign Code for Machine Learning,
+//          Automatically Synthesize Fast Gradients},
+// author = {Moses, William S. and Churavy, Valentin},
+// booktitle = {Advances in Neural Information Processing Systems 33},
+// year = {2020},
+// note = {To appear in},
+// }
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the declaration of an analysis deducing a conservative
+// Jacobian sparsity pattern of a function f(T *in, T *out, ...), namely which
+// elements of in each element of out may depend on.
+//
+//===----------------------------------------------------------------------===//
+#ifndef ENZYME_SPARSITY_ANALYSIS_H
+#define ENZYME_SPARSITY_ANALYSIS_H 1
+
+#include <cstdint>
+#include <map>
+#include <set>
+
+#include "llvm/IR/Function.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "TypeAnalysis/TypeAnalysis.h"
+
+class PreProcessCache;
+
+/// Conservative Jacobian sparsity pattern. Output element i may depend on
+///   every input, if Dense or i is in DenseRows,
+///   and otherwise on the inputs i + c for c in Offsets, on the inputs in
+///   Columns and on the inputs in Fixed[i].
+struct SparsityPattern {
+  bool Dense = false;
+  std::set<int64_t> Offsets;
+  std::set<int64_t> Columns;
+  std::set<int64_t> DenseRows;
+  std::map<int64_t, std::set<int64_t>> Fixed;
+
+  void print(llvm::raw_ostream &OS) const;
+};
+
+/// Whether F takes the input and output arrays, of the same pointer type, as
+/// its first two arguments, as required of the function of a sparsity
+/// pattern or sparse Jacobian
+bool hasSparsitySignature(llvm::Function *F);
+
+/// Compute the sparsity pattern of typeInfo.Function, whose first two
+/// arguments are the input and output arrays and whose other arguments are
+/// inactive. Derivative dependencies are those deemed active by activity
+/// analysis, indices are related through scalar evolution.
+SparsityPattern computeSparsityPattern(PreProcessCache &PPC, TypeAnalysis &TA,
+                                       const FnTypeInfo &typeInfo);
+
+/// Create a function void(i64 n, i64 m, i64 *rowptr, i64 *colidx) filling a
+/// CSR description of the pattern for n inputs and m outputs. If colidx is
+/// null only rowptr is filled, allowing the caller to size colidx from
+/// rowptr[m]. Columns within a row are not necessarily sorted.
+llvm::Function *createSparsityPatternFunction(llvm::Function *F,
+                                              const SparsityPattern &P);
+
+#endif
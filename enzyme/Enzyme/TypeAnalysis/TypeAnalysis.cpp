@@ -37,8 +37,14 @@
 
 #include "llvm/IR/InstIterator.h"
 
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
+
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
+#if LLVM_VERSION_MAJOR >= 9
+#include "llvm/Support/TimeProfiler.h"
+#endif
 
 #include "llvm/IR/InlineAsm.h"
 
@@ -50,6 +56,15 @@
 
 #include "TBAA.h"
 
+#ifdef DEBUG_TYPE
+#undef DEBUG_TYPE
+#endif
+#define DEBUG_TYPE "enzyme-type-analysis"
+
+STATISTIC(NumTypeVisits, "Number of values visited by type analysis");
+STATISTIC(NumTypeCallVisits, "Number of calls visited by type analysis");
+STATISTIC(NumTypeWidened, "Number of type trees widened by type analysis");
+
 extern "C" {
 /// Maximum offset for type trees to keep
 llvm::cl::opt<int> MaxIntOffset("enzyme-max-int-offset", cl::init(100),
@@ -63,6 +78,11 @@ llvm::cl::opt<bool> EnzymePrintType("enzyme-print-type", cl::init(false),
 llvm::cl::opt<bool> RustTypeRules("enzyme-rust-type", cl::init(false),
                                   cl::Hidden,
                                   cl::desc("Enable rust-specific type rules"));
+
+llvm::cl::opt<int> EnzymeTypeWidening(
+    "enzyme-type-widening", cl::init(0), cl::Hidden,
+    cl::desc("Number of changes to the type of a value after which repeated "
+             "offsets of the same type are widened (0 to disable)"));
 }
 
 const std::map<std::string, llvm::Intrinsic::ID> LIBM_FUNCTIONS = {
@@ -144,6 +164,71 @@ const std::map<std::string, llvm::Intrinsic::ID> LIBM_FUNCTIONS = {
 #endif
 };
 
+unsigned TypeAnalysisWorkList::getPriority(Value *V) {
+  auto found = Priority.find(V);
+  if (found != Priority.end())
+    return found->second;
+  // Values not ordered up front (globals, constant expressions, and
+  // instructions in unreachable blocks) are given the lowest priority
+  unsigned P = Values.size();
+  Priority[V] = P;
+  Values.push_back(V);
+  Pending.push_back(false);
+  return P;
+}
+
+void TypeAnalysisWorkList::order(Function &F) {
+  for (auto &Arg : F.args())
+    getPriority(&Arg);
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *BB : RPOT)
+    for (Instruction &I : *BB)
+      getPriority(&I);
+}
+
+bool TypeAnalysisWorkList::insert(Value *V) {
+  unsigned P = getPriority(V);
+  if (Pending[P])
+    return false;
+  Pending.set(P);
+  if (isa<CallInst>(V) || isa<InvokeInst>(V))
+    CallQueue.push(P);
+  else
+    Queue.push(P);
+  ++Size;
+  return true;
+}
+
+bool TypeAnalysisWorkList::count(Value *V) const {
+  auto found = Priority.find(V);
+  return found != Priority.end() && Pending[found->second];
+}
+
+bool TypeAnalysisWorkList::remove(Value *V) {
+  auto found = Priority.find(V);
+  if (found == Priority.end() || !Pending[found->second])
+    return false;
+  // The queued entry is left in place and skipped once popped
+  Pending.reset(found->second);
+  --Size;
+  return true;
+}
+
+Value *TypeAnalysisWorkList::pop() {
+  assert(Size);
+  while (1) {
+    QueueType &Q = Queue.empty() ? CallQueue : Queue;
+    assert(!Q.empty());
+    unsigned P = Q.top();
+    Q.pop();
+    if (!Pending[P])
+      continue;
+    Pending.reset(P);
+    --Size;
+    return Values[P];
+  }
+}
+
 TypeAnalyzer::TypeAnalyzer(const FnTypeInfo &fn, TypeAnalysis &TA,
                            uint8_t direction)
     : notForAnalysis(getGuaranteedUnreachable(fn.Function)), intseen(),
@@ -154,6 +239,8 @@ TypeAnalyzer::TypeAnalyzer(const FnTypeInfo &fn, TypeAnalysis &TA,
   assert(fntypeinfo.KnownValues.size() ==
          fntypeinfo.Function->getFunctionType()->getNumParams());
 
+  workList.order(*fntypeinfo.Function);
+
   // Add all instructions in the function
   for (BasicBlock &BB : *fntypeinfo.Function) {
     if (notForAnalysis.count(&BB))
@@ -183,6 +270,7 @@ TypeAnalyzer::TypeAnalyzer(
       PHIRecur(PHIRecur), DT(DT), LI(LI) {
   assert(fntypeinfo.KnownValues.size() ==
          fntypeinfo.Function->getFunctionType()->getNumParams());
+  workList.order(*fntypeinfo.Function);
 }
 
 /// Given a constant value, deduce any type information applicable
@@ -560,6 +648,22 @@ void TypeAnalyzer::updateAnalysis(Value *Val, TypeTree Data, Value *Origin) {
 
   if (Changed) {
 
+    // Values whose type keeps growing one offset at a time would otherwise
+    // only converge once their offsets exceed MaxTypeOffset.
+    if (EnzymeTypeWidening > 0 &&
+        ++changeCount[Val] > (unsigned)EnzymeTypeWidening) {
+      auto &DL = fntypeinfo.Function->getParent()->getDataLayout();
+      TypeTree Widened = analysis[Val];
+      bool LegalWiden = true;
+      if (Widened.checkedOrIn(analysis[Val].Widen(DL, Val->getType()),
+                              /*PointerIntSame*/ false, LegalWiden) &&
+          LegalWiden) {
+        analysis[Val] = Widened;
+        ++NumWidened;
+        ++NumTypeWidened;
+      }
+    }
+
     if (auto GV = dyn_cast<GlobalVariable>(Val)) {
       if (GV->getValueType()->isSized()) {
         auto &DL = fntypeinfo.Function->getParent()->getDataLayout();
@@ -875,63 +979,30 @@ void TypeAnalyzer::run() {
   //
   // For performance reasons in each round of type analysis
   // only analyze any call instances after all other potential
-  // updates have been done. This is to minimize the number
-  // of expensive interprocedural analyses
-  std::deque<Instruction *> pendingCalls;
-
-  do {
+  // updates have been done, which the worklist ensures. This
+  // is to minimize the number of expensive interprocedural analyses
+#if LLVM_VERSION_MAJOR >= 9
+  TimeTraceScope timeScope("TypeAnalysis", fntypeinfo.Function->getName());
+#endif
 
+  auto fixpoint = [&]() {
     while (!Invalid && workList.size()) {
-      auto todo = *workList.begin();
-      workList.erase(workList.begin());
-      if (auto ci = dyn_cast<CallInst>(todo)) {
-        pendingCalls.push_back(ci);
-        continue;
-      }
-      if (auto ci = dyn_cast<InvokeInst>(todo)) {
-        pendingCalls.push_back(ci);
-        continue;
+      auto todo = workList.pop();
+      ++NumVisits;
+      ++NumTypeVisits;
+      if (isa<CallInst>(todo) || isa<InvokeInst>(todo)) {
+        ++NumCallVisits;
+        ++NumTypeCallVisits;
       }
       visitValue(*todo);
     }
+  };
 
-    if (pendingCalls.size() > 0) {
-      auto todo = pendingCalls.front();
-      pendingCalls.pop_front();
-      visitValue(*todo);
-      continue;
-    } else
-      break;
-
-  } while (1);
+  fixpoint();
 
   runPHIHypotheses();
 
-  do {
-
-    while (!Invalid && workList.size()) {
-      auto todo = *workList.begin();
-      workList.erase(workList.begin());
-      if (auto ci = dyn_cast<CallInst>(todo)) {
-        pendingCalls.push_back(ci);
-        continue;
-      }
-      if (auto ci = dyn_cast<InvokeInst>(todo)) {
-        pendingCalls.push_back(ci);
-        continue;
-      }
-      visitValue(*todo);
-    }
-
-    if (pendingCalls.size() > 0) {
-      auto todo = pendingCalls.front();
-      pendingCalls.pop_front();
-      visitValue(*todo);
-      continue;
-    } else
-      break;
-
-  } while (1);
+  fixpoint();
 }
 
 void TypeAnalyzer::visitValue(Value &val) {
@@ -2632,6 +2703,69 @@ void TypeAnalyzer::visitIntrinsicInst(llvm::IntrinsicInst &I) {
     return;
   }
 
+  case Intrinsic::masked_load:
+  case Intrinsic::masked_store: {
+    auto &DL = I.getParent()->getParent()->getParent()->getDataLayout();
+    bool isLoad = I.getIntrinsicID() == Intrinsic::masked_load;
+    Value *Val = isLoad ? (Value *)&I : I.getOperand(0);
+    Value *Ptr = I.getOperand(isLoad ? 0 : 1);
+    auto Size = (DL.getTypeSizeInBits(Val->getType()) + 7) / 8;
+
+    // No direction check as always valid
+    updateAnalysis(I.getOperand(isLoad ? 2 : 3),
+                   TypeTree(BaseType::Integer).Only(-1), &I);
+    if (isLoad) {
+      // The passthru provides the disabled lanes of the result
+      updateAnalysis(&I, getAnalysis(I.getOperand(3)), &I);
+      updateAnalysis(I.getOperand(3), getAnalysis(&I), &I);
+    }
+
+    if (direction & UP) {
+      TypeTree ptr(BaseType::Pointer);
+      ptr |= getAnalysis(Val).PurgeAnything().ShiftIndices(
+          DL, /*start*/ 0, Size, /*addOffset*/ 0);
+      updateAnalysis(Ptr, ptr.Only(-1), &I);
+    }
+    if (direction & DOWN)
+      updateAnalysis(Val, getAnalysis(Ptr).PurgeAnything().Lookup(Size, DL),
+                     &I);
+    return;
+  }
+
+  case Intrinsic::masked_gather:
+  case Intrinsic::masked_scatter:
+  case Intrinsic::masked_expandload:
+  case Intrinsic::masked_compressstore: {
+    bool isLoad = !I.getType()->isVoidTy();
+    bool hasAlign = I.getIntrinsicID() == Intrinsic::masked_gather ||
+                    I.getIntrinsicID() == Intrinsic::masked_scatter;
+    Value *Val = isLoad ? (Value *)&I : I.getOperand(0);
+    Value *Ptr = I.getOperand(isLoad ? 0 : 1);
+    unsigned MaskIdx = (isLoad ? 1 : 2) + (hasAlign ? 1 : 0);
+
+    // No direction check as always valid
+    updateAnalysis(I.getOperand(MaskIdx), TypeTree(BaseType::Integer).Only(-1),
+                   &I);
+    if (isLoad) {
+      // The passthru provides the disabled lanes of the result
+      updateAnalysis(&I, getAnalysis(I.getOperand(MaskIdx + 1)), &I);
+      updateAnalysis(I.getOperand(MaskIdx + 1), getAnalysis(&I), &I);
+    }
+
+    // Lanes are not laid out contiguously in memory, so only propagate the
+    // element type when it is known to be floating point.
+    Type *EltTy = Val->getType()->getScalarType();
+    if (EltTy->isFloatingPointTy()) {
+      TypeTree ptr(BaseType::Pointer);
+      ptr |= TypeTree(ConcreteType(EltTy)).Only(0);
+      // No direction check as always valid
+      updateAnalysis(Ptr, ptr.Only(-1), &I);
+      // No direction check as always valid
+      updateAnalysis(Val, TypeTree(ConcreteType(EltTy)).Only(-1), &I);
+    }
+    return;
+  }
+
   case Intrinsic::log:
   case Intrinsic::log2:
   case Intrinsic::log10:
@@ -3403,6 +3537,20 @@ void TypeAnalyzer::visitCallInst(CallInst &call) {
                      &call);
       return;
     }
+    if (funcName == "pthread_create") {
+      updateAnalysis(&call, TypeTree(BaseType::Integer).Only(-1), &call);
+      updateAnalysis(call.getOperand(0), TypeTree(BaseType::Pointer).Only(-1),
+                     &call);
+      updateAnalysis(call.getOperand(2), TypeTree(BaseType::Pointer).Only(-1),
+                     &call);
+      return;
+    }
+    if (funcName == "pthread_join") {
+      updateAnalysis(&call, TypeTree(BaseType::Integer).Only(-1), &call);
+      updateAnalysis(call.getOperand(1), TypeTree(BaseType::Pointer).Only(-1),
+                     &call);
+      return;
+    }
     if (isDeallocationFunction(*ci, interprocedural.TLI)) {
       size_t Idx = 0;
       for (auto &Arg : ci->args()) {
@@ -3550,14 +3698,14 @@ void TypeAnalyzer::visitCallInst(CallInst &call) {
     if (isMemFreeLibMFunction(funcName)) {
       for (size_t i = 0; i < call.getNumArgOperands(); ++i) {
         Type *T = call.getArgOperand(i)->getType();
-        if (T->isFloatingPointTy()) {
+        if (T->isFPOrFPVectorTy()) {
           updateAnalysis(
               call.getArgOperand(i),
               TypeTree(ConcreteType(
                            call.getArgOperand(i)->getType()->getScalarType()))
                   .Only(-1),
               &call);
-        } else if (T->isIntegerTy()) {
+        } else if (T->isIntOrIntVectorTy()) {
           updateAnalysis(call.getArgOperand(i),
                          TypeTree(BaseType::Integer).Only(-1), &call);
         } else {
@@ -3566,12 +3714,12 @@ void TypeAnalyzer::visitCallInst(CallInst &call) {
         }
       }
       Type *T = call.getType();
-      if (T->isFloatingPointTy()) {
+      if (T->isFPOrFPVectorTy()) {
         updateAnalysis(
             &call,
             TypeTree(ConcreteType(call.getType()->getScalarType())).Only(-1),
             &call);
-      } else if (T->isIntegerTy()) {
+      } else if (T->isIntOrIntVectorTy()) {
         updateAnalysis(&call, TypeTree(BaseType::Integer).Only(-1), &call);
       } else if (T->isVoidTy()) {
 
@@ -4294,4 +4442,30 @@ std::set<int64_t> TypeAnalyzer::knownIntegralValues(Value *val) {
   return fntypeinfo.knownIntegralValues(val, *DT, intseen);
 }
 
+FnTypeInfo TypeAnalysis::getCallerTypeInfo(Function *F) {
+  FnTypeInfo type_args(F);
+  for (auto &a : F->args()) {
+    TypeTree dt;
+    if (a.getType()->isFPOrFPVectorTy()) {
+      dt = ConcreteType(a.getType()->getScalarType());
+    } else if (a.getType()->isPointerTy()) {
+      auto et = cast<PointerType>(a.getType())->getElementType();
+      if (et->isFPOrFPVectorTy()) {
+        dt = TypeTree(ConcreteType(et->getScalarType())).Only(-1);
+      } else if (et->isPointerTy()) {
+        dt = TypeTree(ConcreteType(BaseType::Pointer)).Only(-1);
+      }
+    } else if (a.getType()->isIntOrIntVectorTy()) {
+      dt = ConcreteType(BaseType::Integer);
+    }
+    type_args.Arguments.insert(
+        std::pair<Argument *, TypeTree>(&a, dt.Only(-1)));
+    // TODO note that here we do NOT propagate constants in type info (and
+    // should consider whether we should)
+    type_args.KnownValues.insert(
+        std::pair<Argument *, std::set<int64_t>>(&a, {}));
+  }
+  return analyzeFunction(type_args).getAnalyzedTypeInfo();
+}
+
 void TypeAnalysis::clear() { analyzedFunctions.clear(); }
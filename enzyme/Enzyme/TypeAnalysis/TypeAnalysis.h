@@ -30,6 +30,12 @@
 
 #include <llvm/Config/llvm-config.h>
 
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SetVector.h"
 
 #include "llvm/Analysis/TargetLibraryInfo.h"
@@ -46,8 +52,8 @@
 
 extern const std::map<std::string, llvm::Intrinsic::ID> LIBM_FUNCTIONS;
 
-static inline bool isMemFreeLibMFunction(llvm::StringRef str,
-                                         llvm::Intrinsic::ID *ID = nullptr) {
+static inline bool isScalarLibMFunction(llvm::StringRef str,
+                                        llvm::Intrinsic::ID *ID = nullptr) {
   if (str.startswith("__") && str.endswith("_finite")) {
     str = str.substr(2, str.size() - 2 - 7);
   } else if (str.startswith("__fd_") && str.endswith("_1")) {
@@ -71,6 +77,144 @@ static inline bool isMemFreeLibMFunction(llvm::StringRef str,
   return false;
 }
 
+/// Decomposition of the name of a vector math library variant of a scalar
+/// libm function, such as _ZGVdN4v_exp (libmvec), Sleef_expd4_u10 (SLEEF) or
+/// __svml_exp4 (SVML). Masked variants are not recognized.
+struct VectorLibMFunction {
+  enum class Library { LibMVec, Sleef, SVML };
+  Library Lib;
+  /// Scalar function name without the single precision suffix
+  std::string Base;
+  /// Whether this is the single precision variant
+  bool Single;
+  /// Number of lanes
+  unsigned Width;
+  /// Name fragment encoding the ISA and accuracy (e.g. _u10avx2 for SLEEF)
+  std::string Tail;
+
+  /// Name of the scalar libm function this vectorizes
+  std::string getScalarName() const { return Base + (Single ? "f" : ""); }
+
+  /// Name of the variant of the scalar function Base taking NumArgs vector
+  /// arguments from the same library, precision, width, ISA and accuracy.
+  std::string getVariant(llvm::StringRef Base, unsigned NumArgs = 1) const {
+    std::string W = std::to_string(Width);
+    switch (Lib) {
+    case Library::LibMVec:
+      return "_ZGV" + Tail + "N" + W + std::string(NumArgs, 'v') + "_" +
+             Base.str() + (Single ? "f" : "");
+    case Library::Sleef:
+      return "Sleef_" + Base.str() + (Single ? "f" : "d") + W + Tail;
+    case Library::SVML:
+      return "__svml_" + Base.str() + (Single ? "f" : "") + W + Tail;
+    }
+    llvm_unreachable("unknown vector library");
+  }
+};
+
+/// Split the scalar libm name str into its base and precision.
+static inline bool splitScalarLibMName(llvm::StringRef str,
+                                       VectorLibMFunction &VF) {
+  if (str.startswith("__") && str.endswith("_finite"))
+    str = str.substr(2, str.size() - 2 - 7);
+  if (LIBM_FUNCTIONS.count(str.str())) {
+    VF.Base = str.str();
+    VF.Single = false;
+    return true;
+  }
+  if (str.endswith("f") && LIBM_FUNCTIONS.count(str.drop_back().str())) {
+    VF.Base = str.drop_back().str();
+    VF.Single = true;
+    return true;
+  }
+  return false;
+}
+
+/// Parse str as the name of a vector math library function, returning true
+/// and filling VF on success.
+static inline bool parseVectorLibMFunction(llvm::StringRef str,
+                                           VectorLibMFunction &VF) {
+  // libmvec follows the vector function ABI: _ZGV<isa><mask><vlen><params>_fn
+  if (str.startswith("_ZGV")) {
+    llvm::StringRef rest = str.drop_front(4);
+    if (rest.size() < 3 || rest[1] != 'N')
+      return false;
+    VF.Lib = VectorLibMFunction::Library::LibMVec;
+    VF.Tail = rest.substr(0, 1).str();
+    rest = rest.drop_front(2);
+    llvm::StringRef width = rest.take_while(
+        [](char c) { return c >= '0' && c <= '9'; });
+    if (width.empty() || width.getAsInteger(10, VF.Width))
+      return false;
+    rest = rest.drop_front(width.size());
+    rest = rest.drop_while([](char c) { return c == 'v'; });
+    if (!rest.startswith("_"))
+      return false;
+    return splitScalarLibMName(rest.drop_front(1), VF);
+  }
+  // SLEEF: Sleef_<fn><d|f><vlen>_u<ulp><isa>
+  if (str.startswith("Sleef_")) {
+    llvm::StringRef rest = str.drop_front(6);
+    size_t split = rest.rfind("_u");
+    if (split == llvm::StringRef::npos)
+      return false;
+    VF.Lib = VectorLibMFunction::Library::Sleef;
+    VF.Tail = rest.substr(split).str();
+    rest = rest.substr(0, split);
+    llvm::StringRef width = rest.take_back(
+        rest.size() -
+        rest.find_last_not_of("0123456789", llvm::StringRef::npos) - 1);
+    if (width.empty() || width.getAsInteger(10, VF.Width))
+      return false;
+    rest = rest.drop_back(width.size());
+    if (!rest.endswith("d") && !rest.endswith("f"))
+      return false;
+    VF.Single = rest.endswith("f");
+    VF.Base = rest.drop_back().str();
+    return LIBM_FUNCTIONS.count(VF.Base);
+  }
+  // SVML: __svml_<fn>[f]<vlen>[_ha|_ep]
+  if (str.startswith("__svml_")) {
+    llvm::StringRef rest = str.drop_front(7);
+    size_t split = rest.find('_');
+    VF.Lib = VectorLibMFunction::Library::SVML;
+    VF.Tail = split == llvm::StringRef::npos ? "" : rest.substr(split).str();
+    if (VF.Tail == "_mask")
+      return false;
+    rest = rest.substr(0, split);
+    // Base names such as log10 end in digits themselves, so try each width.
+    for (unsigned W : {16, 8, 4, 2}) {
+      std::string Ws = std::to_string(W);
+      if (!rest.endswith(Ws))
+        continue;
+      llvm::StringRef name = rest.drop_back(Ws.size());
+      bool Single = name.endswith("f") &&
+                    LIBM_FUNCTIONS.count(name.drop_back().str()) &&
+                    !LIBM_FUNCTIONS.count(name.str());
+      if (Single)
+        name = name.drop_back();
+      if (!LIBM_FUNCTIONS.count(name.str()))
+        continue;
+      VF.Width = W;
+      VF.Single = Single;
+      VF.Base = name.str();
+      return true;
+    }
+    return false;
+  }
+  return false;
+}
+
+/// Whether str is a libm function (or a vector library variant of one) that
+/// does not access memory, optionally returning the equivalent intrinsic.
+static inline bool isMemFreeLibMFunction(llvm::StringRef str,
+                                         llvm::Intrinsic::ID *ID = nullptr) {
+  VectorLibMFunction VF;
+  if (parseVectorLibMFunction(str, VF))
+    return isScalarLibMFunction(VF.Base, ID);
+  return isScalarLibMFunction(str, ID);
+}
+
 /// Struct containing all contextual type information for a
 /// particular function call
 struct FnTypeInfo {
@@ -159,11 +303,62 @@ public:
   FnTypeInfo getCallInfo(llvm::CallInst &CI, llvm::Function &fn);
 };
 
+/// Worklist of values whose type information should be (re)analyzed.
+/// Values are popped in priority order, which follows a reverse post order
+/// traversal of the function so that information flows forward before
+/// values are revisited. Calls are only popped once no other work remains,
+/// minimizing the number of expensive interprocedural analyses. Membership is
+/// a bitset over the priorities, making insertion, lookup and removal
+/// constant time and popping logarithmic.
+class TypeAnalysisWorkList {
+  typedef std::priority_queue<unsigned, std::vector<unsigned>,
+                              std::greater<unsigned>>
+      QueueType;
+
+  /// Priority of each value seen so far
+  llvm::DenseMap<llvm::Value *, unsigned> Priority;
+  /// Value of each priority
+  std::vector<llvm::Value *> Values;
+  /// Priorities currently in the worklist
+  llvm::BitVector Pending;
+  /// Queued priorities of non-call values, and of calls. These may contain
+  /// stale entries that have since been removed.
+  QueueType Queue, CallQueue;
+  /// Number of values in the worklist
+  size_t Size = 0;
+
+  unsigned getPriority(llvm::Value *V);
+
+public:
+  /// Assign priorities to the arguments and instructions of F
+  void order(llvm::Function &F);
+
+  /// Add V, returning whether it was not already present
+  bool insert(llvm::Value *V);
+
+  /// Return whether V is present
+  bool count(llvm::Value *V) const;
+
+  /// Remove V, returning whether it was present
+  bool remove(llvm::Value *V);
+
+  /// Remove and return the value of highest priority
+  llvm::Value *pop();
+
+  size_t size() const { return Size; }
+};
+
 /// Helper class that computes the fixed-point type results of a given function
 class TypeAnalyzer : public llvm::InstVisitor<TypeAnalyzer> {
 public:
   /// List of value's which should be re-analyzed now with new information
-  llvm::SetVector<llvm::Value *> workList;
+  TypeAnalysisWorkList workList;
+
+  /// Number of values visited, number of those which were calls, and number
+  /// of widenings applied while running this analysis
+  size_t NumVisits = 0;
+  size_t NumCallVisits = 0;
+  size_t NumWidened = 0;
 
   const llvm::SmallPtrSet<llvm::BasicBlock *, 4> notForAnalysis;
 
@@ -174,6 +369,9 @@ private:
   /// Map of Value to known integer constants that it will take on
   std::map<llvm::Value *, std::set<int64_t>> intseen;
 
+  /// Number of times the analysis of each value has changed
+  llvm::DenseMap<llvm::Value *, unsigned> changeCount;
+
   std::map<llvm::Value *, std::pair<bool, bool>> mriseen;
   bool mustRemainInteger(llvm::Value *val, bool *returned = nullptr);
 
@@ -358,6 +556,10 @@ public:
     return analyzedFunctions.find(fn)->second.getReturnAnalysis();
   }
 
+  /// Get the analyzed type information of the arguments of F as seen by an
+  /// Enzyme call site, derived from their LLVM types alone
+  FnTypeInfo getCallerTypeInfo(llvm::Function *F);
+
   /// Clear existing analyses
   void clear();
 };
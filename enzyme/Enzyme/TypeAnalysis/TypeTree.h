@@ -809,6 +809,111 @@ public:
     return dat;
   }
 
+  /// Collapse offsets which all hold the same type, at any level of
+  /// indirection, into a single repeated (-1) offset. This is a widening used
+  /// to force convergence of values whose TypeTree keeps growing one offset
+  /// at a time. Offsets are only collapsed when the LLVM type of the value
+  /// says they are elements of an array, that is when they start at 0 and
+  /// step by the size of the pointee element type, and every one holds a type
+  /// of that size. Otherwise the tree is unchanged.
+  TypeTree Widen(const llvm::DataLayout &dl, llvm::Type *T) const {
+    TypeTree Result = *this;
+    size_t maxLen = 0;
+    for (const auto &pair : mapping)
+      if (pair.first.size() > maxLen)
+        maxLen = pair.first.size();
+
+    // Size of the type held at the given offsets, or 0 if not known
+    auto heldSize = [&](const std::vector<int> &prefix) -> size_t {
+      auto found = Result.mapping.find(prefix);
+      if (found == Result.mapping.end())
+        return 0;
+      if (auto FT = found->second.isFloat())
+        return (dl.getTypeSizeInBits(FT) + 7) / 8;
+      if (found->second == BaseType::Pointer)
+        return dl.getPointerSize();
+      return 0;
+    };
+
+    // Size of the elements pointed to at every position, or 0 if the pointee
+    // is not an array of scalars.
+    std::vector<size_t> strides(maxLen, 0);
+    for (size_t pos = 1; pos < maxLen; ++pos) {
+      auto PT = llvm::dyn_cast<llvm::PointerType>(T);
+      if (!PT)
+        break;
+      T = PT->getElementType();
+      llvm::Type *ET = T;
+      while (llvm::isa<llvm::ArrayType>(ET) || llvm::isa<llvm::VectorType>(ET))
+        ET = ET->getContainedType(0);
+      if (ET->isFloatingPointTy() || ET->isIntegerTy() || ET->isPointerTy())
+        strides[pos] = (dl.getTypeSizeInBits(ET) + 7) / 8;
+    }
+
+    for (size_t pos = 0; pos < maxLen; ++pos) {
+      // Group the sequences that only differ at this position
+      std::map<std::vector<int>, std::pair<std::set<int>, ConcreteType>>
+          groups;
+      std::set<std::vector<int>> conflicting;
+      for (const auto &pair : Result.mapping) {
+        if (pair.first.size() <= pos)
+          continue;
+        std::vector<int> key = pair.first;
+        key[pos] = -1;
+        auto found = groups.find(key);
+        if (found == groups.end()) {
+          groups.emplace(key, std::make_pair(std::set<int>({pair.first[pos]}),
+                                             pair.second));
+          continue;
+        }
+        if (found->second.second != pair.second)
+          conflicting.insert(key);
+        found->second.first.insert(pair.first[pos]);
+      }
+
+      for (const auto &group : groups) {
+        const std::set<int> &offsets = group.second.first;
+        if (conflicting.count(group.first) || offsets.size() < 2 ||
+            offsets.count(-1))
+          continue;
+
+        // Every offset must hold a known element of the pointee type, placed
+        // one after the other from offset 0.
+        size_t stride = strides[pos];
+        if (stride == 0)
+          continue;
+        std::vector<int> prefix(group.first.begin(),
+                                group.first.begin() + pos + 1);
+        bool strided = true;
+        int expected = 0;
+        for (int off : offsets) {
+          prefix[pos] = off;
+          if (off != expected || heldSize(prefix) != stride) {
+            strided = false;
+            break;
+          }
+          expected += (int)stride;
+        }
+        if (!strided)
+          continue;
+
+        TypeTree Next;
+        for (const auto &pair : Result.mapping) {
+          if (pair.first.size() > pos) {
+            std::vector<int> key = pair.first;
+            key[pos] = -1;
+            if (key == group.first)
+              continue;
+          }
+          Next.insert(pair.first, pair.second);
+        }
+        Next.insert(group.first, group.second.second);
+        Result = Next;
+      }
+    }
+    return Result;
+  }
+
   /// Select mappings in range [0, max), preserving -1's
   TypeTree AtMost(size_t max) const {
     assert(max > 0);
@@ -25,14 +25,29 @@
 #include "Utils.h"
 
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 
+#include "llvm/Support/MathExtras.h"
+
 using namespace llvm;
 
+extern "C" {
+llvm::cl::opt<bool> EnzymeVectorizeMemcpy(
+    "enzyme-vectorize-memcpy", cl::init(false), cl::Hidden,
+    cl::desc("Use vectorized helpers for the derivatives of memcpy and "
+             "memmove"));
+
+llvm::cl::opt<unsigned> EnzymeMemcpyNonTemporalThreshold(
+    "enzyme-memcpy-nontemporal-threshold", cl::init(1 << 20), cl::Hidden,
+    cl::desc("Size in bytes above which vectorized derivatives of memcpy use "
+             "non-temporal stores (0 to disable)"));
+}
+
 EnzymeFailure::EnzymeFailure(llvm::StringRef RemarkName,
                              const llvm::DiagnosticLocation &Loc,
                              const llvm::Instruction *CodeRegion)
@@ -68,11 +83,220 @@ static inline std::string tofltstr(Type *T) {
   }
 }
 
+/// Create a vectorized function for type which adds the elements of dst into
+/// src and zeros dst; dst, src, numelems. Wide vector operations are
+/// unrolled, with a scalar loop for the remaining elements. Large copies use
+/// non-temporal stores. If move is set, dst and src may overlap and elements
+/// are processed in the order that keeps this correct, as for memmove.
+/// Returns null if the type cannot be vectorized at the given width.
+static Function *getOrInsertVectorDifferentialFloatCopy(
+    Module &M, PointerType *T, unsigned dstalign, unsigned srcalign,
+    unsigned vectorBits, bool move) {
+  Type *elementType = T->getElementType();
+  assert(elementType->isFloatingPointTy());
+  auto &DL = M.getDataLayout();
+  unsigned elemBits = DL.getTypeSizeInBits(elementType);
+  if (DL.getTypeAllocSizeInBits(elementType) != elemBits ||
+      (elemBits & (elemBits - 1)) != 0)
+    return nullptr;
+  unsigned lanes = vectorBits / elemBits;
+  if (lanes < 2 || (lanes & (lanes - 1)) != 0)
+    return nullptr;
+  const unsigned unroll = 4;
+  unsigned step = lanes * unroll;
+  unsigned elemBytes = elemBits / 8;
+  unsigned vecBytes = elemBytes * lanes;
+
+  std::string name = std::string(move ? "__enzyme_memmoveadd_"
+                                      : "__enzyme_memcpyadd_") +
+                     tofltstr(elementType) + "da" + std::to_string(dstalign) +
+                     "sa" + std::to_string(srcalign) + "v" +
+                     std::to_string(lanes);
+  auto i64 = Type::getInt64Ty(M.getContext());
+  FunctionType *FT =
+      FunctionType::get(Type::getVoidTy(M.getContext()), {T, T, i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::ArgMemOnly);
+  F->addFnAttr(Attribute::NoUnwind);
+  F->addParamAttr(0, Attribute::NoCapture);
+  F->addParamAttr(1, Attribute::NoCapture);
+  if (!move) {
+    F->addParamAttr(0, Attribute::NoAlias);
+    F->addParamAttr(1, Attribute::NoAlias);
+  }
+
+#if LLVM_VERSION_MAJOR >= 11
+  Type *VT = FixedVectorType::get(elementType, lanes);
+#else
+  Type *VT = VectorType::get(elementType, lanes);
+#endif
+
+  auto dst = F->arg_begin();
+  dst->setName("dst");
+  auto src = dst + 1;
+  src->setName("src");
+  Value *num = src + 1;
+  num->setName("num");
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *end = BasicBlock::Create(M.getContext(), "for.end", F);
+
+  // Add the Ty sized chunk of dst at idx into src, zeroing dst. Accesses to
+  // vectors are aligned to the smaller of the vector size and the alignment
+  // of the pointers.
+  auto addChunk = [&](IRBuilder<> &B, Value *idx, Type *Ty, unsigned bytes,
+                      bool nontemporal) {
+    auto setAlign = [&](Instruction *I, unsigned align) {
+      align = MinAlign(align ? align : elemBytes, bytes);
+#if LLVM_VERSION_MAJOR >= 10
+      if (auto LI = dyn_cast<LoadInst>(I))
+        LI->setAlignment(Align(align));
+      else
+        cast<StoreInst>(I)->setAlignment(Align(align));
+#else
+      if (auto LI = dyn_cast<LoadInst>(I))
+        LI->setAlignment(align);
+      else
+        cast<StoreInst>(I)->setAlignment(align);
+#endif
+      if (nontemporal && isa<StoreInst>(I))
+        I->setMetadata(LLVMContext::MD_nontemporal,
+                       MDNode::get(I->getContext(),
+                                   ConstantAsMetadata::get(ConstantInt::get(
+                                       Type::getInt32Ty(I->getContext()), 1))));
+    };
+    Value *dsti = B.CreatePointerCast(B.CreateInBoundsGEP(dst, idx),
+                                      PointerType::getUnqual(Ty));
+    LoadInst *dstl = B.CreateLoad(dsti, "dst.i.l");
+    setAlign(dstl, dstalign);
+    setAlign(B.CreateStore(Constant::getNullValue(Ty), dsti), dstalign);
+
+    Value *srci = B.CreatePointerCast(B.CreateInBoundsGEP(src, idx),
+                                      PointerType::getUnqual(Ty));
+    LoadInst *srcl = B.CreateLoad(srci, "src.i.l");
+    setAlign(srcl, srcalign);
+    setAlign(B.CreateStore(B.CreateFAdd(srcl, dstl), srci), srcalign);
+  };
+
+  // Emit a loop over [from, to) in steps of width elements, either in
+  // increasing or decreasing order, ending in exit.
+  auto emitLoop = [&](const Twine &label, BasicBlock *pred, Value *from,
+                      Value *to, unsigned width, bool descending,
+                      bool nontemporal, BasicBlock *exit) {
+    BasicBlock *body = BasicBlock::Create(M.getContext(), label, F, end);
+    IRBuilder<> B(body);
+    B.setFastMathFlags(getFast());
+    PHINode *idx = B.CreatePHI(i64, 2, "idx");
+    idx->addIncoming(descending ? to : from, pred);
+    Value *base = idx;
+    if (descending)
+      base = B.CreateNUWSub(idx, ConstantInt::get(i64, width));
+    if (width == 1) {
+      addChunk(B, base, elementType, elemBytes, nontemporal);
+    } else {
+      // Chunks are visited in the direction of the loop, as required for
+      // overlapping memory
+      for (unsigned i = 0; i < unroll; ++i) {
+        unsigned u = descending ? unroll - 1 - i : i;
+        Value *off = base;
+        if (u != 0)
+          off = B.CreateNUWAdd(base, ConstantInt::get(i64, u * lanes));
+        addChunk(B, off, VT, vecBytes, nontemporal);
+      }
+    }
+    Value *next = descending ? base
+                             : B.CreateNUWAdd(idx, ConstantInt::get(i64, width),
+                                              "idx.next");
+    idx->addIncoming(next, body);
+    B.CreateCondBr(B.CreateICmpEQ(next, descending ? from : to), exit, body);
+    return body;
+  };
+
+  IRBuilder<> B(entry);
+  Value *zero = ConstantInt::get(i64, 0);
+  // Number of elements handled by the vector loop
+  Value *vnum = B.CreateAnd(num, ConstantInt::get(i64, -(int64_t)step), "vnum");
+  Value *ascending = nullptr;
+  if (move)
+    ascending = B.CreateICmpUGE(B.CreatePtrToInt(dst, i64),
+                                B.CreatePtrToInt(src, i64), "ascending");
+
+  // Emit the vector loops over [0, vnum), selecting the non-temporal variant
+  // for copies of at least EnzymeMemcpyNonTemporalThreshold bytes.
+  auto emitVector = [&](StringRef prefix, BasicBlock *pred, bool descending,
+                        BasicBlock *exit) {
+    BasicBlock *check = BasicBlock::Create(M.getContext(), prefix + ".check",
+                                           F, end);
+    {
+      IRBuilder<> PB(pred);
+      PB.CreateCondBr(PB.CreateICmpEQ(vnum, zero), exit, check);
+    }
+    IRBuilder<> CB(check);
+    if (EnzymeMemcpyNonTemporalThreshold == 0) {
+      CB.CreateBr(emitLoop(prefix + ".body", check, zero, vnum, step,
+                           descending, false, exit));
+      return;
+    }
+    Value *large = CB.CreateICmpUGE(
+        CB.CreateMul(num, ConstantInt::get(i64, elemBytes)),
+        ConstantInt::get(i64, EnzymeMemcpyNonTemporalThreshold), "large");
+    CB.CreateCondBr(large,
+                    emitLoop(prefix + ".nt.body", check, zero, vnum, step,
+                             descending, true, exit),
+                    emitLoop(prefix + ".body", check, zero, vnum, step,
+                             descending, false, exit));
+  };
+
+  // Emit the scalar loop over [vnum, num)
+  auto emitScalar = [&](StringRef prefix, BasicBlock *pred, bool descending,
+                        BasicBlock *exit) {
+    IRBuilder<> PB(pred);
+    PB.CreateCondBr(PB.CreateICmpEQ(vnum, num), exit,
+                    emitLoop(prefix + ".body", pred, vnum, num, 1, descending,
+                             false, exit));
+  };
+
+  BasicBlock *fwd = BasicBlock::Create(M.getContext(), "fwd", F, end);
+  BasicBlock *fwdRem = BasicBlock::Create(M.getContext(), "fwd.rem", F, end);
+  emitVector("fwd.vec", fwd, /*descending*/ false, fwdRem);
+  emitScalar("fwd.rem", fwdRem, /*descending*/ false, end);
+  if (move) {
+    BasicBlock *bwd = BasicBlock::Create(M.getContext(), "bwd", F, end);
+    BasicBlock *bwdVec = BasicBlock::Create(M.getContext(), "bwd.vec", F, end);
+    emitScalar("bwd.rem", bwd, /*descending*/ true, bwdVec);
+    emitVector("bwd.vec", bwdVec, /*descending*/ true, end);
+    B.CreateCondBr(ascending, fwd, bwd);
+  } else {
+    B.CreateBr(fwd);
+  }
+
+  {
+    IRBuilder<> B(end);
+    B.CreateRetVoid();
+  }
+  return F;
+}
+
 /// Create function for type that is equivalent to memcpy but adds to
 /// destination rather than a direct copy; dst, src, numelems
 Function *getOrInsertDifferentialFloatMemcpy(Module &M, PointerType *T,
                                              unsigned dstalign,
-                                             unsigned srcalign) {
+                                             unsigned srcalign,
+                                             unsigned vectorBits) {
+  if (vectorBits)
+    if (auto F = getOrInsertVectorDifferentialFloatCopy(
+            M, T, dstalign, srcalign, vectorBits, /*move*/ false))
+      return F;
   Type *elementType = T->getElementType();
   assert(elementType->isFloatingPointTy());
   std::string name = "__enzyme_memcpyadd_" + tofltstr(elementType) + "da" +
@@ -158,15 +382,41 @@ Function *getOrInsertDifferentialFloatMemcpy(Module &M, PointerType *T,
   return F;
 }
 
-// TODO implement differential memmove
+// TODO implement scalar differential memmove
 Function *getOrInsertDifferentialFloatMemmove(Module &M, PointerType *T,
                                               unsigned dstalign,
-                                              unsigned srcalign) {
+                                              unsigned srcalign,
+                                              unsigned vectorBits) {
+  if (vectorBits)
+    if (auto F = getOrInsertVectorDifferentialFloatCopy(
+            M, T, dstalign, srcalign, vectorBits, /*move*/ true))
+      return F;
   llvm::errs() << "warning: didn't implement memmove, using memcpy as fallback "
                   "which can result in errors\n";
   return getOrInsertDifferentialFloatMemcpy(M, T, dstalign, srcalign);
 }
 
+void emitCountedLoop(IRBuilder<> &B, Value *start, Value *end,
+                     const Twine &name,
+                     function_ref<void(IRBuilder<> &, Value *)> body) {
+  Function *F = B.GetInsertBlock()->getParent();
+  LLVMContext &Ctx = F->getContext();
+  BasicBlock *preheader = B.GetInsertBlock();
+  BasicBlock *loop = BasicBlock::Create(Ctx, name + ".body", F);
+  BasicBlock *exit = BasicBlock::Create(Ctx, name + ".end", F);
+  B.CreateCondBr(B.CreateICmpSLT(start, end), loop, exit);
+
+  B.SetInsertPoint(loop);
+  PHINode *idx = B.CreatePHI(start->getType(), 2, name + ".idx");
+  idx->addIncoming(start, preheader);
+  body(B, idx);
+  Value *next = B.CreateNUWAdd(idx, ConstantInt::get(idx->getType(), 1),
+                               name + ".next");
+  idx->addIncoming(next, B.GetInsertBlock());
+  B.CreateCondBr(B.CreateICmpSLT(next, end), loop, exit);
+  B.SetInsertPoint(exit);
+}
+
 /// Create function to computer nearest power of two
 llvm::Value *nextPowerOfTwo(llvm::IRBuilder<> &B, llvm::Value *V) {
   assert(V->getType()->isIntegerTy());
@@ -179,6 +429,997 @@ llvm::Value *nextPowerOfTwo(llvm::IRBuilder<> &B, llvm::Value *V) {
   return V;
 }
 
+/// Return the thread local state of the tape stack, a struct of the current
+/// chunk, the offset of its first free byte and its capacity. Each chunk
+/// begins with a header saving the state of the previous chunk.
+static GlobalVariable *getOrInsertTapeStackState(Module &M) {
+  std::string name = "__enzyme_tapestack";
+  if (auto GV = M.getGlobalVariable(name, /*AllowInternal*/ true))
+    return GV;
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto ST = StructType::get(Type::getInt8PtrTy(M.getContext()), i64, i64);
+  return new GlobalVariable(M, ST, false, GlobalVariable::InternalLinkage,
+                            Constant::getNullValue(ST), name, nullptr,
+                            GlobalVariable::GeneralDynamicTLSModel);
+}
+
+/// Size of the header at the start of each tape stack chunk
+static const uint64_t TapeStackHeader = 32;
+/// Minimum size of a tape stack chunk
+static const uint64_t TapeStackChunk = 65536;
+
+/// Round a tape stack record size up to keep records 16 byte aligned
+static Value *roundTapeStackSize(IRBuilder<> &B, Value *size) {
+  auto T = size->getType();
+  return B.CreateAnd(B.CreateAdd(size, ConstantInt::get(T, 15)),
+                     ConstantInt::get(T, -16));
+}
+
+Function *getOrInsertTapeStackPush(Module &M) {
+  std::string name = "__enzyme_tapestack_push";
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT = FunctionType::get(i8p, {i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+  F->addAttribute(AttributeList::ReturnIndex, Attribute::NoAlias);
+  F->addAttribute(AttributeList::ReturnIndex, Attribute::NonNull);
+
+  auto state = getOrInsertTapeStackState(M);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *grow = BasicBlock::Create(M.getContext(), "grow", F);
+  BasicBlock *bump = BasicBlock::Create(M.getContext(), "bump", F);
+
+  Value *size = F->arg_begin();
+  size->setName("size");
+
+  auto chunkPtr = [&](IRBuilder<> &B, unsigned idx) {
+    return B.CreateConstInBoundsGEP2_32(state->getValueType(), state, 0, idx);
+  };
+
+  IRBuilder<> B(entry);
+  size = roundTapeStackSize(B, size);
+  Value *top = B.CreateLoad(chunkPtr(B, 1), "top");
+  Value *cap = B.CreateLoad(chunkPtr(B, 2), "cap");
+  B.CreateCondBr(B.CreateICmpULE(B.CreateAdd(top, size), cap), bump, grow);
+
+  {
+    // Start a new chunk, recording the state of the current one in its
+    // header so that it can be restored once the new chunk is emptied.
+    B.SetInsertPoint(grow);
+    auto header = ConstantInt::get(i64, TapeStackHeader);
+    auto needed = B.CreateAdd(size, header);
+    auto minimum = ConstantInt::get(i64, TapeStackChunk);
+    auto chunkSize =
+        B.CreateSelect(B.CreateICmpUGT(needed, minimum), needed, minimum);
+    auto br = B.CreateBr(bump);
+    Instruction *chunk = CallInst::CreateMalloc(
+        br, i64, Type::getInt8Ty(M.getContext()), ConstantInt::get(i64, 1),
+        chunkSize, nullptr, "chunk");
+    B.SetInsertPoint(br);
+    auto saved = B.CreatePointerCast(
+        chunk, PointerType::getUnqual(state->getValueType()));
+    for (unsigned i = 0; i < 3; i++)
+      B.CreateStore(B.CreateLoad(chunkPtr(B, i)),
+                    B.CreateConstInBoundsGEP2_32(state->getValueType(), saved,
+                                                 0, i));
+    B.CreateStore(chunk, chunkPtr(B, 0));
+    B.CreateStore(header, chunkPtr(B, 1));
+    B.CreateStore(chunkSize, chunkPtr(B, 2));
+  }
+
+  {
+    B.SetInsertPoint(bump);
+    Value *base = B.CreateLoad(chunkPtr(B, 0), "base");
+    top = B.CreateLoad(chunkPtr(B, 1), "top");
+    Value *res = B.CreateInBoundsGEP(base, top, "record");
+    B.CreateStore(B.CreateAdd(top, size, "", /*NUW*/ true, /*NSW*/ true),
+                  chunkPtr(B, 1));
+    B.CreateRet(res);
+  }
+  return F;
+}
+
+Function *getOrInsertTapeStackPop(Module &M) {
+  std::string name = "__enzyme_tapestack_pop";
+  auto i64 = Type::getInt64Ty(M.getContext());
+  FunctionType *FT =
+      FunctionType::get(Type::getVoidTy(M.getContext()), {i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  auto state = getOrInsertTapeStackState(M);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *underflow = BasicBlock::Create(M.getContext(), "underflow", F);
+  BasicBlock *pop = BasicBlock::Create(M.getContext(), "pop", F);
+  BasicBlock *release = BasicBlock::Create(M.getContext(), "release", F);
+  BasicBlock *end = BasicBlock::Create(M.getContext(), "end", F);
+
+  Value *size = F->arg_begin();
+  size->setName("size");
+
+  auto chunkPtr = [&](IRBuilder<> &B, unsigned idx) {
+    return B.CreateConstInBoundsGEP2_32(state->getValueType(), state, 0, idx);
+  };
+
+  IRBuilder<> B(entry);
+  size = roundTapeStackSize(B, size);
+  Value *cur = B.CreateLoad(chunkPtr(B, 1), "cur");
+  // The current chunk must hold a record of this size above its header. An
+  // empty stack has no chunk and an offset of zero, so is caught too.
+  B.CreateCondBr(
+      B.CreateICmpUGE(cur, B.CreateAdd(size, ConstantInt::get(
+                                                 i64, TapeStackHeader))),
+      pop, underflow);
+
+  {
+    B.SetInsertPoint(underflow);
+#if LLVM_VERSION_MAJOR >= 9
+    auto putsF = M.getOrInsertFunction(
+        "puts", FunctionType::get(Type::getInt32Ty(M.getContext()),
+                                  {Type::getInt8PtrTy(M.getContext())},
+                                  false));
+#else
+    auto putsF = cast<Function>(M.getOrInsertFunction(
+        "puts", FunctionType::get(Type::getInt32Ty(M.getContext()),
+                                  {Type::getInt8PtrTy(M.getContext())},
+                                  false)));
+#endif
+    B.CreateCall(putsF, B.CreateGlobalStringPtr(
+                            "Enzyme: tape stack popped more than was pushed"));
+    B.CreateCall(Intrinsic::getDeclaration(&M, Intrinsic::trap));
+    B.CreateUnreachable();
+  }
+
+  B.SetInsertPoint(pop);
+  Value *top = B.CreateSub(cur, size, "top", /*NUW*/ true, /*NSW*/ true);
+  B.CreateStore(top, chunkPtr(B, 1));
+  B.CreateCondBr(
+      B.CreateICmpEQ(top, ConstantInt::get(i64, TapeStackHeader)), release,
+      end);
+
+  {
+    // The chunk is empty, restore the previous one and release it.
+    B.SetInsertPoint(release);
+    Value *chunk = B.CreateLoad(chunkPtr(B, 0), "chunk");
+    auto saved = B.CreatePointerCast(
+        chunk, PointerType::getUnqual(state->getValueType()));
+    for (unsigned i = 0; i < 3; i++)
+      B.CreateStore(B.CreateLoad(B.CreateConstInBoundsGEP2_32(
+                        state->getValueType(), saved, 0, i)),
+                    chunkPtr(B, i));
+    B.CreateBr(end);
+    CallInst::CreateFree(chunk, release->getTerminator());
+  }
+
+  {
+    B.SetInsertPoint(end);
+    B.CreateRetVoid();
+  }
+  return F;
+}
+
+Function *getOrInsertCacheGrow(Module &M, bool tapeBuffer) {
+  std::string name =
+      tapeBuffer ? "__enzyme_tapebuffer_cache_grow" : "__enzyme_cache_grow";
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT = FunctionType::get(i8p, {i8p, i64, i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *grow = BasicBlock::Create(M.getContext(), "grow", F);
+  BasicBlock *keep = BasicBlock::Create(M.getContext(), "keep", F);
+
+  auto arg = F->arg_begin();
+  Value *ptr = arg;
+  ptr->setName("ptr");
+  Value *size = ++arg;
+  size->setName("size");
+  Value *oldsize = ++arg;
+  oldsize->setName("oldsize");
+
+  IRBuilder<> B(entry);
+  B.CreateCondBr(B.CreateOr(B.CreateIsNull(ptr),
+                            B.CreateICmpNE(size, oldsize)),
+                 grow, keep);
+
+  B.SetInsertPoint(grow);
+  if (tapeBuffer) {
+    B.CreateRet(B.CreateCall(getOrInsertTapeBufferRealloc(M), {ptr, size}));
+  } else {
+    auto realloc = M.getOrInsertFunction("realloc", i8p, i8p, i64);
+    B.CreateRet(B.CreateCall(realloc, {ptr, size}));
+  }
+
+  B.SetInsertPoint(keep);
+  B.CreateRet(ptr);
+  return F;
+}
+
+/// Return the thread local state of the tape buffer, a struct of the start
+/// of the caller provided buffer, its first free byte, its end, the number
+/// of bytes requested and the number of caches reallocated on the heap
+/// since it was set. If last, return instead the state which the most recent
+/// call given a tape buffer left behind.
+static GlobalVariable *getOrInsertTapeBufferState(Module &M,
+                                                  bool last = false) {
+  std::string name = last ? "__enzyme_tapebuffer_last" : "__enzyme_tapebuffer";
+  if (auto GV = M.getGlobalVariable(name, /*AllowInternal*/ true))
+    return GV;
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto ST = StructType::get(i8p, i8p, i8p, i64, i64);
+  return new GlobalVariable(M, ST, false, GlobalVariable::InternalLinkage,
+                            Constant::getNullValue(ST), name, nullptr,
+                            GlobalVariable::GeneralDynamicTLSModel);
+}
+
+static Value *getTapeBufferField(IRBuilder<> &B, GlobalVariable *state,
+                                 unsigned idx) {
+  return B.CreateConstInBoundsGEP2_32(state->getValueType(), state, 0, idx);
+}
+
+Function *getOrInsertTapeBufferAlloc(Module &M) {
+  std::string name = "__enzyme_tapebuffer_alloc";
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT = FunctionType::get(i8p, {i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+  F->addAttribute(AttributeList::ReturnIndex, Attribute::NoAlias);
+
+  auto state = getOrInsertTapeBufferState(M);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *bump = BasicBlock::Create(M.getContext(), "bump", F);
+  BasicBlock *heap = BasicBlock::Create(M.getContext(), "heap", F);
+
+  Value *size = F->arg_begin();
+  size->setName("size");
+
+  IRBuilder<> B(entry);
+  Value *rounded = roundTapeStackSize(B, size);
+  Value *needed = getTapeBufferField(B, state, 3);
+  B.CreateStore(B.CreateAdd(B.CreateLoad(needed), rounded), needed);
+  Value *cur = B.CreateLoad(getTapeBufferField(B, state, 1), "cur");
+  Value *end = B.CreateLoad(getTapeBufferField(B, state, 2), "end");
+  Value *avail = B.CreateSub(B.CreatePtrToInt(end, i64),
+                             B.CreatePtrToInt(cur, i64), "avail");
+  // An unset buffer has no space available.
+  B.CreateCondBr(B.CreateICmpULE(rounded, avail), bump, heap);
+
+  {
+    B.SetInsertPoint(bump);
+    B.CreateStore(B.CreateInBoundsGEP(cur, rounded),
+                  getTapeBufferField(B, state, 1));
+    B.CreateRet(cur);
+  }
+
+  {
+    // Fall back to the heap once the buffer is exhausted.
+    B.SetInsertPoint(heap);
+    auto ret = B.CreateRet(UndefValue::get(i8p));
+    Instruction *mem =
+        CallInst::CreateMalloc(ret, i64, Type::getInt8Ty(M.getContext()),
+                               ConstantInt::get(i64, 1), size, nullptr, "mem");
+    ret->setOperand(0, mem);
+  }
+  return F;
+}
+
+Function *getOrInsertTapeBufferFree(Module &M) {
+  std::string name = "__enzyme_tapebuffer_free";
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT =
+      FunctionType::get(Type::getVoidTy(M.getContext()), {i8p}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  auto state = getOrInsertTapeBufferState(M);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *heap = BasicBlock::Create(M.getContext(), "heap", F);
+  BasicBlock *end = BasicBlock::Create(M.getContext(), "end", F);
+
+  Value *ptr = F->arg_begin();
+  ptr->setName("ptr");
+
+  // Memory within the buffer is owned by the caller.
+  IRBuilder<> B(entry);
+  Value *start = B.CreateLoad(getTapeBufferField(B, state, 0), "start");
+  Value *stop = B.CreateLoad(getTapeBufferField(B, state, 2), "stop");
+  Value *inBuffer = B.CreateAnd(B.CreateICmpUGE(ptr, start),
+                                B.CreateICmpULT(ptr, stop));
+  B.CreateCondBr(inBuffer, end, heap);
+
+  {
+    B.SetInsertPoint(heap);
+    B.CreateBr(end);
+    CallInst::CreateFree(ptr, heap->getTerminator());
+  }
+
+  {
+    B.SetInsertPoint(end);
+    B.CreateRetVoid();
+  }
+  return F;
+}
+
+Function *getOrInsertTapeBufferRealloc(Module &M) {
+  std::string name = "__enzyme_tapebuffer_realloc";
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT = FunctionType::get(i8p, {i8p, i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  auto state = getOrInsertTapeBufferState(M);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+
+  auto arg = F->arg_begin();
+  Value *ptr = arg;
+  ptr->setName("ptr");
+  Value *size = ++arg;
+  size->setName("size");
+
+  // The cache lives on the heap rather than in the buffer, and so can not
+  // be serialized along with it.
+  IRBuilder<> B(entry);
+  Value *reallocs = getTapeBufferField(B, state, 4);
+  B.CreateStore(B.CreateAdd(B.CreateLoad(reallocs), ConstantInt::get(i64, 1)),
+                reallocs);
+  auto realloc = M.getOrInsertFunction("realloc", i8p, i8p, i64);
+  B.CreateRet(B.CreateCall(realloc, {ptr, size}));
+  return F;
+}
+
+void setTapeBuffer(IRBuilder<> &B, Value *buffer, Value *size,
+                   bool resetCursor) {
+  Module &M = *B.GetInsertBlock()->getParent()->getParent();
+  auto state = getOrInsertTapeBufferState(M);
+  buffer = B.CreatePointerCast(buffer, Type::getInt8PtrTy(M.getContext()));
+  size = B.CreateZExtOrTrunc(size, Type::getInt64Ty(M.getContext()));
+  Value *end = B.CreateInBoundsGEP(buffer, size);
+  B.CreateStore(buffer, getTapeBufferField(B, state, 0));
+  B.CreateStore(end, getTapeBufferField(B, state, 2));
+  if (resetCursor) {
+    B.CreateStore(buffer, getTapeBufferField(B, state, 1));
+    B.CreateStore(ConstantInt::get(Type::getInt64Ty(M.getContext()), 0),
+                  getTapeBufferField(B, state, 3));
+    B.CreateStore(ConstantInt::get(Type::getInt64Ty(M.getContext()), 0),
+                  getTapeBufferField(B, state, 4));
+  } else {
+    // Continue after the tape which the previous call left in the buffer. A
+    // buffer filled by another thread, whose cursor is unknown here, is
+    // considered full such that the tape within it is not overwritten.
+    auto last = getOrInsertTapeBufferState(M, /*last*/ true);
+    Value *cur = B.CreateLoad(getTapeBufferField(B, last, 1));
+    Value *inBuffer = B.CreateAnd(B.CreateICmpUGE(cur, buffer),
+                                  B.CreateICmpULE(cur, end));
+    B.CreateStore(B.CreateSelect(inBuffer, cur, end),
+                  getTapeBufferField(B, state, 1));
+    B.CreateStore(B.CreateLoad(getTapeBufferField(B, last, 3)),
+                  getTapeBufferField(B, state, 3));
+    B.CreateStore(B.CreateLoad(getTapeBufferField(B, last, 4)),
+                  getTapeBufferField(B, state, 4));
+  }
+}
+
+Value *saveTapeBuffer(IRBuilder<> &B) {
+  Module &M = *B.GetInsertBlock()->getParent()->getParent();
+  auto state = getOrInsertTapeBufferState(M);
+  return B.CreateLoad(state->getValueType(), state, "tapebuffer");
+}
+
+void restoreTapeBuffer(IRBuilder<> &B, Value *saved) {
+  Module &M = *B.GetInsertBlock()->getParent()->getParent();
+  auto state = getOrInsertTapeBufferState(M);
+  auto last = getOrInsertTapeBufferState(M, /*last*/ true);
+  B.CreateStore(B.CreateLoad(state->getValueType(), state), last);
+  B.CreateStore(saved, state);
+}
+
+Value *getTapeBufferRequested(IRBuilder<> &B) {
+  Module &M = *B.GetInsertBlock()->getParent()->getParent();
+  return B.CreateLoad(
+      getTapeBufferField(B, getOrInsertTapeBufferState(M, /*last*/ true), 3));
+}
+
+Value *getTapeBufferOffset(IRBuilder<> &B, Value *ptr) {
+  Module &M = *B.GetInsertBlock()->getParent()->getParent();
+  auto i64 = Type::getInt64Ty(M.getContext());
+  Value *start = B.CreateLoad(
+      getTapeBufferField(B, getOrInsertTapeBufferState(M), 0), "tapestart");
+  Value *offset =
+      B.CreateSub(B.CreatePtrToInt(ptr, i64), B.CreatePtrToInt(start, i64));
+  return B.CreateIntToPtr(offset, ptr->getType(), ptr->getName() + "_offset");
+}
+
+Value *getTapeBufferPointer(IRBuilder<> &B, Value *offset) {
+  Module &M = *B.GetInsertBlock()->getParent()->getParent();
+  auto i64 = Type::getInt64Ty(M.getContext());
+  Value *start = B.CreateLoad(
+      getTapeBufferField(B, getOrInsertTapeBufferState(M), 0), "tapestart");
+  // Not inbounds, as memory which fell back to the heap is also addressed
+  // relative to the buffer.
+  Value *ptr = B.CreateGEP(start, B.CreatePtrToInt(offset, i64));
+  return B.CreatePointerCast(ptr, offset->getType());
+}
+
+static CallInst *createTapeBufferCopy(IRBuilder<> &B, Value *dst, Value *src,
+                                      Value *size) {
+  Module &M = *B.GetInsertBlock()->getParent()->getParent();
+  Value *nargs[] = {dst, src, size, ConstantInt::getFalse(M.getContext())};
+  Type *tys[] = {dst->getType(), src->getType(), size->getType()};
+  auto memcpyF = Intrinsic::getDeclaration(&M, Intrinsic::memcpy, tys);
+  return B.CreateCall(memcpyF, nargs);
+}
+
+Function *getOrInsertTapeBufferSerialize(Module &M) {
+  std::string name = "__enzyme_tapebuffer_serialize";
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT = FunctionType::get(i64, {i8p, i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  auto state = getOrInsertTapeBufferState(M, /*last*/ true);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *check = BasicBlock::Create(M.getContext(), "check", F);
+  BasicBlock *copy = BasicBlock::Create(M.getContext(), "copy", F);
+  BasicBlock *end = BasicBlock::Create(M.getContext(), "end", F);
+  BasicBlock *fail = BasicBlock::Create(M.getContext(), "fail", F);
+
+  auto arg = F->arg_begin();
+  Value *dst = arg;
+  dst->setName("dst");
+  ++arg;
+  Value *size = arg;
+  size->setName("size");
+
+  IRBuilder<> B(entry);
+  Value *start = B.CreateLoad(getTapeBufferField(B, state, 0), "start");
+  Value *cur = B.CreateLoad(getTapeBufferField(B, state, 1), "cur");
+  Value *used = B.CreateSub(B.CreatePtrToInt(cur, i64),
+                            B.CreatePtrToInt(start, i64), "used");
+  Value *needed = B.CreateLoad(getTapeBufferField(B, state, 3), "needed");
+  Value *reallocs = B.CreateLoad(getTapeBufferField(B, state, 4), "reallocs");
+  // Memory which fell back to the heap, or caches reallocated there, are not
+  // moved along with the buffer.
+  Value *inBuffer = B.CreateAnd(B.CreateICmpEQ(needed, used),
+                                B.CreateIsNull(reallocs));
+  B.CreateCondBr(inBuffer, check, fail);
+
+  {
+    B.SetInsertPoint(check);
+    B.CreateCondBr(B.CreateICmpULE(used, size), copy, end);
+  }
+
+  {
+    B.SetInsertPoint(copy);
+    createTapeBufferCopy(B, dst, start, used);
+    B.CreateBr(end);
+  }
+
+  {
+    B.SetInsertPoint(end);
+    B.CreateRet(used);
+  }
+
+  {
+    B.SetInsertPoint(fail);
+    B.CreateRet(ConstantInt::get(i64, 0));
+  }
+  return F;
+}
+
+Function *getOrInsertTapeBufferDeserialize(Module &M) {
+  std::string name = "__enzyme_tapebuffer_deserialize";
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT = FunctionType::get(i64, {i8p, i64, i8p, i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  auto state = getOrInsertTapeBufferState(M, /*last*/ true);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *copy = BasicBlock::Create(M.getContext(), "copy", F);
+  BasicBlock *fail = BasicBlock::Create(M.getContext(), "fail", F);
+
+  auto arg = F->arg_begin();
+  Value *src = arg;
+  src->setName("src");
+  ++arg;
+  Value *used = arg;
+  used->setName("used");
+  ++arg;
+  Value *buffer = arg;
+  buffer->setName("buffer");
+  ++arg;
+  Value *size = arg;
+  size->setName("size");
+
+  IRBuilder<> B(entry);
+  B.CreateCondBr(B.CreateICmpULE(used, size), copy, fail);
+
+  {
+    // Allocations of the reverse pass, given this buffer, continue after the
+    // copied tape.
+    B.SetInsertPoint(copy);
+    createTapeBufferCopy(B, buffer, src, used);
+    B.CreateStore(buffer, getTapeBufferField(B, state, 0));
+    B.CreateStore(B.CreateInBoundsGEP(buffer, used),
+                  getTapeBufferField(B, state, 1));
+    B.CreateStore(B.CreateInBoundsGEP(buffer, size),
+                  getTapeBufferField(B, state, 2));
+    B.CreateStore(used, getTapeBufferField(B, state, 3));
+    B.CreateStore(ConstantInt::get(i64, 0), getTapeBufferField(B, state, 4));
+    B.CreateRet(used);
+  }
+
+  {
+    B.SetInsertPoint(fail);
+    B.CreateRet(ConstantInt::get(i64, 0));
+  }
+  return F;
+}
+
+/// Size of the header preceding memory returned by the mapped cache
+/// allocation function, holding the length of the mapping (or 0 if the
+/// memory is on the heap) and the window last accessed
+static const unsigned MappedCacheHeader = 16;
+
+/// Log2 of the size of the windows in which mapped caches are paged
+static const unsigned MappedCacheWindowBits = 26;
+
+static Value *getMappedCacheField(IRBuilder<> &B, Value *header,
+                                  unsigned idx) {
+  auto i64p = Type::getInt64PtrTy(B.getContext());
+  return B.CreateConstInBoundsGEP1_32(B.CreatePointerCast(header, i64p), idx);
+}
+
+Function *getOrInsertMappedCacheAlloc(Module &M) {
+  std::string name = "__enzyme_mappedcache_alloc";
+  auto i32 = Type::getInt32Ty(M.getContext());
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT = FunctionType::get(i8p, {i64, i64}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+  F->addAttribute(AttributeList::ReturnIndex, Attribute::NoAlias);
+  F->addAttribute(AttributeList::ReturnIndex, Attribute::NonNull);
+
+  auto tmpfileF = M.getOrInsertFunction("tmpfile", i8p);
+  auto filenoF = M.getOrInsertFunction("fileno", i32, i8p);
+  auto ftruncateF = M.getOrInsertFunction("ftruncate", i32, i32, i64);
+  auto mmapF = M.getOrInsertFunction("mmap", i8p, i8p, i64, i32, i32, i32, i64);
+  auto fcloseF = M.getOrInsertFunction("fclose", i32, i8p);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *open = BasicBlock::Create(M.getContext(), "open", F);
+  BasicBlock *resize = BasicBlock::Create(M.getContext(), "resize", F);
+  BasicBlock *map = BasicBlock::Create(M.getContext(), "map", F);
+  BasicBlock *close = BasicBlock::Create(M.getContext(), "close", F);
+  BasicBlock *mapped = BasicBlock::Create(M.getContext(), "mapped", F);
+  BasicBlock *heap = BasicBlock::Create(M.getContext(), "heap", F);
+
+  auto arg = F->arg_begin();
+  Value *size = arg;
+  size->setName("size");
+  ++arg;
+  Value *threshold = arg;
+  threshold->setName("threshold");
+
+  IRBuilder<> B(entry);
+  Value *len = B.CreateAdd(size, ConstantInt::get(i64, MappedCacheHeader),
+                           "len", /*NUW*/ true, /*NSW*/ true);
+  B.CreateCondBr(B.CreateICmpUGE(size, threshold), open, heap);
+
+  Value *file;
+  {
+    // The file is removed once closed, which the mapping outlives.
+    B.SetInsertPoint(open);
+    file = B.CreateCall(tmpfileF, ArrayRef<Value *>(), "file");
+    B.CreateCondBr(B.CreateIsNull(file), heap, resize);
+  }
+
+  {
+    B.SetInsertPoint(resize);
+    Value *fd = B.CreateCall(filenoF, {file}, "fd");
+    Value *res = B.CreateCall(ftruncateF, {fd, len});
+    B.CreateCondBr(B.CreateICmpEQ(res, ConstantInt::get(i32, 0)), map, close);
+
+    B.SetInsertPoint(map);
+    // PROT_READ | PROT_WRITE, MAP_SHARED
+    Value *args[] = {ConstantPointerNull::get(i8p),
+                     len,
+                     ConstantInt::get(i32, 3),
+                     ConstantInt::get(i32, 1),
+                     fd,
+                     ConstantInt::get(i64, 0)};
+    Value *mem = B.CreateCall(mmapF, args, "mem");
+    B.CreateCall(fcloseF, {file});
+    Value *failed = B.CreateICmpEQ(B.CreatePtrToInt(mem, i64),
+                                   ConstantInt::getAllOnesValue(i64));
+    B.CreateCondBr(failed, heap, mapped);
+
+    B.SetInsertPoint(mapped);
+    B.CreateStore(len, getMappedCacheField(B, mem, 0));
+    B.CreateStore(ConstantInt::getAllOnesValue(i64),
+                  getMappedCacheField(B, mem, 1));
+    B.CreateRet(B.CreateConstInBoundsGEP1_32(mem, MappedCacheHeader));
+  }
+
+  {
+    B.SetInsertPoint(close);
+    B.CreateCall(fcloseF, {file});
+    B.CreateBr(heap);
+  }
+
+  {
+    // Caches below the threshold, or which could not be mapped, are
+    // allocated on the heap.
+    B.SetInsertPoint(heap);
+    auto ret = B.CreateRet(UndefValue::get(i8p));
+    Instruction *mem =
+        CallInst::CreateMalloc(ret, i64, Type::getInt8Ty(M.getContext()),
+                               ConstantInt::get(i64, 1), len, nullptr, "mem");
+    B.SetInsertPoint(ret);
+    B.CreateStore(ConstantInt::get(i64, 0), getMappedCacheField(B, mem, 0));
+    ret->setOperand(0, B.CreateConstInBoundsGEP1_32(mem, MappedCacheHeader));
+  }
+  return F;
+}
+
+Function *getOrInsertMappedCacheFree(Module &M) {
+  std::string name = "__enzyme_mappedcache_free";
+  auto i32 = Type::getInt32Ty(M.getContext());
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT =
+      FunctionType::get(Type::getVoidTy(M.getContext()), {i8p}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  auto munmapF = M.getOrInsertFunction("munmap", i32, i8p, i64);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *unmap = BasicBlock::Create(M.getContext(), "unmap", F);
+  BasicBlock *heap = BasicBlock::Create(M.getContext(), "heap", F);
+  BasicBlock *end = BasicBlock::Create(M.getContext(), "end", F);
+
+  Value *ptr = F->arg_begin();
+  ptr->setName("ptr");
+
+  IRBuilder<> B(entry);
+  Value *header = B.CreateInBoundsGEP(
+      ptr, ConstantInt::getSigned(i64, -(int64_t)MappedCacheHeader), "header");
+  Value *len = B.CreateLoad(getMappedCacheField(B, header, 0), "len");
+  B.CreateCondBr(B.CreateICmpEQ(len, ConstantInt::get(i64, 0)), heap, unmap);
+
+  {
+    B.SetInsertPoint(unmap);
+    B.CreateCall(munmapF, {header, len});
+    B.CreateBr(end);
+  }
+
+  {
+    B.SetInsertPoint(heap);
+    B.CreateBr(end);
+    CallInst::CreateFree(header, heap->getTerminator());
+  }
+
+  {
+    B.SetInsertPoint(end);
+    B.CreateRetVoid();
+  }
+  return F;
+}
+
+Function *getOrInsertMappedCacheAdvise(Module &M) {
+  std::string name = "__enzyme_mappedcache_advise";
+  auto i32 = Type::getInt32Ty(M.getContext());
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  FunctionType *FT =
+      FunctionType::get(Type::getVoidTy(M.getContext()), {i8p, i8p}, false);
+
+#if LLVM_VERSION_MAJOR >= 9
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT).getCallee());
+#else
+  Function *F = cast<Function>(M.getOrInsertFunction(name, FT));
+#endif
+
+  if (!F->empty())
+    return F;
+
+  F->setLinkage(Function::LinkageTypes::InternalLinkage);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  auto madviseF = M.getOrInsertFunction("madvise", i32, i8p, i64, i32);
+
+  BasicBlock *entry = BasicBlock::Create(M.getContext(), "entry", F);
+  BasicBlock *check = BasicBlock::Create(M.getContext(), "check", F);
+  BasicBlock *moved = BasicBlock::Create(M.getContext(), "moved", F);
+  BasicBlock *release = BasicBlock::Create(M.getContext(), "release", F);
+  BasicBlock *next = BasicBlock::Create(M.getContext(), "next", F);
+  BasicBlock *prefetch = BasicBlock::Create(M.getContext(), "prefetch", F);
+  BasicBlock *end = BasicBlock::Create(M.getContext(), "end", F);
+
+  auto arg = F->arg_begin();
+  Value *ptr = arg;
+  ptr->setName("ptr");
+  ++arg;
+  Value *cur = arg;
+  cur->setName("cur");
+
+  IRBuilder<> B(entry);
+  Value *header = B.CreateInBoundsGEP(
+      ptr, ConstantInt::getSigned(i64, -(int64_t)MappedCacheHeader), "header");
+  Value *len = B.CreateLoad(getMappedCacheField(B, header, 0), "len");
+  B.CreateCondBr(B.CreateICmpEQ(len, ConstantInt::get(i64, 0)), end, check);
+
+  // Advise the pages of the given window of the mapping
+  auto advise = [&](Value *window, int advice) {
+    Value *offset =
+        B.CreateShl(window, ConstantInt::get(i64, MappedCacheWindowBits));
+    Value *size = B.CreateSub(len, offset);
+    Value *windowSize = ConstantInt::get(i64, 1ULL << MappedCacheWindowBits);
+    size = B.CreateSelect(B.CreateICmpULT(size, windowSize), size, windowSize);
+    B.CreateCall(madviseF, {B.CreateGEP(header, offset), size,
+                            ConstantInt::get(i32, advice)});
+  };
+
+  Value *last, *window;
+  {
+    B.SetInsertPoint(check);
+    Value *lastPtr = getMappedCacheField(B, header, 1);
+    last = B.CreateLoad(lastPtr, "last");
+    window = B.CreateLShr(B.CreateSub(B.CreatePtrToInt(cur, i64),
+                                      B.CreatePtrToInt(header, i64)),
+                          ConstantInt::get(i64, MappedCacheWindowBits),
+                          "window");
+    B.CreateCondBr(B.CreateICmpEQ(last, window), end, moved);
+
+    B.SetInsertPoint(moved);
+    B.CreateStore(window, lastPtr);
+    B.CreateCondBr(B.CreateICmpEQ(last, ConstantInt::getAllOnesValue(i64)),
+                   next, release);
+  }
+
+  {
+    // The window left is not accessed again, MADV_DONTNEED
+    B.SetInsertPoint(release);
+    advise(last, 4);
+    B.CreateBr(next);
+  }
+
+  {
+    // Caches are read back in reverse, hence request the preceding window
+    // ahead of its use, MADV_WILLNEED
+    B.SetInsertPoint(next);
+    Value *backward = B.CreateICmpULT(window, last);
+    Value *first = B.CreateICmpEQ(window, ConstantInt::get(i64, 0));
+    B.CreateCondBr(B.CreateAnd(backward, B.CreateNot(first)), prefetch, end);
+
+    B.SetInsertPoint(prefetch);
+    advise(B.CreateSub(window, ConstantInt::get(i64, 1)), 3);
+    B.CreateBr(end);
+  }
+
+  {
+    B.SetInsertPoint(end);
+    B.CreateRetVoid();
+  }
+  return F;
+}
+
+void markTapeProfileCall(CallInst *CI, StringRef kind, StringRef cache,
+                         BasicBlock *header) {
+  LLVMContext &C = CI->getContext();
+  DebugLoc loc = CI->getDebugLoc();
+  if (header)
+    for (auto &I : *header)
+      if (I.getDebugLoc()) {
+        loc = I.getDebugLoc();
+        break;
+      }
+  StringRef file = "";
+  unsigned line = 0;
+  if (loc) {
+    file = loc->getFilename();
+    line = loc.getLine();
+  }
+  Metadata *ops[] = {
+      MDString::get(C, kind), MDString::get(C, cache),
+      MDString::get(C, header ? header->getName() : ""),
+      MDString::get(C, file),
+      ConstantAsMetadata::get(ConstantInt::get(Type::getInt32Ty(C), line))};
+  CI->setMetadata("enzyme_tapeprofile", MDNode::get(C, ops));
+}
+
+void instrumentTapeProfile(Function &F) {
+  Module &M = *F.getParent();
+  auto i32 = Type::getInt32Ty(M.getContext());
+  auto i64 = Type::getInt64Ty(M.getContext());
+  auto i8p = Type::getInt8PtrTy(M.getContext());
+  auto voidTy = Type::getVoidTy(M.getContext());
+
+  // The runtime library describes each site as
+  // { function, cache, loop, file, line }
+  StructType *siteTy = StructType::get(i8p, i8p, i8p, i8p, i32);
+  auto allocF = M.getOrInsertFunction("__enzyme_tape_profile_alloc", voidTy,
+                                      i8p, i64, PointerType::getUnqual(siteTy));
+  auto reallocF =
+      M.getOrInsertFunction("__enzyme_tape_profile_realloc", voidTy, i8p, i8p,
+                            i64, PointerType::getUnqual(siteTy));
+  auto freeF = M.getOrInsertFunction("__enzyme_tape_profile_free", voidTy, i8p);
+
+  SmallVector<CallInst *, 8> calls;
+  for (auto &BB : F)
+    for (auto &I : BB)
+      if (auto CI = dyn_cast<CallInst>(&I))
+        if (CI->getMetadata("enzyme_tapeprofile"))
+          calls.push_back(CI);
+
+  for (auto CI : calls) {
+    MDNode *md = CI->getMetadata("enzyme_tapeprofile");
+    CI->setMetadata("enzyme_tapeprofile", nullptr);
+    StringRef kind = cast<MDString>(md->getOperand(0))->getString();
+
+    if (kind == "free") {
+      IRBuilder<> B(CI);
+      B.CreateCall(freeF, B.CreatePointerCast(CI->getArgOperand(0), i8p));
+      continue;
+    }
+
+    IRBuilder<> B(CI->getNextNode());
+    auto str = [&](unsigned i) {
+      StringRef S = cast<MDString>(md->getOperand(i))->getString();
+      return ConstantExpr::getPointerCast(
+          B.CreateGlobalString(S, "enzyme_tapesite_str"), i8p);
+    };
+    Constant *fields[] = {
+        ConstantExpr::getPointerCast(
+            B.CreateGlobalString(F.getName(), "enzyme_tapesite_str"), i8p),
+        str(1), str(2), str(3),
+        cast<ConstantAsMetadata>(md->getOperand(4))->getValue()};
+    auto site = new GlobalVariable(M, siteTy, /*isConstant*/ true,
+                                   GlobalVariable::PrivateLinkage,
+                                   ConstantStruct::get(siteTy, fields),
+                                   "enzyme_tapesite");
+
+    if (kind == "realloc") {
+      B.CreateCall(reallocF,
+                   {B.CreatePointerCast(CI->getArgOperand(0), i8p),
+                    B.CreatePointerCast(CI, i8p),
+                    B.CreateZExtOrTrunc(CI->getArgOperand(1), i64), site});
+      continue;
+    }
+
+    // The size is the first integer argument of the allocation function,
+    // except for calloc which takes a count and a size
+    Value *size = ConstantInt::get(i64, 0);
+    for (auto &arg : CI->arg_operands())
+      if (arg->getType()->isIntegerTy()) {
+        size = B.CreateZExtOrTrunc(arg, i64);
+        break;
+      }
+    if (auto called = CI->getCalledFunction())
+      if (called->getName() == "calloc")
+        size = B.CreateMul(B.CreateZExtOrTrunc(CI->getArgOperand(0), i64),
+                           B.CreateZExtOrTrunc(CI->getArgOperand(1), i64));
+    B.CreateCall(allocF, {B.CreatePointerCast(CI, i8p), size, site});
+  }
+}
+
 llvm::Function *getOrInsertDifferentialMPI_Wait(llvm::Module &M,
                                                 ArrayRef<llvm::Type *> T,
                                                 Type *reqType) {
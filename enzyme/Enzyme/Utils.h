@@ -62,6 +62,8 @@
 extern "C" {
 /// Print additional debug info relevant to performance
 extern llvm::cl::opt<bool> EnzymePrintPerf;
+/// Use vectorized helpers for the derivatives of memcpy and memmove
+extern llvm::cl::opt<bool> EnzymeVectorizeMemcpy;
 }
 
 extern std::map<std::string, std::function<llvm::Value *(
@@ -255,6 +257,17 @@ static inline std::string to_string(DerivativeMode mode) {
   llvm_unreachable("illegal derivative mode");
 }
 
+/// Type of the shadow of a value of type T when propagating truncated Taylor
+/// polynomials of the given degree. The shadow of a floating point scalar
+/// holds its coefficients of degree 1 to TaylorDegree, the coefficient of
+/// degree 0 being the primal value. A degree of 0 denotes first order duals.
+static inline llvm::Type *getTaylorShadowType(llvm::Type *T,
+                                              unsigned TaylorDegree) {
+  if (TaylorDegree && T->isFloatingPointTy())
+    return llvm::ArrayType::get(T, TaylorDegree);
+  return T;
+}
+
 /// Convert DIFFE_TYPE to a string
 static inline std::string to_string(DIFFE_TYPE t) {
   switch (t) {
@@ -511,24 +524,121 @@ static inline bool isCertainPrintMallocOrFree(llvm::Function *called) {
 }
 
 /// Create function for type that performs the derivative memcpy on floating
-/// point memory
+/// point memory, vectorized with vectors of the given number of bits if
+/// nonzero
 llvm::Function *getOrInsertDifferentialFloatMemcpy(llvm::Module &M,
                                                    llvm::PointerType *T,
                                                    unsigned dstalign,
-                                                   unsigned srcalign);
+                                                   unsigned srcalign,
+                                                   unsigned vectorBits = 0);
 
 /// Create function for type that performs the derivative memmove on floating
-/// point memory
+/// point memory, vectorized with vectors of the given number of bits if
+/// nonzero
 llvm::Function *getOrInsertDifferentialFloatMemmove(llvm::Module &M,
                                                     llvm::PointerType *T,
                                                     unsigned dstalign,
-                                                    unsigned srcalign);
+                                                    unsigned srcalign,
+                                                    unsigned vectorBits = 0);
 
 /// Create function for type that performs the derivative MPI_Wait
 llvm::Function *getOrInsertDifferentialMPI_Wait(llvm::Module &M,
                                                 llvm::ArrayRef<llvm::Type *> T,
                                                 llvm::Type *reqType);
 
+/// Create function which reserves a record of the given size on the
+/// thread local tape stack, returning its address
+llvm::Function *getOrInsertTapeStackPush(llvm::Module &M);
+
+/// Create function which releases the most recently pushed record of the
+/// given size from the thread local tape stack, trapping if it holds none
+llvm::Function *getOrInsertTapeStackPop(llvm::Module &M);
+
+/// Create function which reallocates a cache to the given size only if
+/// it differs from the previous size or the cache is not yet allocated. If
+/// tapeBuffer, the reallocation is recorded in the tape buffer state.
+llvm::Function *getOrInsertCacheGrow(llvm::Module &M, bool tapeBuffer = false);
+
+/// Create function which allocates the given number of bytes from the
+/// thread local tape buffer, or from the heap if the buffer is exhausted
+llvm::Function *getOrInsertTapeBufferAlloc(llvm::Module &M);
+
+/// Create function which releases memory obtained from the tape buffer
+/// allocation function, freeing it only if it is not within the buffer
+llvm::Function *getOrInsertTapeBufferFree(llvm::Module &M);
+
+/// Create function which reallocates a cache on the heap, recording in the
+/// tape buffer state that the tape is no longer contained in the buffer
+llvm::Function *getOrInsertTapeBufferRealloc(llvm::Module &M);
+
+/// Make the given caller provided buffer of size bytes the thread local tape
+/// buffer. If resetCursor, allocations restart at its beginning and the
+/// count of requested bytes is reset.
+void setTapeBuffer(llvm::IRBuilder<> &B, llvm::Value *buffer,
+                   llvm::Value *size, bool resetCursor);
+
+/// Load the thread local tape buffer state, to be restored after a call
+/// which is given its own tape buffer
+llvm::Value *saveTapeBuffer(llvm::IRBuilder<> &B);
+
+/// Restore the thread local tape buffer state saved by saveTapeBuffer,
+/// keeping the state left by the call for later queries
+void restoreTapeBuffer(llvm::IRBuilder<> &B, llvm::Value *saved);
+
+/// Number of bytes requested from the tape buffer by the most recent call
+/// given a tape buffer, since that buffer was last reset
+llvm::Value *getTapeBufferRequested(llvm::IRBuilder<> &B);
+
+/// Offset of the given pointer from the start of the tape buffer, as a value
+/// of the pointer's type
+llvm::Value *getTapeBufferOffset(llvm::IRBuilder<> &B, llvm::Value *ptr);
+
+/// Pointer to the given offset, as computed by getTapeBufferOffset, from the
+/// start of the tape buffer
+llvm::Value *getTapeBufferPointer(llvm::IRBuilder<> &B, llvm::Value *offset);
+
+/// Create function which copies the part of the tape buffer used by the most
+/// recent call given a tape buffer to the given destination if it fits,
+/// returning its size, or 0 if some of the memory requested from the buffer
+/// was instead allocated on the heap or a cache was reallocated there
+llvm::Function *getOrInsertTapeBufferSerialize(llvm::Module &M);
+
+/// Create function which copies a tape serialized into the given number of
+/// bytes into the given buffer and makes it the tape buffer from which the
+/// next call given that buffer continues, returning the number of bytes
+/// copied, or 0 if the buffer is too small
+llvm::Function *getOrInsertTapeBufferDeserialize(llvm::Module &M);
+
+/// Create function which allocates the given number of bytes for a cache,
+/// in a mapping of a temporary file if at least the given threshold, or
+/// otherwise from the heap
+llvm::Function *getOrInsertMappedCacheAlloc(llvm::Module &M);
+
+/// Create function which releases memory from the mapped cache allocation
+/// function
+llvm::Function *getOrInsertMappedCacheFree(llvm::Module &M);
+
+/// Create function which, given memory from the mapped cache allocation
+/// function and a pointer into it about to be accessed, releases the pages
+/// no longer needed and prefetches those needed next by the reverse pass
+llvm::Function *getOrInsertMappedCacheAdvise(llvm::Module &M);
+
+/// Mark a call which allocates, reallocates or frees tape memory, such that
+/// instrumentTapeProfile reports it as kind ("alloc", "realloc" or "free")
+/// of the given cache, within the loop of the given header if not null
+void markTapeProfileCall(llvm::CallInst *CI, llvm::StringRef kind,
+                         llvm::StringRef cache, llvm::BasicBlock *header);
+
+/// Call the tape profiling runtime hooks around every call of F marked by
+/// markTapeProfileCall
+void instrumentTapeProfile(llvm::Function &F);
+
+/// Emit a loop running body over [start, end), leaving B in the exit block
+void emitCountedLoop(
+    llvm::IRBuilder<> &B, llvm::Value *start, llvm::Value *end,
+    const llvm::Twine &name,
+    llvm::function_ref<void(llvm::IRBuilder<> &, llvm::Value *)> body);
+
 /// Create function to computer nearest power of two
 llvm::Value *nextPowerOfTwo(llvm::IRBuilder<> &B, llvm::Value *V);
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../mshared/defs.h"
+#include "../mshared/harness.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -329,6 +330,7 @@ void calculate_jacobian(struct BAInput &input, struct BAOutput &result)
 }
 
 int main(const int argc, const char* argv[]) {
+    bench::init("ba");
     std::string path = "/mnt/Data/git/Enzyme/apps/ADBench/data/ba/ba1_n49_m7776_p31843.txt";
 
     std::vector<std::string> paths = {
@@ -372,11 +374,11 @@ int main(const int argc, const char* argv[]) {
     */
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<compute_reproj_error_b, compute_zach_weight_error_b>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Tapenade combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { result.J.clear(); },
+          [&] { calculate_jacobian<compute_reproj_error_b, compute_zach_weight_error_b>(input, result); });
+      bench::record(path, "Tapenade", "combined", stats);
+      printf("Tapenade combined %0.6f\n", stats.median);
       for(unsigned i=0; i<5; i++) {
         printf("%f ", result.J.vals[i]);
       }
@@ -418,11 +420,11 @@ int main(const int argc, const char* argv[]) {
     */
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<adept_compute_reproj_error, adept_compute_zach_weight_error>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Adept combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { result.J.clear(); },
+          [&] { calculate_jacobian<adept_compute_reproj_error, adept_compute_zach_weight_error>(input, result); });
+      bench::record(path, "Adept", "combined", stats);
+      printf("Adept combined %0.6f\n", stats.median);
       for(unsigned i=0; i<5; i++) {
         printf("%f ", result.J.vals[i]);
       }
@@ -464,11 +466,11 @@ int main(const int argc, const char* argv[]) {
     */
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<dcompute_reproj_error, dcompute_zach_weight_error>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Enzyme combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { result.J.clear(); },
+          [&] { calculate_jacobian<dcompute_reproj_error, dcompute_zach_weight_error>(input, result); });
+      bench::record(path, "Enzyme", "combined", stats);
+      printf("Enzyme combined %0.6f\n", stats.median);
       for(unsigned i=0; i<5; i++) {
         printf("%f ", result.J.vals[i]);
       }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../mshared/defs.h"
+#include "../mshared/harness.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -157,6 +158,7 @@ void calculate_jacobian(struct GMMInput &input, struct GMMOutput &result)
 }
 
 int main(const int argc, const char* argv[]) {
+    bench::init("gmm");
     printf("starting main\n");
 
     const auto replicate_point = (argc > 9 && string(argv[9]) == "-rep");
@@ -183,11 +185,11 @@ int main(const int argc, const char* argv[]) {
     struct GMMOutput result = { 0, std::vector<double>(Jcols) };
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<gmm_objective_b>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Tapenade combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { std::fill(result.gradient.begin(), result.gradient.end(), 0.0); },
+          [&] { calculate_jacobian<gmm_objective_b>(input, result); });
+      bench::record(path, "Tapenade", "combined", stats);
+      printf("Tapenade combined %0.6f\n", stats.median);
       for(unsigned i=0; i<5; i++) {
         printf("%f ", result.gradient[i]);
       }
@@ -207,17 +209,18 @@ int main(const int argc, const char* argv[]) {
     struct GMMOutput result = { 0, std::vector<double>(Jcols) };
 
     try {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<adept_dgmm_objective>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Adept combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { std::fill(result.gradient.begin(), result.gradient.end(), 0.0); },
+          [&] { calculate_jacobian<adept_dgmm_objective>(input, result); });
+      bench::record(path, "Adept", "combined", stats);
+      printf("Adept combined %0.6f\n", stats.median);
       for(unsigned i=0; i<5; i++) {
         printf("%f ", result.gradient[i]);
       }
       printf("\n");
     } catch(std::bad_alloc) {
        printf("Adept combined 88888888 ooms\n");
+       bench::fail(path, "Adept", "combined", "out of memory");
     }
 
     }
@@ -233,11 +236,11 @@ int main(const int argc, const char* argv[]) {
     struct GMMOutput result = { 0, std::vector<double>(Jcols) };
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<dgmm_objective>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Enzyme combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { std::fill(result.gradient.begin(), result.gradient.end(), 0.0); },
+          [&] { calculate_jacobian<dgmm_objective>(input, result); });
+      bench::record(path, "Enzyme", "combined", stats);
+      printf("Enzyme combined %0.6f\n", stats.median);
       for(unsigned i=0; i<5; i++) {
         printf("%f ", result.gradient[i]);
       }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../mshared/defs.h"
+#include "../mshared/harness.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -542,6 +543,7 @@ HandObjectiveData* convert_to_hand_objective_data(const HandInput& input)
 }
 
 int main(const int argc, const char* argv[]) {
+    bench::init("hand");
     printf("starting main\n");
 
     std::vector<std::string> paths = { "simple_small/hand1_t26_c100.txt" };
@@ -587,11 +589,10 @@ int main(const int argc, const char* argv[]) {
     auto us_jacobian_column = std::vector<double>(err_size);
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<hand_objective_d, hand_objective_complicated_d>(objective_input, input, result, params.is_complicated, theta_d, us_d, us_jacobian_column);
-      gettimeofday(&end, NULL);
-      printf("Tapenade combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { calculate_jacobian<hand_objective_d, hand_objective_complicated_d>(objective_input, input, result, params.is_complicated, theta_d, us_d, us_jacobian_column); });
+      bench::record(path, "Tapenade", "combined", stats);
+      printf("Tapenade combined %0.6f\n", stats.median);
       for(unsigned i=0; i<5; i++) {
         printf("%f ", result.jacobian[i]);
       }
@@ -636,11 +637,10 @@ int main(const int argc, const char* argv[]) {
     auto us_jacobian_column = std::vector<double>(err_size);
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<dhand_objective, dhand_objective_complicated>(objective_input, input, result, params.is_complicated, theta_d, us_d, us_jacobian_column);
-      gettimeofday(&end, NULL);
-      printf("Enzyme combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { calculate_jacobian<dhand_objective, dhand_objective_complicated>(objective_input, input, result, params.is_complicated, theta_d, us_d, us_jacobian_column); });
+      bench::record(path, "Enzyme", "combined", stats);
+      printf("Enzyme combined %0.6f\n", stats.median);
       for(unsigned i=0; i<5; i++) {
         printf("%f ", result.jacobian[i]);
       }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../mshared/defs.h"
+#include "../mshared/harness.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -175,6 +176,7 @@ void calculate_jacobian(struct LSTMInput &input, struct LSTMOutput &result)
 }
 
 int main(const int argc, const char* argv[]) {
+    bench::init("lstm");
     printf("starting main\n");
 
     std::vector<std::string> paths = { "lstm_l2_c1024.txt", "lstm_l4_c1024.txt", "lstm_l2_c4096.txt", "lstm_l4_c4096.txt" };
@@ -199,11 +201,11 @@ int main(const int argc, const char* argv[]) {
     struct LSTMOutput result = { 0, std::vector<double>(Jcols) };
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<lstm_objective_b>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Tapenade combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { std::fill(result.gradient.begin(), result.gradient.end(), 0.0); },
+          [&] { calculate_jacobian<lstm_objective_b>(input, result); });
+      bench::record(path, "Tapenade", "combined", stats);
+      printf("Tapenade combined %0.6f\n", stats.median);
       for(unsigned i=result.gradient.size()-5; i<result.gradient.size(); i++) {
         printf("%f ", result.gradient[i]);
       }
@@ -226,11 +228,11 @@ int main(const int argc, const char* argv[]) {
     struct LSTMOutput result = { 0, std::vector<double>(Jcols) };
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<adept_dlstm_objective>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Adept combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { std::fill(result.gradient.begin(), result.gradient.end(), 0.0); },
+          [&] { calculate_jacobian<adept_dlstm_objective>(input, result); });
+      bench::record(path, "Adept", "combined", stats);
+      printf("Adept combined %0.6f\n", stats.median);
       for(unsigned i=result.gradient.size()-5; i<result.gradient.size(); i++) {
         printf("%f ", result.gradient[i]);
       }
@@ -253,11 +255,11 @@ int main(const int argc, const char* argv[]) {
     struct LSTMOutput result = { 0, std::vector<double>(Jcols) };
 
     {
-      struct timeval start, end;
-      gettimeofday(&start, NULL);
-      calculate_jacobian<dlstm_objective>(input, result);
-      gettimeofday(&end, NULL);
-      printf("Enzyme combined %0.6f\n", tdiff(&start, &end));
+      bench::Stats stats = bench::measure(
+          [&] { std::fill(result.gradient.begin(), result.gradient.end(), 0.0); },
+          [&] { calculate_jacobian<dlstm_objective>(input, result); });
+      bench::record(path, "Enzyme", "combined", stats);
+      printf("Enzyme combined %0.6f\n", stats.median);
       for(unsigned i=result.gradient.size()-5; i<result.gradient.size(); i++) {
         printf("%f ", result.gradient[i]);
       }
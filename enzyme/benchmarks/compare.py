@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Combine the JSON results of the benchmarks into a single comparison table.
+
+Every benchmark writes the timings of Enzyme, Tapenade and Adept to
+results.json in its directory (see mshared/harness.h). This prints one row per
+benchmark, input and phase, with the median time of every tool and the speedup
+of Enzyme over the others. Given a baseline, such as the directory of an
+earlier run, it instead reports the change of every median and fails if any
+slowed down by more than the threshold.
+"""
+
+import argparse
+import glob
+import json
+import os
+import sys
+
+TOOLS = ["Enzyme", "Tapenade", "Adept"]
+
+
+def load(path, name):
+    """Return the results under path by (benchmark, input, phase, tool)"""
+    files = [path] if os.path.isfile(path) else sorted(
+        glob.glob(os.path.join(path, "*", name)))
+    results = {}
+    for f in files:
+        with open(f) as data:
+            bench = json.load(data)
+        for r in bench["results"]:
+            key = (bench["benchmark"], r["input"], r["phase"], r["tool"])
+            results[key] = r
+    return results
+
+
+def tools_of(results):
+    present = {key[3] for key in results}
+    return [t for t in TOOLS if t in present] + sorted(present - set(TOOLS))
+
+
+def cell(r):
+    if r is None:
+        return "-"
+    if "error" in r:
+        return r["error"]
+    return "%.6f" % r["median"]
+
+
+def print_table(header, rows):
+    widths = [max(len(str(row[i])) for row in [header] + rows)
+              for i in range(len(header))]
+    for row in [header, ["-" * w for w in widths]] + rows:
+        print("  ".join(str(c).ljust(w) for c, w in zip(row, widths)).rstrip())
+
+
+def compare_tools(results):
+    tools = tools_of(results)
+    others = [t for t in tools if t != "Enzyme"]
+    header = ["benchmark", "input", "phase"] + tools
+    header += ["%s/Enzyme" % t for t in others if "Enzyme" in tools]
+    rows = []
+    for group in sorted({key[:3] for key in results}):
+        row = list(group)
+        row += [cell(results.get(group + (t,))) for t in tools]
+        enzyme = results.get(group + ("Enzyme",))
+        if "Enzyme" in tools:
+            for t in others:
+                other = results.get(group + (t,))
+                if (enzyme and other and "median" in enzyme and
+                        "median" in other and enzyme["median"] > 0):
+                    row.append("%.2fx" % (other["median"] / enzyme["median"]))
+                else:
+                    row.append("-")
+        rows.append(row)
+    print_table(header, rows)
+    return 0
+
+
+def compare_baseline(results, baseline, threshold):
+    header = ["benchmark", "input", "phase", "tool", "baseline", "current",
+              "change"]
+    rows = []
+    regressions = 0
+    for key in sorted(results):
+        old, new = baseline.get(key), results[key]
+        if old is None or "median" not in old or "median" not in new:
+            continue
+        change = new["median"] / old["median"] - 1 if old["median"] > 0 else 0
+        flag = ""
+        if change > threshold:
+            flag = " REGRESSION"
+            regressions += 1
+        rows.append(list(key) + [cell(old), cell(new),
+                                 "%+.1f%%%s" % (100 * change, flag)])
+    print_table(header, rows)
+    if regressions:
+        print("\n%d of %d measurements regressed by more than %.1f%%" %
+              (regressions, len(rows), 100 * threshold))
+    return 1 if regressions else 0
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("results", nargs="?", default=here,
+                        help="benchmarks directory or a single results file")
+    parser.add_argument("--name", default="results.json",
+                        help="name of the results file of every benchmark")
+    parser.add_argument("--baseline",
+                        help="directory or file of results to compare to")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative slowdown reported as a regression")
+    parser.add_argument("--json", help="write the combined results here")
+    args = parser.parse_args()
+
+    results = load(args.results, args.name)
+    if not results:
+        print("no %s found in %s" % (args.name, args.results), file=sys.stderr)
+        return 1
+
+    if args.json:
+        with open(args.json, "w") as out:
+            json.dump([dict(zip(["benchmark", "input", "phase", "tool"], key),
+                            **r) for key, r in sorted(results.items())],
+                      out, indent=2)
+
+    if args.baseline:
+        baseline = load(args.baseline, args.name)
+        return compare_baseline(results, baseline, args.threshold)
+    return compare_tools(results)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -6,6 +6,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <string.h>
+#include "../mshared/harness.h"
 #include <adept_source.h>
 #include <adept.h>
 using adept::adouble;
@@ -78,127 +79,122 @@ static double tfoobar_and_gradient(unsigned len) {
 }
 
 static void adept_sincos(double inp, unsigned len) {
-  {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double *x = new double[2*len];
-  for(int i=0; i<2*len; i++) x[i] = 2.0;
-  foobar(x, len);
-  double res = x[0];
+  std::string input = "n=" + std::to_string(len);
 
-  gettimeofday(&end, NULL);
-  printf("Adept real %0.6f res=%f\n", tdiff(&start, &end), res);
-  delete[] x;
+  {
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    double *x = new double[2*len];
+    for(int i=0; i<2*len; i++) x[i] = 2.0;
+    foobar(x, len);
+    res = x[0];
+    delete[] x;
+  });
+  bench::record(input, "Adept", "real", stats);
+  printf("Adept real %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  adept::Stack stack;
-
-  aVector x(2*len);
-  for(int i=0; i<2*len; i++) x[i] = 2.0;
- // stack.new_recording();
-  afoobar(x, len);
-  double res = x(0).value();
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    adept::Stack stack;
 
-  gettimeofday(&end, NULL);
-  printf("Adept forward %0.6f res=%f\n", tdiff(&start, &end), res);
+    aVector x(2*len);
+    for(int i=0; i<2*len; i++) x[i] = 2.0;
+   // stack.new_recording();
+    afoobar(x, len);
+    res = x(0).value();
+  });
+  bench::record(input, "Adept", "forward", stats);
+  printf("Adept forward %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res2 = afoobar_and_gradient(len);
-
-  gettimeofday(&end, NULL);
-  printf("Adept combined %0.6f res'=%f\n", tdiff(&start, &end), res2);
+  double res2;
+  bench::Stats stats = bench::measure([&] {
+    res2 = afoobar_and_gradient(len);
+  });
+  bench::record(input, "Adept", "combined", stats);
+  printf("Adept combined %0.6f res'=%f\n", stats.median, res2);
   }
 }
 
 
 static void tapenade_sincos(double inp, unsigned len) {
+  std::string input = "n=" + std::to_string(len);
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double *x = new double[2*len];
-  for(int i=0; i<2*len; i++) x[i] = 2.0;
-  foobar(x, len);
-  double res = x[0];
-
-  gettimeofday(&end, NULL);
-  printf("Tapenade real %0.6f res=%f\n", tdiff(&start, &end), res);
-  delete[] x;
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    double *x = new double[2*len];
+    for(int i=0; i<2*len; i++) x[i] = 2.0;
+    foobar(x, len);
+    res = x[0];
+    delete[] x;
+  });
+  bench::record(input, "Tapenade", "real", stats);
+  printf("Tapenade real %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double* x = new double[2*len];
-  for(int i=0; i<2*len; i++) x[i] = 2.0;
-  foobar(x, len);
-  double res = x[0];
-
-  gettimeofday(&end, NULL);
-  printf("Tapenade forward %0.6f res=%f\n", tdiff(&start, &end), res);
-  delete[] x;
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    double* x = new double[2*len];
+    for(int i=0; i<2*len; i++) x[i] = 2.0;
+    foobar(x, len);
+    res = x[0];
+    delete[] x;
+  });
+  bench::record(input, "Tapenade", "forward", stats);
+  printf("Tapenade forward %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res2 = tfoobar_and_gradient(len);
-
-  gettimeofday(&end, NULL);
-  printf("Tapenade combined %0.6f res'=%f\n", tdiff(&start, &end), res2);
+  double res2;
+  bench::Stats stats = bench::measure([&] {
+    res2 = tfoobar_and_gradient(len);
+  });
+  bench::record(input, "Tapenade", "combined", stats);
+  printf("Tapenade combined %0.6f res'=%f\n", stats.median, res2);
   }
 }
 
 static void enzyme_sincos(double inp, unsigned len) {
+  std::string input = "n=" + std::to_string(len);
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double *x = new double[2*len];
-  for(int i=0; i<2*len; i++) x[i] = 2.0;
-  foobar(x, len);
-  double res = x[0];
-
-  gettimeofday(&end, NULL);
-  printf("Enzyme real %0.6f res=%f\n", tdiff(&start, &end), res);
-  delete[] x;
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    double *x = new double[2*len];
+    for(int i=0; i<2*len; i++) x[i] = 2.0;
+    foobar(x, len);
+    res = x[0];
+    delete[] x;
+  });
+  bench::record(input, "Enzyme", "real", stats);
+  printf("Enzyme real %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double *x = new double[2*len];
-  for(int i=0; i<2*len; i++) x[i] = 2.0;
-  foobar(x, len);
-  double res = x[0];
-
-  gettimeofday(&end, NULL);
-  printf("Enzyme forward %0.6f res=%f\n", tdiff(&start, &end), res);
-  delete[] x;
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    double *x = new double[2*len];
+    for(int i=0; i<2*len; i++) x[i] = 2.0;
+    foobar(x, len);
+    res = x[0];
+    delete[] x;
+  });
+  bench::record(input, "Enzyme", "forward", stats);
+  printf("Enzyme forward %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res2 = foobar_and_gradient(len);
-
-  gettimeofday(&end, NULL);
-  printf("Enzyme combined %0.6f res'=%f\n", tdiff(&start, &end), res2);
+  double res2;
+  bench::Stats stats = bench::measure([&] {
+    res2 = foobar_and_gradient(len);
+  });
+  bench::record(input, "Enzyme", "combined", stats);
+  printf("Enzyme combined %0.6f res'=%f\n", stats.median, res2);
   }
 }
 
@@ -216,6 +212,7 @@ unsigned max(unsigned A, unsigned B){
 }
 
 int main(int argc, char** argv) {
+  bench::init("fft");
 
   if (argc < 2) {
     printf("usage %s n [must be power of 2]\n", argv[0]);
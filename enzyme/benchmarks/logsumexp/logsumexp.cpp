@@ -6,6 +6,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <string.h>
+#include "../mshared/harness.h"
 
 #include <adept_source.h>
 #include <adept_arrays.h>
@@ -126,8 +127,8 @@ adouble alogsumexp2(const aVector &x, size_t n) {
 }
 
 static void adept_sincos(double *input, double *inputp, unsigned long n, unsigned long repeat) {
+  std::string label = "n=" + std::to_string(n) + " repeat=" + std::to_string(repeat);
   {
-  struct timeval start, end;
   //gettimeofday(&start, NULL);
  
   adept::Stack stack;
@@ -137,22 +138,24 @@ static void adept_sincos(double *input, double *inputp, unsigned long n, unsigne
   memset(inputp, 0, sizeof(double)*n);
   double total = 0;
 
-  gettimeofday(&start, NULL);
-  for (int iter = 0; iter < repeat; iter++) {
-    stack.new_recording();
-    adouble resa = alogsumexp(inp, n);
-    stack.pause_recording();
-    total += resa.value();
-    stack.continue_recording();
-  }
-  gettimeofday(&end, NULL);
+  bench::Stats stats = bench::measure(
+      [&] { total = 0; },
+      [&] {
+    for (int iter = 0; iter < repeat; iter++) {
+      stack.new_recording();
+      adouble resa = alogsumexp(inp, n);
+      stack.pause_recording();
+      total += resa.value();
+      stack.continue_recording();
+    }
+  });
 
   stack.pause_recording();
 
-  printf("adept forward (recording) %0.6f res'=%f\n", tdiff(&start, &end), total);
+  bench::record(label, "Adept", "forward", stats);
+  printf("adept forward (recording) %0.6f res'=%f\n", stats.median, total);
   }
   {
-  struct timeval start, end;
   //gettimeofday(&start, NULL);
  
   adept::Stack stack;
@@ -161,28 +164,31 @@ static void adept_sincos(double *input, double *inputp, unsigned long n, unsigne
   for(int i=0; i<n; i++) inp(i) = input[i];
   memset(inputp, 0, sizeof(double)*n);
 
-  gettimeofday(&start, NULL);
-  for (int iter = 0; iter < repeat; iter++) {
-    stack.new_recording();
-    adouble resa = alogsumexp(inp, n);
-    resa.set_gradient(1.0);
-    stack.reverse();
-    stack.pause_recording();
-    for (int i = 0; i < n; i++) {
-        inputp[i] += inp(i).get_gradient();
+  bench::Stats stats = bench::measure(
+      [&] { memset(inputp, 0, sizeof(double)*n); },
+      [&] {
+    for (int iter = 0; iter < repeat; iter++) {
+      stack.new_recording();
+      adouble resa = alogsumexp(inp, n);
+      resa.set_gradient(1.0);
+      stack.reverse();
+      stack.pause_recording();
+      for (int i = 0; i < n; i++) {
+          inputp[i] += inp(i).get_gradient();
+      }
+      stack.continue_recording();
     }
-    stack.continue_recording();
-  }
-  gettimeofday(&end, NULL);
+  });
 
   stack.pause_recording();
 
-  printf("adept forward reverse %0.6f res'=%f\n", tdiff(&start, &end), sum(inputp, n));
+  bench::record(label, "Adept", "combined", stats);
+  printf("adept forward reverse %0.6f res'=%f\n", stats.median, sum(inputp, n));
   }
 }
 static void adept2_sincos(double *input, double *inputp, unsigned long n, unsigned long repeat) {
+  std::string label = "n=" + std::to_string(n) + " repeat=" + std::to_string(repeat);
   {
-  struct timeval start, end;
   //gettimeofday(&start, NULL);
  
   adept::Stack stack;
@@ -192,22 +198,24 @@ static void adept2_sincos(double *input, double *inputp, unsigned long n, unsign
   memset(inputp, 0, sizeof(double)*n);
   double total = 0;
 
-  gettimeofday(&start, NULL);
-  for (int iter = 0; iter < repeat; iter++) {
-    stack.new_recording();
-    adouble resa = alogsumexp2(inp, n);
-    stack.pause_recording();
-    total += resa.value();
-    stack.continue_recording();
-  }
-  gettimeofday(&end, NULL);
+  bench::Stats stats = bench::measure(
+      [&] { total = 0; },
+      [&] {
+    for (int iter = 0; iter < repeat; iter++) {
+      stack.new_recording();
+      adouble resa = alogsumexp2(inp, n);
+      stack.pause_recording();
+      total += resa.value();
+      stack.continue_recording();
+    }
+  });
 
   stack.pause_recording();
 
-  printf("adept2 forward (recording) %0.6f res'=%f\n", tdiff(&start, &end), total);
+  bench::record(label, "Adept vector", "forward", stats);
+  printf("adept2 forward (recording) %0.6f res'=%f\n", stats.median, total);
   }
   {
-  struct timeval start, end;
   //gettimeofday(&start, NULL);
  
   adept::Stack stack;
@@ -216,86 +224,94 @@ static void adept2_sincos(double *input, double *inputp, unsigned long n, unsign
   for(int i=0; i<n; i++) inp(i) = input[i];
   memset(inputp, 0, sizeof(double)*n);
 
-  gettimeofday(&start, NULL);
-  for (int iter = 0; iter < repeat; iter++) {
-    stack.new_recording();
-    adouble resa = alogsumexp2(inp, n);
-    resa.set_gradient(1.0);
-    stack.reverse();
-    stack.pause_recording();
-    for (int i = 0; i < n; i++) {
-        inputp[i] += inp(i).get_gradient();
+  bench::Stats stats = bench::measure(
+      [&] { memset(inputp, 0, sizeof(double)*n); },
+      [&] {
+    for (int iter = 0; iter < repeat; iter++) {
+      stack.new_recording();
+      adouble resa = alogsumexp2(inp, n);
+      resa.set_gradient(1.0);
+      stack.reverse();
+      stack.pause_recording();
+      for (int i = 0; i < n; i++) {
+          inputp[i] += inp(i).get_gradient();
+      }
+      stack.continue_recording();
     }
-    stack.continue_recording();
-  }
-  gettimeofday(&end, NULL);
+  });
 
   stack.pause_recording();
 
-  printf("adept2 forward reverse %0.6f res'=%f\n", tdiff(&start, &end), sum(inputp, n));
+  bench::record(label, "Adept vector", "combined", stats);
+  printf("adept2 forward reverse %0.6f res'=%f\n", stats.median, sum(inputp, n));
   }
 }
 
 static void enzyme_sincos(double *input, double *inputp, unsigned long n, unsigned long repeat) {
+  std::string label = "n=" + std::to_string(n) + " repeat=" + std::to_string(repeat);
     double realinput = input[0];
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
   double total = 0;
-  for(int i=0; i<repeat; i++) {
-    input[0] = realinput + (double)i/10000000;
-    total += logsumexp(input, n);
-  }
-
-  gettimeofday(&end, NULL);
-  printf("enzyme forward %0.6f res'=%f\n", tdiff(&start, &end), total);
+  bench::Stats stats = bench::measure(
+      [&] { input[0] = realinput; total = 0; },
+      [&] {
+    for(int i=0; i<repeat; i++) {
+      input[0] = realinput + (double)i/10000000;
+      total += logsumexp(input, n);
+    }
+  });
+  bench::record(label, "Enzyme", "forward", stats);
+  printf("enzyme forward %0.6f res'=%f\n", stats.median, total);
   }
   {
       input[0] = realinput;
-  struct timeval start, end;
   memset(inputp, 0, sizeof(double)*n);
 
-  gettimeofday(&start, NULL);
-
-  for(int i=0; i<repeat; i++) {
-    __enzyme_autodiff<void>(logsumexp, input, inputp, n);
-  }
-
-  gettimeofday(&end, NULL);
-  printf("enzyme forward and reverse %0.6f res'=%f\n", tdiff(&start, &end), sum(inputp, n));
+  bench::Stats stats = bench::measure(
+      [&] { memset(inputp, 0, sizeof(double)*n); },
+      [&] {
+    for(int i=0; i<repeat; i++) {
+      __enzyme_autodiff<void>(logsumexp, input, inputp, n);
+    }
+  });
+  bench::record(label, "Enzyme", "combined", stats);
+  printf("enzyme forward and reverse %0.6f res'=%f\n", stats.median, sum(inputp, n));
   }
 }
 static void tapenade_sincos(double *input, double *inputp, unsigned long n, unsigned long repeat) {
+  std::string label = "n=" + std::to_string(n) + " repeat=" + std::to_string(repeat);
     double realinput = input[0];
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
   double total = 0;
-  for(int i=0; i<repeat; i++) {
-    input[0] = realinput + (double)i/10000000;
-    total += logsumexp(input, n);
-  }
-
-  gettimeofday(&end, NULL);
-  printf("tapenade forward %0.6f res'=%f\n", tdiff(&start, &end), total);
+  bench::Stats stats = bench::measure(
+      [&] { input[0] = realinput; total = 0; },
+      [&] {
+    for(int i=0; i<repeat; i++) {
+      input[0] = realinput + (double)i/10000000;
+      total += logsumexp(input, n);
+    }
+  });
+  bench::record(label, "Tapenade", "forward", stats);
+  printf("tapenade forward %0.6f res'=%f\n", stats.median, total);
   }
   {
       input[0] = realinput;
-  struct timeval start, end;
   memset(inputp, 0, sizeof(double)*n);
 
-  gettimeofday(&start, NULL);
-
-  for(int i=0; i<repeat; i++) {
-    logsumexp_b(input, inputp, n, 1.0);
-  }
-
-  gettimeofday(&end, NULL);
-  printf("tapenade forward and reverse %0.6f res'=%f\n", tdiff(&start, &end), sum(inputp, n));
+  bench::Stats stats = bench::measure(
+      [&] { memset(inputp, 0, sizeof(double)*n); },
+      [&] {
+    for(int i=0; i<repeat; i++) {
+      logsumexp_b(input, inputp, n, 1.0);
+    }
+  });
+  bench::record(label, "Tapenade", "combined", stats);
+  printf("tapenade forward and reverse %0.6f res'=%f\n", stats.median, sum(inputp, n));
   }
 }
 
 int main(int argc, char** argv) {
+    bench::init("logsumexp");
     if (argc < 2) {
         printf("usage %s n repeat\n", argv[0]);
         return 1;
@@ -6,6 +6,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <string.h>
+#include "../mshared/harness.h"
 
 extern int enzyme_const;
 template<typename Return, typename... T>
@@ -146,10 +147,9 @@ void sincos_and_gradient(double *Min, double *Mout, double *vecin, double *vecou
 #endif
 
 static void adept_sincos(double *Min, double *Mout, double *Vin, double *Vout) {
+  std::string input = "N=" + std::to_string(N) + " M=" + std::to_string(M);
 
   {
-  struct timeval start, end;
-
   double res2 = 0;
   adept::Stack stack;
 
@@ -163,33 +163,31 @@ static void adept_sincos(double *Min, double *Mout, double *Vin, double *Vout) {
     for(int i=0; i<M; i++) vec(i) = Vin[i];
 
 
-  gettimeofday(&start, NULL);
-  for (int iter = 0; iter < ITERS; iter++) {
-    stack.new_recording();
-    adouble resa = matvec(mat, vec);
-    resa.set_gradient(1.0);
-    stack.continue_recording();
-  }
-    //stack.reverse();
-    //stack.pause_recording();
-    /*
-    for (int i = 0; i < N; i++) {
-      for (int j = 0; j < M; j++) {
-        mat(i,j) -= mat(i,j).get_gradient()*RATE;
-      }
-    }*/
-  gettimeofday(&end, NULL);
-  //gettimeofday(&end, NULL);
-  printf("%0.6f res'=%f %f %f\n", tdiff(&start, &end), Mout[1], Mout[2], Mout[3]);
+  bench::Stats stats = bench::measure([&] {
+    for (int iter = 0; iter < ITERS; iter++) {
+      stack.new_recording();
+      adouble resa = matvec(mat, vec);
+      resa.set_gradient(1.0);
+      stack.continue_recording();
+    }
+      //stack.reverse();
+      //stack.pause_recording();
+      /*
+      for (int i = 0; i < N; i++) {
+        for (int j = 0; j < M; j++) {
+          mat(i,j) -= mat(i,j).get_gradient()*RATE;
+        }
+      }*/
+  });
+  bench::record(input, "Adept", "forward", stats);
+  printf("%0.6f res'=%f %f %f\n", stats.median, Mout[1], Mout[2], Mout[3]);
 
   }
 
 
 
   {
-  struct timeval start, end;
-  //gettimeofday(&start, NULL);
-
+  bench::Stats stats;
   double res2 = 0;
   {
   adept::Stack stack;
@@ -204,21 +202,21 @@ static void adept_sincos(double *Min, double *Mout, double *Vin, double *Vout) {
     for(int i=0; i<M; i++) vec(i) = Vin[i];
 
 
-  gettimeofday(&start, NULL);
-  for (int iter = 0; iter < ITERS; iter++) {
-    stack.new_recording();
-    adouble resa = matvec(mat, vec);
-    resa.set_gradient(1.0);
-    stack.reverse();
-    stack.pause_recording();
-    for (int i = 0; i < N; i++) {
-      for (int j = 0; j < M; j++) {
-        mat(i,j) -= mat(i,j).get_gradient()*RATE;
+  stats = bench::measure([&] {
+    for (int iter = 0; iter < ITERS; iter++) {
+      stack.new_recording();
+      adouble resa = matvec(mat, vec);
+      resa.set_gradient(1.0);
+      stack.reverse();
+      stack.pause_recording();
+      for (int i = 0; i < N; i++) {
+        for (int j = 0; j < M; j++) {
+          mat(i,j) -= mat(i,j).get_gradient()*RATE;
+        }
       }
+      stack.continue_recording();
     }
-    stack.continue_recording();
-  }
-  gettimeofday(&end, NULL);
+  });
 #if 0
     stack.new_recording();
      gettimeofday(&start, NULL);
@@ -245,104 +243,105 @@ static void adept_sincos(double *Min, double *Mout, double *Vin, double *Vout) {
     }
 
   }
-  //gettimeofday(&end, NULL);
-  printf("%0.6f res'=%f %f %f\n", tdiff(&start, &end), Mout[1], Mout[2], Mout[3]);
+  bench::record(input, "Adept", "combined", stats);
+  printf("%0.6f res'=%f %f %f\n", stats.median, Mout[1], Mout[2], Mout[3]);
   }
 }
 #endif
 
 static void tapenade_sincos(double *Min, double *Mout, double *Vin, double *Vout) {
+  std::string input = "N=" + std::to_string(N) + " M=" + std::to_string(M);
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = matvec_real(Min, Vin);
-
-  gettimeofday(&end, NULL);
-  printf("tapenade %0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = matvec_real(Min, Vin);
+  });
+  bench::record(input, "Tapenade", "real", stats);
+  printf("tapenade %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
   double tmp = Min[0];
-  gettimeofday(&start, NULL);
-
   double sum = 0;
-  for(int i=0; i<ITERS; i++) {
-      Min[0] = tmp + i/100000000.;
-        sum += matvec_real(Min, Vin);
-  }
-
-  gettimeofday(&end, NULL);
-  printf("tapenade mv %0.6f res=%f\n", tdiff(&start, &end), sum);
+  bench::Stats stats = bench::measure([&] { sum = 0; }, [&] {
+    for(int i=0; i<ITERS; i++) {
+        Min[0] = tmp + i/100000000.;
+          sum += matvec_real(Min, Vin);
+    }
+  });
+  bench::record(input, "Tapenade", "forward", stats);
+  printf("tapenade mv %0.6f res=%f\n", stats.median, sum);
   Min[0] = tmp;
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
   double res2;
-
-  for(int i=0; i<ITERS; i++) {
-  for(int i=0; i<N*M; i++) { Mout[i] = 0; }
-  //for(int i=0; i<M; i++) { Vout[i] = 0; }
-    matvec_real_b(Min, Mout, Vin, 1.0);
-  //res2 = __builtin_autodiff(matvec_real, Min, Mout, Vin, Vout);
-  for(int i=0; i<N*M; i++) { Min[i] -= Mout[i] * RATE; }
-  }
-
-  gettimeofday(&end, NULL);
-  printf("tapenade %0.6f res'=%f %f %f\n", tdiff(&start, &end), Mout[1], Mout[2], Mout[3]);
+  std::vector<double> Minit(Min, Min + N*M);
+
+  // Every run descends from the same matrix
+  bench::Stats stats = bench::measure(
+      [&] { std::copy(Minit.begin(), Minit.end(), Min); }, [&] {
+    for(int i=0; i<ITERS; i++) {
+    for(int i=0; i<N*M; i++) { Mout[i] = 0; }
+    //for(int i=0; i<M; i++) { Vout[i] = 0; }
+      matvec_real_b(Min, Mout, Vin, 1.0);
+    //res2 = __builtin_autodiff(matvec_real, Min, Mout, Vin, Vout);
+    for(int i=0; i<N*M; i++) { Min[i] -= Mout[i] * RATE; }
+    }
+  });
+  bench::record(input, "Tapenade", "combined", stats);
+  printf("tapenade %0.6f res'=%f %f %f\n", stats.median, Mout[1], Mout[2], Mout[3]);
   }
 }
 static void enzyme_sincos(double *Min, double *Mout, double *Vin, double *Vout) {
+  std::string input = "N=" + std::to_string(N) + " M=" + std::to_string(M);
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = matvec_real(Min, Vin);
-
-  gettimeofday(&end, NULL);
-  printf("%0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = matvec_real(Min, Vin);
+  });
+  bench::record(input, "Enzyme", "real", stats);
+  printf("%0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
   double tmp = Min[0];
-  gettimeofday(&start, NULL);
-
   double sum = 0;
-  for(int i=0; i<ITERS; i++) {
-      Min[0] = tmp + i/100000000.;
-        sum += matvec_real(Min, Vin);
-  }
-
-  gettimeofday(&end, NULL);
-  printf("mv %0.6f res=%f\n", tdiff(&start, &end), sum);
+  bench::Stats stats = bench::measure([&] { sum = 0; }, [&] {
+    for(int i=0; i<ITERS; i++) {
+        Min[0] = tmp + i/100000000.;
+          sum += matvec_real(Min, Vin);
+    }
+  });
+  bench::record(input, "Enzyme", "forward", stats);
+  printf("mv %0.6f res=%f\n", stats.median, sum);
   Min[0] = tmp;
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
   double res2;
-
-  for(int i=0; i<ITERS; i++) {
-  for(int i=0; i<N*M; i++) { Mout[i] = 0; }
-  //for(int i=0; i<M; i++) { Vout[i] = 0; }
-  res2 = __enzyme_autodiff<double>(matvec_real, Min, Mout, enzyme_const, Vin);
-  //res2 = __builtin_autodiff(matvec_real, Min, Mout, Vin, Vout);
-  for(int i=0; i<N*M; i++) { Min[i] -= Mout[i] * RATE; }
-  }
-
-  gettimeofday(&end, NULL);
-  printf("%0.6f res'=%f %f %f\n", tdiff(&start, &end), Mout[1], Mout[2], Mout[3]);
+  std::vector<double> Minit(Min, Min + N*M);
+
+  // Every run descends from the same matrix
+  bench::Stats stats = bench::measure(
+      [&] { std::copy(Minit.begin(), Minit.end(), Min); }, [&] {
+    for(int i=0; i<ITERS; i++) {
+    for(int i=0; i<N*M; i++) { Mout[i] = 0; }
+    //for(int i=0; i<M; i++) { Vout[i] = 0; }
+    res2 = __enzyme_autodiff<double>(matvec_real, Min, Mout, enzyme_const, Vin);
+    //res2 = __builtin_autodiff(matvec_real, Min, Mout, Vin, Vout);
+    for(int i=0; i<N*M; i++) { Min[i] -= Mout[i] * RATE; }
+    }
+  });
+  bench::record(input, "Enzyme", "combined", stats);
+  printf("%0.6f res'=%f %f %f\n", stats.median, Mout[1], Mout[2], Mout[3]);
   }
 }
 
 int main(int argc, char** argv) {
+  bench::init("matdescent");
 
   double *Min = new double[N*M];
   double *Mout = new double[N*M];
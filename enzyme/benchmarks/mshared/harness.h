@@ -0,0 +1,194 @@
+#pragma once
+
+// Common timing for the benchmarks. Every measurement runs its body a number
+// of untimed warm-up times, then times repeated runs and reports the median
+// and percentiles along with the peak resident set size. The results of a
+// benchmark are written as JSON at exit, to the file named by BENCH_JSON, or
+// results.json by default, for compare.py to aggregate.
+//
+// BENCH_WARMUP and BENCH_REPEAT override the number of warm-up (default 1)
+// and timed (default 3) runs of every measurement.
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+namespace bench {
+
+struct Stats {
+  std::vector<double> samples;
+  double min = 0, max = 0, mean = 0, stddev = 0;
+  double median = 0, p10 = 0, p90 = 0;
+  // Peak resident set size during the measurement in KiB, or since the
+  // start of the process if it can not be reset
+  long peak_rss_kb = 0;
+};
+
+inline unsigned envOr(const char *name, unsigned value) {
+  if (const char *str = getenv(name))
+    return (unsigned)atoi(str);
+  return value;
+}
+
+// Reset the peak resident set size of the process, on Linux only
+inline void resetPeakRSS() {
+  if (FILE *f = fopen("/proc/self/clear_refs", "w")) {
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+inline long peakRSS() {
+  if (FILE *f = fopen("/proc/self/status", "r")) {
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f))
+      if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+        break;
+    fclose(f);
+    if (kb >= 0)
+      return kb;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Linear interpolation between the closest ranks of sorted samples
+inline double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  double rank = p * (sorted.size() - 1);
+  size_t lo = (size_t)rank;
+  size_t hi = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+}
+
+// Time body, calling setup untimed before every run, such as to reset
+// gradients which the body accumulates into
+template <typename Setup, typename Body>
+Stats measure(Setup setup, Body body) {
+  unsigned warmup = envOr("BENCH_WARMUP", 1);
+  unsigned repeat = std::max(1U, envOr("BENCH_REPEAT", 3));
+
+  Stats stats;
+  resetPeakRSS();
+  for (unsigned i = 0; i < warmup; i++) {
+    setup();
+    body();
+  }
+  for (unsigned i = 0; i < repeat; i++) {
+    setup();
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+    stats.samples.push_back(std::chrono::duration<double>(end - start).count());
+  }
+  stats.peak_rss_kb = peakRSS();
+
+  std::vector<double> sorted = stats.samples;
+  std::sort(sorted.begin(), sorted.end());
+  stats.min = sorted.front();
+  stats.max = sorted.back();
+  for (double s : sorted)
+    stats.mean += s / sorted.size();
+  for (double s : sorted)
+    stats.stddev += (s - stats.mean) * (s - stats.mean) / sorted.size();
+  stats.stddev = sqrt(stats.stddev);
+  stats.median = percentile(sorted, 0.5);
+  stats.p10 = percentile(sorted, 0.1);
+  stats.p90 = percentile(sorted, 0.9);
+  return stats;
+}
+
+template <typename Body> Stats measure(Body body) {
+  return measure([] {}, body);
+}
+
+struct Result {
+  std::string input, tool, phase;
+  Stats stats;
+  std::string error;
+};
+
+inline void printString(FILE *out, const std::string &str) {
+  fputc('"', out);
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      fputc('\\', out);
+    if ((unsigned char)c < 0x20)
+      fprintf(out, "\\u%04x", (unsigned char)c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+class Report {
+public:
+  std::string name = "benchmark";
+  std::vector<Result> results;
+
+  ~Report() {
+    const char *path = getenv("BENCH_JSON");
+    FILE *out = fopen(path && *path ? path : "results.json", "w");
+    if (!out)
+      return;
+    fputs("{\n  \"benchmark\": ", out);
+    printString(out, name);
+    fprintf(out, ",\n  \"warmup\": %u,\n  \"repeat\": %u,\n  \"results\": [",
+            envOr("BENCH_WARMUP", 1), std::max(1U, envOr("BENCH_REPEAT", 3)));
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &R = results[i];
+      fputs(i == 0 ? "\n    {\"input\": " : ",\n    {\"input\": ", out);
+      printString(out, R.input);
+      fputs(", \"tool\": ", out);
+      printString(out, R.tool);
+      fputs(", \"phase\": ", out);
+      printString(out, R.phase);
+      if (!R.error.empty()) {
+        fputs(", \"error\": ", out);
+        printString(out, R.error);
+      } else {
+        const Stats &S = R.stats;
+        fprintf(out,
+                ", \"runs\": %zu, \"median\": %.9g, \"p10\": %.9g, "
+                "\"p90\": %.9g, \"mean\": %.9g, \"stddev\": %.9g, "
+                "\"min\": %.9g, \"max\": %.9g, \"peak_rss_kb\": %ld",
+                S.samples.size(), S.median, S.p10, S.p90, S.mean, S.stddev,
+                S.min, S.max, S.peak_rss_kb);
+      }
+      fputc('}', out);
+    }
+    fputs("\n  ]\n}\n", out);
+    fclose(out);
+  }
+};
+
+// A single report per process, shared by all translation units
+inline Report &report() {
+  static Report R;
+  return R;
+}
+
+inline void init(const char *name) { report().name = name; }
+
+// Record the stats of tool (Enzyme, Tapenade, Adept, ...) computing phase
+// (forward, combined, ...) of the given input
+inline void record(const std::string &input, const char *tool,
+                   const char *phase, const Stats &stats) {
+  report().results.push_back({input, tool, phase, stats, ""});
+}
+
+// Record that tool failed to compute phase of the given input
+inline void fail(const std::string &input, const char *tool, const char *phase,
+                 const char *error) {
+  report().results.push_back({input, tool, phase, Stats(), error});
+}
+
+} // namespace bench
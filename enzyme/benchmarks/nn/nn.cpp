@@ -895,12 +895,13 @@ float calculate_accuracy(mnist_dataset_t * dataset, neural_network_t * network)
 #include <math.h>
 #include <inttypes.h>
 #include <string.h>
+#include "../mshared/harness.h"
 
 float tdiff(struct timeval *start, struct timeval *end) {
   return (end->tv_sec-start->tv_sec) + 1e-6*(end->tv_usec-start->tv_usec);
 }
 
-void run(float (*fn)(mnist_dataset_t*, neural_network_t*, float)) {
+void run(const char *tool, float (*fn)(mnist_dataset_t*, neural_network_t*, float)) {
     mnist_dataset_t * train_dataset, * test_dataset;
     mnist_dataset_t batch;
     neural_network_t network;
@@ -911,15 +912,12 @@ void run(float (*fn)(mnist_dataset_t*, neural_network_t*, float)) {
     train_dataset = mnist_get_dataset(train_images_file, train_labels_file);
     test_dataset = mnist_get_dataset(test_images_file, test_labels_file);
 
-    // Initialise weights and biases with random values
-    neural_network_random_weights(&network);
-
     // Calculate how many batches (so we know when to wrap around)
     batches = train_dataset->size / BATCH_SIZE;
 
-    struct timeval start, end;
-    gettimeofday(&start, NULL);
-    
+    // Every run trains from newly initialised random weights and biases
+    bench::Stats stats = bench::measure(
+        [&] { neural_network_random_weights(&network); }, [&] {
     for (i = 0; i < STEPS; i++) {
         // Initialise a new batch
         mnist_batch(train_dataset, &batch, 100, i % batches);
@@ -932,9 +930,9 @@ void run(float (*fn)(mnist_dataset_t*, neural_network_t*, float)) {
 
         printf("Step %04d\tAverage Loss: %.2f\tAccuracy: %.3f\n", i, loss / batch.size, accuracy);
     }
-  
-    gettimeofday(&end, NULL);
-    printf("%0.6f\n", tdiff(&start, &end));
+    });
+    bench::record("steps=" + std::to_string(STEPS), tool, "combined", stats);
+    printf("%0.6f\n", stats.median);
 
     // Cleanup
     mnist_free_dataset(train_dataset);
@@ -944,13 +942,14 @@ void run(float (*fn)(mnist_dataset_t*, neural_network_t*, float)) {
 
 int main(int argc, char *argv[])
 {
+    bench::init("nn");
     printf("Regular\n");
-    run(neural_network_training_step);
+    run("Regular", neural_network_training_step);
     printf("Enzyme\n");
-    run(neural_network_training_step_enzyme);
+    run("Enzyme", neural_network_training_step_enzyme);
     printf("Adept\n");
-    run(neural_network_training_step_adept);
+    run("Adept", neural_network_training_step_adept);
     printf("Tapenade\n");
-    run(neural_network_training_step_tapenade);
+    run("Tapenade", neural_network_training_step_tapenade);
     return 0;
 }
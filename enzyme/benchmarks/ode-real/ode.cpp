@@ -6,6 +6,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <string.h>
+#include "../mshared/harness.h"
 #include <adept_source.h>
 #include <adept.h>
 #include <adept_arrays.h>
@@ -502,6 +503,7 @@ double tfoobar(const double* p, const state_type x, const state_type adjoint, do
 
 //! Main
 int main(int argc, char** argv) {
+  bench::init("ode-real");
   const double p[3] = { /*A*/ 3.4, /*B*/ 1, /*alpha*/10. };
 
   state_type x;
@@ -513,39 +515,33 @@ int main(int argc, char** argv) {
   double t = 2.1;
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
   double res;
-  for(int i=0; i<10000; i++)
-  res = afoobar(p, x, adjoint, t);
-
-  gettimeofday(&end, NULL);
-  printf("Adept combined %0.6f res=%f\n", tdiff(&start, &end), res);
+  bench::Stats stats = bench::measure([&] {
+    for(int i=0; i<10000; i++)
+    res = afoobar(p, x, adjoint, t);
+  });
+  bench::record("N=" + std::to_string(N), "Adept", "combined", stats);
+  printf("Adept combined %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
   double res;
-  for(int i=0; i<10000; i++)
-  res = tfoobar(p, x, adjoint, t);
-
-  gettimeofday(&end, NULL);
-  printf("Tapenade combined %0.6f res=%f\n", tdiff(&start, &end), res);
+  bench::Stats stats = bench::measure([&] {
+    for(int i=0; i<10000; i++)
+    res = tfoobar(p, x, adjoint, t);
+  });
+  bench::record("N=" + std::to_string(N), "Tapenade", "combined", stats);
+  printf("Tapenade combined %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
   double res;
-  for(int i=0; i<10000; i++)
-  res = foobar(p, x, adjoint, t);
-
-  gettimeofday(&end, NULL);
-  printf("Enzyme combined %0.6f res=%f\n", tdiff(&start, &end), res);
+  bench::Stats stats = bench::measure([&] {
+    for(int i=0; i<10000; i++)
+    res = foobar(p, x, adjoint, t);
+  });
+  bench::record("N=" + std::to_string(N), "Enzyme", "combined", stats);
+  printf("Enzyme combined %0.6f res=%f\n", stats.median, res);
   }
   //printf("res=%f\n", foobar(1000));
 }
@@ -6,6 +6,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <string.h>
+#include "../mshared/harness.h"
 #include <adept_source.h>
 #include <adept.h>
 using adept::adouble;
@@ -65,37 +66,35 @@ double afoobar_and_gradient(double xin, double& xgrad, uint64_t iters) {
 }
 
 void adept_sincos(double inp, uint64_t iters) {
-  {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = foobar(inp, iters);
+  std::string input = "iters=" + std::to_string(iters);
 
-  gettimeofday(&end, NULL);
-  printf("Adept real %0.6f res=%f\n", tdiff(&start, &end), res);
+  {
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = foobar(inp, iters);
+  });
+  bench::record(input, "Adept", "real", stats);
+  printf("Adept real %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  adept::Stack stack;
- // stack.new_recording();
-  adouble resa = afoobar(inp, iters);
-  double res = resa.value();
-
-  gettimeofday(&end, NULL);
-  printf("Adept forward %0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    adept::Stack stack;
+   // stack.new_recording();
+    adouble resa = afoobar(inp, iters);
+    res = resa.value();
+  });
+  bench::record(input, "Adept", "forward", stats);
+  printf("Adept forward %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
   double res2 = 0;
-  afoobar_and_gradient(inp, res2, iters);
-
-  gettimeofday(&end, NULL);
-  printf("Adept combined %0.6f res'=%f\n", tdiff(&start, &end), res2);
+  bench::Stats stats = bench::measure([&] {
+    afoobar_and_gradient(inp, res2, iters);
+  });
+  bench::record(input, "Adept", "combined", stats);
+  printf("Adept combined %0.6f res'=%f\n", stats.median, res2);
   }
 }
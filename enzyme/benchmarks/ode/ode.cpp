@@ -6,6 +6,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <string.h>
+#include "../mshared/harness.h"
 
 template<typename Return, typename... T>
 Return __enzyme_autodiff(T...);
@@ -54,40 +55,38 @@ double foobar(double t, uint64_t iters) {
 void adept_sincos(double inp, uint64_t iters);
 
 static void enzyme_sincos(double inp, uint64_t iters) {
+  std::string input = "iters=" + std::to_string(iters);
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = foobar(inp, iters);
-
-  gettimeofday(&end, NULL);
-  printf("Enzyme real %0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = foobar(inp, iters);
+  });
+  bench::record(input, "Enzyme", "real", stats);
+  printf("Enzyme real %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = foobar(inp, iters);
-
-  gettimeofday(&end, NULL);
-  printf("Enzyme forward %0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = foobar(inp, iters);
+  });
+  bench::record(input, "Enzyme", "forward", stats);
+  printf("Enzyme forward %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
   double res2;
-
-  res2 = __enzyme_autodiff<double>(foobar, inp, iters);
-
-  gettimeofday(&end, NULL);
-  printf("Enzyme combined %0.6f res'=%f\n", tdiff(&start, &end), res2);
+  bench::Stats stats = bench::measure([&] {
+    res2 = __enzyme_autodiff<double>(foobar, inp, iters);
+  });
+  bench::record(input, "Enzyme", "combined", stats);
+  printf("Enzyme combined %0.6f res'=%f\n", stats.median, res2);
   }
 }
 
 int main(int argc, char** argv) {
+  bench::init("ode");
 
   int max_iters = atoi(argv[1]) ;
   double inp = 2.1;
@@ -6,6 +6,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <string.h>
+#include "../mshared/harness.h"
 
 template<typename Return, typename... T>
 Return __enzyme_autodiff(T...);
@@ -60,110 +61,106 @@ double sincos_and_gradient(double xin, double& xgrad) {
 }
 
 static void adept_sincos(double inp) {
-  {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = sincos_real(inp);
+  std::string input = "x=" + std::to_string(inp);
 
-  gettimeofday(&end, NULL);
-  printf("%0.6f res=%f\n", tdiff(&start, &end), res);
+  {
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = sincos_real(inp);
+  });
+  bench::record(input, "Adept", "real", stats);
+  printf("%0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  adept::Stack stack;
- // stack.new_recording();
-  adouble resa = sincos(inp);
-  double res = resa.value();
-
-  gettimeofday(&end, NULL);
-  printf("%0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    adept::Stack stack;
+   // stack.new_recording();
+    adouble resa = sincos(inp);
+    res = resa.value();
+  });
+  bench::record(input, "Adept", "forward", stats);
+  printf("%0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res2 = 0;
-  sincos_and_gradient(inp, res2);
-
-  gettimeofday(&end, NULL);
-  printf("%0.6f res'=%f\n", tdiff(&start, &end), res2);
+  double res2;
+  bench::Stats stats = bench::measure([&] {
+    res2 = 0;
+    sincos_and_gradient(inp, res2);
+  });
+  bench::record(input, "Adept", "combined", stats);
+  printf("%0.6f res'=%f\n", stats.median, res2);
   }
 }
 
 static void tapenade_sincos(double inp) {
+  std::string input = "x=" + std::to_string(inp);
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = sincos_real(inp);
-
-  gettimeofday(&end, NULL);
-  printf("tapenade %0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = sincos_real(inp);
+  });
+  bench::record(input, "Tapenade", "real", stats);
+  printf("tapenade %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = sincos_real(inp);
-
-  gettimeofday(&end, NULL);
-  printf("tapenade %0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = sincos_real(inp);
+  });
+  bench::record(input, "Tapenade", "forward", stats);
+  printf("tapenade %0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-  double res2 = 0;
-
-  sincos_real_tapenade(inp, &res2, 1.0);
+  double res2;
+  bench::Stats stats = bench::measure([&] {
+    res2 = 0;
 
-  gettimeofday(&end, NULL);
-  printf("tapendade %0.6f res'=%f\n", tdiff(&start, &end), res2);
+    sincos_real_tapenade(inp, &res2, 1.0);
+  });
+  bench::record(input, "Tapenade", "combined", stats);
+  printf("tapendade %0.6f res'=%f\n", stats.median, res2);
   }
 }
 
 static void enzyme_sincos(double inp) {
+  std::string input = "x=" + std::to_string(inp);
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = sincos_real(inp);
-
-  gettimeofday(&end, NULL);
-  printf("%0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = sincos_real(inp);
+  });
+  bench::record(input, "Enzyme", "real", stats);
+  printf("%0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
-
-  double res = sincos_real(inp);
-
-  gettimeofday(&end, NULL);
-  printf("%0.6f res=%f\n", tdiff(&start, &end), res);
+  double res;
+  bench::Stats stats = bench::measure([&] {
+    res = sincos_real(inp);
+  });
+  bench::record(input, "Enzyme", "forward", stats);
+  printf("%0.6f res=%f\n", stats.median, res);
   }
 
   {
-  struct timeval start, end;
-  gettimeofday(&start, NULL);
   double res2;
-
-  res2 = __enzyme_autodiff<double>(sincos_real, inp);
-
-  gettimeofday(&end, NULL);
-  printf("%0.6f res'=%f\n", tdiff(&start, &end), res2);
+  bench::Stats stats = bench::measure([&] {
+    res2 = __enzyme_autodiff<double>(sincos_real, inp);
+  });
+  bench::record(input, "Enzyme", "combined", stats);
+  printf("%0.6f res'=%f\n", stats.median, res2);
   }
 }
 
 int main(int argc, char** argv) {
+  bench::init("taylorlog");
 
   double inp = atof(argv[1]) ;
   printf("adept\n");
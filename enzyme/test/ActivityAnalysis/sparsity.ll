@@ -0,0 +1,87 @@
+; RUN: %opt < %s %loadEnzyme -print-sparsity-analysis -sparsity-analysis-func=stencil -o /dev/null | FileCheck %s
+; RUN: %opt < %s %loadEnzyme -print-sparsity-analysis -sparsity-analysis-func=prefix -o /dev/null | FileCheck %s --check-prefix=PREFIX
+; RUN: %opt < %s %loadEnzyme -print-sparsity-analysis -sparsity-analysis-func=last -o /dev/null | FileCheck %s --check-prefix=LAST
+
+define void @stencil(double* %x, double* %y, i64 %n) {
+entry:
+  %x0 = load double, double* %x, align 8
+  %x3p = getelementptr inbounds double, double* %x, i64 3
+  %x3 = load double, double* %x3p, align 8
+  %y0 = fmul double %x0, %x3
+  store double %y0, double* %y, align 8
+  br label %loop
+
+loop:
+  %i = phi i64 [ 1, %entry ], [ %next, %loop ]
+  %im1 = add nsw i64 %i, -1
+  %next = add nuw nsw i64 %i, 1
+  %lp = getelementptr inbounds double, double* %x, i64 %im1
+  %l = load double, double* %lp, align 8
+  %cp = getelementptr inbounds double, double* %x, i64 %i
+  %c = load double, double* %cp, align 8
+  %rp = getelementptr inbounds double, double* %x, i64 %next
+  %r = load double, double* %rp, align 8
+  %cr = fmul double %c, %r
+  %sum = fadd double %l, %cr
+  %yp = getelementptr inbounds double, double* %y, i64 %i
+  store double %sum, double* %yp, align 8
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; CHECK: dense: 0
+; CHECK-NEXT: offsets: -1 0 1
+; CHECK-NEXT: columns:
+; CHECK-NEXT: dense rows:
+; CHECK-NEXT: fixed: 0:[0 3]
+
+; y[i] = x[0] + ... + x[i] depends on every earlier input, not just x[i]
+define void @prefix(double* %x, double* %y, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %acc = phi double [ 0.000000e+00, %entry ], [ %sum, %loop ]
+  %xp = getelementptr inbounds double, double* %x, i64 %i
+  %xi = load double, double* %xp, align 8
+  %sum = fadd double %acc, %xi
+  %yp = getelementptr inbounds double, double* %y, i64 %i
+  store double %sum, double* %yp, align 8
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; PREFIX: dense: 1
+
+; y[0] is the input loaded by the last iteration of the loop
+define void @last(double* %x, double* %y, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %xp = getelementptr inbounds double, double* %x, i64 %i
+  %xi = load double, double* %xp, align 8
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  %xl = phi double [ %xi, %loop ]
+  store double %xl, double* %y, align 8
+  ret void
+}
+
+; LAST: dense: 0
+; LAST-NEXT: offsets:
+; LAST-NEXT: columns:
+; LAST-NEXT: dense rows: 0
+; LAST-NEXT: fixed:
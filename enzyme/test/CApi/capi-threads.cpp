@@ -0,0 +1,103 @@
+// RUN: %clang -O1 -c -emit-llvm %S/Inputs/square.c -o %t.bc
+// RUN: %clang -std=c++14 -pthread %s %linkEnzyme -o %t
+// RUN: %t %t.bc | %FileCheck %s
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "CApi.h"
+#include "llvm-c/Analysis.h"
+#include "llvm-c/BitReader.h"
+
+static EnzymeLogicRef Logic;
+static EnzymeTypeAnalysisRef TA;
+static const char *Bitcode;
+static size_t Size;
+static std::atomic<int> Failures(0);
+
+// Differentiate square in a fresh context each iteration, then remove and
+// dispose of the context such that a later one may reuse its address.
+static void differentiate(int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    LLVMContextRef Ctx = LLVMContextCreate();
+    LLVMMemoryBufferRef Buf =
+        LLVMCreateMemoryBufferWithMemoryRangeCopy(Bitcode, Size, "square");
+    LLVMModuleRef M;
+    if (LLVMParseBitcodeInContext2(Ctx, Buf, &M)) {
+      Failures++;
+      LLVMDisposeMemoryBuffer(Buf);
+      LLVMContextDispose(Ctx);
+      continue;
+    }
+    LLVMDisposeMemoryBuffer(Buf);
+
+    CTypeTreeRef Arg = EnzymeNewTypeTreeCT(DT_Double, Ctx);
+    EnzymeTypeTreeOnlyEq(Arg, -1);
+    CTypeTreeRef Ret = EnzymeNewTypeTreeCT(DT_Double, Ctx);
+    EnzymeTypeTreeOnlyEq(Ret, -1);
+    IntList KnownValues = {nullptr, 0};
+    CFnTypeInfo Info = {&Arg, Ret, &KnownValues};
+    CDIFFE_TYPE Activity = DFT_OUT_DIFF;
+    uint8_t Uncacheable = 0;
+
+    LLVMValueRef D = EnzymeCreatePrimalAndGradient(
+        Logic, LLVMGetNamedFunction(M, "square"), DFT_OUT_DIFF, &Activity, 1,
+        TA, /*returnValue*/ 0, /*dretUsed*/ 0, DEM_ReverseModeCombined,
+        /*additionalArg*/ nullptr, Info, &Uncacheable, 1,
+        /*augmented*/ nullptr, /*AtomicAdd*/ 0, /*PostOpt*/ 0);
+
+    // A derivative cached for an earlier context at the same address would
+    // belong to another module.
+    if (!D || LLVMGetGlobalParent(D) != M ||
+        LLVMVerifyModule(M, LLVMReturnStatusAction, nullptr))
+      Failures++;
+
+    EnzymeFreeTypeTree(Arg);
+    EnzymeFreeTypeTree(Ret);
+    LLVMDisposeModule(M);
+    EnzymeRemoveContext(Ctx);
+    LLVMContextDispose(Ctx);
+  }
+}
+
+int main(int argc, char **argv) {
+  FILE *f = fopen(argv[1], "rb");
+  fseek(f, 0, SEEK_END);
+  Size = ftell(f);
+  rewind(f);
+  char *buffer = (char *)malloc(Size);
+  fread(buffer, 1, Size, f);
+  fclose(f);
+  Bitcode = buffer;
+
+  Logic = CreateEnzymeLogic();
+  TA = CreateTypeAnalysis((char *)"", nullptr, nullptr, 0);
+
+  // Requests on distinct contexts run concurrently with clearing the
+  // shared caches, which must neither deadlock nor corrupt a request.
+  std::atomic<bool> Done(false);
+  std::thread Clearer([&]() {
+    while (!Done) {
+      ClearEnzymeLogic(Logic);
+      ClearTypeAnalysis(TA);
+    }
+  });
+  std::vector<std::thread> Workers;
+  for (int i = 0; i < 4; i++)
+    Workers.emplace_back(differentiate, 8);
+  for (auto &W : Workers)
+    W.join();
+  Done = true;
+  Clearer.join();
+
+  printf("failures = %d\n", Failures.load());
+  // CHECK: failures = 0
+
+  FreeTypeAnalysis(TA);
+  FreeEnzymeLogic(Logic);
+  free(buffer);
+  return 0;
+}
@@ -0,0 +1,67 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define void @square(double* %x, double* %y, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %xi = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %xi, align 8
+  %mul = fmul double %ld, %ld
+  %yi = getelementptr inbounds double, double* %y, i64 %i
+  store double %mul, double* %yi, align 8
+  %next = add nuw i64 %i, 1
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+define void @jacobian(i64 %n, i64* %rowptr, i64* %colidx, double* %vals, double* %x, double* %y) {
+entry:
+  tail call void (...) @__enzyme_sparse_jacobian(void (double*, double*, i64)* nonnull @square, i64 %n, i64 %n, i64* %rowptr, i64* %colidx, double* %vals, double* %x, double* %y, i64 %n)
+  ret void
+}
+
+declare void @__enzyme_sparse_jacobian(...)
+
+; CHECK: define void @jacobian(i64 %n, i64* %rowptr, i64* %colidx, double* %vals, double* %x, double* %y)
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   call void @sparsejacobian_square(i64 %n, i64 %n, i64* %rowptr, i64* %colidx, double* %vals, double* %x, double* %y, i64 %n)
+; CHECK-NEXT:   ret void
+
+; CHECK: define internal void @diffesquare(double* %x, double* %"x'", double* %y, double* %"y'", i64 %n)
+
+; CHECK: define internal void @sparsejacobian_square(i64 %n, i64 %m, i64* %rowptr, i64* %colidx, double* %vals, double* %x, double* %y, i64 %n1)
+; CHECK:        %colptr = call {{.*}}i8* @malloc(
+; CHECK:      color.body:
+
+; Column color.idx takes the first color not marked with color.idx by a
+; column sharing one of its rows
+; CHECK:      mark:
+; CHECK:        store i64 %color.idx, i64* %{{.*}}
+; CHECK:      search:
+; CHECK-NEXT:   %c = phi i64 [ 0, %{{.*}} ], [ %[[nextc:.+]], %search ]
+; CHECK-NEXT:   %[[nextc]] = add i64 %c, 1
+; CHECK:        %[[taken:.+]] = icmp eq i64 %{{.*}}, %color.idx
+; CHECK-NEXT:   br i1 %[[taken]], label %search, label %found
+
+; Every column of color sweep.idx is seeded at once
+; CHECK:      sweep.body:
+; CHECK:      seed.body:
+; CHECK:        %[[jcolor:.+]] = load i64, i64* %{{.*}}
+; CHECK-NEXT:   %[[seeded:.+]] = icmp eq i64 %[[jcolor]], %sweep.idx
+; CHECK-NEXT:   %[[seed:.+]] = select i1 %[[seeded]], double 1.000000e+00, double 0.000000e+00
+; CHECK:        store double %[[seed]], double* %{{.*}}
+; CHECK:        call void @diffesquare(double* %x, double* %{{.*}}, double* %y, double* %{{.*}}, i64 %n1)
+
+; and the compressed row r is the value of the nonzero of that color in row r
+; CHECK:      scatter.nz.body:
+; CHECK:        %[[qcolor:.+]] = load i64, i64* %{{.*}}
+; CHECK-NEXT:   %[[hit:.+]] = icmp eq i64 %[[qcolor]], %sweep.idx
+; CHECK:        %[[val:.+]] = select i1 %[[hit]], double %{{.*}}, double %{{.*}}
+; CHECK:        store double %[[val]], double* %{{.*}}
+; CHECK:        call void @free(
+; CHECK:        ret void
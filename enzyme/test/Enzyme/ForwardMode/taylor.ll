@@ -0,0 +1,55 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @tester(double %x) {
+entry:
+  %0 = fmul fast double %x, %x
+  %1 = call fast double @llvm.exp.f64(double %0)
+  ret double %1
+}
+
+define void @test_derivative(double %x, double* %dx, double* %out) {
+entry:
+  tail call void (...) @__enzyme_taylor(double (double)* nonnull @tester, i64 3, double %x, double* %dx, double* %out)
+  ret void
+}
+
+define double @texp(double %x) {
+entry:
+  %e = call fast double @llvm.exp.f64(double %x)
+  ret double %e
+}
+
+define void @test_exp(double %x, double* %dx, double* %out) {
+entry:
+  tail call void (...) @__enzyme_taylor(double (double)* nonnull @texp, i64 2, double %x, double* %dx, double* %out)
+  ret void
+}
+
+declare double @llvm.exp.f64(double)
+
+declare void @__enzyme_taylor(...)
+
+; CHECK: define void @test_derivative(double %x, double* %dx, double* %out)
+; CHECK:        %[[coeffs:.+]] = load [3 x double], [3 x double]* %{{.*}}
+; CHECK-NEXT:   %[[res:.+]] = call { [3 x double] } @taylor3tester(double %x, [3 x double] %[[coeffs]])
+; CHECK-NEXT:   %[[out:.+]] = extractvalue { [3 x double] } %[[res]], 0
+; CHECK:        store [3 x double] %[[out]], [3 x double]* %{{.*}}
+
+; CHECK: define internal { [3 x double] } @taylor3tester(double %x, [3 x double] %"x'")
+; CHECK:        %[[sq:.+]] = fmul fast double %x, %x
+; CHECK-NEXT:   %[[e:.+]] = call fast double @llvm.exp.f64(double %[[sq]])
+; CHECK:        ret { [3 x double] }
+
+; With x = x0 + a1 t + a2 t^2, exp(x) = e (1 + a1 t + (a2 + a1^2 / 2) t^2)
+; CHECK: define internal { [2 x double] } @taylor2texp(double %x, [2 x double] %"x'")
+; CHECK:        %[[e:.+]] = call fast double @llvm.exp.f64(double %x)
+; CHECK:        %[[a1:.+]] = extractvalue [2 x double] %"x'", 0
+; CHECK-NEXT:   %[[a2:.+]] = extractvalue [2 x double] %"x'", 1
+; CHECK-NEXT:   %[[e1:.+]] = fmul {{(fast )?}}double %[[a1]], %[[e]]
+; CHECK-NEXT:   %[[a1e1:.+]] = fmul {{(fast )?}}double %[[a1]], %[[e1]]
+; CHECK-NEXT:   %[[half:.+]] = fmul {{(fast )?}}double %[[a1e1]], 5.000000e-01
+; CHECK-NEXT:   %[[a2e:.+]] = fmul {{(fast )?}}double %[[a2]], %[[e]]
+; CHECK-NEXT:   %[[e2:.+]] = fadd {{(fast )?}}double %[[half]], %[[a2e]]
+; CHECK-NEXT:   %[[c1:.+]] = insertvalue [2 x double] undef, double %[[e1]], 0
+; CHECK-NEXT:   %[[c2:.+]] = insertvalue [2 x double] %[[c1]], double %[[e2]], 1
+; CHECK:        ret { [2 x double] }
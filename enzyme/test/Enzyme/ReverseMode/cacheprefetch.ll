@@ -0,0 +1,96 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-nontemporal-cache -enzyme-cache-prefetch-distance=256 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+; The cache holds 2MiB, beyond the default nontemporal threshold
+define double @sumsquares(double* %x) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %add, %loop ]
+  %gep = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %gep, align 8
+  store double 0.000000e+00, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  %add = fadd fast double %sum, %mul
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, 262144
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret double %add
+}
+
+define double @small(double* %x) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %add, %loop ]
+  %gep = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %gep, align 8
+  store double 0.000000e+00, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  %add = fadd fast double %sum, %mul
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, 16
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret double %add
+}
+
+; The runtime size of the cache is estimated from the profile
+define double @profiled(double* %x, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %add, %loop ]
+  %gep = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %gep, align 8
+  store double 0.000000e+00, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  %add = fadd fast double %sum, %mul
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop, !prof !0
+
+exit:
+  ret double %add
+}
+
+define void @grad(double* %x, double* %dx, i64 %n) {
+entry:
+  %r = call double (...) @__enzyme_autodiff(double (double*)* nonnull @sumsquares, double* %x, double* %dx)
+  %s = call double (...) @__enzyme_autodiff(double (double*)* nonnull @small, double* %x, double* %dx)
+  %p = call double (...) @__enzyme_autodiff(double (double*, i64)* nonnull @profiled, double* %x, double* %dx, i64 %n)
+  ret void
+}
+
+declare double @__enzyme_autodiff(...)
+
+!0 = !{!"branch_weights", i32 1, i32 262144}
+
+; CHECK: define internal void @diffesumsquares(double* %x, double* %"x'", double %differeturn)
+; CHECK: loop:
+; CHECK:   store double %ld, double* %{{.+}}, align 8{{.*}}, !nontemporal ![[nt:[0-9]+]]
+; CHECK: invertloop:
+; CHECK:   %[[ptr:.+]] = getelementptr inbounds double, double* %{{.+}}, i64 %[[idx:.+]]
+; CHECK-NEXT:   %[[byteptr:.+]] = bitcast double* %[[ptr]] to i8*
+; CHECK-NEXT:   %[[ahead:.+]] = getelementptr i8, i8* %[[byteptr]], i64 -256
+; CHECK-NEXT:   call void @llvm.prefetch.p0i8(i8* %[[ahead]], i32 0, i32 0, i32 1)
+; CHECK-NEXT:   load double, double* %[[ptr]]
+
+; CHECK: define internal void @diffesmall(double* %x, double* %"x'", double %differeturn)
+; CHECK: loop:
+; CHECK-NOT: !nontemporal
+; CHECK: invertloop:
+
+; CHECK: define internal void @diffeprofiled(double* %x, double* %"x'", i64 %n, double %differeturn)
+; CHECK: loop:
+; CHECK:   store double %ld, double* %{{.+}}, align 8{{.*}}, !nontemporal ![[nt]]
+
+; CHECK: ![[nt]] = !{i32 1}
@@ -0,0 +1,43 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-combine-caches=2 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @prodsum(double* %x, float* %y, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %add, %loop ]
+  %gepx = getelementptr inbounds double, double* %x, i64 %i
+  %ldx = load double, double* %gepx, align 8
+  store double 0.000000e+00, double* %gepx, align 8
+  %gepy = getelementptr inbounds float, float* %y, i64 %i
+  %ldy = load float, float* %gepy, align 4
+  store float 0.000000e+00, float* %gepy, align 4
+  %ext = fpext float %ldy to double
+  %mul = fmul fast double %ldx, %ext
+  %add = fadd fast double %sum, %mul
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret double %add
+}
+
+define void @grad(double* %x, double* %dx, float* %y, float* %dy, i64 %n) {
+entry:
+  %r = call double (...) @__enzyme_autodiff(double (double*, float*, i64)* nonnull @prodsum, double* %x, double* %dx, float* %y, float* %dy, i64 %n)
+  ret void
+}
+
+declare double @__enzyme_autodiff(...)
+
+; CHECK: define internal void @diffeprodsum(double* %x, double* %"x'", float* %y, float* %"y'", i64 %n, double %differeturn)
+; CHECK-NOT: @malloc(
+; CHECK:   %[[bytes:.+]] = mul nuw nsw i64 %{{.+}}, 12
+; CHECK:   %combinedcache = call noalias nonnull i8* @malloc(i64 %[[bytes]])
+; CHECK-NOT: @malloc(
+; CHECK:   getelementptr inbounds i8, i8* %combinedcache, i64
+; CHECK:   call void @free(i8* nonnull %
+; CHECK-NOT: @free(
+; CHECK: ret void
@@ -0,0 +1,29 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @cube(double* %x) {
+entry:
+  %ld = load double, double* %x, align 8
+  %sq = fmul double %ld, %ld
+  %mul = fmul double %sq, %ld
+  ret double %mul
+}
+
+define void @hvpcube(double* %x, double* %v, double* %g, double* %hv) {
+entry:
+  tail call void (...) @__enzyme_hvp(double (double*)* nonnull @cube, double* %x, double* %v, double* %g, double* %hv)
+  ret void
+}
+
+declare void @__enzyme_hvp(...)
+
+; CHECK: define void @hvpcube(double* %x, double* %v, double* %g, double* %hv)
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   call {{.*}} @diffediffecube(double* %x, double* %hv, double* %v, double* %g, double 1.000000e+00)
+; CHECK-NEXT:   ret void
+
+; The reverse sweep runs over the tangent function, which keeps no tape of
+; its own to allocate, fill or free.
+; CHECK: define internal {{.*}} @diffediffecube(double* %x, double* %"x'", double* %"x'{{.*}}", double* %"x'{{.*}}", double %differeturn)
+; CHECK-NOT: call {{.*}}@malloc
+; CHECK-NOT: call {{.*}}@free
+; CHECK: ret
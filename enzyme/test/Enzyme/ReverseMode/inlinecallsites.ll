@@ -0,0 +1,35 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-inline-heuristic=1 -enzyme-inline-threshold=8 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+; An internal helper of four instructions is only called from the function
+; being differentiated, but from three call sites. Inlining it would copy its
+; body three times, a cost of twelve, so each call stays a call.
+
+define internal double @helper(double %x) {
+entry:
+  %m1 = fmul fast double %x, %x
+  %m2 = fmul fast double %m1, %x
+  %m3 = fmul fast double %m2, %x
+  ret double %m3
+}
+
+define double @tester(double %x) {
+entry:
+  %a = call double @helper(double %x)
+  %b = call double @helper(double %a)
+  %c = call double @helper(double %b)
+  ret double %c
+}
+
+define double @test_derivative(double %x) {
+entry:
+  %0 = tail call double (double (double)*, ...) @__enzyme_autodiff(double (double)* nonnull @tester, double %x)
+  ret double %0
+}
+
+declare double @__enzyme_autodiff(double (double)*, ...)
+
+; CHECK: define internal {{(dso_local )?}}{ double } @diffetester(double %x, double %[[differet:.+]])
+; CHECK: call { double } @diffehelper(
+; CHECK: call { double } @diffehelper(
+; CHECK: call { double } @diffehelper(
+; CHECK: ret { double }
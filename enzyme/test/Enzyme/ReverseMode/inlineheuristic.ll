@@ -0,0 +1,35 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-inline-heuristic=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define internal double @square(double %x) {
+entry:
+  %mul = fmul fast double %x, %x
+  ret double %mul
+}
+
+define internal double @big(double %x) noinline {
+entry:
+  %s = call double @square(double %x)
+  ret double %s
+}
+
+define double @tester(double %x) {
+entry:
+  %a = call double @square(double %x)
+  %b = call double @square(double %a)
+  %c = call double @big(double %b)
+  ret double %c
+}
+
+define double @test_derivative(double %x) {
+entry:
+  %0 = tail call double (double (double)*, ...) @__enzyme_autodiff(double (double)* nonnull @tester, double %x)
+  ret double %0
+}
+
+declare double @__enzyme_autodiff(double (double)*, ...)
+
+; CHECK: define internal {{(dso_local )?}}{ double } @diffetester(double %x, double %[[differet:.+]])
+; CHECK-NOT: call {{.*}} @diffesquare
+; CHECK: call { double } @diffebig(
+; CHECK-NOT: call {{.*}} @diffesquare
+; CHECK: ret { double }
@@ -0,0 +1,45 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-inline-subtapes=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @rec(double* %x, i64 %n) {
+entry:
+  %cmp = icmp eq i64 %n, 0
+  br i1 %cmp, label %base, label %recur
+
+base:
+  ret double 1.000000e+00
+
+recur:
+  %ld = load double, double* %x, align 8
+  %n1 = sub i64 %n, 1
+  %r = call double @rec(double* %x, i64 %n1)
+  %m = fmul fast double %ld, %r
+  ret double %m
+}
+
+define double @tester(double* %x, i64 %n) {
+entry:
+  %r = call double @rec(double* %x, i64 %n)
+  store double 0.000000e+00, double* %x, align 8
+  ret double %r
+}
+
+define void @test_derivative(double* %x, double* %dx, i64 %n) {
+entry:
+  %0 = tail call double (double (double*, i64)*, ...) @__enzyme_autodiff(double (double*, i64)* nonnull @tester, double* %x, double* %dx, i64 %n)
+  ret void
+}
+
+declare double @__enzyme_autodiff(double (double*, i64)*, ...)
+
+; CHECK: define internal void @diffetester(double* %x, double* %"x'", i64 %n, double %differeturn)
+; CHECK-NOT: tapeld
+; CHECK: call {{.*}} @augmented_outer_rec(double* %x, double* %"x'", i64 %n)
+; CHECK-NOT: tapeld
+; CHECK: ret void
+
+; CHECK: define internal {{.*}} @augmented_rec(double* %x, double* %"x'", i64 %n)
+; CHECK: %tapemem = bitcast i8* %malloccall to
+
+; CHECK: define internal {{.*}} @augmented_outer_rec(double* %x, double* %"x'", i64 %n)
+; CHECK-NOT: @malloc(
+; CHECK: call {{.*}} @augmented_rec(double* %x, double* %"x'", i64 %n1)
@@ -0,0 +1,49 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-inline-heuristic=1 -enzyme-inline-threshold=8 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+; Both callees are externally visible, so their cost is their size: small is
+; two instructions and is inlined, large is twelve and stays a call.
+
+define double @small(double %x) {
+entry:
+  %mul = fmul fast double %x, %x
+  ret double %mul
+}
+
+define double @large(double %x) {
+entry:
+  %m1 = fmul fast double %x, %x
+  %m2 = fmul fast double %m1, %x
+  %m3 = fmul fast double %m2, %x
+  %m4 = fmul fast double %m3, %x
+  %m5 = fmul fast double %m4, %x
+  %m6 = fmul fast double %m5, %x
+  %m7 = fmul fast double %m6, %x
+  %m8 = fmul fast double %m7, %x
+  %m9 = fmul fast double %m8, %x
+  %m10 = fmul fast double %m9, %x
+  %m11 = fmul fast double %m10, %x
+  ret double %m11
+}
+
+define double @tester(double %x) {
+entry:
+  %a = call double @small(double %x)
+  %b = call double @large(double %a)
+  ret double %b
+}
+
+define double @test_derivative(double %x) {
+entry:
+  %0 = tail call double (double (double)*, ...) @__enzyme_autodiff(double (double)* nonnull @tester, double %x)
+  ret double %0
+}
+
+declare double @__enzyme_autodiff(double (double)*, ...)
+
+; CHECK: define internal {{(dso_local )?}}{ double } @diffetester(double %x, double %[[differet:.+]])
+; CHECK-NOT: @small
+; CHECK: call { double } @diffelarge(
+; CHECK-NOT: @small
+; CHECK: ret { double }
+
+; CHECK-NOT: define internal {{.*}} @diffesmall(
@@ -0,0 +1,45 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -enzyme-invert-recurrences -enzyme-invert-fp-recurrences -mem2reg -simplifycfg -early-cse-memssa -instsimplify -adce -S | FileCheck %s
+
+define double @series(double %x, i64 %N) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %pow = phi double [ 1.000000e+00, %entry ], [ %pow2, %loop ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %add, %loop ]
+  %term = fmul fast double %pow, %x
+  %add = fadd fast double %sum, %term
+  %pow2 = fmul fast double %pow, 2.000000e+00
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %N
+  br i1 %cmp, label %end, label %loop
+
+end:
+  ret double %add
+}
+
+define double @test_derivative(double %x, i64 %N) {
+entry:
+  %r = call double (double (double, i64)*, ...) @__enzyme_autodiff(double (double, i64)* nonnull @series, double %x, i64 %N)
+  ret double %r
+}
+
+declare double @__enzyme_autodiff(double (double, i64)*, ...)
+
+; The powers are reconstructed from the last one instead of being cached,
+; and the reconstructed power is the derivative of the term in the reverse loop
+
+; CHECK: define internal { double } @diffeseries(double %x, i64 %N, double %differeturn)
+; CHECK-NOT:    malloccache
+; CHECK-NOT:    call {{.*}}@malloc
+; CHECK:      invertloop:
+; CHECK-NOT:    malloccache
+; CHECK:        %[[cur:.+]] = phi double {{.*}}%pow2
+; CHECK-NOT:    malloccache
+; CHECK:        %[[prev:.+]] = fdiv double %[[cur]], 2.000000e+00
+; CHECK-NOT:    malloccache
+; CHECK:        %[[dx:.+]] = fmul fast double {{.*}}%[[prev]]
+; CHECK:        br i1
+; CHECK-NOT:    malloccache
+; CHECK:        ret { double }
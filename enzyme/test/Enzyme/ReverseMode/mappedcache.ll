@@ -0,0 +1,48 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-mapped-cache-threshold=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @sumsquares(double* %x, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %add, %loop ]
+  %gep = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %gep, align 8
+  store double 0.000000e+00, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  %add = fadd fast double %sum, %mul
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret double %add
+}
+
+define void @grad(double* %x, double* %dx, i64 %n) {
+entry:
+  %r = call double (...) @__enzyme_autodiff(double (double*, i64)* nonnull @sumsquares, double* %x, double* %dx, i64 %n)
+  ret void
+}
+
+declare double @__enzyme_autodiff(...)
+
+; CHECK: define internal void @diffesumsquares(double* %x, double* %"x'", i64 %n, double %differeturn)
+; CHECK:   %[[bytes:.+]] = mul nuw nsw i64 %{{.+}}, 8
+; CHECK:   %[[mem:.+]] = call i8* @__enzyme_mappedcache_alloc(i64 %[[bytes]], i64 1048576)
+; CHECK:   %[[cache:.+]] = bitcast i8* %[[mem]] to double*
+; CHECK: loop:
+; CHECK:   call void @__enzyme_mappedcache_advise(i8* %[[mem]], i8*
+; CHECK-DAG:   call void @__enzyme_mappedcache_advise(i8* %[[mem]], i8*
+; CHECK-DAG:   call void @__enzyme_mappedcache_free(i8* nonnull %[[mem]])
+
+; CHECK: define internal i8* @__enzyme_mappedcache_alloc(i64 %size, i64 %threshold)
+; CHECK:   call i8* @tmpfile()
+; CHECK:   call i8* @mmap(i8* null, i64 %len, i32 3, i32 1, i32 %fd, i64 0)
+
+; CHECK: define internal void @__enzyme_mappedcache_free(i8* %ptr)
+; CHECK:   call i32 @munmap(i8* %header, i64 %len)
+
+; CHECK: define internal void @__enzyme_mappedcache_advise(i8* %ptr, i8* %cur)
+; CHECK:   call i32 @madvise(
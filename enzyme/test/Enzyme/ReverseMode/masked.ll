@@ -0,0 +1,34 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define void @square(<4 x double>* %x, <4 x double>* %out, <4 x i1> %mask) {
+entry:
+  %ld = call <4 x double> @llvm.masked.load.v4f64.p0v4f64(<4 x double>* %x, i32 8, <4 x i1> %mask, <4 x double> zeroinitializer)
+  %mul = fmul <4 x double> %ld, %ld
+  call void @llvm.masked.store.v4f64.p0v4f64(<4 x double> %mul, <4 x double>* %out, i32 8, <4 x i1> %mask)
+  ret void
+}
+
+define void @dsquare(<4 x double>* %x, <4 x double>* %xp, <4 x double>* %out, <4 x double>* %outp, <4 x i1> %mask) {
+entry:
+  tail call void (...) @__enzyme_autodiff(void (<4 x double>*, <4 x double>*, <4 x i1>)* nonnull @square, <4 x double>* %x, <4 x double>* %xp, <4 x double>* %out, <4 x double>* %outp, <4 x i1> %mask)
+  ret void
+}
+
+declare <4 x double> @llvm.masked.load.v4f64.p0v4f64(<4 x double>*, i32, <4 x i1>, <4 x double>)
+
+declare void @llvm.masked.store.v4f64.p0v4f64(<4 x double>, <4 x double>*, i32, <4 x i1>)
+
+declare void @__enzyme_autodiff(...)
+
+; CHECK: define internal void @diffesquare(<4 x double>* %x, <4 x double>* %"x'", <4 x double>* %out, <4 x double>* %"out'", <4 x i1> %mask)
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %ld = call <4 x double> @llvm.masked.load.v4f64.p0v4f64(<4 x double>* %x, i32 8, <4 x i1> %mask, <4 x double> zeroinitializer)
+; CHECK-NEXT:   %mul = fmul <4 x double> %ld, %ld
+; CHECK-NEXT:   call void @llvm.masked.store.v4f64.p0v4f64(<4 x double> %mul, <4 x double>* %out, i32 8, <4 x i1> %mask)
+; CHECK-NEXT:   %[[dout:.+]] = call <4 x double> @llvm.masked.load.v4f64.p0v4f64(<4 x double>* %"out'", i32 8, <4 x i1> %mask, <4 x double> zeroinitializer)
+; CHECK-NEXT:   call void @llvm.masked.store.v4f64.p0v4f64(<4 x double> zeroinitializer, <4 x double>* %"out'", i32 8, <4 x i1> %mask)
+; CHECK:        %[[dx:.+]] = fadd fast <4 x double>
+; CHECK:        %[[old:.+]] = call <4 x double> @llvm.masked.load.v4f64.p0v4f64(<4 x double>* %"x'", i32 8, <4 x i1> %mask, <4 x double> zeroinitializer)
+; CHECK-NEXT:   %[[sum:.+]] = fadd fast <4 x double> %[[old]], %[[dx]]
+; CHECK-NEXT:   call void @llvm.masked.store.v4f64.p0v4f64(<4 x double> %[[sum]], <4 x double>* %"x'", i32 8, <4 x i1> %mask)
+; CHECK-NEXT:   ret void
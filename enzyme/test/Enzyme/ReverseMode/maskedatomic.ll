@@ -0,0 +1,55 @@
+; RUN: if [ %llvmver -ge 9 ]; then %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s; fi
+
+target datalayout = "e-i64:64-i128:128-v16:16-v32:32-n16:32:64"
+target triple = "nvptx64-nvidia-cuda"
+
+define void @square(<2 x double>* %x, double* %y, <2 x double>* %out, <2 x i1> %mask) {
+entry:
+  %ld = call <2 x double> @llvm.masked.load.v2f64.p0v2f64(<2 x double>* %x, i32 8, <2 x i1> %mask, <2 x double> zeroinitializer)
+  %ex = call <2 x double> @llvm.masked.expandload.v2f64(double* %y, <2 x i1> %mask, <2 x double> zeroinitializer)
+  %mul = fmul <2 x double> %ld, %ex
+  store <2 x double> %mul, <2 x double>* %out, align 8
+  ret void
+}
+
+define void @dsquare(<2 x double>* %x, <2 x double>* %xp, double* %y, double* %yp, <2 x double>* %out, <2 x double>* %outp, <2 x i1> %mask) {
+entry:
+  tail call void (...) @__enzyme_autodiff(void (<2 x double>*, double*, <2 x double>*, <2 x i1>)* nonnull @square, <2 x double>* %x, <2 x double>* %xp, double* %y, double* %yp, <2 x double>* %out, <2 x double>* %outp, <2 x i1> %mask)
+  ret void
+}
+
+declare <2 x double> @llvm.masked.load.v2f64.p0v2f64(<2 x double>*, i32, <2 x i1>, <2 x double>)
+
+declare <2 x double> @llvm.masked.expandload.v2f64(double*, <2 x i1>, <2 x double>)
+
+declare void @__enzyme_autodiff(...)
+
+; Threads may share the shadow, so every enabled lane is added atomically and
+; disabled lanes go to a scratch slot instead of memory outside of the mask.
+
+; CHECK: define internal void @diffesquare(<2 x double>* %x, <2 x double>* %"x'", double* %y, double* %"y'", <2 x double>* %out, <2 x double>* %"out'", <2 x i1> %mask)
+; CHECK: = alloca double
+
+; CHECK: %[[e0:.+]] = extractelement <2 x i1> %mask, i32 0
+; CHECK-NEXT: %[[off:.+]] = zext i1 %[[e0]] to i64
+; CHECK-NEXT: %[[a0:.+]] = select i1 %[[e0]], double* %"y'", double* %{{.+}}
+; CHECK-NEXT: %[[d0:.+]] = extractelement <2 x double> %{{.+}}, i32 0
+; CHECK-NEXT: %{{.+}} = atomicrmw fadd double* %[[a0]], double %[[d0]] monotonic
+; CHECK-NEXT: %[[e1:.+]] = extractelement <2 x i1> %mask, i32 1
+; CHECK-NEXT: %[[p1:.+]] = getelementptr double, double* %"y'", i64 %[[off]]
+; CHECK-NEXT: %[[a1:.+]] = select i1 %[[e1]], double* %[[p1]], double* %{{.+}}
+; CHECK-NEXT: %[[d1:.+]] = extractelement <2 x double> %{{.+}}, i32 1
+; CHECK-NEXT: %{{.+}} = atomicrmw fadd double* %[[a1]], double %[[d1]] monotonic
+
+; CHECK: %[[x0:.+]] = bitcast <2 x double>* %"x'" to double*
+; CHECK: %[[m0:.+]] = extractelement <2 x i1> %mask, i32 0
+; CHECK-NEXT: %[[b0:.+]] = select i1 %[[m0]], double* %[[x0]], double* %{{.+}}
+; CHECK-NEXT: %[[v0:.+]] = extractelement <2 x double> %{{.+}}, i32 0
+; CHECK-NEXT: %{{.+}} = atomicrmw fadd double* %[[b0]], double %[[v0]] monotonic
+; CHECK-NEXT: %[[m1:.+]] = extractelement <2 x i1> %mask, i32 1
+; CHECK-NEXT: %[[x1:.+]] = getelementptr double, double* %[[x0]], i64 1
+; CHECK-NEXT: %[[b1:.+]] = select i1 %[[m1]], double* %[[x1]], double* %{{.+}}
+; CHECK-NEXT: %[[v1:.+]] = extractelement <2 x double> %{{.+}}, i32 1
+; CHECK-NEXT: %{{.+}} = atomicrmw fadd double* %[[b1]], double %[[v1]] monotonic
+; CHECK-NOT: llvm.masked.store
+; CHECK: ret void
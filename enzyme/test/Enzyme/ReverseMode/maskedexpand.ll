@@ -0,0 +1,31 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define void @square(double* %x, double* %out, <4 x i1> %mask) {
+entry:
+  %ld = call <4 x double> @llvm.masked.expandload.v4f64(double* %x, <4 x i1> %mask, <4 x double> zeroinitializer)
+  %mul = fmul <4 x double> %ld, %ld
+  call void @llvm.masked.compressstore.v4f64(<4 x double> %mul, double* %out, <4 x i1> %mask)
+  ret void
+}
+
+define void @dsquare(double* %x, double* %xp, double* %out, double* %outp, <4 x i1> %mask) {
+entry:
+  tail call void (...) @__enzyme_autodiff(void (double*, double*, <4 x i1>)* nonnull @square, double* %x, double* %xp, double* %out, double* %outp, <4 x i1> %mask)
+  ret void
+}
+
+declare <4 x double> @llvm.masked.expandload.v4f64(double*, <4 x i1>, <4 x double>)
+
+declare void @llvm.masked.compressstore.v4f64(<4 x double>, double*, <4 x i1>)
+
+declare void @__enzyme_autodiff(...)
+
+; CHECK: define internal void @diffesquare(double* %x, double* %"x'", double* %out, double* %"out'", <4 x i1> %mask)
+; CHECK: call void @llvm.masked.compressstore.v4f64(<4 x double> %mul, double* %out, <4 x i1> %mask)
+; CHECK-NEXT: %[[dout:.+]] = call <4 x double> @llvm.masked.expandload.v4f64(double* %"out'", <4 x i1> %mask, <4 x double> zeroinitializer)
+; CHECK-NEXT: call void @llvm.masked.compressstore.v4f64(<4 x double> zeroinitializer, double* %"out'", <4 x i1> %mask)
+; CHECK:      %[[dx:.+]] = fadd fast <4 x double>
+; CHECK:      %[[old:.+]] = call <4 x double> @llvm.masked.expandload.v4f64(double* %"x'", <4 x i1> %mask, <4 x double> zeroinitializer)
+; CHECK-NEXT: %[[sum:.+]] = fadd fast <4 x double> %[[old]], %[[dx]]
+; CHECK-NEXT: call void @llvm.masked.compressstore.v4f64(<4 x double> %[[sum]], double* %"x'", <4 x i1> %mask)
+; CHECK-NEXT: ret void
@@ -0,0 +1,44 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define void @square(double* %x, double* %out, <4 x i64> %idx, <4 x i1> %mask) {
+entry:
+  %xs = getelementptr inbounds double, double* %x, <4 x i64> %idx
+  %ld = call <4 x double> @llvm.masked.gather.v4f64.v4p0f64(<4 x double*> %xs, i32 8, <4 x i1> %mask, <4 x double> zeroinitializer)
+  %mul = fmul <4 x double> %ld, %ld
+  %outs = getelementptr inbounds double, double* %out, <4 x i64> %idx
+  call void @llvm.masked.scatter.v4f64.v4p0f64(<4 x double> %mul, <4 x double*> %outs, i32 8, <4 x i1> %mask)
+  ret void
+}
+
+define void @dsquare(double* %x, double* %xp, double* %out, double* %outp, <4 x i64> %idx, <4 x i1> %mask) {
+entry:
+  tail call void (...) @__enzyme_autodiff(void (double*, double*, <4 x i64>, <4 x i1>)* nonnull @square, double* %x, double* %xp, double* %out, double* %outp, <4 x i64> %idx, <4 x i1> %mask)
+  ret void
+}
+
+declare <4 x double> @llvm.masked.gather.v4f64.v4p0f64(<4 x double*>, i32, <4 x i1>, <4 x double>)
+
+declare void @llvm.masked.scatter.v4f64.v4p0f64(<4 x double>, <4 x double*>, i32, <4 x i1>)
+
+declare void @__enzyme_autodiff(...)
+
+; Lanes may alias, so the scatter is released from the last lane to the first
+; and the gather accumulated one lane at a time.
+
+; CHECK: define internal void @diffesquare(double* %x, double* %"x'", double* %out, double* %"out'", <4 x i64> %idx, <4 x i1> %mask)
+; CHECK: call void @llvm.masked.scatter.v4f64.v4p0f64(<4 x double> %mul, <4 x double*> %outs, i32 8, <4 x i1> %mask)
+; CHECK: %[[l3:.+]] = and <4 x i1> %mask, <i1 false, i1 false, i1 false, i1 true>
+; CHECK-NEXT: %{{.+}} = call <4 x double> @llvm.masked.gather.v4f64.v4p0f64(<4 x double*> %"outs'ipg", i32 8, <4 x i1> %[[l3]], <4 x double> zeroinitializer)
+; CHECK-NEXT: call void @llvm.masked.scatter.v4f64.v4p0f64(<4 x double> zeroinitializer, <4 x double*> %"outs'ipg", i32 8, <4 x i1> %[[l3]])
+; CHECK: %[[l0:.+]] = and <4 x i1> %mask, <i1 true, i1 false, i1 false, i1 false>
+; CHECK-NEXT: %{{.+}} = call <4 x double> @llvm.masked.gather.v4f64.v4p0f64(<4 x double*> %"outs'ipg", i32 8, <4 x i1> %[[l0]], <4 x double> zeroinitializer)
+; CHECK-NEXT: call void @llvm.masked.scatter.v4f64.v4p0f64(<4 x double> zeroinitializer, <4 x double*> %"outs'ipg", i32 8, <4 x i1> %[[l0]])
+; CHECK: %[[g0:.+]] = and <4 x i1> %mask, <i1 true, i1 false, i1 false, i1 false>
+; CHECK-NEXT: %[[old0:.+]] = call <4 x double> @llvm.masked.gather.v4f64.v4p0f64(<4 x double*> %"xs'ipg", i32 8, <4 x i1> %[[g0]], <4 x double> zeroinitializer)
+; CHECK-NEXT: %[[sum0:.+]] = fadd fast <4 x double> %[[old0]], %{{.+}}
+; CHECK-NEXT: call void @llvm.masked.scatter.v4f64.v4p0f64(<4 x double> %[[sum0]], <4 x double*> %"xs'ipg", i32 8, <4 x i1> %[[g0]])
+; CHECK: %[[g3:.+]] = and <4 x i1> %mask, <i1 false, i1 false, i1 false, i1 true>
+; CHECK-NEXT: %[[old3:.+]] = call <4 x double> @llvm.masked.gather.v4f64.v4p0f64(<4 x double*> %"xs'ipg", i32 8, <4 x i1> %[[g3]], <4 x double> zeroinitializer)
+; CHECK-NEXT: %[[sum3:.+]] = fadd fast <4 x double> %[[old3]], %{{.+}}
+; CHECK-NEXT: call void @llvm.masked.scatter.v4f64.v4p0f64(<4 x double> %[[sum3]], <4 x double*> %"xs'ipg", i32 8, <4 x i1> %[[g3]])
+; CHECK-NEXT: ret void
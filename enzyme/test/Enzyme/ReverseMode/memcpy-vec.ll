@@ -0,0 +1,60 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -enzyme-vectorize-memcpy=1 -mem2reg -simplifycfg -S | FileCheck %s
+
+define void @copy(double* nocapture %dst, double* nocapture readonly %src, i64 %num) {
+entry:
+  %0 = bitcast double* %dst to i8*
+  %1 = bitcast double* %src to i8*
+  tail call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 8 %0, i8* align 8 %1, i64 %num, i1 false)
+  ret void
+}
+
+define void @move(double* nocapture %dst, double* nocapture readonly %src, i64 %num) {
+entry:
+  %0 = bitcast double* %dst to i8*
+  %1 = bitcast double* %src to i8*
+  tail call void @llvm.memmove.p0i8.p0i8.i64(i8* align 8 %0, i8* align 8 %1, i64 %num, i1 false)
+  ret void
+}
+
+define void @dcopy(double* %dst, double* %dstp, double* %src, double* %srcp, i64 %n) {
+entry:
+  tail call void (...) @__enzyme_autodiff(void (double*, double*, i64)* nonnull @copy, double* %dst, double* %dstp, double* %src, double* %srcp, i64 %n)
+  ret void
+}
+
+define void @dmove(double* %dst, double* %dstp, double* %src, double* %srcp, i64 %n) {
+entry:
+  tail call void (...) @__enzyme_autodiff(void (double*, double*, i64)* nonnull @move, double* %dst, double* %dstp, double* %src, double* %srcp, i64 %n)
+  ret void
+}
+
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8* nocapture writeonly, i8* nocapture readonly, i64, i1)
+
+declare void @llvm.memmove.p0i8.p0i8.i64(i8* nocapture, i8* nocapture readonly, i64, i1)
+
+declare void @__enzyme_autodiff(...)
+
+; CHECK: define internal void @diffecopy(
+; CHECK: call void @__enzyme_memcpyadd_doubleda8sa8v2(double* %"dst'", double* %"src'", i64 %{{.*}})
+
+; CHECK: define internal void @__enzyme_memcpyadd_doubleda8sa8v2(double* noalias nocapture %dst, double* noalias nocapture %src, i64 %num)
+; CHECK: %vnum = and i64 %num, -8
+; CHECK: fwd.vec.check:
+; CHECK: %large = icmp uge i64 %{{.*}}, 1048576
+; CHECK: fwd.vec.nt.body:
+; CHECK: store <2 x double> zeroinitializer, <2 x double>* %{{.*}}, align 8, !nontemporal
+; CHECK: fwd.vec.body:
+; CHECK: %dst.i.l = load <2 x double>, <2 x double>* %{{.*}}, align 8
+; CHECK-NEXT: store <2 x double> zeroinitializer, <2 x double>* %{{.*}}, align 8
+; CHECK: %src.i.l = load <2 x double>, <2 x double>* %{{.*}}, align 8
+; CHECK: fwd.rem.body:
+; CHECK: load double, double* %{{.*}}, align 8
+
+; CHECK: define internal void @diffemove(
+; CHECK: call void @__enzyme_memmoveadd_doubleda8sa8v2(double* %"dst'", double* %"src'", i64 %{{.*}})
+
+; CHECK: define internal void @__enzyme_memmoveadd_doubleda8sa8v2(double* nocapture %dst, double* nocapture %src, i64 %num)
+; CHECK: %ascending = icmp uge i64
+; CHECK: br i1 %ascending, label %fwd, label %bwd
+; CHECK: bwd.rem.body:
+; CHECK: bwd.vec.body:
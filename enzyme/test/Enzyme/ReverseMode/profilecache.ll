@@ -0,0 +1,41 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -enzyme-profile-guided-cache=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @f(double %x, i64 %n) !prof !0 {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ %i_inc, %loop ], [ 0, %entry ]
+  %phi = phi double [ %mul, %loop ], [ %x, %entry ]
+  %mul = fmul fast double %phi, %phi
+  %i_inc = add nuw i64 %i, 1
+  %iand = and i64 %i, 1234
+  %exitcond = icmp eq i64 %iand, %n
+  br i1 %exitcond, label %exit, label %loop, !prof !1
+
+exit:
+  ret double %mul
+}
+
+define double @test_derivative(double %x, i64 %n) {
+entry:
+  %0 = tail call double (double (double, i64)*, ...) @__enzyme_autodiff(double (double, i64)* nonnull @f, double %x, i64 %n)
+  ret double %0
+}
+
+declare double @__enzyme_autodiff(double (double, i64)*, ...)
+
+!0 = !{!"function_entry_count", i64 1}
+!1 = !{!"branch_weights", i32 1, i32 99}
+
+; CHECK: define internal { double } @diffef(double %x, i64 %n, double %differeturn)
+; CHECK: loop:
+; CHECK: %[[small:.+]] = icmp ule i64 %iv.next, [[trips:[0-9]+]]
+; CHECK: %[[count:.+]] = select i1 %[[small]], i64 [[trips]], i64 %{{.+}}
+; CHECK: %phi_realloccache = call i8* @__enzyme_cache_grow(i8* %{{.*}}, i64 %{{.+}}, i64 %{{.+}})
+; CHECK-NOT: @realloc(
+
+; The cache is only reallocated when its capacity changes.
+; CHECK: define internal i8* @__enzyme_cache_grow(i8* %ptr, i64 %size, i64 %oldsize)
+; CHECK: icmp ne i64 %size, %oldsize
+; CHECK: call i8* @realloc(i8* %ptr, i64 %size)
@@ -0,0 +1,51 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define internal i8* @square(i8* %p) {
+entry:
+  %x = bitcast i8* %p to double*
+  %0 = load double, double* %x, align 8
+  %mul = fmul double %0, %0
+  store double %mul, double* %x, align 8
+  ret i8* null
+}
+
+define void @f(double* %x) {
+entry:
+  %t = alloca i64, align 8
+  %p = bitcast double* %x to i8*
+  %call = call i32 @pthread_create(i64* nonnull %t, i8* null, i8* (i8*)* nonnull @square, i8* %p)
+  %0 = load i64, i64* %t, align 8
+  %call1 = call i32 @pthread_join(i64 %0, i8** null)
+  ret void
+}
+
+define void @dsquare(double* %x, double* %xp) {
+entry:
+  %0 = tail call double (...) @__enzyme_autodiff(void (double*)* nonnull @f, double* %x, double* %xp)
+  ret void
+}
+
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+
+declare i32 @pthread_join(i64, i8**)
+
+declare double @__enzyme_autodiff(...)
+
+; CHECK: define internal void @diffef(double* %x, double* %"x'")
+; CHECK: %threadclosure = bitcast i8* %malloccall to { i8* (i8*)*, i8*, i8*, i8*, i8*, i64 }*
+; CHECK: store i8* (i8*)* @diffethread_square, i8* (i8*)** %{{.*}}
+; CHECK: %call = call i32 @pthread_create(i64* nonnull %t, i8* null, i8* (i8*)* @augmentedthread_square, i8* %malloccall)
+; CHECK: %call1 = call i32 @pthread_join(i64 %{{.*}}, i8** %{{.*}})
+; CHECK: %[[revfn:.+]] = load i8* (i8*)*, i8* (i8*)** %{{.*}}
+; CHECK: call i32 @pthread_create(i64* %{{.*}}, i8* null, i8* (i8*)* %[[revfn]], i8* %{{.*}})
+; CHECK: call i32 @pthread_join(i64 %{{.*}}, i8** null)
+; CHECK: call void @free(i8* nonnull %{{.*}})
+; CHECK-NEXT: ret void
+
+; CHECK: define internal i8* @augmentedthread_square(i8* %0)
+; CHECK: call { i8*, i8* } @augmented_square(i8* %{{.*}}, i8* %{{.*}})
+; CHECK: ret i8* %0
+
+; CHECK: define internal i8* @diffethread_square(i8* %0)
+; CHECK: call {{.*}} @diffesquare(i8* %{{.*}}, i8* %{{.*}}, i8* %{{.*}})
+; CHECK: ret i8* null
@@ -0,0 +1,47 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define internal i8* @square(i8* %p) {
+entry:
+  %x = bitcast i8* %p to double*
+  %0 = load double, double* %x, align 8
+  %mul = fmul double %0, %0
+  store double %mul, double* %x, align 8
+  ret i8* null
+}
+
+define void @f(double* %x, double* %y) {
+entry:
+  %t = alloca i64, align 8
+  %p = bitcast double* %y to i8*
+  %call = call i32 @pthread_create(i64* nonnull %t, i8* null, i8* (i8*)* nonnull @square, i8* %p)
+  %0 = load i64, i64* %t, align 8
+  %call1 = call i32 @pthread_join(i64 %0, i8** null)
+  %1 = load double, double* %x, align 8
+  %mul = fmul double %1, %1
+  store double %mul, double* %x, align 8
+  ret void
+}
+
+define void @dsquare(double* %x, double* %xp, double* %y) {
+entry:
+  %0 = tail call double (...) @__enzyme_autodiff(void (double*, double*)* nonnull @f, double* %x, double* %xp, metadata !"enzyme_const", double* %y)
+  ret void
+}
+
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+
+declare i32 @pthread_join(i64, i8**)
+
+declare double @__enzyme_autodiff(...)
+
+; The worker only sees inactive memory, so the thread runs as in the primal
+; and has no adjoint.
+
+; CHECK: define internal void @diffef(double* %x, double* %"x'", double* %y)
+; CHECK-NOT: threadclosure
+; CHECK: %call = call i32 @pthread_create(i64* nonnull %t, i8* null, i8* (i8*)* nonnull @square, i8* %p)
+; CHECK: %call1 = call i32 @pthread_join(i64 %{{.*}}, i8** null)
+; CHECK-NOT: pthread_
+; CHECK: ret void
+
+; CHECK-NOT: @diffethread_square
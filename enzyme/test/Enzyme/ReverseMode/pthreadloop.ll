@@ -0,0 +1,64 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define internal i8* @square(i8* %p) {
+entry:
+  %x = bitcast i8* %p to double*
+  %0 = load double, double* %x, align 8
+  %mul = fmul double %0, %0
+  store double %mul, double* %x, align 8
+  ret i8* null
+}
+
+; A pool of threads, each created in one loop and joined in the next through
+; a separately computed address of its id.
+define void @f(double* %x, i8** %rets) {
+entry:
+  %threads = alloca [4 x i64], align 8
+  br label %create
+
+create:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %create ]
+  %tid = getelementptr inbounds [4 x i64], [4 x i64]* %threads, i64 0, i64 %i
+  %xi = getelementptr inbounds double, double* %x, i64 %i
+  %p = bitcast double* %xi to i8*
+  %call = call i32 @pthread_create(i64* nonnull %tid, i8* null, i8* (i8*)* nonnull @square, i8* %p)
+  %i.next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %i.next, 4
+  br i1 %cmp, label %join, label %create
+
+join:
+  %j = phi i64 [ 0, %create ], [ %j.next, %join ]
+  %jid = getelementptr inbounds [4 x i64], [4 x i64]* %threads, i64 0, i64 %j
+  %t = load i64, i64* %jid, align 8
+  %ret = getelementptr inbounds i8*, i8** %rets, i64 %j
+  %call1 = call i32 @pthread_join(i64 %t, i8** %ret)
+  %j.next = add nuw nsw i64 %j, 1
+  %cmp1 = icmp eq i64 %j.next, 4
+  br i1 %cmp1, label %exit, label %join
+
+exit:
+  ret void
+}
+
+define void @dsquare(double* %x, double* %xp, i8** %rets) {
+entry:
+  %0 = tail call double (...) @__enzyme_autodiff(void (double*, i8**)* nonnull @f, double* %x, double* %xp, metadata !"enzyme_const", i8** %rets)
+  ret void
+}
+
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+
+declare i32 @pthread_join(i64, i8**)
+
+declare double @__enzyme_autodiff(...)
+
+; CHECK: define internal void @diffef(double* %x, double* %"x'", i8** %rets)
+; CHECK: %call = call i32 @pthread_create(i64* nonnull %tid, i8* null, i8* (i8*)* @augmentedthread_square, i8* %malloccall)
+; CHECK: %call1 = call i32 @pthread_join(i64 %t, i8** %{{.*}})
+; CHECK: %[[isnull:.+]] = icmp eq i8** %ret, null
+; CHECK-NEXT: %[[dst:.+]] = select i1 %[[isnull]], i8** %{{.*}}, i8** %ret
+; CHECK: store i8* %{{.*}}, i8** %[[dst]]
+; CHECK: %[[revfn:.+]] = load i8* (i8*)*, i8* (i8*)** %{{.*}}
+; CHECK: call i32 @pthread_create(i64* %{{.*}}, i8* null, i8* (i8*)* %[[revfn]], i8* %{{.*}})
+; CHECK: call i32 @pthread_join(i64 %{{.*}}, i8** null)
+; CHECK: call void @free(i8* nonnull %{{.*}})
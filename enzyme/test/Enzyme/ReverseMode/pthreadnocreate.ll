@@ -0,0 +1,26 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S 2>&1 | FileCheck %s
+
+define void @f(double* %x, i64* %t) {
+entry:
+  %0 = load i64, i64* %t, align 8
+  %call = call i32 @pthread_join(i64 %0, i8** null)
+  %1 = load double, double* %x, align 8
+  %mul = fmul double %1, %1
+  store double %mul, double* %x, align 8
+  ret void
+}
+
+define void @dsquare(double* %x, double* %xp, i64* %t) {
+entry:
+  %0 = tail call double (...) @__enzyme_autodiff(void (double*, i64*)* nonnull @f, double* %x, double* %xp, metadata !"enzyme_const", i64* %t)
+  ret void
+}
+
+declare i32 @pthread_join(i64, i8**)
+
+declare double @__enzyme_autodiff(...)
+
+; The closure of the adjoint worker is handed over by pthread_create, so a
+; join of a thread spawned elsewhere can not be differentiated.
+
+; CHECK: could not find the pthread_create joined by {{.*}} = call i32 @pthread_join(
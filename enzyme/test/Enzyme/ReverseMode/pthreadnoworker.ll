@@ -0,0 +1,29 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S 2>&1 | FileCheck %s
+
+declare i8* @square(i8*)
+
+define void @f(double* %x) {
+entry:
+  %t = alloca i64, align 8
+  %p = bitcast double* %x to i8*
+  %call = call i32 @pthread_create(i64* nonnull %t, i8* null, i8* (i8*)* nonnull @square, i8* %p)
+  %0 = load i64, i64* %t, align 8
+  %call1 = call i32 @pthread_join(i64 %0, i8** null)
+  ret void
+}
+
+define void @dsquare(double* %x, double* %xp) {
+entry:
+  %0 = tail call double (...) @__enzyme_autodiff(void (double*)* nonnull @f, double* %x, double* %xp)
+  ret void
+}
+
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+
+declare i32 @pthread_join(i64, i8**)
+
+declare double @__enzyme_autodiff(...)
+
+; The worker is only declared, so its derivative can not be synthesized.
+
+; CHECK: could not find the definition of the worker spawned by {{.*}} = call i32 @pthread_create(
@@ -0,0 +1,75 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-tape-buffer=1 -enzyme-relocatable-tape=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+@enzyme_allocated = external global i32
+@enzyme_tape_buffer = external global i32
+
+define void @square(double* %x, i64 %n, i64 %m) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %inext, %outer.latch ]
+  %row = mul nuw nsw i64 %i, %m
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %jnext, %inner ]
+  %idx = add nuw nsw i64 %row, %j
+  %gep = getelementptr inbounds double, double* %x, i64 %idx
+  %ld = load double, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  store double %mul, double* %gep, align 8
+  %jnext = add nuw nsw i64 %j, 1
+  %jcmp = icmp eq i64 %jnext, %m
+  br i1 %jcmp, label %outer.latch, label %inner
+
+outer.latch:
+  %inext = add nuw nsw i64 %i, 1
+  %icmp = icmp eq i64 %inext, %n
+  br i1 %icmp, label %exit, label %outer
+
+exit:
+  ret void
+}
+
+define void @grad(double* %x, double* %dx, i64 %n, i64 %m, i8* %buf, i64 %bufsize, i8* %out, i8* %moved) {
+entry:
+  %a = load i32, i32* @enzyme_allocated, align 4
+  %b = load i32, i32* @enzyme_tape_buffer, align 4
+  %tape = call [64 x i8] (...) @__enzyme_augmentfwd(void (double*, i64, i64)* nonnull @square, i32 %a, i64 64, i32 %b, i8* %buf, i64 %bufsize, double* %x, double* %dx, i64 %n, i64 %m)
+  %size = call i64 @__enzyme_tape_serialize(i8* %out, i64 %bufsize)
+  %ok = call i64 @__enzyme_tape_deserialize(i8* %out, i64 %size, i8* %moved, i64 %bufsize)
+  %c = load i32, i32* @enzyme_tape_buffer, align 4
+  call void (...) @__enzyme_reverse(void (double*, i64, i64)* nonnull @square, i32 %c, i8* %moved, i64 %bufsize, double* %x, double* %dx, i64 %n, i64 %m, [64 x i8] %tape)
+  ret void
+}
+
+declare [64 x i8] @__enzyme_augmentfwd(...)
+
+declare void @__enzyme_reverse(...)
+
+declare i64 @__enzyme_tape_serialize(i8*, i64)
+
+declare i64 @__enzyme_tape_deserialize(i8*, i64, i8*, i64)
+
+; CHECK: define void @grad(
+; CHECK:   call {{.*}} @augmented_square(
+; CHECK:   %[[size:.+]] = call i64 @__enzyme_tapebuffer_serialize(i8* %out, i64 %bufsize)
+; CHECK:   call i64 @__enzyme_tapebuffer_deserialize(i8* %out, i64 %[[size]], i8* %moved, i64 %bufsize)
+; CHECK:   call void @diffesquare(
+
+; CHECK: define internal {{.*}} @augmented_square(
+; CHECK:   call i8* @__enzyme_tapebuffer_alloc(i64
+; CHECK:   call i8* @__enzyme_tapebuffer_alloc(i64
+; CHECK:   %[[inneroff:.+]] = sub i64
+; CHECK:   inttoptr i64 %[[inneroff]] to double*
+
+; CHECK: define internal void @diffesquare(
+; CHECK:   %[[start:.+]] = load i8*, i8** getelementptr inbounds ({ i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer, i32 0, i32 0)
+; CHECK:   getelementptr i8, i8* %[[start]], i64
+
+; CHECK: define internal i64 @__enzyme_tapebuffer_serialize(i8* %dst, i64 %size)
+; CHECK:   call void @llvm.memcpy.p0i8.p0i8.i64(i8* %dst, i8* %start, i64 %used, i1 false)
+
+; CHECK: define internal i64 @__enzyme_tapebuffer_deserialize(i8* %src, i64 %used, i8* %buffer, i64 %size)
+; CHECK:   call void @llvm.memcpy.p0i8.p0i8.i64(i8* %buffer, i8* %src, i64 %used, i1 false)
@@ -0,0 +1,46 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-reverse-cycle-counters=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @sumsquares(double* %x, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %add, %loop ]
+  %gep = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  %add = fadd fast double %sum, %mul
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret double %add
+}
+
+define void @grad(double* %x, double* %dx, i64 %n) {
+entry:
+  %r = call double (...) @__enzyme_autodiff(double (double*, i64)* nonnull @sumsquares, double* %x, double* %dx, i64 %n)
+  ret void
+}
+
+declare double @__enzyme_autodiff(...)
+
+; CHECK: @enzyme_region_str{{.*}} = private unnamed_addr constant [16 x i8] c"diffesumsquares\00"
+; CHECK: @enzyme_region_str{{.*}} = private unnamed_addr constant [11 x i8] c"invertloop\00"
+; CHECK: @enzyme_reverse_regions = internal global [{{[0-9]+}} x { i8*, i8*, i8*, i32, i64, i64 }]
+; CHECK: @llvm.global_ctors = appending global {{.*}} @__enzyme_reverse_profile_init_diffesumsquares
+
+; CHECK: define internal void @diffesumsquares(double* %x, double* %"x'", i64 %n, double %differeturn)
+; CHECK: invertloop:
+; CHECK:   %[[start:.+]] = call i64 @llvm.readcyclecounter()
+; CHECK:   %[[end:.+]] = call i64 @llvm.readcyclecounter()
+; CHECK-NEXT:   %[[elapsed:.+]] = sub i64 %[[end]], %[[start]]
+; CHECK-NEXT:   atomicrmw add i64* getelementptr inbounds ({{.*}} @enzyme_reverse_regions, i32 0, i32 {{[0-9]+}}, i32 4), i64 %[[elapsed]] monotonic
+; CHECK-NEXT:   atomicrmw add i64* getelementptr inbounds ({{.*}} @enzyme_reverse_regions, i32 0, i32 {{[0-9]+}}, i32 5), i64 1 monotonic
+
+; CHECK: define internal void @__enzyme_reverse_profile_init_diffesumsquares()
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   call void @__enzyme_reverse_profile_register(i8* bitcast ([{{[0-9]+}} x { i8*, i8*, i8*, i32, i64, i64 }]* @enzyme_reverse_regions to i8*), i64 {{[0-9]+}})
+; CHECK-NEXT:   ret void
@@ -0,0 +1,54 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -S | FileCheck %s
+
+; Blocks are unnamed, as emitted by compilers which discard value names
+define double @sumsquares(double* %x, i64 %n) !dbg !5 {
+  br label %1, !dbg !8
+
+1:
+  %2 = phi i64 [ 0, %0 ], [ %8, %1 ]
+  %3 = phi double [ 0.000000e+00, %0 ], [ %7, %1 ]
+  %4 = getelementptr inbounds double, double* %x, i64 %2, !dbg !9
+  %5 = load double, double* %4, align 8, !dbg !9
+  %6 = fmul fast double %5, %5, !dbg !10
+  %7 = fadd fast double %3, %6, !dbg !10
+  %8 = add nuw nsw i64 %2, 1, !dbg !11
+  %9 = icmp eq i64 %8, %n, !dbg !11
+  br i1 %9, label %10, label %1, !dbg !11
+
+10:
+  ret double %7, !dbg !12
+}
+
+define void @grad(double* %x, double* %dx, i64 %n) {
+entry:
+  %r = call double (...) @__enzyme_autodiff(double (double*, i64)* nonnull @sumsquares, double* %x, double* %dx, i64 %n)
+  ret void
+}
+
+declare double @__enzyme_autodiff(...)
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: true, runtimeVersion: 0, emissionKind: LineTablesOnly, enums: !2)
+!1 = !DIFile(filename: "sumsquares.c", directory: "/tmp")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!5 = distinct !DISubprogram(name: "sumsquares", scope: !1, file: !1, line: 1, type: !6, scopeLine: 1, flags: DIFlagPrototyped, spFlags: DISPFlagDefinition | DISPFlagOptimized, unit: !0, retainedNodes: !2)
+!6 = !DISubroutineType(types: !2)
+!8 = !DILocation(line: 2, column: 3, scope: !5)
+!9 = !DILocation(line: 3, column: 12, scope: !5)
+!10 = !DILocation(line: 4, column: 9, scope: !5)
+!11 = !DILocation(line: 5, column: 3, scope: !5)
+!12 = !DILocation(line: 6, column: 3, scope: !5)
+
+; CHECK: define internal void @diffesumsquares(double* %x, double* %"x'", i64 %n, double %differeturn) !dbg
+; CHECK: {{^}}invertbb{{[0-9]+}}.L2:
+; CHECK:   ret void, !dbg ![[br:[0-9]+]]
+; CHECK: {{^}}invertbb{{[0-9]+}}.L3:
+; CHECK:   fmul fast double %{{.+}}, %{{.+}}, !dbg ![[mul:[0-9]+]]
+; CHECK: {{^}}invertbb{{[0-9]+}}.L6:
+
+; CHECK-DAG: ![[br]] = !DILocation(line: 2, column: 3,
+; CHECK-DAG: ![[mul]] = !DILocation(line: 4, column: 9,
@@ -0,0 +1,64 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-stack-tape=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @rec(double* %x, i64 %n) {
+entry:
+  %cmp = icmp eq i64 %n, 0
+  br i1 %cmp, label %base, label %recur
+
+base:
+  ret double 1.000000e+00
+
+recur:
+  %ld = load double, double* %x, align 8
+  %n1 = sub i64 %n, 1
+  %r = call double @rec(double* %x, i64 %n1)
+  %m = fmul fast double %ld, %r
+  ret double %m
+}
+
+define double @tester(double* %x, i64 %n) {
+entry:
+  %r = call double @rec(double* %x, i64 %n)
+  store double 0.000000e+00, double* %x, align 8
+  ret double %r
+}
+
+define void @test_derivative(double* %x, double* %dx, i64 %n) {
+entry:
+  %0 = tail call double (double (double*, i64)*, ...) @__enzyme_autodiff(double (double*, i64)* nonnull @tester, double* %x, double* %dx, i64 %n)
+  ret void
+}
+
+declare double @__enzyme_autodiff(double (double*, i64)*, ...)
+
+; CHECK: @__enzyme_tapestack = internal thread_local global { i8*, i64, i64 } zeroinitializer
+
+; CHECK: define internal void @diffetester(double* %x, double* %"x'", i64 %n, double %differeturn)
+; CHECK: %[[tape:.+]] = extractvalue {{.*}} %{{.*}}, 0
+; CHECK-NOT: call void @free(
+; CHECK: call {{.*}} @diffe{{.*}}rec(double* %x, double* %"x'", i64 %n, double %{{.*}}, {{.*}})
+; CHECK-NEXT: call void @__enzyme_tapestack_pop(i64 {{[0-9]+}})
+; CHECK: ret void
+
+; CHECK: define internal {{.*}} @augmented_rec(double* %x, double* %"x'", i64 %n)
+; CHECK-NOT: @malloc(
+; CHECK: %tapemem = call noalias nonnull {{.*}}i8* @__enzyme_tapestack_push(i64 {{[0-9]+}})
+
+; CHECK: define internal i8* @__enzyme_tapestack_push(i64 %size)
+; CHECK: call noalias nonnull i8* @malloc(
+; CHECK: ret i8*
+
+; CHECK: define internal void @diffe{{.*}}rec(
+; CHECK-NOT: call void @free(
+; CHECK: call void @__enzyme_tapestack_pop(i64 {{[0-9]+}})
+
+; CHECK: define internal void @__enzyme_tapestack_pop(i64 %size)
+; CHECK: %cur = load i64, i64* getelementptr {{.*}}@__enzyme_tapestack, i32 0, i32 1)
+; CHECK: %[[ok:.+]] = icmp uge i64 %cur, %{{.+}}
+; CHECK-NEXT: br i1 %[[ok]], label %pop, label %underflow
+; CHECK: underflow:
+; CHECK-NEXT: call i32 @puts(
+; CHECK-NEXT: call void @llvm.trap()
+; CHECK-NEXT: unreachable
+; CHECK: call void @free(i8* %chunk)
+; CHECK: ret void
@@ -0,0 +1,41 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-stack-tape=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @rec(double* %x, i64 %n) {
+entry:
+  %cmp = icmp eq i64 %n, 0
+  br i1 %cmp, label %base, label %recur
+
+base:
+  ret double 1.000000e+00
+
+recur:
+  %ld = load double, double* %x, align 8
+  %n1 = sub i64 %n, 1
+  %r = call double @rec(double* %x, i64 %n1)
+  %m = fmul fast double %ld, %r
+  ret double %m
+}
+
+define double @tester(double* %x, i64 %n) {
+entry:
+  %r = call double @rec(double* %x, i64 %n)
+  store double 0.000000e+00, double* %x, align 8
+  ret double %r
+}
+
+define i8* @test_augment(double* %x, double* %dx, i64 %n) {
+entry:
+  %0 = tail call i8* (double (double*, i64)*, ...) @__enzyme_augmentfwd(double (double*, i64)* nonnull @tester, double* %x, double* %dx, i64 %n)
+  ret i8* %0
+}
+
+declare i8* @__enzyme_augmentfwd(double (double*, i64)*, ...)
+
+; A split mode caller may run the reverse passes in any order or on another
+; thread, so the recursive tapes stay on the heap.
+
+; CHECK-NOT: @__enzyme_tapestack
+
+; CHECK: define internal {{.*}} @augmented_rec(double* %x, double* %"x'", i64 %n)
+; CHECK: call {{.*}}i8* @malloc(
+; CHECK-NOT: @__enzyme_tapestack_push
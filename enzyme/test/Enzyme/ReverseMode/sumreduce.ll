@@ -0,0 +1,40 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -enzyme-reduction-adjoint -mem2reg -simplifycfg -early-cse-memssa -instsimplify -correlated-propagation -adce -S | FileCheck %s
+
+define double @dot(double* nocapture readonly %A, double* nocapture readonly %B, i64 %N, double %start) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %reduce = phi double [ %start, %entry ], [ %add, %loop ]
+  %gepa = getelementptr inbounds double, double* %A, i64 %i
+  %lda = load double, double* %gepa, align 8
+  %gepb = getelementptr inbounds double, double* %B, i64 %i
+  %ldb = load double, double* %gepb, align 8
+  %mul = fmul fast double %lda, %ldb
+  %add = fadd fast double %reduce, %mul
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %N
+  br i1 %cmp, label %end, label %loop
+
+end:
+  ret double %add
+}
+
+define double @test_derivative(double* %A, double* %dA, double* %B, i64 %N, double %start) {
+entry:
+  %r = call double @__enzyme_autodiff(i8* bitcast (double (double*, double*, i64, double)* @dot to i8*), double* %A, double* %dA, metadata !"enzyme_const", double* %B, i64 %N, double %start)
+  ret double %r
+}
+
+declare double @__enzyme_autodiff(i8*, double*, double*, metadata, double*, i64, double)
+
+; CHECK: define internal { double } @diffedot(double* nocapture readonly %A, double* {{.*}}%"A'", double* nocapture readonly %B, i64 %N, double %start, double %differeturn)
+; CHECK: invertloop:
+; CHECK-NOT:   phi double
+; CHECK:        %[[dmul:.+]] = fmul fast double %differeturn, %{{.*}}
+; CHECK:        fadd fast double %{{.*}}, %[[dmul]]
+; CHECK:        store double
+; CHECK:        br i1
+; CHECK:        %[[res:.+]] = insertvalue { double } undef, double %differeturn, 0
+; CHECK-NEXT:   ret { double } %[[res]]
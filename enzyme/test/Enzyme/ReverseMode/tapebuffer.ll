@@ -0,0 +1,85 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-tape-buffer=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+@enzyme_allocated = external global i32
+@enzyme_tape_buffer = external global i32
+
+define void @square(double* %x) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %gep = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  store double %mul, double* %gep, align 8
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, 4
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+define i64 @tapesize() {
+entry:
+  %size = call i64 (...) @__enzyme_tape_size(void (double*)* nonnull @square, double* null, double* null)
+  ret i64 %size
+}
+
+define i64 @grad(double* %x, double* %dx, i8* %buf, i64 %bufsize) {
+entry:
+  %a = load i32, i32* @enzyme_allocated, align 4
+  %b = load i32, i32* @enzyme_tape_buffer, align 4
+  %tape = call [8 x i8] (...) @__enzyme_augmentfwd(void (double*)* nonnull @square, i32 %a, i64 8, i32 %b, i8* %buf, i64 %bufsize, double* %x, double* %dx)
+  %c = load i32, i32* @enzyme_tape_buffer, align 4
+  call void (...) @__enzyme_reverse(void (double*)* nonnull @square, i32 %c, i8* %buf, i64 %bufsize, double* %x, double* %dx, [8 x i8] %tape)
+  %used = call i64 @__enzyme_tape_buffer_size()
+  ret i64 %used
+}
+
+declare i64 @__enzyme_tape_size(...)
+
+declare [8 x i8] @__enzyme_augmentfwd(...)
+
+declare void @__enzyme_reverse(...)
+
+declare i64 @__enzyme_tape_buffer_size()
+
+; CHECK-DAG: @__enzyme_tapebuffer = internal thread_local global { i8*, i8*, i8*, i64, i64 } zeroinitializer
+; CHECK-DAG: @__enzyme_tapebuffer_last = internal thread_local global { i8*, i8*, i8*, i64, i64 } zeroinitializer
+
+; CHECK: define i64 @tapesize()
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   ret i64 8
+
+; CHECK: define i64 @grad(
+; CHECK:   %[[saved:.+]] = load { i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer
+; CHECK:   store i8* %buf, i8** getelementptr inbounds ({ i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer, i32 0, i32 0)
+; CHECK:   store i8* %buf, i8** getelementptr inbounds ({ i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer, i32 0, i32 1)
+; CHECK:   call {{.*}} @augmented_square(
+; CHECK-NEXT:   %[[fwd:.+]] = load { i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer
+; CHECK-NEXT:   store { i8*, i8*, i8*, i64, i64 } %[[fwd]], { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer_last
+; CHECK-NEXT:   store { i8*, i8*, i8*, i64, i64 } %[[saved]], { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer
+; CHECK:   load i8*, i8** getelementptr inbounds ({ i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer_last, i32 0, i32 1)
+; CHECK:   call void @diffesquare(
+; CHECK-NEXT:   %[[rev:.+]] = load { i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer
+; CHECK-NEXT:   store { i8*, i8*, i8*, i64, i64 } %[[rev]], { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer_last
+; CHECK-NEXT:   store { i8*, i8*, i8*, i64, i64 } %{{.+}}, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer
+; CHECK-NEXT:   %[[used:.+]] = load i64, i64* getelementptr inbounds ({ i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer_last, i32 0, i32 3)
+; CHECK-NEXT:   ret i64 %[[used]]
+
+; CHECK: define internal {{.*}} @augmented_square(
+; CHECK-NOT: @malloc(
+; CHECK: call i8* @__enzyme_tapebuffer_alloc(i64 32)
+; CHECK: ret
+
+; CHECK: define internal i8* @__enzyme_tapebuffer_alloc(i64 %size)
+; CHECK: call noalias nonnull i8* @malloc(i64 %size)
+
+; CHECK: define internal void @diffesquare(
+; CHECK-NOT: call void @free(
+; CHECK: call void @__enzyme_tapebuffer_free(i8*
+
+; CHECK: define internal void @__enzyme_tapebuffer_free(i8* %ptr)
+; CHECK: call void @free(i8* %ptr)
@@ -0,0 +1,67 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-tape-buffer=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-tape-buffer=1 -enzyme-profile-guided-cache=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s --check-prefix=PROFILE
+
+@enzyme_allocated = external global i32
+@enzyme_tape_buffer = external global i32
+
+; The trip count depends on the data, so the cache is reallocated on the heap
+define void @square(double* %x) !prof !0 {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %gep = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  store double %mul, double* %gep, align 8
+  %next = add nuw nsw i64 %i, 1
+  %cmp = fcmp fast ole double %ld, 0.000000e+00
+  br i1 %cmp, label %exit, label %loop, !prof !1
+
+exit:
+  ret void
+}
+
+define i64 @grad(double* %x, double* %dx, i8* %buf, i64 %bufsize, i8* %out) {
+entry:
+  %a = load i32, i32* @enzyme_allocated, align 4
+  %b = load i32, i32* @enzyme_tape_buffer, align 4
+  %tape = call [64 x i8] (...) @__enzyme_augmentfwd(void (double*)* nonnull @square, i32 %a, i64 64, i32 %b, i8* %buf, i64 %bufsize, double* %x, double* %dx)
+  %size = call i64 @__enzyme_tape_serialize(i8* %out, i64 %bufsize)
+  ret i64 %size
+}
+
+declare [64 x i8] @__enzyme_augmentfwd(...)
+
+declare i64 @__enzyme_tape_serialize(i8*, i64)
+
+!0 = !{!"function_entry_count", i64 1}
+!1 = !{!"branch_weights", i32 1, i32 99}
+
+; CHECK: define i64 @grad(
+; CHECK:   call {{.*}} @augmented_square(
+; CHECK:   %[[size:.+]] = call i64 @__enzyme_tapebuffer_serialize(i8* %out, i64 %bufsize)
+; CHECK-NEXT:   ret i64 %[[size]]
+
+; CHECK: define internal {{.*}} @augmented_square(
+; CHECK-NOT: @realloc(
+; CHECK: call i8* @__enzyme_tapebuffer_realloc(i8*
+; CHECK-NOT: @realloc(
+; CHECK: ret
+
+; CHECK: define internal i8* @__enzyme_tapebuffer_realloc(i8* %ptr, i64 %size)
+; CHECK:   load i64, i64* getelementptr inbounds ({ i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer, i32 0, i32 4)
+; CHECK:   call i8* @realloc(i8* %ptr, i64 %size)
+
+; A tape holding pointers to caches reallocated on the heap is not serialized
+; CHECK: define internal i64 @__enzyme_tapebuffer_serialize(i8* %dst, i64 %size)
+; CHECK:   %reallocs = load i64, i64* getelementptr inbounds ({ i8*, i8*, i8*, i64, i64 }, { i8*, i8*, i8*, i64, i64 }* @__enzyme_tapebuffer_last, i32 0, i32 4)
+; CHECK:   icmp eq i64 %reallocs, 0
+; CHECK:   ret i64 0
+
+; PROFILE: define internal {{.*}} @augmented_square(
+; PROFILE: call i8* @__enzyme_tapebuffer_cache_grow(i8* %{{.*}}, i64 %{{.+}}, i64 %{{.+}})
+
+; PROFILE: define internal i8* @__enzyme_tapebuffer_cache_grow(i8* %ptr, i64 %size, i64 %oldsize)
+; PROFILE: call i8* @__enzyme_tapebuffer_realloc(i8* %ptr, i64 %size)
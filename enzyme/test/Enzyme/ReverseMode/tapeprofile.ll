@@ -0,0 +1,44 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-tape-profile=1 -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define double @sumsquares(double* %x, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %add, %loop ]
+  %gep = getelementptr inbounds double, double* %x, i64 %i
+  %ld = load double, double* %gep, align 8
+  store double 0.000000e+00, double* %gep, align 8
+  %mul = fmul fast double %ld, %ld
+  %add = fadd fast double %sum, %mul
+  %next = add nuw nsw i64 %i, 1
+  %cmp = icmp eq i64 %next, %n
+  br i1 %cmp, label %exit, label %loop
+
+exit:
+  ret double %add
+}
+
+define void @grad(double* %x, double* %dx, i64 %n) {
+entry:
+  %r = call double (...) @__enzyme_autodiff(double (double*, i64)* nonnull @sumsquares, double* %x, double* %dx, i64 %n)
+  ret void
+}
+
+declare double @__enzyme_autodiff(...)
+
+; CHECK: @enzyme_tapesite_str{{.*}} = private unnamed_addr constant [16 x i8] c"diffesumsquares\00"
+; CHECK: @enzyme_tapesite_str{{.*}} = private unnamed_addr constant [9 x i8] c"ld_cache\00"
+; CHECK: @enzyme_tapesite_str{{.*}} = private unnamed_addr constant [5 x i8] c"loop\00"
+; CHECK: @enzyme_tapesite = private constant { i8*, i8*, i8*, i8*, i32 }
+
+; CHECK: define internal void @diffesumsquares(double* %x, double* %"x'", i64 %n, double %differeturn)
+; CHECK:   %[[bytes:.+]] = mul nuw nsw i64 %{{.+}}, 8
+; CHECK:   %[[mem:.+]] = call noalias nonnull i8* @malloc(i64 %[[bytes]])
+; CHECK-NEXT:   call void @__enzyme_tape_profile_alloc(i8* %[[mem]], i64 %[[bytes]], { i8*, i8*, i8*, i8*, i32 }* @enzyme_tapesite)
+; CHECK:   call void @__enzyme_tape_profile_free(i8* %[[free:.+]])
+; CHECK-NEXT:   call void @free(i8* nonnull %[[free]])
+
+; CHECK: declare void @__enzyme_tape_profile_alloc(i8*, i64, { i8*, i8*, i8*, i8*, i32 }*)
+; CHECK: declare void @__enzyme_tape_profile_free(i8*)
@@ -0,0 +1,32 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -mem2reg -instsimplify -simplifycfg -S | FileCheck %s
+
+define void @tester(<4 x double>* %in, <4 x double>* %out) {
+entry:
+  %x = load <4 x double>, <4 x double>* %in, align 32
+  %a = call fast <4 x double> @_ZGVdN4v_sin(<4 x double> %x)
+  %b = call fast <4 x double> @Sleef_expd4_u10(<4 x double> %a)
+  store <4 x double> %b, <4 x double>* %out, align 32
+  ret void
+}
+
+define void @test_derivative(<4 x double>* %in, <4 x double>* %din, <4 x double>* %out, <4 x double>* %dout) {
+entry:
+  tail call void (...) @__enzyme_autodiff(void (<4 x double>*, <4 x double>*)* nonnull @tester, <4 x double>* %in, <4 x double>* %din, <4 x double>* %out, <4 x double>* %dout)
+  ret void
+}
+
+declare <4 x double> @_ZGVdN4v_sin(<4 x double>)
+
+declare <4 x double> @Sleef_expd4_u10(<4 x double>)
+
+declare void @__enzyme_autodiff(...)
+
+; CHECK: define internal void @diffetester(<4 x double>* %in, <4 x double>* %"in'", <4 x double>* %out, <4 x double>* %"out'")
+; CHECK:        %[[dexp:.+]] = call fast <4 x double> @Sleef_expd4_u10(<4 x double> %a)
+; CHECK-NEXT:   %[[da:.+]] = fmul fast <4 x double> %{{.*}}, %[[dexp]]
+; CHECK:        %[[dsin:.+]] = call fast <4 x double> @_ZGVdN4v_cos(<4 x double> %x)
+; CHECK-NEXT:   %[[dx:.+]] = fmul fast <4 x double> %{{.*}}, %[[dsin]]
+; CHECK:        fadd fast <4 x double> %{{.*}}, %[[dx]]
+; CHECK:        ret void
+
+; CHECK: declare <4 x double> @_ZGVdN4v_cos(<4 x double>)
@@ -0,0 +1,24 @@
+; RUN: %opt < %s %loadEnzyme -enzyme -enzyme-preopt=false -S -o /dev/null 2>&1 | FileCheck %s
+
+; fabs is a known libm function with an intrinsic, but there is no rule for
+; its vector library variants, so they must not be differentiated as the
+; scalar intrinsic.
+define void @tester(<4 x double>* %in, <4 x double>* %out) {
+entry:
+  %x = load <4 x double>, <4 x double>* %in, align 32
+  %a = call fast <4 x double> @_ZGVdN4v_fabs(<4 x double> %x)
+  store <4 x double> %a, <4 x double>* %out, align 32
+  ret void
+}
+
+define void @test_derivative(<4 x double>* %in, <4 x double>* %din, <4 x double>* %out, <4 x double>* %dout) {
+entry:
+  tail call void (...) @__enzyme_autodiff(void (<4 x double>*, <4 x double>*)* nonnull @tester, <4 x double>* %in, <4 x double>* %din, <4 x double>* %out, <4 x double>* %dout)
+  ret void
+}
+
+declare <4 x double> @_ZGVdN4v_fabs(<4 x double>)
+
+declare void @__enzyme_autodiff(...)
+
+; CHECK: cannot handle unknown vector math function _ZGVdN4v_fabs
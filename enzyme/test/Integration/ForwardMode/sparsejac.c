@@ -0,0 +1,67 @@
+// RUN: %clang -std=c11 -ffast-math -O0 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O1 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O2 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O3 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+
+#include <stdio.h>
+
+#include "test_utils.h"
+
+extern void __enzyme_sparse_jacobian(void*, long, long, long*, long*, double*,
+                                     double*, double*, int);
+
+int sweeps = 0;
+
+// Tridiagonal, thus columns j and j + 3 never share a row
+void tridiag(double* x, double* y, int n) {
+  sweeps++;
+  for (int i = 0; i < n; i++) {
+    y[i] = x[i] * x[i];
+    if (i > 0)
+      y[i] += 2 * x[i - 1];
+    if (i < n - 1)
+      y[i] += 3 * x[i] * x[i + 1];
+  }
+}
+
+#define N 6
+
+int main() {
+  double x[N] = {1., 2., 3., 4., 5., 6.};
+  double y[N];
+  long rowptr[N + 1];
+  long colidx[3 * N];
+  double vals[3 * N];
+
+  long nnz = 0;
+  for (int i = 0; i < N; i++) {
+    rowptr[i] = nnz;
+    for (int j = i - 1; j <= i + 1; j++)
+      if (j >= 0 && j < N)
+        colidx[nnz++] = j;
+  }
+  rowptr[N] = nnz;
+
+  __enzyme_sparse_jacobian(tridiag, N, N, rowptr, colidx, vals, x, y, N);
+
+  // The columns are greedily colored {0, 3}, {1, 4} and {2, 5}
+  printf("sweeps=%d\n", sweeps);
+  if (sweeps != 3)
+    abort();
+
+  for (int i = 0; i < N; i++)
+    for (long q = rowptr[i]; q < rowptr[i + 1]; q++) {
+      long j = colidx[q];
+      double expected;
+      if (j == i - 1)
+        expected = 2;
+      else if (j == i)
+        expected = 2 * x[i] + (i < N - 1 ? 3 * x[i + 1] : 0);
+      else
+        expected = 3 * x[i];
+      printf("J[%d][%ld] = %f expected %f\n", i, j, vals[q], expected);
+      APPROX_EQ(vals[q], expected, 1e-10);
+    }
+
+  return 0;
+}
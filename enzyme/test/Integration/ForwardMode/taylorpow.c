@@ -0,0 +1,44 @@
+// RUN: %clang -std=c11 -ffast-math -O0 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O1 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O2 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O3 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+
+#include <stdio.h>
+#include <math.h>
+
+#include "test_utils.h"
+
+extern void __enzyme_taylor(void*, long, double, double*, double*);
+
+double square(double x) { return pow(x, 2.0); }
+
+double cube(double x) { return __builtin_powi(x, 3); }
+
+double frac(double x) { return pow(x, 3.5); }
+
+static void check(double* out, double* expected) {
+  for (int i = 0; i < 3; i++) {
+    printf("k=%d out=%f expected=%f\n", i + 1, out[i], expected[i]);
+    APPROX_EQ(out[i], expected[i], 1e-10);
+  }
+}
+
+int main() {
+  // x(t) = t, so the coefficients of f(x(t)) at x = 0 are those of f(t)
+  double dx[] = {1., 0., 0.};
+  double out[] = {0., 0., 0.};
+
+  __enzyme_taylor((void*)square, 3, 0.0, dx, out);
+  double square_coeffs[] = {0., 1., 0.};
+  check(out, square_coeffs);
+
+  __enzyme_taylor((void*)cube, 3, 0.0, dx, out);
+  double cube_coeffs[] = {0., 0., 1.};
+  check(out, cube_coeffs);
+
+  // t^3.5 has no terms up to degree 3
+  __enzyme_taylor((void*)frac, 3, 0.0, dx, out);
+  double frac_coeffs[] = {0., 0., 0.};
+  check(out, frac_coeffs);
+  printf("done\n");
+}
@@ -0,0 +1,74 @@
+// RUN: %clang -std=c11 -ffast-math -O0 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O1 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O2 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O3 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+
+#include <stdio.h>
+#include <math.h>
+
+#include "test_utils.h"
+
+extern void __enzyme_taylor(void*, long, double, double*, double*);
+
+double recip(double x) { return 1.0 / (1.0 + x); }
+
+double logarithm(double x) { return log(x); }
+
+double root(double x) { return sqrt(x); }
+
+double sine(double x) { return sin(x); }
+
+double cosine(double x) { return cos(x); }
+
+double fused(double x) { return __builtin_fma(x, x, x); }
+
+double frac(double x) { return pow(x, 2.5); }
+
+static void check(const char* name, double* out, double* expected) {
+  for (int i = 0; i < 3; i++) {
+    printf("%s k=%d out=%f expected=%f\n", name, i + 1, out[i], expected[i]);
+    APPROX_EQ(out[i], expected[i], 1e-10);
+  }
+}
+
+int main() {
+  // x(t) = x0 + t, so the coefficient of degree k is f^(k)(x0) / k!
+  double dx[] = {1., 0., 0.};
+  double out[] = {0., 0., 0.};
+
+  // 1 / (2 + t) = 1/2 - t/4 + t^2/8 - t^3/16
+  __enzyme_taylor((void*)recip, 3, 1.0, dx, out);
+  double recip_coeffs[] = {-1. / 4, 1. / 8, -1. / 16};
+  check("recip", out, recip_coeffs);
+
+  // log(2 + t) = log(2) + t/2 - t^2/8 + t^3/24
+  __enzyme_taylor((void*)logarithm, 3, 2.0, dx, out);
+  double log_coeffs[] = {1. / 2, -1. / 8, 1. / 24};
+  check("log", out, log_coeffs);
+
+  // sqrt(4 + t) = 2 + t/4 - t^2/64 + t^3/512
+  __enzyme_taylor((void*)root, 3, 4.0, dx, out);
+  double sqrt_coeffs[] = {1. / 4, -1. / 64, 1. / 512};
+  check("sqrt", out, sqrt_coeffs);
+
+  double x0 = 0.5;
+  __enzyme_taylor((void*)sine, 3, x0, dx, out);
+  double sin_coeffs[] = {cos(x0), -sin(x0) / 2, -cos(x0) / 6};
+  check("sin", out, sin_coeffs);
+
+  __enzyme_taylor((void*)cosine, 3, x0, dx, out);
+  double cos_coeffs[] = {-sin(x0), -cos(x0) / 2, sin(x0) / 6};
+  check("cos", out, cos_coeffs);
+
+  // (1 + t)^2 + (1 + t) = 2 + 3t + t^2
+  __enzyme_taylor((void*)fused, 3, 1.0, dx, out);
+  double fma_coeffs[] = {3., 1., 0.};
+  check("fma", out, fma_coeffs);
+
+  // (1 + t)^2.5 = 1 + 2.5t + 1.875t^2 + 0.3125t^3
+  __enzyme_taylor((void*)frac, 3, 1.0, dx, out);
+  double pow_coeffs[] = {2.5, 1.875, 0.3125};
+  check("pow", out, pow_coeffs);
+
+  printf("done\n");
+}
@@ -0,0 +1,39 @@
+// RUN: %clang -std=c11 -ffast-math -O0 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O1 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O2 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+// RUN: %clang -std=c11 -ffast-math -O3 %s -S -emit-llvm -o - | %opt - %loadEnzyme -enzyme -S | %lli -
+
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#include "test_utils.h"
+
+extern void __enzyme_hvp(void*, double*, double*, double*, double*, int);
+
+// f(x) = sum_i x_i^2 x_{i+1}
+double f(double* x, int n) {
+  double ret = 0.0;
+  for (int i = 0; i + 1 < n; i++)
+    ret += x[i] * x[i] * x[i + 1];
+  return ret;
+}
+
+int main() {
+  double x[] = {1., 2., 3.};
+  double v[] = {1., -1., 2.};
+  double g[] = {0., 0., 0.};
+  double hv[] = {0., 0., 0.};
+  __enzyme_hvp((void*)f, x, v, g, hv, 3);
+
+  // g = (2 x0 x1, x0^2 + 2 x1 x2, x1^2)
+  double grad[] = {4., 13., 4.};
+  // H = [[2 x1, 2 x0, 0], [2 x0, 2 x2, 2 x1], [0, 2 x1, 0]]
+  double prod[] = {2., 4., -4.};
+  for (int i = 0; i < 3; i++) {
+    printf("i=%d g=%f hv=%f\n", i, g[i], hv[i]);
+    APPROX_EQ(g[i], grad[i], 1e-7);
+    APPROX_EQ(hv[i], prod[i], 1e-7);
+  }
+  printf("done\n");
+}
@@ -0,0 +1,59 @@
+// RUN: %clang -O1 -c -emit-llvm %S/Inputs/square.c -o %t.bc
+// RUN: %clang -std=c++14 %s %linkJIT -o %t
+// RUN: %t %t.bc | %FileCheck %s
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "EnzymeJIT.h"
+
+struct Gradient {
+  double dx;
+};
+typedef Gradient (*GradientFn)(double, double);
+
+static uint64_t get(EnzymeJITRef JIT, const char *bitcode, size_t size,
+                    const char *name) {
+  CDIFFE_TYPE args[] = {DFT_OUT_DIFF};
+  char *error = nullptr;
+  uint64_t addr = EnzymeJITGetDerivative(JIT, bitcode, size, name,
+                                         DFT_OUT_DIFF, args, 1,
+                                         DEM_ReverseModeCombined, &error);
+  if (error) {
+    printf("%s: %s\n", name, error);
+    EnzymeJITDisposeMessage(error);
+  }
+  return addr;
+}
+
+int main(int argc, char **argv) {
+  FILE *f = fopen(argv[1], "rb");
+  fseek(f, 0, SEEK_END);
+  size_t size = ftell(f);
+  rewind(f);
+  char *bitcode = (char *)malloc(size);
+  fread(bitcode, 1, size, f);
+  fclose(f);
+
+  EnzymeJITRef JIT = EnzymeCreateJIT(nullptr, 1);
+
+  // A failed request leaves nothing behind, so the same request fails again
+  // for the same reason rather than on a duplicate JITDylib.
+  get(JIT, bitcode, size, "missing");
+  get(JIT, bitcode, size, "missing");
+  // CHECK: missing: no definition of missing
+  // CHECK-NEXT: missing: no definition of missing
+
+  auto dsquare = (GradientFn)get(JIT, bitcode, size, "square");
+  printf("d/dx x^2 at 3 = %f\n", dsquare(3.0, 1.0).dx);
+  // CHECK-NEXT: d/dx x^2 at 3 = 6.000000
+
+  // The derivative is compiled once and then returned from the cache
+  printf("cached = %d\n",
+         (GradientFn)get(JIT, bitcode, size, "square") == dsquare);
+  // CHECK-NEXT: cached = 1
+
+  EnzymeFreeJIT(JIT);
+  free(bitcode);
+  return 0;
+}
@@ -0,0 +1,48 @@
+; RUN: %opt < %s %loadEnzyme -print-type-analysis -type-analysis-func=callee -enzyme-type-widening=1 -o /dev/null | FileCheck %s
+; RUN: %opt < %s %loadEnzyme -print-type-analysis -type-analysis-func=gap -enzyme-type-widening=1 -o /dev/null | FileCheck %s --check-prefix=GAP
+; RUN: %opt < %s %loadEnzyme -print-type-analysis -type-analysis-func=mixed -enzyme-type-widening=1 -o /dev/null | FileCheck %s --check-prefix=MIXED
+
+define void @callee(double* %x) {
+entry:
+  store double 0.000000e+00, double* %x, align 8
+  %x1 = getelementptr inbounds double, double* %x, i64 1
+  store double 1.000000e+00, double* %x1, align 8
+  %x2 = getelementptr inbounds double, double* %x, i64 2
+  store double 2.000000e+00, double* %x2, align 8
+  ret void
+}
+
+; CHECK: callee - {} |{}:{}
+; CHECK-NEXT: double* %x: {[-1]:Pointer, [-1,-1]:Float@double}
+
+; Offset 16 is never written, so the doubles are not an array
+define void @gap(double* %x) {
+entry:
+  store double 0.000000e+00, double* %x, align 8
+  %x1 = getelementptr inbounds double, double* %x, i64 1
+  store double 1.000000e+00, double* %x1, align 8
+  %x3 = getelementptr inbounds double, double* %x, i64 3
+  store double 3.000000e+00, double* %x3, align 8
+  ret void
+}
+
+; GAP: gap - {} |{}:{}
+; GAP-NEXT: double* %x: {[-1]:Pointer, [-1,0]:Float@double, [-1,8]:Float@double, [-1,24]:Float@double}
+
+; The pointee is a struct, whose leading doubles must not be widened over the
+; integer which follows them
+define void @mixed({ double, double, i64 }* %x) {
+entry:
+  %x0 = getelementptr inbounds { double, double, i64 }, { double, double, i64 }* %x, i64 0, i32 0
+  store double 0.000000e+00, double* %x0, align 8
+  %x1 = getelementptr inbounds { double, double, i64 }, { double, double, i64 }* %x, i64 0, i32 1
+  store double 1.000000e+00, double* %x1, align 8
+  %x2 = getelementptr inbounds { double, double, i64 }, { double, double, i64 }* %x, i64 0, i32 2
+  %i = load i64, i64* %x2, align 8
+  %n = add i64 %i, 1
+  store i64 %n, i64* %x2, align 8
+  ret void
+}
+
+; MIXED: mixed - {} |{}:{}
+; MIXED-NEXT: { double, double, i64 }* %x: {[-1]:Pointer, [-1,0]:Float@double, [-1,8]:Float@double, [-1,16]:Integer}